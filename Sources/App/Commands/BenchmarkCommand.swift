@@ -78,6 +78,184 @@ final class BenchmarkCommand: Command {
             let timeNew = exradTime.range.add(-exradTime.dtSeconds + dtNew).range(dtSeconds: dtNew)
             return exrad.interpolate(type: .solar_backwards_averaged, timeOld: exradTime, timeNew: timeNew, latitude: 52, longitude: 7, scalefactor: 100)
         }
+
+        // Rate limiter contention. The same number of operations is distributed to more threads. Mean time should decrease with thread count
+        let limiter = RateLimitCounterTable(windowSeconds: 60, capacity: 262_144)
+        let now = Timestamp.now().timeIntervalSince1970
+        let operations = 1_000_000
+        for threads in Set([1, 2, 4, System.coreCount]).sorted() where threads <= System.coreCount {
+            run.measure("Rate limiter check and increment, \(operations / 1000)k ops, 10k IPs, \(threads) threads", nil) {
+                DispatchQueue.concurrentPerform(iterations: threads) { thread in
+                    for i in stride(from: thread, to: operations, by: threads) {
+                        let key = UInt64(i % 10_000)
+                        _ = limiter.usage(key: key, now: now)
+                        limiter.add(key: key, count: 1, now: now)
+                    }
+                }
+            }
+        }
+
+        // Block cache index on a skewed workload. Each access reads the block or inserts it on a miss.
+        // Compares the previous linear probe with LRU eviction, the bucketed CLOCK index with the default window and with the window used for file meta data
+        let cacheSlots = 8192
+        let block = Data(repeating: 1, count: 4096)
+        let zipf = ZipfDistribution(count: 65536, exponent: 0.99)
+        var rng = SplitMix64(seed: 42)
+        let keys = (0..<200_000).map { _ in UInt64(zipf.sample(using: &rng)) &* 0x9E37_79B9_7F4A_7C15 }
+        var linearProbe = LinearProbeLruIndex(slots: cacheSlots, blockSize: 4096)
+        let linearHitRatio = Double(linearProbe.run(keys: keys, block: block)) / Double(keys.count) * 100
+        run.measure("Block cache Zipf(0.99) 200k get or set, linear probe 1024 LRU (previous), \(Int(linearHitRatio))% hits", nil) {
+            return linearProbe.run(keys: keys, block: block)
+        }
+        let cacheData = DataAsClass(data: Data(repeating: 0, count: (4096 + AtomicBlockCache<DataAsClass>.slotOverhead) * cacheSlots))
+        for lookAheadCount in [AtomicBlockCache<DataAsClass>.defaultLookAheadCount, 64] {
+            cacheData.data.resetBytes(in: 0..<cacheData.data.count)
+            let blockCache = AtomicBlockCache(data: cacheData, blockSize: 4096, lookAheadCount: lookAheadCount)
+            let zipfWorkload = {
+                var hits = 0
+                for key in keys {
+                    if blockCache.withData(key: key, count: 1, { $0[0] }) != nil {
+                        hits += 1
+                    } else {
+                        blockCache.set(key: key, value: block)
+                    }
+                }
+                return hits
+            }
+            let hitRatio = Double(zipfWorkload()) / Double(keys.count) * 100
+            run.measure("Block cache Zipf(0.99) 200k get or set, 64k keys, 8k slots, CLOCK window \(lookAheadCount), \(Int(hitRatio))% hits", nil) {
+                return zipfWorkload()
+            }
+        }
+        
+        // Same memory as LZ4 compressed pages. Blocks are half zero, half a regular ramp
+        let pageSize = CompressedBlockCache<DataAsClass>.pageSize(blockSize: 4096)
+        let pageData = DataAsClass(data: Data(repeating: 0, count: cacheData.data.count / (pageSize + AtomicBlockCache<DataAsClass>.slotOverhead) * (pageSize + AtomicBlockCache<DataAsClass>.slotOverhead)))
+        let compressedCache = CompressedBlockCache(pages: AtomicBlockCache(data: pageData, blockSize: pageSize), blockSize: 4096)
+        let sparseBlock = Data((0..<4096).map { $0 < 2048 ? 0 : UInt8(truncatingIfNeeded: $0 / 16) })
+        let compressedWorkload = {
+            var hits = 0
+            for key in keys {
+                if compressedCache.withData(key: key, count: 1, { $0[0] }) != nil {
+                    hits += 1
+                } else {
+                    compressedCache.set(key: key, value: sparseBlock)
+                }
+            }
+            return hits
+        }
+        let compressedHitRatio = Double(compressedWorkload()) / Double(keys.count) * 100
+        run.measure("Block cache LZ4 pages Zipf(0.99) 200k get or set, same memory, \(Int(compressedHitRatio))% hits", nil) {
+            return compressedWorkload()
+        }
+    }
+}
+
+/**
+ Single threaded model of the previous `AtomicBlockCache` index: Linear probing over up to 1024 slots, nanosecond timestamps from `Date()` and LRU eviction.
+ Atomics are omitted, therefore timings are a lower bound of the previous implementation. Hit ratios are identical.
+ */
+fileprivate struct LinearProbeLruIndex {
+    static let lookAheadCount = 1024
+    var keys: [UInt64]
+    /// Last access in nanoseconds. 0 means empty
+    var times: [UInt64]
+    var data: [UInt8]
+    let blockSize: Int
+
+    init(slots: Int, blockSize: Int) {
+        self.keys = [UInt64](repeating: 0, count: slots)
+        self.times = [UInt64](repeating: 0, count: slots)
+        self.data = [UInt8](repeating: 0, count: slots * blockSize)
+        self.blockSize = blockSize
+    }
+
+    /// Get or set each key. Returns the number of hits
+    mutating func run(keys requests: [UInt64], block: Data) -> Int {
+        keys.withUnsafeMutableBufferPointer { $0.update(repeating: 0) }
+        times.withUnsafeMutableBufferPointer { $0.update(repeating: 0) }
+        var hits = 0
+        let slots = UInt64(keys.count)
+        for key in requests {
+            let time = UInt64(Date().timeIntervalSince1970 * 1_000_000_000)
+            var found: Int? = nil
+            var free: Int? = nil
+            var oldest = (slot: 0, time: UInt64.max)
+            for lookAhead in 0..<UInt64(Self.lookAheadCount) {
+                let slot = Int((key &+ lookAhead) % slots)
+                if times[slot] == 0 {
+                    free = free ?? slot
+                    continue
+                }
+                if keys[slot] == key {
+                    found = slot
+                    break
+                }
+                if times[slot] < oldest.time {
+                    oldest = (slot, times[slot])
+                }
+            }
+            if let found {
+                times[found] = time
+                hits += 1
+                continue
+            }
+            let slot = free ?? oldest.slot
+            keys[slot] = key
+            times[slot] = time
+            block.withUnsafeBytes { block in
+                data.withUnsafeMutableBytes { data in
+                    UnsafeMutableRawBufferPointer(rebasing: data[slot * blockSize ..< (slot + 1) * blockSize]).copyMemory(from: block)
+                }
+            }
+        }
+        return hits
+    }
+}
+
+/// Zipf distributed ranks in `0..<count` sampled by binary search on the cumulative distribution
+fileprivate struct ZipfDistribution {
+    let cdf: [Double]
+
+    init(count: Int, exponent: Double) {
+        var sum = 0.0
+        let weights = (1...count).map {
+            sum += 1 / pow(Double($0), exponent)
+            return sum
+        }
+        cdf = weights.map { $0 / sum }
+    }
+
+    func sample<G: RandomNumberGenerator>(using rng: inout G) -> Int {
+        let x = Double.random(in: 0..<1, using: &rng)
+        var low = 0
+        var high = cdf.count - 1
+        while low < high {
+            let mid = (low + high) / 2
+            if cdf[mid] < x {
+                low = mid + 1
+            } else {
+                high = mid
+            }
+        }
+        return low
+    }
+}
+
+/// Deterministic random number generator for reproducible benchmarks
+fileprivate struct SplitMix64: RandomNumberGenerator {
+    var state: UInt64
+
+    init(seed: UInt64) {
+        state = seed
+    }
+
+    mutating func next() -> UInt64 {
+        state &+= 0x9E37_79B9_7F4A_7C15
+        var z = state
+        z = (z ^ (z >> 30)) &* 0xBF58_476D_1CE4_E5B9
+        z = (z ^ (z >> 27)) &* 0x94D0_49BB_1331_11EB
+        return z ^ (z >> 31)
     }
 }
 
@@ -85,7 +263,8 @@ struct BenchmarkRun {
     var timePerTest: Int
 
     @discardableResult
-    func measure<T>(_ section: String, _ baseLineMeanMs: Double, fn: () throws -> T) rethrows -> T {
+    /// `baseLineMeanMs` is the mean time on Apple M1. Comparison is skipped if `nil`
+    func measure<T>(_ section: String, _ baseLineMeanMs: Double?, fn: () throws -> T) rethrows -> T {
         print("| \(section.pad(80)) | ", terminator: "")
         // Do not measure first execution
         var result = try fn()
@@ -110,9 +289,14 @@ struct BenchmarkRun {
         } while DispatchTime.now().uptimeNanoseconds <= end
         let elapsed = Double((DispatchTime.now().uptimeNanoseconds - start.uptimeNanoseconds)) / 1_000_000_000
         let mean = elapsed / Double(count)
-        let diff = mean - baseLineMeanMs / 1000
-        let factor = round((mean) / (baseLineMeanMs / 1000) * 100) / 100
-        let b = "\(diff > 0 ? "+" : "")\(diff.asSecondsPrettyPrint) (x\(factor))"
+        let b: String
+        if let baseLineMeanMs {
+            let diff = mean - baseLineMeanMs / 1000
+            let factor = round((mean) / (baseLineMeanMs / 1000) * 100) / 100
+            b = "\(diff > 0 ? "+" : "")\(diff.asSecondsPrettyPrint) (x\(factor))"
+        } else {
+            b = "-"
+        }
         print("\(mean.asSecondsPrettyPrint.pad(8)) | \(min.asSecondsPrettyPrint.pad(8)) | \(max.asSecondsPrettyPrint.pad(8)) | \(String(count).pad(8)) | \(b.pad(20)) |")
         return result
     }
@@ -14,6 +14,7 @@ Options:
              rate Transfer rate in megabytes per second. Not applicable for AWS open-data.
         past-days Maximum age of synchronised files. Default 7 days.
   repeat-interval If set, check for new files every specified amount of minutes.
+concurrent-ranges Number of parallel HTTP range requests per file. Default 4.
 
 Example to download from a local endpoint
 DATA_DIRECTORY=/Volumes/2TB_1GBs/data/ API_SYNC_APIKEYS=123 openmeteo-api
@@ -52,6 +53,9 @@ struct SyncCommand: AsyncCommand {
         @Option(name: "concurrent-models", short: "c", help: "Number of concurrent models to download. Default 2")
         var concurrentModels: Int?
 
+        @Option(name: "concurrent-ranges", help: "Number of parallel HTTP range requests per file. Default 4")
+        var concurrentRanges: Int?
+
         @Flag(name: "execute", help: "Actually perfom file delete on cleanup")
         var execute: Bool
 
@@ -95,6 +99,7 @@ struct SyncCommand: AsyncCommand {
         let pastDays = signature.pastDays ?? 7
         let concurrent = signature.concurrent ?? 2
         let concurrentModels = signature.concurrentModels ?? 2
+        let concurrentRanges = signature.concurrentRanges ?? 4
 
         /// Select all files that contain data within a range of years
         let yearRange = signature.year.map { yearStr in
@@ -140,6 +145,7 @@ struct SyncCommand: AsyncCommand {
                         try await syncModel(
                             application: context.application,
                             concurrent: concurrent,
+                            concurrentRanges: concurrentRanges,
                             server: server,
                             model: model,
                             variablesSig: variablesSig,
@@ -164,7 +170,7 @@ struct SyncCommand: AsyncCommand {
         }
     }
     
-    func syncModel(application: Application, concurrent: Int, server: String, model: DomainRegistry, variablesSig: [String], yearRange: Range<Timestamp>?, pastDays: Int, apikey: String?, downloadPressureNow: Bool) async throws {
+    func syncModel(application: Application, concurrent: Int, concurrentRanges: Int, server: String, model: DomainRegistry, variablesSig: [String], yearRange: Range<Timestamp>?, pastDays: Int, apikey: String?, downloadPressureNow: Bool) async throws {
         let logger = application.logger
         
         /// Undocumented switch to download all weather variables. This can generate immense traffic!
@@ -236,14 +242,16 @@ struct SyncCommand: AsyncCommand {
             } else {
                 for _ in 0..<10 {
                     do {
-                        let response = try await client.executeRetryChunked(.init(url: request.url.string), logger: logger)
-                        /// Download file chunked into 8 MB parts. Get 4 chunks in parallel
-                        try await response.body.saveTo(file: localFile, size: try response.contentLength(), modificationDate: response.headers.lastModified?.value, logger: logger)
-                        await progress.add(try response.contentLength() ?? 0)
+                        /// Download file in 8 MB ranges directly into `localFile~`. Interrupted downloads are resumed from completed ranges
+                        try await client.downloadRanges(.init(url: request.url.string), file: localFile, logger: logger, progress: progress, nConcurrent: concurrentRanges)
                         break
                     } catch CurlErrorNonRetry.fileModifiedSinceLastDownload {
                         /// Because we are downloading chunks, the remote server might have updated the initial file and we have to restart the entire download
                         try FileManager.default.removeItemIfExists(at: localFile)
+                    } catch RangeDownloadError.downloadInProgress {
+                        /// Another sync process is downloading this file right now
+                        logger.warning("Skipping \(pathNoData). File is being downloaded by another process")
+                        break
                     }
                 }
             }
@@ -22,12 +22,41 @@ enum OmMetrics {
     static let requestsElevationApiTotal = Atomic(0)
     static let requestsCloudflareWorkersTotal = Atomic(0)
     static let requestsServiceOverloadedTotal = Atomic(0)
+    static let requestsStreamingErrorsTotal = Atomic(0)
     
     static let memoryReadAllocated = Atomic(0)
     
     static let limiterMinutelyExceededTotal = Atomic(0)
     static let limiterHourlyExceededTotal = Atomic(0)
     static let limiterDailyExceededTotal = Atomic(0)
+    
+    static let blockCacheHotHitsTotal = Atomic(0)
+    static let blockCacheColdHitsTotal = Atomic(0)
+    static let blockCacheMissesTotal = Atomic(0)
+    static let blockCachePromotionsTotal = Atomic(0)
+    static let blockCacheDemotionsTotal = Atomic(0)
+    static let blockCacheAdmissionsRejectedTotal = Atomic(0)
+    static let blockCacheCompressedBytesTotal = Atomic(0)
+    static let blockCacheUncompressedBytesTotal = Atomic(0)
+    static let blockCachePreloadBytesTotal = Atomic(0)
+    
+    static let chunkCacheHitsTotal = Atomic(0)
+    static let chunkCacheMissesTotal = Atomic(0)
+    static let chunkCacheEvictionsTotal = Atomic(0)
+    static let chunkCacheBytesSavedTotal = Atomic(0)
+    
+    static let apiResponseCacheHitsTotal = Atomic(0)
+    static let apiResponseCacheSharedTotal = Atomic(0)
+    static let apiResponseCacheMissesTotal = Atomic(0)
+    static let apiResponseCacheEvictionsTotal = Atomic(0)
+    
+    static let backendRangeRequestsTotal = Atomic(0)
+    static let backendRangeRequestsCoalescedTotal = Atomic(0)
+    
+    static let readAheadIssuedBytesTotal = Atomic(0)
+    static let readAheadUsefulBytesTotal = Atomic(0)
+    static let readAheadWastedBytesTotal = Atomic(0)
+    static let readAheadSkippedTotal = Atomic(0)
 }
 
 
@@ -44,6 +73,9 @@ struct MetricsController: RouteCollection {
         let cacheStats = OpenMeteo.dataBlockCacheInitialized.load(ordering: .relaxed)
             ? OpenMeteo.dataBlockCache.cache.statistics()
             : .zero
+        let hotCacheStats = OpenMeteo.dataBlockCacheInitialized.load(ordering: .relaxed)
+            ? OpenMeteo.dataBlockCache.hot?.statistics() ?? .zero
+            : .zero
 
         let monitored_ips = await ConcurrencyGroupLimiter.instance.numberOfTrackedSlots()
 
@@ -87,6 +119,81 @@ om_block_cache_accessed_bytes{window="30m"} \(cacheStats.accessed_30min)
 om_block_cache_accessed_bytes{window="60m"} \(cacheStats.accessed_60min)
 om_block_cache_accessed_bytes{window="3h"} \(cacheStats.accessed_3hours)
 om_block_cache_accessed_bytes{window="24h"} \(cacheStats.accessed_24hours)
+# TYPE om_block_cache_hot_used_bytes gauge
+# UNIT om_block_cache_hot_used_bytes bytes
+# HELP om_block_cache_hot_used_bytes Used bytes in the in-memory hot tier
+om_block_cache_hot_used_bytes \(hotCacheStats.used)
+# TYPE om_block_cache_hot_free_bytes gauge
+# UNIT om_block_cache_hot_free_bytes bytes
+# HELP om_block_cache_hot_free_bytes Free bytes in the in-memory hot tier
+om_block_cache_hot_free_bytes \(hotCacheStats.free)
+# TYPE om_block_cache_hits counter
+# HELP om_block_cache_hits Block cache hits by tier. Only counted if the hot tier is enabled
+om_block_cache_hits_total{tier="hot"} \(OmMetrics.blockCacheHotHitsTotal.load(ordering: .relaxed))
+om_block_cache_hits_total{tier="cold"} \(OmMetrics.blockCacheColdHitsTotal.load(ordering: .relaxed))
+# TYPE om_block_cache_misses counter
+# HELP om_block_cache_misses Blocks fetched from the backend
+om_block_cache_misses_total \(OmMetrics.blockCacheMissesTotal.load(ordering: .relaxed))
+# TYPE om_block_cache_promotions counter
+# HELP om_block_cache_promotions Blocks copied from the cold to the hot tier
+om_block_cache_promotions_total \(OmMetrics.blockCachePromotionsTotal.load(ordering: .relaxed))
+# TYPE om_block_cache_demotions counter
+# HELP om_block_cache_demotions Blocks evicted from the hot tier and written back to the cold tier
+om_block_cache_demotions_total \(OmMetrics.blockCacheDemotionsTotal.load(ordering: .relaxed))
+# TYPE om_block_cache_admissions_rejected counter
+# HELP om_block_cache_admissions_rejected Promotions rejected by TinyLFU because the block in the hot tier is accessed more frequently
+om_block_cache_admissions_rejected_total \(OmMetrics.blockCacheAdmissionsRejectedTotal.load(ordering: .relaxed))
+# TYPE om_block_cache_compression_stored_bytes counter
+# UNIT om_block_cache_compression_stored_bytes bytes
+# HELP om_block_cache_compression_stored_bytes Page bytes used to store compressed blocks. Divide uncompressed by stored bytes for the compression ratio
+om_block_cache_compression_stored_bytes_total \(OmMetrics.blockCacheCompressedBytesTotal.load(ordering: .relaxed))
+# TYPE om_block_cache_compression_uncompressed_bytes counter
+# UNIT om_block_cache_compression_uncompressed_bytes bytes
+# HELP om_block_cache_compression_uncompressed_bytes Uncompressed bytes of blocks stored compressed
+om_block_cache_compression_uncompressed_bytes_total \(OmMetrics.blockCacheUncompressedBytesTotal.load(ordering: .relaxed))
+# TYPE om_block_cache_preload_bytes counter
+# HELP om_block_cache_preload_bytes Bytes downloaded to warm up the cache after file modifications and restarts
+om_block_cache_preload_bytes_total \(OmMetrics.blockCachePreloadBytesTotal.load(ordering: .relaxed))
+# TYPE om_chunk_cache_hits counter
+# HELP om_chunk_cache_hits Reads served from the decompressed chunk cache
+om_chunk_cache_hits_total \(OmMetrics.chunkCacheHitsTotal.load(ordering: .relaxed))
+# TYPE om_chunk_cache_misses counter
+# HELP om_chunk_cache_misses Reads not found in the decompressed chunk cache
+om_chunk_cache_misses_total \(OmMetrics.chunkCacheMissesTotal.load(ordering: .relaxed))
+# TYPE om_chunk_cache_evictions counter
+# HELP om_chunk_cache_evictions Chunks evicted from the decompressed chunk cache
+om_chunk_cache_evictions_total \(OmMetrics.chunkCacheEvictionsTotal.load(ordering: .relaxed))
+# TYPE om_chunk_cache_saved_bytes counter
+# HELP om_chunk_cache_saved_bytes Decompressed bytes served from the chunk cache instead of decompressing them again
+om_chunk_cache_saved_bytes_total \(OmMetrics.chunkCacheBytesSavedTotal.load(ordering: .relaxed))
+# TYPE om_chunk_cache_used_bytes gauge
+# HELP om_chunk_cache_used_bytes Bytes used by the decompressed chunk cache
+om_chunk_cache_used_bytes \(OpenMeteo.decompressedChunkCache?.usedBytes ?? 0)
+# TYPE om_api_response_cache_requests counter
+# HELP om_api_response_cache_requests API requests by response cache result. Shared requests waited for an identical concurrent request
+om_api_response_cache_requests_total{result="hit"} \(OmMetrics.apiResponseCacheHitsTotal.load(ordering: .relaxed))
+om_api_response_cache_requests_total{result="shared"} \(OmMetrics.apiResponseCacheSharedTotal.load(ordering: .relaxed))
+om_api_response_cache_requests_total{result="miss"} \(OmMetrics.apiResponseCacheMissesTotal.load(ordering: .relaxed))
+# TYPE om_api_response_cache_evictions counter
+# HELP om_api_response_cache_evictions Responses evicted from the API response cache before they expired
+om_api_response_cache_evictions_total \(OmMetrics.apiResponseCacheEvictionsTotal.load(ordering: .relaxed))
+# TYPE om_api_response_cache_used_bytes gauge
+# HELP om_api_response_cache_used_bytes Bytes used by cached API responses
+om_api_response_cache_used_bytes \(OpenMeteo.apiResponseCache?.usedBytes ?? 0)
+# TYPE om_backend_range_requests counter
+# HELP om_backend_range_requests Range requests sent to remote backends after coalescing
+om_backend_range_requests_total \(OmMetrics.backendRangeRequestsTotal.load(ordering: .relaxed))
+# TYPE om_backend_range_requests_coalesced counter
+# HELP om_backend_range_requests_coalesced Range requests merged into another request
+om_backend_range_requests_coalesced_total \(OmMetrics.backendRangeRequestsCoalescedTotal.load(ordering: .relaxed))
+# TYPE om_read_ahead_bytes counter
+# HELP om_read_ahead_bytes Uncompressed bytes of predicted reads. Useful if the next read matched the prediction
+om_read_ahead_bytes_total{result="issued"} \(OmMetrics.readAheadIssuedBytesTotal.load(ordering: .relaxed))
+om_read_ahead_bytes_total{result="useful"} \(OmMetrics.readAheadUsefulBytesTotal.load(ordering: .relaxed))
+om_read_ahead_bytes_total{result="wasted"} \(OmMetrics.readAheadWastedBytesTotal.load(ordering: .relaxed))
+# TYPE om_read_ahead_skipped counter
+# HELP om_read_ahead_skipped Predicted reads not issued because requests were queued or the budget was exhausted
+om_read_ahead_skipped_total \(OmMetrics.readAheadSkippedTotal.load(ordering: .relaxed))
 # TYPE om_requests_monitored_ips gauge
 # HELP om_requests_monitored_ips Distinct IPs currently rate-limited
 om_requests_monitored_ips \(monitored_ips)
@@ -105,6 +212,9 @@ om_requests_too_many_locations_total \(OmMetrics.requestsTooManyLocationsTotal.l
 # TYPE om_requests_service_overloaded_total counter
 # HELP om_requests_service_overloaded_total Number of API calls rejected with service overloaded error
 om_requests_service_overloaded_total \(OmMetrics.requestsServiceOverloadedTotal.load(ordering: .relaxed))
+# TYPE om_requests_streaming_errors_total counter
+# HELP om_requests_streaming_errors_total Number of API calls with an error after the response started streaming
+om_requests_streaming_errors_total \(OmMetrics.requestsStreamingErrorsTotal.load(ordering: .relaxed))
 # TYPE om_requests_cloudflare_workers_total counter
 # HELP om_requests_cloudflare_workers_total Number of API calls from CF Workers
 om_requests_cloudflare_workers_total \(OmMetrics.requestsCloudflareWorkersTotal.load(ordering: .relaxed))
@@ -0,0 +1,128 @@
+import Foundation
+import NIOConcurrencyHelpers
+import OmFileFormat
+import Vapor
+
+/**
+ Surface elevation of all grid points of a domain, decoded and kept in memory.
+
+ Terrain optimised and sea grid point selection would otherwise read 3x3 elevation values from the elevation file for every location and model.
+ With the index, grid point selection in `GenericReader` is synchronous and does not read from the elevation file.
+ Values are identical to the elevation file: -999 marks sea, 9999 land without elevation and NaN missing data.
+ */
+public struct ElevationIndex: Sendable {
+    let nx: Int
+
+    /// Elevation for each grid point
+    let elevation: [Float]
+
+    init(nx: Int, elevation: [Float]) {
+        self.nx = nx
+        self.elevation = elevation
+    }
+
+    func read(gridpoint: Int) -> ElevationOrSea {
+        return ElevationOrSea(surfaceElevation: elevation[gridpoint])
+    }
+
+    /// Read a 2D range of a regular or projected grid. Same layout as `elevationFile.read(range: [y, x])`
+    func read(x: Range<Int>, y: Range<Int>) -> [Float] {
+        var out = [Float]()
+        out.reserveCapacity(x.count * y.count)
+        for y in y {
+            out.append(contentsOf: elevation[y * nx + x.lowerBound ..< y * nx + x.upperBound])
+        }
+        return out
+    }
+
+    /// Read surrounding grid points of Gaussian grids. Grid points with index -1 are outside the grid and set to NaN
+    func read(gridpoints: InlineArray<9, Int>) -> InlineArray<9, Float> {
+        var out = InlineArray<9, Float>(repeating: .nan)
+        for i in gridpoints.indices where gridpoints[i] >= 0 {
+            out[i] = elevation[gridpoints[i]]
+        }
+        return out
+    }
+}
+
+/**
+ Process wide elevation indices for each domain. Indices are built on first use, shared by all requests and rebuilt after one hour to pick up updated elevation files.
+ Domains are only kept in memory while the sum of all indices fits into `capacityBytes`. Other domains keep reading elevation files.
+ Failed builds, e.g. a missing elevation file, are remembered for `failureRetrySeconds` and do not count against `capacityBytes`.
+ */
+final class ElevationIndexCache: Sendable {
+    fileprivate struct Entry {
+        let index: Task<ElevationIndex?, Never>
+        let expires: Timestamp
+        let bytes: Int
+    }
+
+    /// Maximum size of all elevation indices
+    let capacityBytes: Int
+
+    /// A failed build is retried after this duration
+    static let failureRetrySeconds = 60
+
+    private let entries = NIOLockedValueBox([DomainRegistry: Entry]())
+
+    init(capacityBytes: Int) {
+        self.capacityBytes = capacityBytes
+    }
+
+    /// Bytes reserved by indices that are built or being built
+    var usedBytes: Int {
+        return entries.withLockedValue { $0.values.reduce(0, { $0 + $1.bytes }) }
+    }
+
+    /// Get the elevation index of a domain. Concurrent calls wait for the same index to be built
+    func get(domain: any GenericDomain, httpClient: HTTPClient?, logger: Logger) async -> ElevationIndex? {
+        guard let registry = domain.domainRegistryStatic else {
+            return nil
+        }
+        let grid = domain.grid
+        let bytes = grid.count * MemoryLayout<Float>.stride
+        let now = Timestamp.now()
+        let task = entries.withLockedValue { entries -> Task<ElevationIndex?, Never>? in
+            if let entry = entries[registry], entry.expires > now {
+                return entry.index
+            }
+            let used = entries.values.reduce(0, { $0 + $1.bytes }) - (entries[registry]?.bytes ?? 0)
+            guard used + bytes <= capacityBytes else {
+                return nil
+            }
+            let index = Task { () -> ElevationIndex? in
+                guard let elevationFile = await domain.getStaticFile(type: .elevation, httpClient: httpClient, logger: logger) else {
+                    return nil
+                }
+                guard let elevation = try? await elevationFile.read(), elevation.count == grid.count else {
+                    logger.warning("Could not build elevation index for domain \(registry.rawValue)")
+                    return nil
+                }
+                return ElevationIndex(nx: grid.nx, elevation: elevation)
+            }
+            entries[registry] = Entry(index: index, expires: now.add(3600), bytes: bytes)
+            return index
+        }
+        guard let task else {
+            return nil
+        }
+        guard let index = await task.value else {
+            // Release the reserved bytes and retry soon
+            entries.withLockedValue { entries in
+                guard let entry = entries[registry], entry.index == task, entry.bytes > 0 else {
+                    return
+                }
+                entries[registry] = Entry(index: task, expires: Timestamp.now().add(Self.failureRetrySeconds), bytes: 0)
+            }
+            return nil
+        }
+        return index
+    }
+}
+
+extension GenericDomain {
+    /// Elevation of all grid points kept in memory. Nil if disabled, the domain has no elevation file or the memory budget is exhausted
+    func getElevationIndex(httpClient: HTTPClient?, logger: Logger) async -> ElevationIndex? {
+        return await OpenMeteo.elevationIndexCache?.get(domain: self, httpClient: httpClient, logger: logger)
+    }
+}
@@ -289,7 +289,47 @@ struct GaussianGrid: Gridable {
         }
         // Resolve elevation for all grid cells
         try await getSurroundingElevation(gridpoints: gridpoints, elevation: &elevations, onlyMinDistanceIndex: minDistanceIndex, firstPass: false, elevationFile: elevationFile)
-        
+        return Self.selectPointInSea(gridpoints: gridpoints, distances: distances, minDistanceIndex: minDistanceIndex, elevations: elevations)
+    }
+    
+    func findPointTerrainOptimised(lat: Float, lon: Float, elevation: Float, elevationFile: any OmFileReaderArrayProtocol<Float>) async throws -> (gridpoint: Int, gridElevation: ElevationOrSea)? {
+        // Get surrounding 3x3 grid cells
+        let (gridpoints, distances, minDistanceIndex) = self.getSurroundingGridpoints(lat: lat, lon: lon)
+        var elevations = InlineArray<9, Float>(repeating: .nan)
+        // Get elevation only for closest grid cell
+        try await getSurroundingElevation(gridpoints: gridpoints, elevation: &elevations, onlyMinDistanceIndex: minDistanceIndex, firstPass: true, elevationFile: elevationFile)
+        let centerPoint = gridpoints[minDistanceIndex]
+        let centerElevation = elevations[minDistanceIndex]
+        let deltaCenter = abs(centerElevation - elevation )
+        if deltaCenter <= 100 {
+            return (centerPoint, .elevation(elevation))
+        }
+        // Resolve elevation for all grid cells
+        try await getSurroundingElevation(gridpoints: gridpoints, elevation: &elevations, onlyMinDistanceIndex: minDistanceIndex, firstPass: false, elevationFile: elevationFile)
+        return Self.selectPointTerrainOptimised(gridpoints: gridpoints, distances: distances, minDistanceIndex: minDistanceIndex, elevations: elevations, elevation: elevation)
+    }
+
+    /// Find point, preferably in sea, using elevation kept in memory
+    func findPointInSea(lat: Float, lon: Float, elevationIndex: ElevationIndex) -> (gridpoint: Int, gridElevation: ElevationOrSea)? {
+        let (gridpoints, distances, minDistanceIndex) = self.getSurroundingGridpoints(lat: lat, lon: lon)
+        let elevations = elevationIndex.read(gridpoints: gridpoints)
+        if elevations[minDistanceIndex] <= -999 {
+            return (gridpoints[minDistanceIndex], .sea)
+        }
+        return Self.selectPointInSea(gridpoints: gridpoints, distances: distances, minDistanceIndex: minDistanceIndex, elevations: elevations)
+    }
+
+    func findPointTerrainOptimised(lat: Float, lon: Float, elevation: Float, elevationIndex: ElevationIndex) -> (gridpoint: Int, gridElevation: ElevationOrSea)? {
+        let (gridpoints, distances, minDistanceIndex) = self.getSurroundingGridpoints(lat: lat, lon: lon)
+        let elevations = elevationIndex.read(gridpoints: gridpoints)
+        if abs(elevations[minDistanceIndex] - elevation) <= 100 {
+            return (gridpoints[minDistanceIndex], .elevation(elevation))
+        }
+        return Self.selectPointTerrainOptimised(gridpoints: gridpoints, distances: distances, minDistanceIndex: minDistanceIndex, elevations: elevations, elevation: elevation)
+    }
+
+    /// Select the closest sea grid point given the elevation of all 3x3 surrounding grid points. Also used by `GaussianGridArea`
+    static func selectPointInSea(gridpoints: InlineArray<9, Int>, distances: InlineArray<9, Float>, minDistanceIndex: Int, elevations: InlineArray<9, Float>) -> (gridpoint: Int, gridElevation: ElevationOrSea) {
         var minDistance = Float.greatestFiniteMagnitude
         var minPosition = -1
         for i in elevations.indices {
@@ -310,22 +350,11 @@ struct GaussianGrid: Gridable {
         }
         return (minPosition, .sea)
     }
-    
-    func findPointTerrainOptimised(lat: Float, lon: Float, elevation: Float, elevationFile: any OmFileReaderArrayProtocol<Float>) async throws -> (gridpoint: Int, gridElevation: ElevationOrSea)? {
-        // Get surrounding 3x3 grid cells
-        let (gridpoints, distances, minDistanceIndex) = self.getSurroundingGridpoints(lat: lat, lon: lon)
-        var elevations = InlineArray<9, Float>(repeating: .nan)
-        // Get elevation only for closest grid cell
-        try await getSurroundingElevation(gridpoints: gridpoints, elevation: &elevations, onlyMinDistanceIndex: minDistanceIndex, firstPass: true, elevationFile: elevationFile)
+
+    /// Select the grid point with the best elevation match given the elevation of all 3x3 surrounding grid points. Also used by `GaussianGridArea`
+    static func selectPointTerrainOptimised(gridpoints: InlineArray<9, Int>, distances: InlineArray<9, Float>, minDistanceIndex: Int, elevations: InlineArray<9, Float>, elevation: Float) -> (gridpoint: Int, gridElevation: ElevationOrSea) {
         let centerPoint = gridpoints[minDistanceIndex]
         let centerElevation = elevations[minDistanceIndex]
-        let deltaCenter = abs(centerElevation - elevation )
-        if deltaCenter <= 100 {
-            return (centerPoint, .elevation(elevation))
-        }
-        // Resolve elevation for all grid cells
-        try await getSurroundingElevation(gridpoints: gridpoints, elevation: &elevations, onlyMinDistanceIndex: minDistanceIndex, firstPass: false, elevationFile: elevationFile)
-        
         var minDelta = Float.greatestFiniteMagnitude
         var minPosition = -1
         var minElevation = Float.nan
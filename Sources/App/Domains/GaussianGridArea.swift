@@ -237,23 +237,7 @@ struct GaussianGridArea: Gridable {
         }
         // Resolve elevation for all grid cells
         try await getSurroundingElevation(gridpoints: gridpoints, elevation: &elevations, onlyMinDistanceIndex: minDistanceIndex, firstPass: false, elevationFile: elevationFile)
-        var minDistance = Float.greatestFiniteMagnitude
-        var minPosition = -1
-        for i in elevations.indices {
-            if elevations[i].isNaN { continue }
-            let distance = distances[i]
-            if elevations[i] <= -999 && distance < minDistance {
-                minDistance = distance
-                minPosition = gridpoints[i]
-            }
-        }
-        guard minPosition >= 0 else {
-            if elevations[minDistanceIndex].isNaN {
-                return (gridpoints[minDistanceIndex], .noData)
-            }
-            return (gridpoints[minDistanceIndex], .elevation(elevations[minDistanceIndex]))
-        }
-        return (minPosition, .sea)
+        return GaussianGrid.selectPointInSea(gridpoints: gridpoints, distances: distances, minDistanceIndex: minDistanceIndex, elevations: elevations)
     }
 
     func findPointTerrainOptimised(lat: Float, lon: Float, elevation: Float, elevationFile: any OmFileReaderArrayProtocol<Float>) async throws -> (gridpoint: Int, gridElevation: ElevationOrSea)? {
@@ -270,30 +254,27 @@ struct GaussianGridArea: Gridable {
         }
         // Resolve elevation for all grid cells
         try await getSurroundingElevation(gridpoints: gridpoints, elevation: &elevations, onlyMinDistanceIndex: minDistanceIndex, firstPass: false, elevationFile: elevationFile)
-        var minDelta = Float.greatestFiniteMagnitude
-        var minPosition = -1
-        var minElevation = Float.nan
-        for i in elevations.indices {
-            if elevations[i].isNaN || elevations[i] <= -999 { continue }
-            let distanceKm = sqrt(distances[i]) * 111
-            /// For every 1km in distance, the elevation must be 30 m better
-            let distancePenalty = distanceKm * 30
-            let delta = abs(elevations[i] - elevation) + distancePenalty
-            if delta < minDelta && distanceKm < 50 {
-                minDelta = delta
-                minPosition = gridpoints[i]
-                minElevation = elevations[i]
-            }
-        }
-        /// only sea points or elevation is hugely off -> just use center
-        if minElevation.isNaN || minDelta > 1500 {
-            minElevation = centerElevation
-            minPosition = centerPoint
+        return GaussianGrid.selectPointTerrainOptimised(gridpoints: gridpoints, distances: distances, minDistanceIndex: minDistanceIndex, elevations: elevations, elevation: elevation)
+    }
+
+    func findPointInSea(lat: Float, lon: Float, elevationIndex: ElevationIndex) -> (gridpoint: Int, gridElevation: ElevationOrSea)? {
+        let (gridpoints, distances, minDistanceIndex) = getSurroundingGridpoints(lat: lat, lon: lon)
+        guard minDistanceIndex >= 0 else { return nil }
+        let elevations = elevationIndex.read(gridpoints: gridpoints)
+        if elevations[minDistanceIndex] <= -999 {
+            return (gridpoints[minDistanceIndex], .sea)
         }
-        if minElevation <= -999 {
-            return (minPosition, .sea)
+        return GaussianGrid.selectPointInSea(gridpoints: gridpoints, distances: distances, minDistanceIndex: minDistanceIndex, elevations: elevations)
+    }
+
+    func findPointTerrainOptimised(lat: Float, lon: Float, elevation: Float, elevationIndex: ElevationIndex) -> (gridpoint: Int, gridElevation: ElevationOrSea)? {
+        let (gridpoints, distances, minDistanceIndex) = getSurroundingGridpoints(lat: lat, lon: lon)
+        guard minDistanceIndex >= 0 else { return nil }
+        let elevations = elevationIndex.read(gridpoints: gridpoints)
+        if abs(elevations[minDistanceIndex] - elevation) <= 100 {
+            return (gridpoints[minDistanceIndex], .elevation(elevation))
         }
-        return (minPosition, .elevation(minElevation))
+        return GaussianGrid.selectPointTerrainOptimised(gridpoints: gridpoints, distances: distances, minDistanceIndex: minDistanceIndex, elevations: elevations, elevation: elevation)
     }
 }
 
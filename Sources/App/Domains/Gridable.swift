@@ -15,9 +15,13 @@ public protocol Gridable: Sendable {
     func findBox(boundingBox bb: BoundingBoxWGS84) -> SliceType?
     func estimatedNumberOfGridCells(boundingBox bb: BoundingBoxWGS84) -> Int?
     func getCoordinates(gridpoint: Int) -> (latitude: Float, longitude: Float)
+    func getCoordinates<C: RandomAccessCollection>(gridpoints: C) -> (latitude: [Float], longitude: [Float]) where C.Element == Int
     
     func findPointTerrainOptimised(lat: Float, lon: Float, elevation: Float, elevationFile: any OmFileReaderArrayProtocol<Float>) async throws -> (gridpoint: Int, gridElevation: ElevationOrSea)?
     func findPointInSea(lat: Float, lon: Float, elevationFile: any OmFileReaderArrayProtocol<Float>) async throws -> (gridpoint: Int, gridElevation: ElevationOrSea)?
+
+    func findPointTerrainOptimised(lat: Float, lon: Float, elevation: Float, elevationIndex: ElevationIndex) -> (gridpoint: Int, gridElevation: ElevationOrSea)?
+    func findPointInSea(lat: Float, lon: Float, elevationIndex: ElevationIndex) -> (gridpoint: Int, gridElevation: ElevationOrSea)?
     
     /// Coordinate reference system WKT string with projection information
     var crsWkt2: String { get }
@@ -66,6 +70,19 @@ public enum ElevationOrSea {
         }
     }
 
+    /// Interpret a value of an elevation file. -999 marks sea and 9999 land without elevation information
+    init(surfaceElevation elevation: Float) {
+        if elevation.isNaN {
+            self = .noData
+        } else if elevation <= -999 {
+            self = .sea
+        } else if elevation >= 9999 {
+            self = .landWithoutElevation
+        } else {
+            self = .elevation(elevation)
+        }
+    }
+
     var numeric: Float {
         switch self {
         case .noData:
@@ -86,6 +103,20 @@ extension Gridable {
         return nx * ny
     }
 
+    /// Coordinates of many grid points at once. Projected grids use batched projection kernels
+    func getCoordinates<C: RandomAccessCollection>(gridpoints: C) -> (latitude: [Float], longitude: [Float]) where C.Element == Int {
+        var latitude = [Float]()
+        var longitude = [Float]()
+        latitude.reserveCapacity(gridpoints.count)
+        longitude.reserveCapacity(gridpoints.count)
+        for gridpoint in gridpoints {
+            let coordinate = getCoordinates(gridpoint: gridpoint)
+            latitude.append(coordinate.latitude)
+            longitude.append(coordinate.longitude)
+        }
+        return (latitude, longitude)
+    }
+
     func findPoint(lat: Float, lon: Float, elevation: Float, elevationFile: (any OmFileReaderArrayProtocol<Float>)?, mode: GridSelectionMode) async throws -> (gridpoint: Int, gridElevation: ElevationOrSea)? {
         guard let elevationFile = elevationFile else {
             guard let point = findPoint(lat: lat, lon: lon) else {
@@ -108,21 +139,25 @@ extension Gridable {
         }
     }
 
+    /// Same as `findPoint(lat:lon:elevation:elevationFile:mode:)`, but uses elevation kept in memory. Does not perform any IO
+    func findPoint(lat: Float, lon: Float, elevation: Float, elevationIndex: ElevationIndex, mode: GridSelectionMode) -> (gridpoint: Int, gridElevation: ElevationOrSea)? {
+        switch mode {
+        case .land:
+            guard !elevation.isNaN else {
+                return findPointNearest(lat: lat, lon: lon, elevationIndex: elevationIndex)
+            }
+            return findPointTerrainOptimised(lat: lat, lon: lon, elevation: elevation, elevationIndex: elevationIndex)
+        case .sea:
+            return findPointInSea(lat: lat, lon: lon, elevationIndex: elevationIndex)
+        case .nearest:
+            return findPointNearest(lat: lat, lon: lon, elevationIndex: elevationIndex)
+        }
+    }
+
     /// Read elevation for a single grid point
     func readElevation(gridpoint: Int, elevationFile: any OmFileReaderArrayProtocol<Float>) async throws -> ElevationOrSea {
         let elevation = try await readFromStaticFile(gridpoint: gridpoint, file: elevationFile)
-        if elevation.isNaN {
-            return .noData
-        }
-        if elevation <= -999 {
-            // sea grid point
-            return .sea
-        }
-        if elevation >= 9999 {
-            // land, but no data
-            return .landWithoutElevation
-        }
-        return .elevation(elevation)
+        return ElevationOrSea(surfaceElevation: elevation)
     }
 
     /// Read elevation for a single grid point. Interpolates linearly between grid-cells. Should only be used for linear interpolated reads afterwards
@@ -165,19 +200,51 @@ extension Gridable {
         return (center, elevation)
     }
 
-    /// Find point, perferably in sea
-    func findPointInSea(lat: Float, lon: Float, elevationFile: any OmFileReaderArrayProtocol<Float>) async throws -> (gridpoint: Int, gridElevation: ElevationOrSea)? {
+    /// Get nearest grid point using elevation kept in memory
+    func findPointNearest(lat: Float, lon: Float, elevationIndex: ElevationIndex) -> (gridpoint: Int, gridElevation: ElevationOrSea)? {
         guard let center = findPoint(lat: lat, lon: lon) else {
             return nil
         }
+        let elevation = elevationIndex.read(gridpoint: center)
+        if elevation.hasNoData {
+            // grid is masked out in certain areas
+            return nil
+        }
+        return (center, elevation)
+    }
+
+    /// Grid cells within `searchRadius` around the center grid point, clamped to the grid
+    fileprivate func searchRange(center: Int) -> (x: Range<Int>, y: Range<Int>) {
         let x = center % nx
         let y = center / nx
-
         let xrange = (x - searchRadius..<x + searchRadius + 1).clamped(to: 0..<nx)
         let yrange = (y - searchRadius..<y + searchRadius + 1).clamped(to: 0..<ny)
+        return (xrange, yrange)
+    }
 
+    /// Find point, perferably in sea
+    func findPointInSea(lat: Float, lon: Float, elevationFile: any OmFileReaderArrayProtocol<Float>) async throws -> (gridpoint: Int, gridElevation: ElevationOrSea)? {
+        guard let center = findPoint(lat: lat, lon: lon) else {
+            return nil
+        }
+        let (xrange, yrange) = searchRange(center: center)
         /// -999 marks sea points, therefore  elevation matching will naturally avoid those
         let elevationSurrounding = try await elevationFile.read(range: [yrange.toUInt64(), xrange.toUInt64()])
+        return selectPointInSea(lat: lat, lon: lon, center: center, xrange: xrange, yrange: yrange, elevationSurrounding: elevationSurrounding)
+    }
+
+    /// Find point, perferably in sea, using elevation kept in memory
+    func findPointInSea(lat: Float, lon: Float, elevationIndex: ElevationIndex) -> (gridpoint: Int, gridElevation: ElevationOrSea)? {
+        guard let center = findPoint(lat: lat, lon: lon) else {
+            return nil
+        }
+        let (xrange, yrange) = searchRange(center: center)
+        let elevationSurrounding = elevationIndex.read(x: xrange, y: yrange)
+        return selectPointInSea(lat: lat, lon: lon, center: center, xrange: xrange, yrange: yrange, elevationSurrounding: elevationSurrounding)
+    }
+
+    /// Select the closest sea grid point given the elevation of surrounding grid cells
+    fileprivate func selectPointInSea(lat: Float, lon: Float, center: Int, xrange: Range<Int>, yrange: Range<Int>, elevationSurrounding: [Float]) -> (gridpoint: Int, gridElevation: ElevationOrSea) {
         let centerElevation = elevationSurrounding[elevationSurrounding.count / 2]
         if centerElevation <= -999 {
             return (center, .sea)
@@ -203,13 +270,13 @@ extension Gridable {
         }
         guard minPosition >= 0 else {
             if centerElevation.isNaN {
-                return (y * nx + x, .noData)
+                return (center, .noData)
             }
             if centerElevation >= 9000 {
                 // land, but no data
-                return (y * nx + x, .landWithoutElevation)
+                return (center, .landWithoutElevation)
             }
-            return (y * nx + x, .elevation(centerElevation))
+            return (center, .elevation(centerElevation))
         }
         return (minPosition, .sea)
     }
@@ -225,15 +292,24 @@ extension Gridable {
         guard let center = findPoint(lat: lat, lon: lon) else {
             return nil
         }
-        let x = center % nx
-        let y = center / nx
-
-        let xrange = (x - searchRadius..<x + searchRadius + 1).clamped(to: 0..<nx)
-        let yrange = (y - searchRadius..<y + searchRadius + 1).clamped(to: 0..<ny)
-
+        let (xrange, yrange) = searchRange(center: center)
         /// -999 marks sea points, therefore  elevation matching will naturally avoid those
         let elevationSurrounding = try await elevationFile.read(range: [yrange.toUInt64(), xrange.toUInt64()])
+        return selectPointTerrainOptimised(lat: lat, lon: lon, elevation: elevation, center: center, xrange: xrange, yrange: yrange, elevationSurrounding: elevationSurrounding)
+    }
+
+    /// Analyse 3x3 locations around the desired coordinate using elevation kept in memory
+    func findPointTerrainOptimised(lat: Float, lon: Float, elevation: Float, elevationIndex: ElevationIndex) -> (gridpoint: Int, gridElevation: ElevationOrSea)? {
+        guard let center = findPoint(lat: lat, lon: lon) else {
+            return nil
+        }
+        let (xrange, yrange) = searchRange(center: center)
+        let elevationSurrounding = elevationIndex.read(x: xrange, y: yrange)
+        return selectPointTerrainOptimised(lat: lat, lon: lon, elevation: elevation, center: center, xrange: xrange, yrange: yrange, elevationSurrounding: elevationSurrounding)
+    }
 
+    /// Select the grid point with the best elevation match given the elevation of surrounding grid cells
+    fileprivate func selectPointTerrainOptimised(lat: Float, lon: Float, elevation: Float, center: Int, xrange: Range<Int>, yrange: Range<Int>, elevationSurrounding: [Float]) -> (gridpoint: Int, gridElevation: ElevationOrSea)? {
         let centerElevation = elevationSurrounding[elevationSurrounding.count / 2]
         let deltaCenter = abs(centerElevation - elevation )
         if deltaCenter <= 100 {
@@ -271,7 +347,7 @@ extension Gridable {
 
         /// only sea points or elevation ish hugly off -> just use center
         if minElevation.isNaN || minDelta > 1500 {
-            minPosition = y * nx + x
+            minPosition = center
             minElevation = centerElevation
         }
 
@@ -1,4 +1,5 @@
 import Foundation
+import CHelper
 
 /// See https://mathworld.wolfram.com/LambertAzimuthalEqual-AreaProjection.html
 struct LambertAzimuthalEqualAreaProjection: Projectable {
@@ -60,4 +61,25 @@ struct LambertAzimuthalEqualAreaProjection: Projectable {
         let λ = λ0 + atanf((x * sinf(c) / (p * cosf(ϕ1) * cosf(c) - y * sinf(ϕ1) * sinf(c))))
         return (ϕ.radiansToDegrees, λ.radiansToDegrees)
     }
+
+    /// Precomputed constants for the batched C kernels
+    private var params: LambertAzimuthalEqualAreaParams {
+        return LambertAzimuthalEqualAreaParams(lambda0: λ0, sinPhi1: sinf(ϕ1), cosPhi1: cosf(ϕ1), R: R)
+    }
+
+    func forward(latitude: [Float], longitude: [Float]) -> (x: [Float], y: [Float]) {
+        precondition(latitude.count == longitude.count)
+        var x = [Float](repeating: .nan, count: latitude.count)
+        var y = [Float](repeating: .nan, count: latitude.count)
+        lambertAzimuthalEqualAreaForward(params, latitude.count, latitude, longitude, &x, &y)
+        return (x, y)
+    }
+
+    func inverse(x: [Float], y: [Float]) -> (latitude: [Float], longitude: [Float]) {
+        precondition(x.count == y.count)
+        var latitude = [Float](repeating: .nan, count: x.count)
+        var longitude = [Float](repeating: .nan, count: x.count)
+        lambertAzimuthalEqualAreaInverse(params, x.count, x, y, &latitude, &longitude)
+        return (latitude, longitude)
+    }
 }
@@ -1,4 +1,5 @@
 import Foundation
+import CHelper
 
 /// Converts to spherical coordinates in meters from origin 0°/0°
 struct LambertConformalConicProjection: Projectable {
@@ -89,4 +90,25 @@ struct LambertConformalConicProjection: Projectable {
 
         return (ϕ, λ > 180 ? λ - 360 : λ)
     }
+
+    /// Precomputed constants for the batched C kernels
+    private var params: LambertConformalConicParams {
+        return LambertConformalConicParams(rho0: ρ0, F: F, n: n, lambda0: λ0, R: R)
+    }
+
+    func forward(latitude: [Float], longitude: [Float]) -> (x: [Float], y: [Float]) {
+        precondition(latitude.count == longitude.count)
+        var x = [Float](repeating: .nan, count: latitude.count)
+        var y = [Float](repeating: .nan, count: latitude.count)
+        lambertConformalConicForward(params, latitude.count, latitude, longitude, &x, &y)
+        return (x, y)
+    }
+
+    func inverse(x: [Float], y: [Float]) -> (latitude: [Float], longitude: [Float]) {
+        precondition(x.count == y.count)
+        var latitude = [Float](repeating: .nan, count: x.count)
+        var longitude = [Float](repeating: .nan, count: x.count)
+        lambertConformalConicInverse(params, x.count, x, y, &latitude, &longitude)
+        return (latitude, longitude)
+    }
 }
@@ -4,9 +4,36 @@ protocol Projectable: Sendable {
     func forward(latitude: Float, longitude: Float) -> (x: Float, y: Float)
     func inverse(x: Float, y: Float) -> (latitude: Float, longitude: Float)
 
+    /// Project many coordinates at once. Results are identical to the scalar `forward`
+    func forward(latitude: [Float], longitude: [Float]) -> (x: [Float], y: [Float])
+    /// Inverse projection for many coordinates at once. Results are identical to the scalar `inverse`
+    func inverse(x: [Float], y: [Float]) -> (latitude: [Float], longitude: [Float])
+
     func crsWkt2(latMin: Float, lonMin: Float, latMax: Float, lonMax: Float) -> String
 }
 
+extension Projectable {
+    func forward(latitude: [Float], longitude: [Float]) -> (x: [Float], y: [Float]) {
+        precondition(latitude.count == longitude.count)
+        var x = [Float](repeating: .nan, count: latitude.count)
+        var y = [Float](repeating: .nan, count: latitude.count)
+        for i in latitude.indices {
+            (x[i], y[i]) = forward(latitude: latitude[i], longitude: longitude[i])
+        }
+        return (x, y)
+    }
+
+    func inverse(x: [Float], y: [Float]) -> (latitude: [Float], longitude: [Float]) {
+        precondition(x.count == y.count)
+        var latitude = [Float](repeating: .nan, count: x.count)
+        var longitude = [Float](repeating: .nan, count: x.count)
+        for i in x.indices {
+            (latitude[i], longitude[i]) = inverse(x: x[i], y: y[i])
+        }
+        return (latitude, longitude)
+    }
+}
+
 struct ProjectionGrid<Projection: Projectable>: Gridable {
     let projection: Projection
     let nx: Int
@@ -92,6 +119,25 @@ struct ProjectionGrid<Projection: Projectable>: Gridable {
         return (lat, (lon + 180).truncatingRemainder(dividingBy: 360) - 180 )
     }
 
+    /// Coordinates of many grid points using the batched inverse projection. Identical to calling `getCoordinates(gridpoint:)` for each grid point
+    func getCoordinates<C: RandomAccessCollection>(gridpoints: C) -> (latitude: [Float], longitude: [Float]) where C.Element == Int {
+        var xcord = [Float]()
+        var ycord = [Float]()
+        xcord.reserveCapacity(gridpoints.count)
+        ycord.reserveCapacity(gridpoints.count)
+        for gridpoint in gridpoints {
+            let y = gridpoint / nx
+            let x = gridpoint - y * nx
+            xcord.append(Float(x) * dx + origin.x)
+            ycord.append(Float(y) * dy + origin.y)
+        }
+        var (latitude, longitude) = projection.inverse(x: xcord, y: ycord)
+        for i in longitude.indices {
+            longitude[i] = (longitude[i] + 180).truncatingRemainder(dividingBy: 360) - 180
+        }
+        return (latitude, longitude)
+    }
+
     /// Get angle towards true north. 0 = points towards north pole (e.g. no correction necessary), range -180;180
     func getTrueNorthDirection() -> [Float] {
         let pos = projection.forward(latitude: 90, longitude: 0)
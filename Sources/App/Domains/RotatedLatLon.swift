@@ -1,4 +1,5 @@
 import Foundation
+import CHelper
 
 /// RotatedLatLon projection for HRDP continental
 /// https://gis.stackexchange.com/questions/10808/manually-transforming-rotated-lat-lon-to-regular-lat-lon
@@ -60,4 +61,25 @@ struct RotatedLatLonProjection: Projectable {
         let lon2 = -1 * (atan2(sin(lon), tan(lat) * sin(θ) + cos(lon) * cos(θ)) - ϕ)
         return (lat2.radiansToDegrees, (lon2.radiansToDegrees + 180).truncatingRemainder(dividingBy: 360) - 180)
     }
+
+    /// Precomputed constants for the batched C kernels
+    private var params: RotatedLatLonParams {
+        return RotatedLatLonParams(sinTheta: sin(θ), cosTheta: cos(θ), sinPhi: sin(ϕ), cosPhi: cos(ϕ), phi: ϕ)
+    }
+
+    func forward(latitude: [Float], longitude: [Float]) -> (x: [Float], y: [Float]) {
+        precondition(latitude.count == longitude.count)
+        var x = [Float](repeating: .nan, count: latitude.count)
+        var y = [Float](repeating: .nan, count: latitude.count)
+        rotatedLatLonForward(params, latitude.count, latitude, longitude, &x, &y)
+        return (x, y)
+    }
+
+    func inverse(x: [Float], y: [Float]) -> (latitude: [Float], longitude: [Float]) {
+        precondition(x.count == y.count)
+        var latitude = [Float](repeating: .nan, count: x.count)
+        var longitude = [Float](repeating: .nan, count: x.count)
+        rotatedLatLonInverse(params, x.count, x, y, &latitude, &longitude)
+        return (latitude, longitude)
+    }
 }
@@ -1,4 +1,5 @@
 import Foundation
+import CHelper
 
 /// Stereographic projection
 /// https://mathworld.wolfram.com/StereographicProjection.html
@@ -65,4 +66,25 @@ struct StereographicProjection: Projectable {
         let λ = λ0 + atan2(x * sin(c), p * cosϕ1 * cos(c) - y * sinϕ1 * sin(c))
         return (ϕ.radiansToDegrees, λ.radiansToDegrees)
     }
+
+    /// Precomputed constants for the batched C kernels
+    private var params: StereographicParams {
+        return StereographicParams(lambda0: λ0, sinPhi1: sinϕ1, cosPhi1: cosϕ1, R: R)
+    }
+
+    func forward(latitude: [Float], longitude: [Float]) -> (x: [Float], y: [Float]) {
+        precondition(latitude.count == longitude.count)
+        var x = [Float](repeating: .nan, count: latitude.count)
+        var y = [Float](repeating: .nan, count: latitude.count)
+        stereographicForward(params, latitude.count, latitude, longitude, &x, &y)
+        return (x, y)
+    }
+
+    func inverse(x: [Float], y: [Float]) -> (latitude: [Float], longitude: [Float]) {
+        precondition(x.count == y.count)
+        var latitude = [Float](repeating: .nan, count: x.count)
+        var longitude = [Float](repeating: .nan, count: x.count)
+        stereographicInverse(params, x.count, x, y, &latitude, &longitude)
+        return (latitude, longitude)
+    }
 }
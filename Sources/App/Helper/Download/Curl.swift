@@ -17,6 +17,7 @@ enum CurlError: Error {
     case timeoutReached
     case timeoutPerChunkReached(httpRange: Range<Int>)
     case futimes(error: String)
+    case fileWrite(error: String)
     case contentLengthHeaderTooLarge(got: Int)
     case couldNotGetContentLengthForConcurrentDownload
     case invalidURL(String)
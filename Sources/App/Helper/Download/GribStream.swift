@@ -6,21 +6,44 @@ import AsyncAlgorithms
 
 extension AsyncSequence where Element == ByteBuffer {
     /// Decode incoming data to GRIB messages
-    func decodeGrib() -> GribAsyncStream<Self> {
-        return GribAsyncStream(sequence: self)
+    /// `nConcurrent` messages are decoded by eccodes in parallel. The order of messages is preserved.
+    /// Memory is bounded by `nConcurrent` compressed messages in flight
+    func decodeGrib(nConcurrent: Int = min(4, System.coreCount)) -> GribAsyncStream<Self> {
+        precondition(nConcurrent > 0)
+        return GribAsyncStream(sequence: self, nConcurrent: nConcurrent)
     }
 }
 
 
 enum GribAsyncStreamHelper {
+    /// Find the offset of the next `GRIB` sync word. `memchr` is vectorised in libc and skips quickly over message payloads.
+    static func findSyncWord(memory: UnsafeRawBufferPointer) -> Int? {
+        guard let base = memory.baseAddress, memory.count >= 4 else {
+            return nil
+        }
+        /// Last position at which a 4 byte sync word could start
+        let end = memory.count - 3
+        var position = 0
+        while position < end {
+            guard let found = memchr(base.advanced(by: position), Int32(UInt8(ascii: "G")), end - position) else {
+                return nil
+            }
+            let offset = base.distance(to: UnsafeRawPointer(found))
+            if UInt32(bigEndian: memory.loadUnaligned(fromByteOffset: offset, as: UInt32.self)) == 0x47524942 {
+                return offset
+            }
+            position = offset + 1
+        }
+        return nil
+    }
+
     /// Detect a range of bytes in a byte stream if there is a grib header and returns it
     /// Note: The required length to decode a GRIB message is not checked of the input buffer
     static func seekGrib(memory: UnsafeRawBufferPointer) -> (offset: Int, length: Int, gribVersion: Int)? {
-        let search = "GRIB"
         guard let base = memory.baseAddress else {
             return nil
         }
-        guard let offset = search.withCString({ memory.firstRange(of: UnsafeRawBufferPointer(start: $0, count: strlen($0))) })?.lowerBound else {
+        guard let offset = findSyncWord(memory: memory) else {
             return nil
         }
         guard offset <= (1 << 40), offset + 16 <= memory.count else {
@@ -105,76 +128,212 @@ enum GribAsyncStreamError: Error {
     case unexpectedEndOfFile
 }
 
+/// GRIB messages decoded from one sync word. eccodes handles are not marked as `Sendable`, but are only accessed by one task at a time.
+fileprivate struct GribMessages: @unchecked Sendable {
+    let messages: [GribMessage]
+}
+
 /**
  Decode incoming binary stream to GRIB messages
+
+ Messages that are fully contained in one incoming `ByteBuffer` are passed to eccodes as a slice without copying. Only messages spanning multiple buffers are assembled into a new buffer of exactly the message size.
+ Up to `nConcurrent` messages are decoded in parallel similar to `Bzip2AsyncStream`.
  */
 struct GribAsyncStream<T: AsyncSequence>: AsyncSequence where T.Element == ByteBuffer {
     public typealias Element = AsyncIterator.Element
 
     let sequence: T
+    let nConcurrent: Int
 
     public final class AsyncIterator: AsyncIteratorProtocol {
-        private var iterator: T.AsyncIterator
+        private var splitter: GribMessageSplitter<T.AsyncIterator>
 
-        /// Collect enough bytes to decompress a single message
-        private var buffer: ByteBuffer
+        /// Messages which are currently decoded in the background. Order matches the input stream.
+        private var tasks: CircularBuffer<Task<GribMessages, any Error>>
 
         /// Buffer mutliple messages to only return one at a time
         private var messages: [GribMessage]?
 
-        fileprivate init(iterator: T.AsyncIterator) {
-            self.iterator = iterator
-            self.buffer = ByteBuffer()
-            buffer.reserveCapacity(minimumWritableBytes: 4096)
+        private let nConcurrent: Int
+
+        fileprivate init(iterator: T.AsyncIterator, nConcurrent: Int) {
+            self.splitter = GribMessageSplitter(iterator: iterator)
+            self.nConcurrent = nConcurrent
+            self.tasks = CircularBuffer(initialCapacity: nConcurrent)
         }
 
-        public func next() async throws -> GribMessage? {
-            if let next = messages?.popLast() {
-                return next
+        deinit {
+            for task in tasks {
+                task.cancel()
+            }
+        }
+
+        /// Fill the task queue until `nConcurrent` messages are being decoded
+        private func spawnDecodeTasks() async throws {
+            while tasks.count < nConcurrent {
+                guard let message = try await splitter.next() else {
+                    return
+                }
+                tasks.append(Task {
+                    // Deocode message with eccodes
+                    return GribMessages(messages: try message.withUnsafeReadableBytes {
+                        try SwiftEccodes.getMessages(memory: $0, multiSupport: true)
+                    })
+                })
             }
+        }
 
+        public func next() async throws -> GribMessage? {
             while true {
-                // repeat until GRIB header is found
-                guard let seek = buffer.withUnsafeReadableBytes(GribAsyncStreamHelper.seekGrib) else {
-                    guard let input = try await self.iterator.next() else {
-                        guard buffer.readableBytes < 64 * 1024 else {
+                if let next = messages?.popLast() {
+                    return next
+                }
+                try await spawnDecodeTasks()
+                guard !tasks.isEmpty else {
+                    return nil
+                }
+                messages = try await tasks.removeFirst().value.messages
+            }
+        }
+    }
+
+    public func makeAsyncIterator() -> AsyncIterator {
+        AsyncIterator(iterator: sequence.makeAsyncIterator(), nConcurrent: nConcurrent)
+    }
+}
+
+/**
+ Split a stream of `ByteBuffer` into `ByteBuffer` slices that contain exactly one GRIB message
+ */
+struct GribMessageSplitter<Iterator: AsyncIteratorProtocol> where Iterator.Element == ByteBuffer {
+    private var iterator: Iterator
+
+    /// Incoming buffers which have not been consumed yet
+    private var pending = CircularBuffer<ByteBuffer>(initialCapacity: 4)
+
+    /// Sum of readable bytes in `pending`
+    private var available = 0
+
+    /// True if the first pending buffer was allocated by `mergeFirstTwoBuffers` and is not referenced by any returned message
+    private var firstIsMerged = false
+
+    init(iterator: Iterator) {
+        self.iterator = iterator
+    }
+
+    /// Get the next buffer from the input stream. Return false on end of file
+    private mutating func fetch() async throws -> Bool {
+        guard let input = try await iterator.next() else {
+            return false
+        }
+        if input.readableBytes > 0 {
+            pending.append(input)
+            available += input.readableBytes
+        }
+        return true
+    }
+
+    /// Consume `count` bytes from pending buffers
+    private mutating func skip(_ count: Int) {
+        var remaining = count
+        while remaining > 0 {
+            let skip = Swift.min(remaining, pending[pending.startIndex].readableBytes)
+            pending[pending.startIndex].moveReaderIndex(forwardBy: skip)
+            if pending[pending.startIndex].readableBytes == 0 {
+                _ = pending.removeFirst()
+                firstIsMerged = false
+            }
+            remaining -= skip
+            available -= skip
+        }
+    }
+
+    /// Merge the first two pending buffers to search for a GRIB header that is crossing buffer boundaries
+    /// The first merge allocates a new buffer, because the first buffer may still be referenced by previously returned message slices. Following merges append to this buffer, which grows geometrically
+    private mutating func mergeFirstTwoBuffers() {
+        var first = pending.removeFirst()
+        let second = pending.removeFirst()
+        if firstIsMerged {
+            first.writeImmutableBuffer(second)
+            pending.prepend(first)
+            return
+        }
+        var merged = ByteBufferAllocator().buffer(capacity: first.readableBytes + second.readableBytes)
+        merged.writeImmutableBuffer(first)
+        merged.writeImmutableBuffer(second)
+        pending.prepend(merged)
+        firstIsMerged = true
+    }
+
+    /// Return the next GRIB message or nil at the end of the stream
+    mutating func next() async throws -> ByteBuffer? {
+        while true {
+            guard let first = pending.first else {
+                guard try await fetch() else {
+                    return nil
+                }
+                continue
+            }
+            // repeat until GRIB header is found
+            guard let seek = first.withUnsafeReadableBytes(GribAsyncStreamHelper.seekGrib) else {
+                // IFS HRES WAM files have the section 3 header at the end of the message (8 MB)
+                guard first.readableBytes < 8 * 1024 * 1024 else {
+                    throw GribAsyncStreamError.didNotFindGibHeader
+                }
+                if pending.count < 2 {
+                    guard try await fetch() else {
+                        guard available < 64 * 1024 else {
                             throw GribAsyncStreamError.didNotFindGibHeader
                         }
                         return nil
                     }
-                    // IFS HRES WAM files have the section 3 header at the end of the message (8 MB)
-                    guard buffer.readableBytes < 8 * 1024 * 1024 else {
-                        throw GribAsyncStreamError.didNotFindGibHeader
-                    }
-                    buffer.writeImmutableBuffer(input)
-                    continue
                 }
+                // The sync word or the GRIB header may cross buffer boundaries
+                if pending.count >= 2 {
+                    mergeFirstTwoBuffers()
+                }
+                continue
+            }
 
-                // Repeat until enough data is available
-                while buffer.readableBytes < seek.offset + seek.length {
-                    guard let input = try await self.iterator.next() else {
-                        throw GribAsyncStreamError.unexpectedEndOfFile
-                    }
-                    buffer.writeImmutableBuffer(input)
+            // Skip data in front of the GRIB header
+            skip(seek.offset)
+
+            // Zero-copy: Message is fully contained in the first buffer
+            if seek.length <= pending[pending.startIndex].readableBytes {
+                guard let message = pending[pending.startIndex].readSlice(length: seek.length) else {
+                    fatalError("Could not slice GRIB message")
                 }
+                available -= seek.length
+                firstIsMerged = false
+                if pending[pending.startIndex].readableBytes == 0 {
+                    _ = pending.removeFirst()
+                }
+                return message
+            }
 
-                // Deocode message with eccodes
-                messages = try buffer.readWithUnsafeReadableBytes({
-                    let range = seek.offset ..< Swift.min(seek.offset + seek.length, $0.count)
-                    let memory = UnsafeRawBufferPointer(rebasing: $0[range])
-                    let messages = try SwiftEccodes.getMessages(memory: memory, multiSupport: true)
-                    return (seek.offset + seek.length, messages)
-                })
+            // Repeat until enough data is available
+            while available < seek.length {
+                guard try await fetch() else {
+                    throw GribAsyncStreamError.unexpectedEndOfFile
+                }
+            }
 
-                buffer.discardReadBytes()
-                if let next = messages?.popLast() {
-                    return next
+            // Message is crossing buffer boundaries. Copy exactly once into a buffer of the message size
+            firstIsMerged = false
+            var message = ByteBufferAllocator().buffer(capacity: seek.length)
+            while message.readableBytes < seek.length {
+                var first = pending.removeFirst()
+                let length = Swift.min(seek.length - message.readableBytes, first.readableBytes)
+                guard let part = first.readSlice(length: length) else {
+                    fatalError("Could not slice GRIB message")
+                }
+                message.writeImmutableBuffer(part)
+                available -= length
+                if first.readableBytes > 0 {
+                    pending.prepend(first)
                 }
             }
+            return message
         }
     }
-
-    public func makeAsyncIterator() -> AsyncIterator {
-        AsyncIterator(iterator: sequence.makeAsyncIterator())
-    }
 }
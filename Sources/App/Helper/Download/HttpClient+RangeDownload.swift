@@ -0,0 +1,263 @@
+import Foundation
+import AsyncHTTPClient
+import NIOCore
+import NIOConcurrencyHelpers
+import Logging
+import NIOHTTP1
+
+/**
+ Completed chunks of a partial download. Stored as a small sidecar file `file~.ranges` next to the partial file `file~` to resume downloads after interruption.
+ The state is only valid for the same remote file. If size, ETag or modification time differ, the download starts from scratch.
+ */
+struct RangeDownloadBitmap: Codable, Equatable {
+    let size: Int
+    let chunkSize: Int
+    let etag: String?
+    let lastModified: Int?
+
+    /// One bit per chunk. Set if the chunk was completely written to the partial file
+    private(set) var bitmap: [UInt64]
+
+    init(size: Int, chunkSize: Int, etag: String?, lastModified: Int?) {
+        precondition(chunkSize > 0)
+        self.size = size
+        self.chunkSize = chunkSize
+        self.etag = etag
+        self.lastModified = lastModified
+        self.bitmap = [UInt64](repeating: 0, count: size.divideRoundedUp(divisor: chunkSize).divideRoundedUp(divisor: 64))
+    }
+
+    var nChunks: Int {
+        return size.divideRoundedUp(divisor: chunkSize)
+    }
+
+    /// Byte range of a chunk
+    func range(chunk: Int) -> Range<Int> {
+        return chunk * chunkSize ..< min((chunk + 1) * chunkSize, size)
+    }
+
+    func isComplete(chunk: Int) -> Bool {
+        return bitmap[chunk / 64] & (1 << UInt64(chunk % 64)) != 0
+    }
+
+    mutating func setComplete(chunk: Int) {
+        bitmap[chunk / 64] |= 1 << UInt64(chunk % 64)
+    }
+
+    /// Chunks that still need to be downloaded
+    var missingChunks: [Int] {
+        return (0..<nChunks).filter { !isComplete(chunk: $0) }
+    }
+
+    var completedBytes: Int {
+        return (0..<nChunks).reduce(0, { isComplete(chunk: $1) ? $0 + range(chunk: $1).count : $0 })
+    }
+
+    var isComplete: Bool {
+        return (0..<nChunks).allSatisfy { isComplete(chunk: $0) }
+    }
+
+    /// True if the state belongs to the same remote file and can be resumed
+    func isSameFile(as other: RangeDownloadBitmap) -> Bool {
+        return size == other.size && chunkSize == other.chunkSize && etag == other.etag && lastModified == other.lastModified
+    }
+
+    static func read(file: String) -> RangeDownloadBitmap? {
+        guard let data = FileManager.default.contents(atPath: file) else {
+            return nil
+        }
+        return try? JSONDecoder().decode(RangeDownloadBitmap.self, from: data)
+    }
+
+    func write(file: String) throws {
+        try JSONEncoder().encode(self).write(to: URL(fileURLWithPath: file), options: .atomic)
+    }
+}
+
+enum RangeDownloadError: Error {
+    /// Another process holds the lock on the partial file and is downloading the same file
+    case downloadInProgress(file: String)
+}
+
+extension HTTPClient {
+    /**
+     Download a file with parallel HTTP range requests directly into a preallocated partial file `file~`. Each chunk is written with `pwrite` at its offset.
+     Completed chunks are tracked in a sidecar bitmap `file~.ranges`. If the download is interrupted, the next call only downloads missing chunks as long as size, ETag and modification time of the remote file did not change.
+     The ETag of every range response must match the initial HEAD request. Once all chunks are complete, the file size is verified and the partial file is moved to `file`.
+     The modification time of the local file is set to the remote modification time.
+     An exclusive `flock` on the partial file is held for the entire download. If another process is downloading the same file, `RangeDownloadError.downloadInProgress` is thrown without modifying any file.
+
+     IMPORTANT: It may throw `CurlErrorNonRetry.fileModifiedSinceLastDownload` if the remote file was modified during download. The partial file is deleted in this case.
+     */
+    func downloadRanges(
+        _ request: HTTPClientRequest,
+        file: String,
+        logger: Logger,
+        progress: TransferAmountTracker? = nil,
+        chunkSize: Int = 8*1024*1024,
+        nConcurrent: Int = 4,
+        deadline: Date = .minutes(60),
+        timeoutPerRequest: TimeAmount = .seconds(30),
+        backOffSettings: ExponentialBackOff = .init()
+    ) async throws {
+        var headRequest = request
+        headRequest.method = .HEAD
+        let head = try await executeMapRetry(headRequest, logger: logger, deadline: deadline, timeoutPerRequest: timeoutPerRequest, backOffSettings: backOffSettings) {$0}
+        guard let size = try head.contentLength() else {
+            throw CurlError.couldNotGetContentLengthForConcurrentDownload
+        }
+        let etag = head.headers.first(name: "ETag")
+        let lastModified = head.headers.lastModified?.value
+        let expected = RangeDownloadBitmap(size: size, chunkSize: chunkSize, etag: etag, lastModified: lastModified.map { Int($0.timeIntervalSince1970) })
+
+        let partialFile = "\(file)~"
+        let bitmapFile = "\(file)~.ranges"
+        let fd = open(partialFile, O_RDWR | O_CREAT, 0o644)
+        guard fd != -1 else {
+            throw CurlError.fileWrite(error: String(cString: strerror(errno)))
+        }
+        let fn = FileHandle(fileDescriptor: fd, closeOnDealloc: true)
+        /// The lock is released once `fn` is closed. Files are only deleted, truncated or moved while holding the lock
+        guard flock(fd, LOCK_EX | LOCK_NB) == 0 else {
+            if errno == EWOULDBLOCK {
+                throw RangeDownloadError.downloadInProgress(file: file)
+            }
+            throw CurlError.fileWrite(error: String(cString: strerror(errno)))
+        }
+        /// The previous owner of the lock may have moved the partial file to `file` after it was opened here
+        guard let stats = FileManager.default.fileStats(at: partialFile), stats.st_ino == fn.fileStats().st_ino, stats.st_dev == fn.fileStats().st_dev else {
+            throw RangeDownloadError.downloadInProgress(file: file)
+        }
+        let state: RangeDownloadBitmap
+        if let previous = RangeDownloadBitmap.read(file: bitmapFile), previous.isSameFile(as: expected), fn.fileSize() == size {
+            state = previous
+        } else {
+            try FileManager.default.removeItemIfExists(at: bitmapFile)
+            guard ftruncate(fd, 0) == 0 else {
+                throw CurlError.fileWrite(error: String(cString: strerror(errno)))
+            }
+            state = expected
+        }
+
+        if fn.fileSize() != size {
+            #if os(Linux)
+            // Reserve disk space upfront. Not supported by all file systems, `ftruncate` creates a sparse file instead
+            _ = posix_fallocate(fd, 0, off_t(size))
+            #endif
+            guard ftruncate(fd, off_t(size)) == 0 else {
+                throw CurlError.fileWrite(error: String(cString: strerror(errno)))
+            }
+        }
+
+        let missing = state.missingChunks
+        let resumedBytes = state.completedBytes
+        if resumedBytes > 0 {
+            logger.info("Resume download \(request.url.stripHttpPassword()) [\(resumedBytes.bytesHumanReadable) of \(size.bytesHumanReadable) already downloaded]")
+            await progress?.add(resumedBytes)
+        }
+        logger.debug("Download \(request.url.stripHttpPassword()) [nConcurrent=\(nConcurrent) nChunks=\(missing.count) size=\(size.bytesHumanReadable) chunkLength=\(chunkSize.bytesHumanReadable)]")
+
+        /// Persist the bitmap at most every 10 seconds. Data is flushed to disk before to guarantee that all chunks marked as complete are actually stored
+        let bitmap = NIOLockedValueBox((state: state, lastPersist: Date()))
+        do {
+            try await missing.foreachConcurrent(nConcurrent: nConcurrent) { chunk in
+                let range = state.range(chunk: chunk)
+                var request = request
+                request.headers.add(name: "range", value: "bytes=\(range.lowerBound)-\(range.upperBound - 1)")
+                if let etag {
+                    request.headers.replaceOrAdd(name: "If-Match", value: etag)
+                }
+                try await self.executeMapRetry(request, logger: logger, deadline: deadline, timeoutPerRequest: timeoutPerRequest, backOffSettings: backOffSettings) { response in
+                    if let etag, let responseEtag = response.headers.first(name: "ETag"), responseEtag != etag {
+                        throw CurlErrorNonRetry.fileModifiedSinceLastDownload
+                    }
+                    if let contentLength = try response.contentLength(), contentLength != range.count {
+                        throw CurlErrorNonRetry.chunkSizeMismatch
+                    }
+                    /// Buffer up to 1024kb to write full ZFS records
+                    let recordSize = 1024 * 1024
+                    var buffer = ByteBuffer()
+                    buffer.reserveCapacity(recordSize)
+                    var offset = range.lowerBound
+                    // Allow 5 minutes per chunk, then restart
+                    let deadLineChunk = Date.minutes(5)
+                    for try await fragment in response.body {
+                        if Date() > deadLineChunk {
+                            throw CurlErrorRetry.chunkTimeoutReached
+                        }
+                        if Date() > deadline {
+                            throw CurlErrorNonRetry.timeoutReached
+                        }
+                        guard offset + buffer.readableBytes + fragment.readableBytes <= range.upperBound else {
+                            throw CurlErrorNonRetry.chunkSizeMismatch
+                        }
+                        buffer.writeImmutableBuffer(fragment)
+                        if buffer.readableBytes >= recordSize {
+                            try fn.write(buffer, at: offset)
+                            offset += buffer.readableBytes
+                            buffer.clear()
+                        }
+                    }
+                    try fn.write(buffer, at: offset)
+                    offset += buffer.readableBytes
+                    guard offset == range.upperBound else {
+                        throw CurlErrorNonRetry.chunkSizeMismatch
+                    }
+                }
+                /// Only count completed chunks. Bytes of failed attempts are downloaded again
+                await progress?.add(range.count)
+                try bitmap.withLockedValue { bitmap in
+                    bitmap.state.setComplete(chunk: chunk)
+                    guard Date().timeIntervalSince(bitmap.lastPersist) > 10 else {
+                        return
+                    }
+                    guard fsync(fd) == 0 else {
+                        throw CurlError.fileWrite(error: String(cString: strerror(errno)))
+                    }
+                    try bitmap.state.write(file: bitmapFile)
+                    bitmap.lastPersist = Date()
+                }
+            }
+        } catch CurlErrorNonRetry.fileModifiedSinceLastDownload {
+            try FileManager.default.removeItemIfExists(at: bitmapFile)
+            try FileManager.default.removeItemIfExists(at: partialFile)
+            throw CurlErrorNonRetry.fileModifiedSinceLastDownload
+        } catch {
+            // Keep completed chunks for the next attempt
+            if fsync(fd) == 0 {
+                try? bitmap.withLockedValue { try $0.state.write(file: bitmapFile) }
+            }
+            throw error
+        }
+
+        guard bitmap.withLockedValue({ $0.state.isComplete }), fn.fileSize() == size else {
+            throw CurlErrorNonRetry.chunkSizeMismatch
+        }
+        if let lastModified {
+            let times = [timespec](repeating: timespec(tv_sec: Int(lastModified.timeIntervalSince1970), tv_nsec: 0), count: 2)
+            guard futimens(fd, times) == 0 else {
+                throw CurlError.futimes(error: String(cString: strerror(errno)))
+            }
+        }
+        try FileManager.default.moveFileOverwrite(from: partialFile, to: file)
+        try FileManager.default.removeItemIfExists(at: bitmapFile)
+        // Keep the lock until the partial file has been moved
+        withExtendedLifetime(fn) {}
+    }
+}
+
+fileprivate extension FileHandle {
+    /// Write all bytes at a given file offset using `pwrite`. Does not modify the file position and can be called concurrently for different offsets
+    func write(_ buffer: ByteBuffer, at offset: Int) throws {
+        try buffer.withUnsafeReadableBytes { ptr in
+            var written = 0
+            while written < ptr.count {
+                let ret = pwrite(fileDescriptor, ptr.baseAddress?.advanced(by: written), ptr.count - written, off_t(offset + written))
+                guard ret > 0 else {
+                    throw CurlError.fileWrite(error: String(cString: strerror(errno)))
+                }
+                written += ret
+            }
+        }
+    }
+}
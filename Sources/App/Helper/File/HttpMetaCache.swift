@@ -9,7 +9,9 @@ enum HttpMetaCache {
     }
     
     static func get(url: String) -> State {
-        return OpenMeteo.fileMetaCache.get(key: url.fnv1aHash64, maxAccessedAgeInSeconds: 365*24*3600)?.assumingMemoryBound(to: Entry.self)[0].state ?? .missing(lastValidated: Timestamp(0))
+        return OpenMeteo.fileMetaCache.withData(key: url.fnv1aHash64, maxAccessedAgeInSeconds: 365*24*3600) {
+            $0.assumingMemoryBound(to: Entry.self)[0]
+        }?.state ?? .missing(lastValidated: Timestamp(0))
     }
     
     static func set(url: String, state: State) throws {
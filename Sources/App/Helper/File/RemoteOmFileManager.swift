@@ -17,6 +17,8 @@ import Synchronization
  - Remote files are checked every 3 minutes
  - All files are evicted from cache after 15 minutes of inactivity
  
+ Recently accessed blocks of remote files are written to a hot block manifest every 5 minutes. After a restart, those blocks are preloaded in the background.
+ 
  TODO:
  - Support multiple cache files. Could be useful if multiple NVMe drive are available for caching
  - Support cache tiering for HDD + NVME cache
@@ -27,6 +29,9 @@ final class RemoteFileManager: Sendable {
     /// Isolate requests to files
     private let cache = RemoteFileManagerCache()
     
+    /// Unix timestamp of the last hot block manifest update. 0 if the cache has not been warmed up yet
+    private let lastHotBlockManifestUpdate = Atomic<Int>(0)
+    
     /// Execute a closure with a reader. If the remote file was modified during execution, restart the execution
     func with<R, Key: RemoteFileManageable>(file: Key, client: HTTPClient?, logger: Logger, fn: (_ value: Key.Value) async throws -> R) async throws -> R? {
         guard let value = try await get(file: file, client: client, logger: logger, forceNew: false) else {
@@ -42,6 +47,22 @@ final class RemoteFileManager: Sendable {
         }
     }
     
+    /// Like `with<R>()`, but additionally provides a version of the opened file. The version changes if a local file is replaced or a remote file is modified.
+    /// Used as key for caches of decompressed data.
+    func withVersion<R, Key: RemoteFileManageable>(file: Key, client: HTTPClient?, logger: Logger, fn: (_ value: Key.Value, _ version: UInt64) async throws -> R) async throws -> R? {
+        guard let opened = try await getWithVersion(file: file, client: client, logger: logger, forceNew: false) else {
+            return nil
+        }
+        do {
+            return try await fn(opened.value, opened.version)
+        } catch CurlErrorNonRetry.fileModifiedSinceLastDownload {
+            guard let opened = try await getWithVersion(file: file, client: client, logger: logger, forceNew: true) else {
+                return nil
+            }
+            return try await fn(opened.value, opened.version)
+        }
+    }
+    
     /// Check if the file is available locally or remotely.
     /// `with<R>()` is recommended to automatically reload files if they are modified during execution
     /// Note: If the file is remote, the reader may throw `CurlError.fileModifiedSinceLastDownload` if the file was modified on the remote end
@@ -50,7 +71,7 @@ final class RemoteFileManager: Sendable {
             return nil
         }
         switch backend {
-        case .local(let value):
+        case .local(let value, _):
             guard let value = value as? (any LocalFileRepresentable<Key.Value>) else {
                 fatalError("Not cast-able to LocalFileRepresentable")
             }
@@ -63,6 +84,25 @@ final class RemoteFileManager: Sendable {
         }
     }
     
+    /// Get a file and its version. See `withVersion`
+    private func getWithVersion<Key: RemoteFileManageable>(file: Key, client: HTTPClient?, logger: Logger, forceNew: Bool) async throws -> (value: Key.Value, version: UInt64)? {
+        guard let backend = try await cache.get(key: file, client: client, logger: logger, forceNew: forceNew) else {
+            return nil
+        }
+        switch backend {
+        case .local(let value, let version):
+            guard let value = value as? (any LocalFileRepresentable<Key.Value>) else {
+                fatalError("Not cast-able to LocalFileRepresentable")
+            }
+            return (value.cast(), version)
+        case .remote(let value):
+            guard let value = value as? (any RemoteFileRepresentable<Key.Value>) else {
+                fatalError("Not cast-able to RemoteFileRepresentable")
+            }
+            return (value.cast(), value.fn.cacheKey)
+        }
+    }
+    
     /// On cache miss this function is called to create a new reader
     /// If `forceNew` is set, do not use cached meta data
     static fileprivate func open<Key: RemoteFileManageable>(key: Key, client: HTTPClient?, logger: Logger, forceNew: Bool) async throws -> (value: LocalOrRemote?, lastValidated: Timestamp) {
@@ -71,7 +111,7 @@ final class RemoteFileManager: Sendable {
             do {
                 let file = try MmapFile(fn: try FileHandle.openFileReading(file: localFile))
                 let reader = try await key.makeLocalReader(file: file)
-                return (.local(reader), .now())
+                return (.local(reader, version: file.version), .now())
             } catch OmFileFormatSwiftError.notAnOpenMeteoFile {
                 print("[ ERROR ] Not an OpenMeteo file \(localFile)")
                 return (nil, .now())
@@ -102,7 +142,7 @@ final class RemoteFileManager: Sendable {
             
         case .available(let lastValidated, let count, let lastModified, let eTag):
             let reader = OmHttpReaderBackend(client: client, logger: logger, url: remoteFile, count: count, lastModified: lastModified, eTag: eTag, lastValidated: lastValidated)
-            let cached = OmReaderBlockCache(backend: reader, cache: OpenMeteo.dataBlockCache, cacheKey: reader.cacheKey)
+            let cached = OmReaderBlockCache(backend: reader, cache: OpenMeteo.dataBlockCache, cacheKey: reader.cacheKey, coalescing: OpenMeteo.remoteRangeCoalescing)
             let revalidateSeconds = key.revalidateEverySeconds(modificationTime: lastModified, now: now)
             if lastValidated >= now.subtract(seconds: revalidateSeconds) {
                 /// Reuse cached meta attributes
@@ -143,7 +183,7 @@ final class RemoteFileManager: Sendable {
         // Every minute: Check if local files got added or deleted
         // Local File IO is blocking, therefore we get a list of keys and check it outside actor isolation
         for (key, entry) in await cache.entriesLastValidatedLocal(olderThan: now.subtract(minutes: 1)) {
-            if case .local(let local) = entry.value {
+            if case .local(let local, _) = entry.value {
                 // Local file open. Check if it was deleted
                 if local.fn.file.wasDeleted() {
                     OmMetrics.fileCacheLocalModified.add(1, ordering: .relaxed)
@@ -190,10 +230,16 @@ final class RemoteFileManager: Sendable {
                 let activeBlocks = old.fn.listOfActiveBlocks(maxAgeSeconds: 15*60)
                 logger.error("OmFileManager: Remote file modified \(key). \(activeBlocks.count) blocks active in the last 15 minutes")
                 if activeBlocks.count > 0 {
-                    // TODO: Consider: While we are preloading, another call could fail and we fetch data twice. Solution could be some kind of preload manager
-                    let startPreload = DispatchTime.now()
-                    try await new.preloadBlocks(blocks: activeBlocks)
-                    logger.error("OmFileManager: Preload completed in \(startPreload.timeElapsedPretty())")
+                    // Preload is rate limited and may take minutes. Run detached to not stall revalidation of other files. Requests that need a block before it is preloaded fetch it themselves
+                    Task {
+                        let startPreload = DispatchTime.now()
+                        do {
+                            try await new.preloadBlocks(blocks: activeBlocks, limiter: OpenMeteo.cacheWarmupLimiter)
+                            logger.error("OmFileManager: Preload of \(remoteFile) completed in \(startPreload.timeElapsedPretty())")
+                        } catch {
+                            logger.warning("OmFileManager: Preload of \(remoteFile) failed: \(error)")
+                        }
+                    }
                 }
                 await cache.setEntry(forKey: key, value: entry.with(value: .remote(reader), lastValidated: now))
             } else {
@@ -224,18 +270,94 @@ final class RemoteFileManager: Sendable {
         }
     }
     
+    /**
+     On the first call, preload blocks of the last hot block manifest in the background. Afterwards, merge recently accessed blocks into the manifest every 5 minutes.
+     The manifest and the block cache are shared by all processes on a host. The warm-up is skipped if another process updated the manifest recently, because the shared cache is then still warm. Of concurrently starting processes only one warms up the cache.
+     Only used if `REMOTE_DATA_DIRECTORY` is set.
+     */
+    func updateHotBlockManifest(client: HTTPClient, logger: Logger) async throws {
+        guard OpenMeteo.remoteDataDirectory != nil else {
+            return
+        }
+        let now = Timestamp.now().timeIntervalSince1970
+        let lastUpdate = lastHotBlockManifestUpdate.load(ordering: .relaxed)
+        let path = OpenMeteo.hotBlockManifestFile
+        let blockSize = OpenMeteo.dataBlockCache.blockSize
+        if lastUpdate == 0 {
+            lastHotBlockManifestUpdate.store(now, ordering: .relaxed)
+            guard let manifest = HotBlockManifest.read(path: path, blockSize: blockSize) else {
+                return
+            }
+            if let updated = manifest.updated, updated >= now - 10*60 {
+                logger.info("OmFileManager: Skipping warm up. Hot block manifest was updated \(now - updated) seconds ago by another process")
+                return
+            }
+            Task {
+                let warmedUp = try? await HotBlockManifest.withLock(path: "\(path).warmup", nonBlocking: true) {
+                    await warmUp(manifest: manifest, client: client, logger: logger)
+                }
+                if warmedUp == nil {
+                    logger.info("OmFileManager: Skipping warm up. Another process is warming up the cache")
+                }
+            }
+            return
+        }
+        guard lastUpdate <= now - 5*60 else {
+            return
+        }
+        lastHotBlockManifestUpdate.store(now, ordering: .relaxed)
+        // Scanning blocks is done outside actor isolation
+        let files = await cache.activeRemoteFiles().compactMap { fn -> HotBlockManifest.File? in
+            let blocks = fn.listOfActiveBlockRanges(maxAgeSeconds: 15*60)
+            return blocks.isEmpty ? nil : HotBlockManifest.File(url: fn.backend.url, blocks: blocks)
+        }
+        try await HotBlockManifest.update(path: path, blockSize: blockSize, active: files, now: now, maxAgeSeconds: 15*60)
+    }
+    
+    /// Preload blocks of all files in the manifest. Files are revalidated first, so that blocks of modified files are fetched from the new file version
+    func warmUp(manifest: HotBlockManifest, client: HTTPClient, logger: Logger) async {
+        let start = DispatchTime.now()
+        let blockCount = manifest.files.reduce(0) { $0 + $1.blocks.reduce(0) { $0 + $1.count } }
+        logger.info("OmFileManager: Warming up cache with \(blockCount) blocks of \(manifest.files.count) files")
+        try? await manifest.files.foreachConcurrent(nConcurrent: 4) { file in
+            do {
+                guard let reader = try await OmHttpReaderBackend.makeRemoteReaderAndCacheMeta(client: client, logger: logger, url: file.url) else {
+                    return
+                }
+                try await reader.preloadBlocks(blocks: file.blocks.flatMap { $0 }, limiter: OpenMeteo.cacheWarmupLimiter)
+            } catch {
+                logger.warning("OmFileManager: Warm up of \(file.url) failed: \(error)")
+            }
+        }
+        logger.info("OmFileManager: Warm up completed in \(start.timeElapsedPretty())")
+    }
+    
     /// Called every second from a life cycle handler on an available thread
     func backgroundTask(application: Application) async throws {
         try await revalidate(client: application.http.client.shared, logger: application.logger)
+        try await updateHotBlockManifest(client: application.http.client.shared, logger: application.logger)
     }
 }
 
 
 fileprivate enum LocalOrRemote: Sendable {
-    case local(any LocalFileRepresentable)
+    /// `version` is computed once when the file is opened
+    case local(any LocalFileRepresentable, version: UInt64)
     case remote(any RemoteFileRepresentable)
 }
 
+extension MmapFile {
+    /// Hash of device, inode, size and modification time. Changes if the file is replaced. Calls `fstat`, therefore only evaluated when a file is opened
+    var version: UInt64 {
+        let stats = file.fileStats()
+        return UInt64.fnvOffsetBasis
+            .addFnv1aHash(UInt64(truncatingIfNeeded: stats.st_dev))
+            .addFnv1aHash(UInt64(truncatingIfNeeded: stats.st_ino))
+            .addFnv1aHash(UInt64(truncatingIfNeeded: stats.st_size))
+            .addFnv1aHash(UInt64(truncatingIfNeeded: Int64(stats.modificationTime.timeIntervalSince1970 * 1000)))
+    }
+}
+
 
 fileprivate extension OmHttpReaderBackend {
     /// Create a new remote reader and store in meta cache if the file is available
@@ -245,7 +367,7 @@ fileprivate extension OmHttpReaderBackend {
             return nil
         }
         try HttpMetaCache.set(url: url, state: .available(lastValidated: .now(), contentLength: reader.count, lastModified: reader.lastModifiedTimestamp, eTag: reader.eTag))
-        return OmReaderBlockCache(backend: reader, cache: OpenMeteo.dataBlockCache, cacheKey: reader.cacheKey)
+        return OmReaderBlockCache(backend: reader, cache: OpenMeteo.dataBlockCache, cacheKey: reader.cacheKey, coalescing: OpenMeteo.remoteRangeCoalescing)
     }
 }
 
@@ -412,6 +534,16 @@ fileprivate final actor RemoteFileManagerCache {
         })
     }
     
+    /// Readers of all open remote files
+    func activeRemoteFiles() -> [OmReaderBlockCache<OmHttpReaderBackend, MmapFile>] {
+        return cache.compactMap({ (_, state) in
+            guard case .cached(let entry) = state, case .remote(let file) = entry.value else {
+                return nil
+            }
+            return file.fn
+        })
+    }
+    
     func setEntry(forKey key: AnyRemoteFileManageable, value: Entry) {
         return cache[key] = .cached(value)
     }
@@ -7,26 +7,18 @@ extension ForecastapiResult {
     /// Convert data into a FlatBuffers scheme far fast binary encoding and transfer
     /// Each `ForecastapiResult` is converted indifuavually into an flatbuffer message -> very long time-VariableWithValues require a lot of memory
     /// Data is using `size prefixed` flatbuffers to allow streaming of multiple messages for multiple locations
-    func toFlatbuffersResponse(fixedGenerationTime: Double?, concurrencySlot: Int?, logger: Logger) throws -> Response {
+    func toFlatbuffersResponse(fixedGenerationTime: Double?, concurrencySlot: Int?, encoding: ResponseContentEncoding? = nil, logger: Logger) throws -> Response {
         // First excution outside stream, to capture potential errors better
         // var first = try self.first?()
-        let response = Response(body: .init(asyncStream: { writer in
-            try await writer.submit(concurrencySlot: concurrencySlot, logger: logger) {
-                // TODO: Zero-copy for flatbuffer to NIO bytebuffer conversion. Probably writing an optimised flatbuffer encoder would be better.
-                // TODO: Estimate initial buffer size
-                let initialSize = Int32(4096) // Int32(((first?.estimatedFlatbufferSize ?? 4096)/4096+1)*4096)
-                var fbb = FlatBufferBuilder(initialSize: initialSize)
-                var b = BufferAndAsyncWriter(writer: writer)
-                // if let first {
-                //    first.writeToFlatbuffer(&fbb)
-                //    b.buffer.writeBytes(fbb.buffer.unsafeRawBufferPointer)
-                //    fbb.clear()
-                // }
-                // first = nil
-                // try await b.flushIfRequired()
+        let response = Response(body: .init(cacheableStream: { writer in
+            try await writer.submit(concurrencySlot: concurrencySlot, encoding: encoding, logger: logger) {
+                // Builder is reused for all locations. If a message does not fit, `writeToFlatbuffer` replaces it with a larger builder
+                var fbb = FlatBufferBuilder(initialSize: Int32(FlatBufferBuilder.minimumCapacity))
+                var capacity = FlatBufferBuilder.minimumCapacity
+                var b = BufferAndAsyncWriter(writer: writer, encoding: encoding)
                 for location in results {
                     for model in location.results {
-                        try await model.writeToFlatbuffer(&fbb, variables: variables, timezone: location.timezone, fixedGenerationTime: fixedGenerationTime, locationId: location.locationId)
+                        try await model.writeToFlatbuffer(&fbb, capacity: &capacity, variables: variables, timezone: location.timezone, fixedGenerationTime: fixedGenerationTime, locationId: location.locationId)
                         let buffer = fbb.buffer
                         buffer.withUnsafeBytes(body: { ptr in
                             b.buffer.writeBytes(UnsafeRawBufferPointer(start: ptr.baseAddress?.advanced(by: buffer.reader), count: Int(buffer.size)))
@@ -40,6 +32,7 @@ extension ForecastapiResult {
             }
         }))
         response.headers.replaceOrAdd(name: .contentType, value: "application/octet-stream")
+        response.setContentEncoding(encoding)
         return response
     }
 }
@@ -89,7 +82,30 @@ extension VariableOrDerived: FlatBuffersVariable where Raw: FlatBuffersVariable,
     }
 }
 
+extension FlatBufferBuilder {
+    static let minimumCapacity = 4096
+
+    /// Replace the builder if `requiredSize` exceeds the current `capacity`. Avoids repeated reallocation and copies while encoding long time-series
+    mutating func reserve(capacity: inout Int, requiredSize: Int) {
+        guard requiredSize > capacity else {
+            return
+        }
+        capacity = requiredSize.ceil(to: Self.minimumCapacity)
+        self = FlatBufferBuilder(initialSize: Int32(capacity))
+    }
+}
+
 extension ApiArray {
+    /// Upper bound of the encoded size including vector length and alignment
+    var estimatedFlatbufferSize: Int {
+        switch self {
+        case .float(let values):
+            return values.count * MemoryLayout<Float>.size + 12
+        case .timestamp(let values):
+            return values.count * MemoryLayout<Int64>.size + 12
+        }
+    }
+
     func encodeFlatBuffers(_ fbb: inout FlatBufferBuilder) -> Offset {
         switch self {
         case .float(let values):
@@ -125,7 +141,17 @@ extension ApiColumn where Variable: FlatBuffersVariable {
 }
 
 
+/// Upper bound for a `VariableWithValues` table without values including its vtable and offset
+private let flatbufferVariableOverhead = 96
+
 extension ApiSection where Variable: FlatBuffersVariable {
+    /// Upper bound of the encoded size of `VariablesWithTime` or `VariablesWithMonth`
+    var estimatedFlatbufferSize: Int {
+        return 64 + columns.reduce(0) { size, column in
+            size + column.variables.reduce(0) { $0 + $1.estimatedFlatbufferSize + flatbufferVariableOverhead }
+        }
+    }
+
     func encodeFlatBuffers(_ fbb: inout FlatBufferBuilder, memberOffset: Int) -> Offset {
         let offsets = ApiColumn.encodeFlatBuffers(columns, &fbb, memberOffset: memberOffset)
         return openmeteo_sdk_VariablesWithTime.createVariablesWithTime(
@@ -151,6 +177,11 @@ extension ApiSection where Variable: FlatBuffersVariable {
 }
 
 extension ApiSectionSingle where Variable: FlatBuffersVariable {
+    /// Upper bound of the encoded size of `VariablesWithTime`
+    var estimatedFlatbufferSize: Int {
+        return 64 + columns.count * flatbufferVariableOverhead
+    }
+
     func encodeFlatBuffers(_ fbb: inout FlatBufferBuilder) -> Offset {
         let offsets = fbb.createVector(ofOffsets: self.columns.map { c -> Offset in
             let VariableWithValues = openmeteo_sdk_VariableWithValues.startVariableWithValues(&fbb)
@@ -170,15 +201,27 @@ extension ApiSectionSingle where Variable: FlatBuffersVariable {
 }
 
 extension ModelFlatbufferSerialisable {
-    func writeToFlatbuffer(_ fbb: inout FlatBufferBuilder, variables: ForecastapiResult<Self>.RequestVariables, timezone: TimezoneWithOffset, fixedGenerationTime: Double?, locationId: Int) async throws {        
+    func writeToFlatbuffer(_ fbb: inout FlatBufferBuilder, capacity: inout Int, variables: ForecastapiResult<Self>.RequestVariables, timezone: TimezoneWithOffset, fixedGenerationTime: Double?, locationId: Int) async throws {
         let generationTimeStart = Date()
-        let hourly = await (try hourly(variables: variables.hourlyVariables)).map { $0.encodeFlatBuffers(&fbb, memberOffset: Self.memberOffset) } ?? Offset()
-        let minutely15 = await (try minutely15(variables: variables.minutely15Variables)).map { $0.encodeFlatBuffers(&fbb, memberOffset: Self.memberOffset) } ?? Offset()
-        let daily = await (try daily(variables: variables.dailyVariables)).map { $0.encodeFlatBuffers(&fbb, memberOffset: Self.memberOffset) } ?? Offset()
-        let monthly = await (try monthly(variables: variables.monthlyVariables)).map { $0.encodeMonthlyFlatBuffers(&fbb, memberOffset: Self.memberOffset) } ?? Offset()
-        let weekly = await (try weekly(variables: variables.weeklyVariables)).map { $0.encodeMonthlyFlatBuffers(&fbb, memberOffset: Self.memberOffset) } ?? Offset()
+        let hourlySection = try await hourly(variables: variables.hourlyVariables)
+        let minutely15Section = try await minutely15(variables: variables.minutely15Variables)
+        let dailySection = try await daily(variables: variables.dailyVariables)
+        let monthlySection = try await monthly(variables: variables.monthlyVariables)
+        let weeklySection = try await weekly(variables: variables.weeklyVariables)
+        let currentSection = try await current(variables: variables.currentVariables)
+
+        // Size all sections up front, so that the builder does not grow while copying values
+        let sectionsSize = (hourlySection?.estimatedFlatbufferSize ?? 0) + (minutely15Section?.estimatedFlatbufferSize ?? 0) + (dailySection?.estimatedFlatbufferSize ?? 0) + (monthlySection?.estimatedFlatbufferSize ?? 0) + (weeklySection?.estimatedFlatbufferSize ?? 0) + (currentSection?.estimatedFlatbufferSize ?? 0)
+        let requiredSize = 256 + timezone.identifier.utf8.count + timezone.abbreviation.utf8.count + sectionsSize
+        fbb.reserve(capacity: &capacity, requiredSize: requiredSize)
+
+        let hourly = hourlySection.map { $0.encodeFlatBuffers(&fbb, memberOffset: Self.memberOffset) } ?? Offset()
+        let minutely15 = minutely15Section.map { $0.encodeFlatBuffers(&fbb, memberOffset: Self.memberOffset) } ?? Offset()
+        let daily = dailySection.map { $0.encodeFlatBuffers(&fbb, memberOffset: Self.memberOffset) } ?? Offset()
+        let monthly = monthlySection.map { $0.encodeMonthlyFlatBuffers(&fbb, memberOffset: Self.memberOffset) } ?? Offset()
+        let weekly = weeklySection.map { $0.encodeMonthlyFlatBuffers(&fbb, memberOffset: Self.memberOffset) } ?? Offset()
 
-        let current = await (try current(variables: variables.currentVariables)).map { $0.encodeFlatBuffers(&fbb) } ?? Offset()
+        let current = currentSection.map { $0.encodeFlatBuffers(&fbb) } ?? Offset()
         let generationTimeMs = fixedGenerationTime ?? (Date().timeIntervalSince(generationTimeStart) * 1000)
         
         let result = openmeteo_sdk_WeatherApiResponse.createWeatherApiResponse(
@@ -1,5 +1,6 @@
 import Foundation
 import Vapor
+import NIOConcurrencyHelpers
 @preconcurrency import SwiftTimeZoneLookup
 
 struct ApiQueryStartEndRanges {
@@ -146,6 +147,8 @@ struct ApiQueryParameter: Content, ApiUnitsSelectable {
             return .csv(locationInformation: location_information)
         case .flatbuffers:
             return .flatbuffers()
+        case .arrow:
+            return .arrow
         }
     }
 
@@ -225,8 +228,11 @@ struct ApiQueryParameter: Content, ApiUnitsSelectable {
         return try GenericReaderOptions(tilt: tilt, azimuth: azimuth, logger: logger, httpClient: httpClient)
     }
 
+    /// Grid point reads of all locations in this request are combined
     func readerOptions(for request: Request, allowRemoteArchive: Bool) throws -> GenericReaderOptions {
-        return try GenericReaderOptions(tilt: tilt, azimuth: azimuth, logger: request.logger, httpClient: allowRemoteArchive ? request.application.http.client.shared : nil)
+        var options = try GenericReaderOptions(tilt: tilt, azimuth: azimuth, logger: request.logger, httpClient: allowRemoteArchive ? request.application.http.client.shared : nil)
+        options.batch = OmFileSplitterBatch()
+        return options
     }
 
     /// Parse `start_date` and `end_date` parameter to range of timestamps
@@ -284,7 +290,7 @@ struct ApiQueryParameter: Content, ApiUnitsSelectable {
                 case .auto:
                     throw ForecastApiError.generic(message: "Timezone 'auto' not supported with bounding box queries")
                 case .timezone(let t):
-                    return TimezoneWithOffset(timezone: t)
+                    return TimezoneWithOffset.cached(timezone: t)
                 }
             }) ?? TimezoneWithOffset.gmt
             return .boundingBox(bb, dates: dates, timezone: timezone)
@@ -359,17 +365,8 @@ struct ApiQueryParameter: Content, ApiUnitsSelectable {
                 ($0, .gmt)
             }
         }
-        if timezone.count == 1 {
-            return try coordinates.map {
-                ($0, try timezone[0].resolve(coordinate: $0))
-            }
-        }
-        guard timezone.count == coordinates.count else {
-            throw ForecastApiError.coordinatesAndTimezoneCountMustBeTheSame
-        }
-        return try zip(coordinates, timezone).map {
-            ($0, try $1.resolve(coordinate: $0))
-        }
+        let timezones = try TimeZoneOrAuto.resolve(timezone, coordinates: coordinates)
+        return Array(zip(coordinates, timezones))
     }
 
     /// Parse latitude, longitude and elevation arrays to an array of coordinates
@@ -713,15 +710,40 @@ enum TimeZoneOrAuto: Codable, Equatable {
     }
 
     /// Given a coordinate, resolve auto timezone if required
-    func resolve(coordinate: CoordinatesAndElevation) throws -> TimezoneWithOffset {
+    func resolve(coordinate: CoordinatesAndElevation, now: Date = Date()) throws -> TimezoneWithOffset {
         switch self {
         case .auto:
             return try .init(
                 latitude: coordinate.latitude,
-                longitude: coordinate.longitude
+                longitude: coordinate.longitude,
+                now: now
             )
         case .timezone(let timezone):
-            return .init(timezone: timezone)
+            return .cached(timezone: timezone, now: now)
+        }
+    }
+
+    /// Resolve timezones for many coordinates at once. If only one timezone is given, it is used for all coordinates.
+    /// Identical coordinates are only looked up once in the timezone database. Offsets are taken from the process wide `TimezoneWithOffset.cached` table.
+    static func resolve(_ timezones: [TimeZoneOrAuto], coordinates: [CoordinatesAndElevation], now: Date = Date()) throws -> [TimezoneWithOffset] {
+        guard timezones.count == 1 || timezones.count == coordinates.count else {
+            throw ForecastApiError.coordinatesAndTimezoneCountMustBeTheSame
+        }
+        /// Key is the bit pattern of latitude and longitude
+        var lookups = [UInt64: TimezoneWithOffset]()
+        return try coordinates.enumerated().map { element -> TimezoneWithOffset in
+            let coordinate = element.element
+            let timezone = timezones.count == 1 ? timezones[0] : timezones[element.offset]
+            guard timezone == .auto else {
+                return try timezone.resolve(coordinate: coordinate, now: now)
+            }
+            let key = UInt64(coordinate.latitude.bitPattern) << 32 | UInt64(coordinate.longitude.bitPattern)
+            if let resolved = lookups[key] {
+                return resolved
+            }
+            let resolved = try TimezoneWithOffset(latitude: coordinate.latitude, longitude: coordinate.longitude, now: now)
+            lookups[key] = resolved
+            return resolved
         }
     }
 }
@@ -744,17 +766,43 @@ struct TimezoneWithOffset {
         self.abbreviation = abbreviation
     }
 
-    public init(timezone: TimeZone) {
-        self.utcOffsetSeconds = timezone.secondsFromGMT()
+    public init(timezone: TimeZone, now: Date = Date()) {
+        self.utcOffsetSeconds = timezone.secondsFromGMT(for: now)
         self.identifier = timezone.identifier
-        self.abbreviation = timezone.abbreviation() ?? ""
+        self.abbreviation = timezone.abbreviation(for: now) ?? ""
     }
 
-    public init(latitude: Float, longitude: Float) throws {
+    public init(latitude: Float, longitude: Float, now: Date = Date()) throws {
         guard let identifier = TimezoneWithOffset.timezoneDatabase.simple(latitude: latitude, longitude: longitude) else {
             throw ForecastApiError.invalidTimezone
         }
-        self.init(timezone: try TimeZone.initWithFallback(identifier))
+        self = try .cached(identifier: identifier, now: now)
+    }
+
+    /// Resolved offsets per timezone identifier. Entries are valid from the time they were resolved until the next daylight saving time transition
+    private static let cache = NIOLockedValueBox([String: (timezone: TimezoneWithOffset, validFrom: Date, validUntil: Date)]())
+
+    /// Offset and abbreviation for a timezone identifier. `TimeZone` is only created once per identifier and daylight saving time period
+    static func cached(identifier: String, now: Date = Date()) throws -> TimezoneWithOffset {
+        if let entry = cache.withLockedValue({ $0[identifier] }), entry.validFrom <= now, now < entry.validUntil {
+            return entry.timezone
+        }
+        return store(key: identifier, timezone: try TimeZone.initWithFallback(identifier), now: now)
+    }
+
+    /// Offset and abbreviation for a timezone using the process wide cache
+    static func cached(timezone: TimeZone, now: Date = Date()) -> TimezoneWithOffset {
+        if let entry = cache.withLockedValue({ $0[timezone.identifier] }), entry.validFrom <= now, now < entry.validUntil {
+            return entry.timezone
+        }
+        return store(key: timezone.identifier, timezone: timezone, now: now)
+    }
+
+    private static func store(key: String, timezone: TimeZone, now: Date) -> TimezoneWithOffset {
+        let resolved = TimezoneWithOffset(timezone: timezone, now: now)
+        let validUntil = timezone.nextDaylightSavingTimeTransition(after: now) ?? .distantFuture
+        cache.withLockedValue { $0[key] = (resolved, now, validUntil) }
+        return resolved
     }
     static let gmt = TimezoneWithOffset(utcOffsetSeconds: 0, identifier: "GMT", abbreviation: "GMT")
 }
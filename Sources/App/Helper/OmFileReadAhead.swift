@@ -0,0 +1,130 @@
+import Foundation
+import NIOConcurrencyHelpers
+import Synchronization
+import Vapor
+
+/**
+ Predict the next read of a file from the stride between the previous reads. Used by `OmFileSplitter.willNeed` to prefetch data for clients that sweep over locations (e.g. bounding box crawls) or time windows.
+
+ For each file and level, the last location and time range is kept. If `requiredStrides` consecutive reads have the same size and are shifted by the same location and time stride, the next read is predicted by applying the stride again.
+ State is shared by all clients reading the same file. Requiring several identical strides avoids predictions from unrelated reads of different clients that happen to line up. Interleaved sweeps of multiple clients reset the stride and are not predicted.
+ Predictions are only issued while no API requests are queued and while the prefetch budget per second is not exhausted.
+ If the next read of the file matches a prediction, the predicted bytes are counted as useful, otherwise as wasted. Bytes are estimated from the number of uncompressed float values.
+ */
+final class OmFileReadAhead: Sendable {
+    struct Key: Hashable {
+        let file: OmFileType
+        let level: Int
+    }
+
+    /// Location and time range of a read
+    struct Window: Equatable {
+        let location: Range<Int>
+        let time: Range<Int>
+
+        /// Uncompressed size
+        var bytes: Int {
+            return location.count * time.count * MemoryLayout<Float>.stride
+        }
+
+        func shifted(location locationStride: Int, time timeStride: Int) -> Window {
+            return Window(location: location.add(locationStride), time: time.add(timeStride))
+        }
+
+        func overlaps(_ other: Window) -> Bool {
+            return location.overlaps(other.location) && time.overlaps(other.time)
+        }
+    }
+
+    fileprivate struct State {
+        var last: Window
+        var stride: (location: Int, time: Int)?
+        /// Number of consecutive reads with `stride`
+        var strideCount = 0
+        var predicted: Window?
+    }
+
+    fileprivate struct Budget {
+        var second: Int = 0
+        var used: Int = 0
+    }
+
+    /// Maximum predicted bytes per second. 0 disables read-ahead
+    let bytesPerSecond: Int
+
+    /// Maximum number of files to track. If exceeded, all state is cleared
+    let maxTrackedFiles: Int
+
+    /// Number of consecutive identical strides before a read is predicted
+    let requiredStrides: Int
+
+    private let state: NIOLockedValueBox<(files: [Key: State], budget: Budget)>
+
+    init(bytesPerSecond: Int, maxTrackedFiles: Int = 16384, requiredStrides: Int = 3) {
+        precondition(requiredStrides >= 1)
+        self.bytesPerSecond = bytesPerSecond
+        self.maxTrackedFiles = maxTrackedFiles
+        self.requiredStrides = requiredStrides
+        self.state = .init(([:], Budget()))
+    }
+
+    static let instance = OmFileReadAhead(bytesPerSecond: try! ByteSizeParser.parseSizeStringToBytes(Environment.get("READ_AHEAD_BYTES_PER_SECOND") ?? "64MB"))
+
+    /// Record a read and return the window that should be prefetched next
+    /// `nLocations` and `nTime` are the file dimensions. A predicted location range must stay within one row of `nx` locations
+    func record(key: Key, window: Window, nx: Int, nLocations: Int, nTime: Int, now: Int = Timestamp.now().timeIntervalSince1970) -> Window? {
+        guard bytesPerSecond > 0 else {
+            return nil
+        }
+        return state.withLockedValue { state in
+            guard var file = state.files[key] else {
+                if state.files.count >= maxTrackedFiles {
+                    state.files.removeAll(keepingCapacity: true)
+                }
+                state.files[key] = State(last: window)
+                return nil
+            }
+            if let predicted = file.predicted {
+                if predicted.overlaps(window) {
+                    OmMetrics.readAheadUsefulBytesTotal.add(predicted.bytes, ordering: .relaxed)
+                } else {
+                    OmMetrics.readAheadWastedBytesTotal.add(predicted.bytes, ordering: .relaxed)
+                }
+                file.predicted = nil
+            }
+            let stride = (location: window.location.lowerBound - file.last.location.lowerBound, time: window.time.lowerBound - file.last.time.lowerBound)
+            let sameSize = window.location.count == file.last.location.count && window.time.count == file.last.time.count
+            let repeated = file.stride.map { $0 == stride } ?? false
+            file.last = window
+            file.stride = sameSize ? stride : nil
+            file.strideCount = sameSize ? (repeated ? file.strideCount + 1 : 1) : 0
+            defer { state.files[key] = file }
+
+            guard file.strideCount >= requiredStrides, stride != (0, 0) else {
+                return nil
+            }
+            let next = window.shifted(location: stride.location, time: stride.time)
+            guard next.location.lowerBound >= 0, next.location.upperBound <= nLocations,
+                  next.location.lowerBound / nx == (next.location.upperBound - 1) / nx,
+                  next.time.lowerBound >= 0, next.time.upperBound <= nTime else {
+                return nil
+            }
+            // Only prefetch if the server is idle and the budget is available
+            guard OmMetrics.requestsQueued.load(ordering: .relaxed) == 0 else {
+                OmMetrics.readAheadSkippedTotal.add(1, ordering: .relaxed)
+                return nil
+            }
+            if state.budget.second != now {
+                state.budget = Budget(second: now, used: 0)
+            }
+            guard state.budget.used + next.bytes <= bytesPerSecond else {
+                OmMetrics.readAheadSkippedTotal.add(1, ordering: .relaxed)
+                return nil
+            }
+            state.budget.used += next.bytes
+            file.predicted = next
+            OmMetrics.readAheadIssuedBytesTotal.add(next.bytes, ordering: .relaxed)
+            return next
+        }
+    }
+}
@@ -75,7 +75,11 @@ struct OmFileSplitter {
     }
 
     /// Prefetch all required data into memory
-    func willNeed(variable: String, location: Range<Int>, level: Int, time: TimerangeDtAndSettings, logger: Logger, httpClient: HTTPClient?) async throws {
+    /// If `batch` is set, single grid point reads are registered to be read together with other locations of the same request.
+    func willNeed(variable: String, location: Range<Int>, level: Int, time: TimerangeDtAndSettings, logger: Logger, httpClient: HTTPClient?, batch: OmFileSplitterBatch? = nil) async throws {
+        if let batch, location.count == 1, time.run == nil {
+            batch.register(key: .init(domain: domain, variable: variable, level: level, time: time), location: location.lowerBound)
+        }
         // TODO: maybe we can keep the file handles better in scope
         let indexTime = time.time.toIndexTime()
         let nTime = indexTime.count
@@ -97,12 +101,12 @@ struct OmFileSplitter {
                 /// Fixed time resolution. Can use linear reads into output array
                 if fullRunTime.count == timestamps.count {
                     if let offsets = indexTime.intersect(fileTime: fullRunTime.toIndexTime()) {
-                        try await reader.willNeed3D(ny: ny, nx: nx, nTime: nTime, nMembers: nMembers, location: location, level: level, timeOffsets: offsets)
+                        try await willNeed3D(reader: reader, file: file, nTime: nTime, location: location, level: level, timeOffsets: offsets)
                     }
                     return
                 }
                 /// Prefetch entire run
-                try await reader.willNeed3D(ny: ny, nx: nx, nTime: timestamps.count, nMembers: nMembers, location: location, level: level, timeOffsets: (file: 0..<timestamps.count, array:  0..<timestamps.count))
+                try await willNeed3D(reader: reader, file: file, nTime: timestamps.count, location: location, level: level, timeOffsets: (file: 0..<timestamps.count, array:  0..<timestamps.count))
             }
             return
         }
@@ -113,7 +117,7 @@ struct OmFileSplitter {
             let file = OmFileType.domainChunk(domain: domain, variable: variable, type: .master, chunk: 0, ensembleMember: time.ensembleMember, previousDay: time.previousDay)
             if let offsets = indexTime.intersect(fileTime: fileTime) {
                 try await RemoteFileManager.instance.with(file: file, client: httpClient, logger: logger) { (reader, _, _) in
-                    try await reader.willNeed3D(ny: ny, nx: nx, nTime: nTime, nMembers: nMembers, location: location, level: level, timeOffsets: offsets)
+                    try await willNeed3D(reader: reader, file: file, nTime: nTime, location: location, level: level, timeOffsets: offsets)
                     start = fileTime.upperBound
                 }
             }
@@ -135,7 +139,7 @@ struct OmFileSplitter {
                 }
                 let file = OmFileType.domainChunk(domain: domain, variable: variable, type: .year, chunk: year, ensembleMember: time.ensembleMember, previousDay: time.previousDay)
                 try await RemoteFileManager.instance.with(file: file, client: httpClient, logger: logger) { (reader, _, _) in
-                    try await reader.willNeed3D(ny: ny, nx: nx, nTime: nTime, nMembers: nMembers, location: location, level: level, timeOffsets: offsets)
+                    try await willNeed3D(reader: reader, file: file, nTime: nTime, location: location, level: level, timeOffsets: offsets)
                     start = fileTime.upperBound
                 }
             }
@@ -154,7 +158,7 @@ struct OmFileSplitter {
                 guard let offsets = indexTime.intersect(fileTime: fileTime.toIndexTime()) else {
                     return true
                 }
-                try await reader.willNeed3D(ny: ny, nx: nx, nTime: nTime, nMembers: nMembers, location: location, level: level, timeOffsets: offsets)
+                try await willNeed3D(reader: reader, file: file, nTime: nTime, location: location, level: level, timeOffsets: offsets)
                 return true
             }) == true {
                 return
@@ -169,23 +173,45 @@ struct OmFileSplitter {
             }
             let file = OmFileType.domainChunk(domain: domain, variable: variable, type: .chunk, chunk: timeChunk, ensembleMember: time.ensembleMember, previousDay: time.previousDay)
             try await RemoteFileManager.instance.with(file: file, client: httpClient, logger: logger) { (reader, _, _) in
-                try await reader.willNeed3D(ny: ny, nx: nx, nTime: nTime, nMembers: nMembers, location: location, level: level, timeOffsets: offsets)
+                try await willNeed3D(reader: reader, file: file, nTime: nTime, location: location, level: level, timeOffsets: offsets)
             }
         }
     }
 
+    /// Prefetch data of one file and issue a read-ahead for the next likely read of the same file
+    fileprivate func willNeed3D(reader: any OmFileReaderArrayProtocol<Float>, file: OmFileType, nTime: Int, location: Range<Int>, level: Int, timeOffsets: (file: CountableRange<Int>, array: CountableRange<Int>)) async throws {
+        try await reader.willNeed3D(ny: ny, nx: nx, nTime: nTime, nMembers: nMembers, location: location, level: level, timeOffsets: timeOffsets)
+        let window = OmFileReadAhead.Window(location: location, time: timeOffsets.file)
+        let nTimeFile = Int(reader.getDimensions().last ?? 0)
+        guard let next = OmFileReadAhead.instance.record(key: .init(file: file, level: level), window: window, nx: nx, nLocations: nx * ny, nTime: nTimeFile) else {
+            return
+        }
+        let (ny, nx, nMembers) = (ny, nx, nMembers)
+        Task {
+            try? await reader.willNeed3D(ny: ny, nx: nx, nTime: next.time.count, nMembers: nMembers, location: next.location, level: level, timeOffsets: (next.time, 0..<next.time.count))
+        }
+    }
+
     func read2D<Variable: GenericVariable>(variable: Variable, location: Range<Int>, level: Int, time: TimerangeDtAndSettings, logger: Logger, httpClient: HTTPClient?) async throws -> Array2DFastTime {
         let data = try await read(variable: variable, location: location, level: level, time: time, logger: logger, httpClient: httpClient)
         return Array2DFastTime(data: data, nLocations: location.count, nTime: time.time.count)
     }
 
-    func read<Variable: GenericVariable>(variable: Variable, location: Range<Int>, level: Int, time: TimerangeDtAndSettings, logger: Logger, httpClient: HTTPClient?) async throws -> [Float] {
+    /// If `batch` is set and the location was registered in `willNeed`, all registered locations are read at once. See `OmFileSplitterBatch`.
+    func read<Variable: GenericVariable>(variable: Variable, location: Range<Int>, level: Int, time: TimerangeDtAndSettings, logger: Logger, httpClient: HTTPClient?, batch: OmFileSplitterBatch? = nil) async throws -> [Float] {
+        if let batch, location.count == 1, time.run == nil {
+            let file = variable.omFileName.file
+            let key = OmFileSplitterBatch.Key(domain: domain, variable: file, level: level, time: time)
+            if let data = try await batch.read(key: key, location: location.lowerBound, fn: { [self] locations in
+                try await self.read(variable: file, locations: locations, level: level, time: time, logger: logger, httpClient: httpClient)
+            }) {
+                return data
+            }
+        }
         let indexTime = time.time.toIndexTime()
         let nTime = indexTime.count
-        var start = indexTime.lowerBound
         OmMetrics.memoryReadAllocated.wrappingAdd(nTime * location.count * MemoryLayout<Float>.stride, ordering: .relaxed)
         
-        /// If yearly files are present, the start parameter is moved to read fewer files later
         var out = [Float](repeating: .nan, count: nTime * location.count)
         
         /// Read individual runs from dedicated database
@@ -240,12 +266,38 @@ struct OmFileSplitter {
             return out
         }
 
+        try await forEachFile(variable: variable.omFileName.file, indexTime: indexTime, time: time, logger: logger, httpClient: httpClient) { reader, offsets, version in
+            try await reader.read3D(into: &out, ny: ny, nx: nx, nTime: nTime, nMembers: nMembers, location: location, level: level, timeOffsets: offsets, version: version, cache: OpenMeteo.decompressedChunkCache)
+        }
+        return out
+    }
+
+    /// Read single grid points of many locations. Grid points in the same chunk are read together, so that each chunk is only decompressed once. Returns one array per location.
+    /// Single runs are not supported, because runs with irregular time steps are interpolated for each location individually.
+    func read(variable: String, locations: [Int], level: Int, time: TimerangeDtAndSettings, logger: Logger, httpClient: HTTPClient?, nConcurrent: Int = 4) async throws -> [[Float]] {
+        precondition(time.run == nil, "Batched reads do not support single runs")
+        let indexTime = time.time.toIndexTime()
+        let nTime = indexTime.count
+        OmMetrics.memoryReadAllocated.wrappingAdd(nTime * locations.count * MemoryLayout<Float>.stride, ordering: .relaxed)
+        
+        var out = [[Float]](repeating: [Float](repeating: .nan, count: nTime), count: locations.count)
+        try await forEachFile(variable: variable, indexTime: indexTime, time: time, logger: logger, httpClient: httpClient) { reader, offsets, _ in
+            try await reader.read3D(into: &out, ny: ny, nx: nx, nTime: nTime, nMembers: nMembers, locations: locations, level: level, timeOffsets: offsets, nConcurrent: nConcurrent)
+        }
+        return out
+    }
+
+    /// Iterate over master, yearly, rolling and chunk files that contain data for `indexTime`. `fn` is called with the reader, the time offsets in the file and in the output array and the file version.
+    fileprivate func forEachFile(variable: String, indexTime: Range<Int>, time: TimerangeDtAndSettings, logger: Logger, httpClient: HTTPClient?, fn: (_ reader: any OmFileReaderArrayProtocol<Float>, _ timeOffsets: (file: CountableRange<Int>, array: CountableRange<Int>), _ version: UInt64) async throws -> Void) async throws {
+        /// If yearly files are present, the start parameter is moved to read fewer files later
+        var start = indexTime.lowerBound
+        
         if let masterTimeRange {
             let fileTime = TimerangeDt(range: masterTimeRange, dtSeconds: time.dtSeconds).toIndexTime()
-            let file = OmFileType.domainChunk(domain: domain, variable: variable.omFileName.file, type: .master, chunk: 0, ensembleMember: time.ensembleMember, previousDay: time.previousDay)
+            let file = OmFileType.domainChunk(domain: domain, variable: variable, type: .master, chunk: 0, ensembleMember: time.ensembleMember, previousDay: time.previousDay)
             if let offsets = indexTime.intersect(fileTime: fileTime) {
-                try await RemoteFileManager.instance.with(file: file, client: httpClient, logger: logger) { (reader, _, _) in
-                    try await reader.read3D(into: &out, ny: ny, nx: nx, nTime: nTime, nMembers: nMembers, location: location, level: level, timeOffsets: offsets)
+                try await RemoteFileManager.instance.withVersion(file: file, client: httpClient, logger: logger) { value, version in
+                    try await fn(value.reader, offsets, version)
                     start = fileTime.upperBound
                 }
             }
@@ -262,32 +314,32 @@ struct OmFileSplitter {
                 guard let offsets = indexTime.intersect(fileTime: fileTime) else {
                     continue
                 }
-                let file = OmFileType.domainChunk(domain: domain, variable: variable.omFileName.file, type: .year, chunk: year, ensembleMember: time.ensembleMember, previousDay: time.previousDay)
-                try await RemoteFileManager.instance.with(file: file, client: httpClient, logger: logger) { (reader, _, _) in
-                    try await reader.read3D(into: &out, ny: ny, nx: nx, nTime: nTime, nMembers: nMembers, location: location, level: level, timeOffsets: offsets)
+                let file = OmFileType.domainChunk(domain: domain, variable: variable, type: .year, chunk: year, ensembleMember: time.ensembleMember, previousDay: time.previousDay)
+                try await RemoteFileManager.instance.withVersion(file: file, client: httpClient, logger: logger) { value, version in
+                    try await fn(value.reader, offsets, version)
                     start = fileTime.upperBound
                 }
             }
         }
         let delta = start - indexTime.lowerBound
         if start >= indexTime.upperBound {
-            return out
+            return
         }
         
         // Rolling files for ensemble data
         if nMembers > 1 {
-            let file = OmFileType.domainChunk(domain: domain, variable: variable.omFileName.file, type: .rolling, chunk: nil, ensembleMember: time.ensembleMember, previousDay: time.previousDay)
-            if try await RemoteFileManager.instance.with(file: file, client: httpClient, logger: logger, fn: { (reader, _, fileTime) in
-                guard let fileTime else {
+            let file = OmFileType.domainChunk(domain: domain, variable: variable, type: .rolling, chunk: nil, ensembleMember: time.ensembleMember, previousDay: time.previousDay)
+            if try await RemoteFileManager.instance.withVersion(file: file, client: httpClient, logger: logger, fn: { value, version in
+                guard let fileTime = value.timeRangeDt else {
                     return true
                 }
                 guard let offsets = indexTime.intersect(fileTime: fileTime.toIndexTime()) else {
                     return true
                 }
-                try await reader.read3D(into: &out, ny: ny, nx: nx, nTime: nTime, nMembers: nMembers, location: location, level: level, timeOffsets: offsets)
+                try await fn(value.reader, offsets, version)
                 return true
             }) == true {
-                return out
+                return
             }
         }
         
@@ -297,12 +349,11 @@ struct OmFileSplitter {
             guard let offsets = subring.intersect(fileTime: fileTime) else {
                 continue
             }
-            let file = OmFileType.domainChunk(domain: domain, variable: variable.omFileName.file, type: .chunk, chunk: timeChunk, ensembleMember: time.ensembleMember, previousDay: time.previousDay)
-            try await RemoteFileManager.instance.with(file: file, client: httpClient, logger: logger) { (reader, _, _) in
-                try await reader.read3D(into: &out, ny: ny, nx: nx, nTime: nTime, nMembers: nMembers, location: location, level: level, timeOffsets: (offsets.file, offsets.array.add(delta)))
+            let file = OmFileType.domainChunk(domain: domain, variable: variable, type: .chunk, chunk: timeChunk, ensembleMember: time.ensembleMember, previousDay: time.previousDay)
+            try await RemoteFileManager.instance.withVersion(file: file, client: httpClient, logger: logger) { value, version in
+                try await fn(value.reader, (offsets.file, offsets.array.add(delta)), version)
             }
         }
-        return out
     }
 
     /**
@@ -740,6 +791,125 @@ extension OmFileReaderArrayProtocol where OmType == Float {
         }
     }
 
+    /// Read a single grid point through the decompressed chunk cache. After repeated access, all time steps of the chunk containing the grid point are decompressed and cached.
+    /// Reads of multiple locations, legacy 2D files and chunks too large for the cache are read directly.
+    /// Note: `nTime` is the output array nTime. It is not the file nTime!
+    func read3D(into: inout [Float], ny: Int, nx: Int, nTime: Int, nMembers: Int, location: Range<Int>, level: Int, timeOffsets: (file: CountableRange<Int>, array: CountableRange<Int>), version: UInt64, cache: DecompressedChunkCache?) async throws {
+        let nDims = self.getDimensionsCount()
+        let dimensions = getDimensions()
+        guard let cache, location.count == 1, (nDims == 3 || nDims == 4), ny == dimensions[0], nx == dimensions[1], nDims == 3 || level < dimensions[2] else {
+            return try await read3D(into: &into, ny: ny, nx: nx, nTime: nTime, nMembers: nMembers, location: location, level: level, timeOffsets: timeOffsets)
+        }
+        let chunks = getChunkDimensions()
+        let chunkY = Int(chunks[0])
+        let chunkX = Int(chunks[1])
+        let nTimeFile = Int(dimensions[nDims - 1])
+        let yChunk = location.lowerBound / nx / chunkY
+        let xChunk = location.lowerBound % nx / chunkX
+        let y = yChunk * chunkY ..< min((yChunk + 1) * chunkY, ny)
+        let x = xChunk * chunkX ..< min((xChunk + 1) * chunkX, nx)
+        let key = version.addFnv1aHash(UInt64(yChunk)).addFnv1aHash(UInt64(xChunk)).addFnv1aHash(UInt64(level))
+        let offset = ((location.lowerBound / nx - y.lowerBound) * x.count + location.lowerBound % nx - x.lowerBound) * nTimeFile
+        let count = y.count * x.count * nTimeFile
+        
+        if let data = cache.get(key: key), data.count == count {
+            for (file, array) in zip(timeOffsets.file, timeOffsets.array) {
+                into[array] = data[offset + file]
+            }
+            return
+        }
+        guard cache.shouldAdmit(key: key, bytes: count * MemoryLayout<Float>.stride) else {
+            return try await read3D(into: &into, ny: ny, nx: nx, nTime: nTime, nMembers: nMembers, location: location, level: level, timeOffsets: timeOffsets)
+        }
+        var data = [Float](repeating: .nan, count: count)
+        let fileTime = UInt64(0) ..< UInt64(nTimeFile)
+        if nDims == 3 {
+            let range: InlineArray<3, Range<UInt64>> = [y.toUInt64(), x.toUInt64(), fileTime]
+            try await read(
+                into: &data,
+                range: range,
+                intoCubeOffset: [0, 0, 0],
+                intoCubeDimension: [UInt64(y.count), UInt64(x.count), UInt64(nTimeFile)]
+            )
+        } else {
+            let l = UInt64(level) ..< UInt64(level + 1)
+            let range: InlineArray<4, Range<UInt64>> = [y.toUInt64(), x.toUInt64(), l, fileTime]
+            try await read(
+                into: &data,
+                range: range,
+                intoCubeOffset: [0, 0, 0, 0],
+                intoCubeDimension: [UInt64(y.count), UInt64(x.count), 1, UInt64(nTimeFile)]
+            )
+        }
+        cache.set(key: key, value: data)
+        for (file, array) in zip(timeOffsets.file, timeOffsets.array) {
+            into[array] = data[offset + file]
+        }
+    }
+
+    /// Read single grid points into one array per location. Grid points are grouped by chunk and each group is read as one bounding box, so that every chunk is decompressed once.
+    /// Up to `nConcurrent` groups are read concurrently. Legacy 2D files are read for each location individually.
+    /// Note: `nTime` is the output array nTime. It is not the file nTime!
+    func read3D(into: inout [[Float]], ny: Int, nx: Int, nTime: Int, nMembers: Int, locations: [Int], level: Int, timeOffsets: (file: CountableRange<Int>, array: CountableRange<Int>), nConcurrent: Int) async throws {
+        let nDims = self.getDimensionsCount()
+        let dimensions = getDimensions()
+        guard (nDims == 3 || nDims == 4), ny == dimensions[0], nx == dimensions[1], nDims == 3 || level < dimensions[2] else {
+            for (i, location) in locations.enumerated() {
+                try await read3D(into: &into[i], ny: ny, nx: nx, nTime: nTime, nMembers: nMembers, location: location ..< location + 1, level: level, timeOffsets: timeOffsets)
+            }
+            return
+        }
+        let chunks = getChunkDimensions()
+        let chunkY = Int(chunks[0])
+        let chunkX = Int(chunks[1])
+        let nChunksX = nx.divideRoundedUp(divisor: chunkX)
+        
+        /// Indices into `locations` grouped by chunk
+        var groups = [Int: [Int]]()
+        for (i, location) in locations.enumerated() {
+            let chunk = location / nx / chunkY * nChunksX + location % nx / chunkX
+            groups[chunk, default: []].append(i)
+        }
+        let nTimeRead = timeOffsets.file.count
+        let fileTime = UInt64(timeOffsets.file.lowerBound) ..< UInt64(timeOffsets.file.upperBound)
+        let boxes = try await Array(groups.values).mapConcurrent(nConcurrent: nConcurrent, body: { group -> (group: [Int], y: Range<Int>, x: Range<Int>, data: [Float]) in
+            let ys = group.map { locations[$0] / nx }
+            let xs = group.map { locations[$0] % nx }
+            let y = ys.min()! ..< ys.max()! + 1
+            let x = xs.min()! ..< xs.max()! + 1
+            var data = [Float](repeating: .nan, count: y.count * x.count * nTimeRead)
+            if nDims == 3 {
+                let range: InlineArray<3, Range<UInt64>> = [y.toUInt64(), x.toUInt64(), fileTime]
+                try await self.read(
+                    into: &data,
+                    range: range,
+                    intoCubeOffset: [0, 0, 0],
+                    intoCubeDimension: [UInt64(y.count), UInt64(x.count), UInt64(nTimeRead)]
+                )
+            } else {
+                let l = UInt64(level) ..< UInt64(level + 1)
+                let range: InlineArray<4, Range<UInt64>> = [y.toUInt64(), x.toUInt64(), l, fileTime]
+                try await self.read(
+                    into: &data,
+                    range: range,
+                    intoCubeOffset: [0, 0, 0, 0],
+                    intoCubeDimension: [UInt64(y.count), UInt64(x.count), 1, UInt64(nTimeRead)]
+                )
+            }
+            return (group, y, x, data)
+        })
+        /// Scatter bounding boxes into the output arrays
+        for box in boxes {
+            for i in box.group {
+                let location = locations[i]
+                let offset = ((location / nx - box.y.lowerBound) * box.x.count + location % nx - box.x.lowerBound) * nTimeRead
+                for (t, array) in timeOffsets.array.enumerated() {
+                    into[i][array] = box.data[offset + t]
+                }
+            }
+        }
+    }
+
     /// Prefetch data for fast access. Switch between old legacy files and new multi dimensional files
     /// Note: `nTime` is the output array nTime. It is not the file nTime!
     /// /// TODO: nMembers variable is wrong if called via API controller. Aways 1
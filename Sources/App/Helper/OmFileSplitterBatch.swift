@@ -0,0 +1,71 @@
+import Foundation
+import NIOConcurrencyHelpers
+
+/**
+ Combine single grid point reads of one API request. Multi location requests use one reader per location and each reader calls `OmFileSplitter.read` on its own.
+ Without batching, the same compressed chunk would be decompressed once for every location.
+
+ `OmFileSplitter.willNeed` registers all locations during prefetch. The first `OmFileSplitter.read` of a registered location reads all registered locations of the same variable, level and time at once.
+ Following reads return the already read data. Each location is returned once and then released. Locations that were not registered or are read again are read individually.
+ */
+final class OmFileSplitterBatch: Sendable {
+    struct Key: Hashable, Sendable {
+        let domain: DomainRegistry
+        let variable: String
+        let level: Int
+        let time: TimerangeDtAndSettings
+    }
+
+    fileprivate struct Entry {
+        var locations = Set<Int>()
+        var task: Task<Void, any Error>?
+        /// Read data of locations that have not been returned yet
+        var data = [Int: [Float]]()
+    }
+
+    private let entries = NIOLockedValueBox<[Key: Entry]>([:])
+
+    /// Register a grid point that will be read later
+    func register(key: Key, location: Int) {
+        entries.withLockedValue { entries in
+            guard entries[key]?.task == nil else {
+                return
+            }
+            entries[key, default: Entry()].locations.insert(location)
+        }
+    }
+
+    /// Return data for a registered grid point. The first call reads all registered locations using `fn`. Returns nil if the location was not registered, is the only registered location or was already returned.
+    /// All callers belong to the same API request. If one of them is cancelled, the shared read is cancelled as well.
+    func read(key: Key, location: Int, fn: @escaping @Sendable (_ locations: [Int]) async throws -> [[Float]]) async throws -> [Float]? {
+        let task = entries.withLockedValue { entries -> Task<Void, any Error>? in
+            guard var entry = entries[key], entry.locations.count > 1, entry.locations.contains(location) else {
+                return nil
+            }
+            if let task = entry.task {
+                return task
+            }
+            let locations = entry.locations.sorted()
+            let task = Task { [self] in
+                let data = try await fn(locations)
+                self.entries.withLockedValue { entries in
+                    entries[key]?.data = [Int: [Float]](uniqueKeysWithValues: zip(locations, data))
+                }
+            }
+            entry.task = task
+            entries[key] = entry
+            return task
+        }
+        guard let task else {
+            return nil
+        }
+        try await withTaskCancellationHandler {
+            try await task.value
+        } onCancel: {
+            task.cancel()
+        }
+        return entries.withLockedValue { entries in
+            entries[key]?.data.removeValue(forKey: location)
+        }
+    }
+}
@@ -33,227 +33,579 @@ extension DataAsClass: AtomicBlockCacheStorable {
     }
 }
 
+enum AtomicBlockCacheError: Error {
+    case cannotOpenFile(file: String, error: String)
+    case cannotLockFile(file: String, error: String)
+    case incompatibleFile(file: String)
+}
+
 extension AtomicBlockCache where Backend == MmapFile {
-    init(file: String, blockSize: Int, blockCount: Int) throws {
-        let size = (MemoryLayout<WordPair>.size + blockSize) * blockCount
-        if FileManager.default.fileExists(atPath: file) {
-            let fn = try FileHandle.openFileReadWrite(file: file)
-            if try fn.seekToEnd() == size {
-                self = .init(data: try MmapFile(fn: fn, mode: .readWrite), blockSize: blockSize)
-                return
+    /**
+     Open or create a cache file. The file can be used by multiple processes at the same time.
+     
+     Every process holds a shared `flock` as long as the file is open. If a process can acquire an exclusive lock, no other process uses the file. Only in this case an incompatible file is recreated and blocks of terminated writers are reset.
+     Otherwise the file must have the same format, block size, block count and look ahead. Entries that remain in-flight are taken over by `set` after a timeout.
+     */
+    init(file: String, blockSize: Int, blockCount: Int, lookAheadCount: Int = Self.defaultLookAheadCount) throws {
+        let size = (Self.slotOverhead + blockSize) * blockCount
+        // The format marker must be smaller than one slot, otherwise it would count as an additional block
+        precondition(AtomicBlockCacheFileFormat.size < Self.slotOverhead + blockSize)
+        let header = AtomicBlockCacheFileFormat(blockSize: blockSize, blockCount: blockCount, lookAheadCount: lookAheadCount)
+        let fileSize = size + AtomicBlockCacheFileFormat.size
+        let fd = open(file, O_RDWR | O_CREAT, 0o644)
+        guard fd != -1 else {
+            throw AtomicBlockCacheError.cannotOpenFile(file: file, error: String(cString: strerror(errno)))
+        }
+        // `MmapFile` keeps the file handle and therefore the lock open
+        let fn = FileHandle(fileDescriptor: fd, closeOnDealloc: true)
+        if flock(fd, LOCK_EX | LOCK_NB) == 0 {
+            if fn.fileSize() != fileSize || AtomicBlockCacheFileFormat(fd: fd, offset: size) != header {
+                guard ftruncate(fd, 0) == 0, ftruncate(fd, off_t(fileSize)) == 0 else {
+                    throw AtomicBlockCacheError.cannotOpenFile(file: file, error: String(cString: strerror(errno)))
+                }
+                try header.write(fd: fd, offset: size, file: file)
+            }
+            let cache = Self(data: try MmapFile(fn: fn, mode: .readWrite), blockSize: blockSize, lookAheadCount: lookAheadCount)
+            cache.resetInvalidEntries()
+            // Other processes waiting for a shared lock may now use the cache
+            guard flock(fd, LOCK_SH) == 0 else {
+                throw AtomicBlockCacheError.cannotLockFile(file: file, error: String(cString: strerror(errno)))
             }
+            self = cache
+            return
+        }
+        // Wait until a process that holds an exclusive lock finished initialising the file
+        guard flock(fd, LOCK_SH) == 0 else {
+            throw AtomicBlockCacheError.cannotLockFile(file: file, error: String(cString: strerror(errno)))
+        }
+        guard fn.fileSize() == fileSize, AtomicBlockCacheFileFormat(fd: fd, offset: size) == header else {
+            throw AtomicBlockCacheError.incompatibleFile(file: file)
+        }
+        self = .init(data: try MmapFile(fn: fn, mode: .readWrite), blockSize: blockSize, lookAheadCount: lookAheadCount)
+    }
+}
+
+/**
+ Format marker of a cache file. Stored after the last data block, therefore the cache layout is identical for files and memory.
+ Any change to the layout or entry encoding requires a new `version`.
+ */
+fileprivate struct AtomicBlockCacheFileFormat: Equatable {
+    static let magic: UInt64 = 0x31454843_41434d4f // "OMCACHE1"
+    static let version: UInt64 = 2
+    static let size = 5 * MemoryLayout<UInt64>.size
+
+    let blockSize: Int
+    let blockCount: Int
+    let lookAheadCount: Int
+
+    init(blockSize: Int, blockCount: Int, lookAheadCount: Int) {
+        self.blockSize = blockSize
+        self.blockCount = blockCount
+        self.lookAheadCount = lookAheadCount
+    }
+
+    /// Read the header at `offset`. Returns nil if the file is too short or magic number and version do not match
+    init?(fd: Int32, offset: Int) {
+        var words = [UInt64](repeating: 0, count: 5)
+        let count = words.withUnsafeMutableBytes { pread(fd, $0.baseAddress, $0.count, off_t(offset)) }
+        guard count == Self.size, words[0] == Self.magic, words[1] == Self.version else {
+            return nil
+        }
+        self.blockSize = Int(words[2])
+        self.blockCount = Int(words[3])
+        self.lookAheadCount = Int(words[4])
+    }
+
+    func write(fd: Int32, offset: Int, file: String) throws {
+        let words: [UInt64] = [Self.magic, Self.version, UInt64(blockSize), UInt64(blockCount), UInt64(lookAheadCount)]
+        let count = words.withUnsafeBytes { pwrite(fd, $0.baseAddress, $0.count, off_t(offset)) }
+        guard count == Self.size else {
+            throw AtomicBlockCacheError.cannotOpenFile(file: file, error: String(cString: strerror(errno)))
         }
-        let fn = try FileHandle.createNewFile(file: file, size: size, overwrite: true)
-        self = .init(data: try MmapFile(fn: fn, mode: .readWrite), blockSize: blockSize)
     }
 }
 
 
 /**
- Key-value cache for fixed block sizes and a fixed amount of blocks. Uses a hash map with LRU strategy.
+ Key-value cache for fixed block sizes and a fixed amount of blocks. Uses a bucketed hash map with CLOCK (second chance) eviction.
  The entire cache size is preallocated. Due to the fixed number of elements, the hash map does not need rebalancing
  
- Uses Atomics for thread safety. The beginning of the cache contains N key entries. Each key entry is the 64 bit key and a 64 bit timestamp in nanoseconds.
+ Uses Atomics for thread safety. The beginning of the cache contains N key entries. Each key entry is the 64 bit key and a 64 bit state:
+ - 0: Empty slot
+ - bit 0 = 1: Committed. Bit 1 is the CLOCK reference bit, bits 2-63 the last access time in seconds
+ - bit 0 = 0: In-flight. Bits 1-30 contain the lower bits of the sequence number the writer will use, bits 31-63 the start time in seconds. This makes every in-flight state unique
  
- The data block contains than N block of `blockSize` length. Key entries and data blocks are allocated as a file and mmaped
+ A writer in another process may be terminated while a block is in-flight. Such entries are evicted by `set` after a timeout of 10 minutes.
  
- Basic principle here https://gist.github.com/glampert/2c462bcc77d326526787708c0f2cceff
+ Four 128 bit key entries form a 64 byte bucket (one cache line). A key is stored in its home slot `key % N` or in any other slot of the `lookAheadCount` slots starting at its home bucket.
+ With the default of 8 slots, a key is in its home bucket or the following bucket and lookups touch at most 2 cache lines. Consecutive keys are usually stored in consecutive slots and can be read at once.
+ If all slots are used, an entry without reference bit and the oldest access time is evicted. Reference bits of skipped entries are cleared (second chance).
  
- N * 128 bit for keys and timestamps. Timestamp of 0 means empty
+ Each block has a 64 bit sequence number (seqlock). Writers increment it to an odd value before modifying a block and to an even value afterwards.
+ Readers check that the sequence number did not change while data was read. If it changed, the read is repeated. Data is never copied on the read path.
+ 
+ The data block contains than N block of `blockSize` length. Key entries, sequence numbers and data blocks are allocated as a file and mmaped. N must be at least `lookAheadCount`.
+ 
+ N * 128 bit for keys and states
+ N * 64 bit for sequence numbers
  N * M for data
  */
 public struct AtomicBlockCache<Backend: AtomicBlockCacheStorable>: Sendable {
     let data: Backend
     let blockSize: Int
     
+    /// Number of slots that are checked for a key starting at the home bucket. Must be a power of 2 and at least `bucketWidth`
+    let lookAheadCount: Int
+    
+    /// Bytes per block in addition to `blockSize` for the key entry and sequence number
+    static var slotOverhead: Int {
+        return MemoryLayout<WordPair>.size + MemoryLayout<UInt64>.size
+    }
+    
+    /// If a block is overwritten while it is read, the read is repeated. After this number of attempts the block is treated as missing
+    static var maxReadAttempts: Int {
+        return 4
+    }
+    
+    /// Number of key entries in one 64 byte cache line
+    static var bucketWidth: Int {
+        return 64 / MemoryLayout<WordPair>.stride
+    }
+    
+    /// Home bucket and the following bucket. Sufficient for block keys, because consecutive blocks of a file have consecutive keys and are spread evenly.
+    /// Random keys, e.g. hashed URLs, cluster more often and should use a larger window to avoid evicting recently used entries
+    static var defaultLookAheadCount: Int {
+        return 2 * bucketWidth
+    }
+    
+    init(data: Backend, blockSize: Int, lookAheadCount: Int = Self.defaultLookAheadCount) {
+        precondition(lookAheadCount >= Self.bucketWidth && lookAheadCount.nonzeroBitCount == 1, "lookAheadCount must be a power of 2 and at least one bucket")
+        self.data = data
+        self.blockSize = blockSize
+        self.lookAheadCount = lookAheadCount
+    }
+    
     var blockCount: Int {
-        return data.count / (blockSize + MemoryLayout<WordPair>.size)
+        return data.count / (blockSize + Self.slotOverhead)
     }
     
-    @discardableResult
-    func set<DataIn: ContiguousBytes>(key: UInt64, value: DataIn) -> UnsafeRawBufferPointer {
-        let time = UInt(Date().timeIntervalSince1970 * 1_000_000_000)
-        /// For in-flight requests set bit 0 to zero
-        let inFlightKey = WordPair(first: UInt(key), second: time & ~0x1)
-        /// For committed requests set bit 0 to zero
-        let committedKey = WordPair(first: UInt(key), second: time | 0x1)
-        /// The maximum number of slots to check for an empty space. Afterwards overwrite LRU value
-        let lookAheadCount: UInt64 = 1024
+    /// Location of a cached block range. `data` may only be used if the sequence numbers did not change after reading
+    fileprivate struct SeqlockRead {
+        let data: UnsafeRawBufferPointer
+        let slot: Int
+        let count: Int
+        /// Sum of all sequence numbers before reading. Sequence numbers only increase, therefore any write changes the sum
+        let sequenceSum: UInt64
+    }
+    
+    /// Get key entries, sequence numbers and the start of the data region
+    @inline(__always) fileprivate func regions(_ bytes: UnsafeMutableRawBufferPointer, blockCount: Int) -> (entries: UnsafeMutableBufferPointer<Atomic<WordPair>>, sequences: UnsafeMutableBufferPointer<Atomic<UInt64>>, data: UnsafeMutableRawPointer) {
+        let entriesSize = blockCount * MemoryLayout<WordPair>.size
+        let sequencesSize = blockCount * MemoryLayout<UInt64>.size
+        let entries = UnsafeMutableRawBufferPointer(rebasing: bytes[0 ..< entriesSize]).assumingMemoryBound(to: Atomic<WordPair>.self)
+        let sequences = UnsafeMutableRawBufferPointer(rebasing: bytes[entriesSize ..< entriesSize + sequencesSize]).assumingMemoryBound(to: Atomic<UInt64>.self)
+        return (entries, sequences, bytes.baseAddress!.advanced(by: entriesSize + sequencesSize))
+    }
+    
+    /// Slots to check for a key. Starts at the home slot and wraps within the home bucket and the following bucket. Only one division per lookup.
+    @inline(__always) fileprivate func probe(key: UInt64, blockCount: Int) -> AtomicBlockCacheProbe {
+        let home = Int(key % UInt64(blockCount))
+        let bucketStart = home & ~(Self.bucketWidth - 1)
+        return AtomicBlockCacheProbe(bucketStart: bucketStart, offset: home - bucketStart, mask: lookAheadCount - 1, blockCount: blockCount)
+    }
+    
+    /// Sum of sequence numbers for a range of slots. Returns nil if any slot is being written
+    @inline(__always) fileprivate func sequenceSum(_ sequences: UnsafeMutableBufferPointer<Atomic<UInt64>>, slot: Int, count: Int) -> UInt64? {
+        var sum: UInt64 = 0
+        for i in slot ..< slot + count {
+            let sequence = sequences[i].load(ordering: .acquiring)
+            guard sequence & 0x1 == 0 else {
+                return nil
+            }
+            sum &+= sequence
+        }
+        return sum
+    }
+    
+    /// Check that no block was modified since `read` was created
+    @inline(__always) fileprivate func isUnchanged(_ read: SeqlockRead) -> Bool {
+        // Make sure all data reads are completed before the sequence number is checked again
+        atomicMemoryFence(ordering: .acquiring)
         let blockCount = blockCount
         return data.withMutableUnsafeBytes { bytes in
-            let entries = bytes.assumingMemoryBound(to: Atomic<WordPair>.self)
-            for lookAhead in 0..<lookAheadCount {
-                let slot = Int((key &+ lookAhead) % UInt64(blockCount))
-                while true {
-                    let entry = entries[slot].load(ordering: .relaxed)
-                    guard entry.second == 0 || entry.first == key else {
-                        break
-                    }
-                    guard entries[slot].compareExchange(expected: entry, desired: inFlightKey, ordering: .relaxed).exchanged else {
-                        continue // another thread stole the slot
-                    }
-                    let dest = bytes.baseAddress?.advanced(by: blockCount * MemoryLayout<WordPair>.size + blockSize * slot)
-                    value.withUnsafeBytes {
-                        let destBuffer = UnsafeMutableRawBufferPointer(start: UnsafeMutableRawPointer(mutating: dest), count: $0.count)
-                        $0.copyBytes(to: destBuffer)
-                    }
-                    guard entries[slot].compareExchange(expected: inFlightKey, desired: committedKey, ordering: .relaxed).exchanged else {
-                        continue // another thread stole the slot
-                    }
-                    return UnsafeRawBufferPointer(start: dest, count: blockSize)
+            let sequences = regions(bytes, blockCount: blockCount).sequences
+            var sum: UInt64 = 0
+            for i in read.slot ..< read.slot + read.count {
+                sum &+= sequences[i].load(ordering: .relaxed)
+            }
+            return sum == read.sequenceSum
+        }
+    }
+    
+    /// Set reference bit and access time. Only writes if the entry changed to keep cache lines shared between readers. Returns false if the entry was modified by another thread.
+    @inline(__always) fileprivate func touch(_ entries: UnsafeMutableBufferPointer<Atomic<WordPair>>, slot: Int, entry: WordPair, now: UInt) -> Bool {
+        let touched = WordPair(first: entry.first, second: AtomicBlockCacheEntryState.committed(accessTime: now, referenced: true))
+        guard touched != entry else {
+            return true
+        }
+        let updated = entries[slot].compareExchange(expected: entry, desired: touched, ordering: .relaxed)
+        return updated.exchanged || (updated.original.first == entry.first && updated.original.isCommitted)
+    }
+    
+    /// A process may have been terminated while writing a block. Clear those blocks before the cache is used.
+    /// IMPORTANT: Only safe if no other process uses the cache. See `init(file:blockSize:blockCount:)`
+    func resetInvalidEntries() {
+        let blockCount = blockCount
+        data.withMutableUnsafeBytes { bytes in
+            let (entries, sequences, _) = regions(bytes, blockCount: blockCount)
+            for slot in 0..<blockCount {
+                let sequence = sequences[slot].load(ordering: .relaxed)
+                if sequence & 0x1 == 1 {
+                    sequences[slot].store(sequence &+ 1, ordering: .relaxed)
+                    entries[slot].store(.init(first: 0, second: 0), ordering: .relaxed)
+                }
+                if entries[slot].load(ordering: .relaxed).isInFlight {
+                    entries[slot].store(.init(first: 0, second: 0), ordering: .relaxed)
                 }
             }
-            // If we are here, no slots were free. Search lowest timestamp and overwrite this slot
-            // Remember that other threads might do the same at the same time
+        }
+    }
+    
+    /// Find a slot to store `key`. `target` is the slot with the same key or the first empty slot. Otherwise `victim` is the entry to evict: Abandoned in-flight entries first, then entries without reference bit and the oldest access time
+    @inline(__always) fileprivate func selectSlot(_ entries: UnsafeMutableBufferPointer<Atomic<WordPair>>, key: UInt64, slots: AtomicBlockCacheProbe, now: UInt) -> (target: (slot: Int, entry: WordPair)?, victim: (slot: Int, entry: WordPair)?) {
+        var target: (slot: Int, entry: WordPair)? = nil
+        var victim: (slot: Int, entry: WordPair, priority: UInt)? = nil
+        for i in 0..<lookAheadCount {
+            let slot = slots.slot(i)
+            let entry = entries[slot].load(ordering: .relaxed)
+            if entry.first == key && entry.second != 0 && !entry.isAbandoned(now: now) {
+                return ((slot, entry), nil)
+            }
+            if entry.second == 0 {
+                if target == nil {
+                    target = (slot, entry)
+                }
+                continue
+            }
+            let priority = entry.isAbandoned(now: now) ? 0 : entry.evictionPriority
+            if victim.map({ priority < $0.priority }) ?? true {
+                victim = (slot, entry, priority)
+            }
+        }
+        return (target, victim.map({ ($0.slot, $0.entry) }))
+    }
+    
+    /// Key that would be evicted if `key` is inserted now. Nil if `key` is already cached or a free slot is available. Used for admission policies.
+    func evictionCandidate(key: UInt64) -> UInt64? {
+        let blockCount = blockCount
+        return data.withMutableUnsafeBytes { bytes in
+            let entries = regions(bytes, blockCount: blockCount).entries
+            let (target, victim) = selectSlot(entries, key: key, slots: probe(key: key, blockCount: blockCount), now: AtomicBlockCacheClock.now())
+            guard target == nil, let victim, victim.entry.isCommitted else {
+                return nil
+            }
+            return UInt64(victim.entry.first)
+        }
+    }
+    
+    /// Write `value` into `slot` with the seqlock protocol. `entry` is the entry that was selected for replacement. Returns false if another thread modified the slot concurrently
+    @inline(__always) fileprivate func write(_ entries: UnsafeMutableBufferPointer<Atomic<WordPair>>, _ sequences: UnsafeMutableBufferPointer<Atomic<UInt64>>, dataStart: UnsafeMutableRawPointer, slot: Int, entry: WordPair, key: UInt64, value: UnsafeRawBufferPointer, now: UInt) -> Bool {
+        let sequence = sequences[slot].load(ordering: .relaxed)
+        /// The writer of an abandoned entry may have been terminated with an odd sequence number. Skip to the next odd number in this case
+        let abandoned = entry.isAbandoned(now: now)
+        guard sequence & 0x1 == 0 || abandoned else {
+            return false // another thread is writing
+        }
+        let writing = sequence & 0x1 == 1 ? sequence &+ 2 : sequence &+ 1
+        /// In-flight state is unique, because it contains the sequence number of this write
+        let inFlight = WordPair(first: UInt(key), second: AtomicBlockCacheEntryState.inFlight(sequence: writing, startTime: now))
+        guard entries[slot].compareExchange(expected: entry, desired: inFlight, ordering: .relaxed).exchanged else {
+            return false // another thread stole the slot
+        }
+        guard sequences[slot].compareExchange(expected: sequence, desired: writing, ordering: .acquiring).exchanged else {
+            // Another thread is writing. Release the entry, otherwise it stays in-flight until the timeout
+            _ = entries[slot].compareExchange(expected: inFlight, desired: entry, ordering: .relaxed)
+            return false
+        }
+        let destBuffer = UnsafeMutableRawBufferPointer(start: dataStart.advanced(by: blockSize * slot), count: value.count)
+        value.copyBytes(to: destBuffer)
+        guard sequences[slot].compareExchange(expected: writing, desired: writing &+ 1, ordering: .releasing).exchanged else {
+            return false // this write took too long and the slot was taken over
+        }
+        let committed = WordPair(first: UInt(key), second: AtomicBlockCacheEntryState.committed(accessTime: now, referenced: false))
+        // Releasing ordering: Readers that observe the committed entry also observe the new sequence number
+        return entries[slot].compareExchange(expected: inFlight, desired: committed, ordering: .releasing).exchanged
+    }
+    
+    func set<DataIn: ContiguousBytes>(key: UInt64, value: DataIn) {
+        let now = AtomicBlockCacheClock.now()
+        let blockCount = blockCount
+        data.withMutableUnsafeBytes { bytes in
+            let (entries, sequences, dataStart) = regions(bytes, blockCount: blockCount)
+            let slots = probe(key: key, blockCount: blockCount)
+            
+            // Remember that other threads might modify the same slots at the same time
             while true {
-                let (slot, entry) = (0..<lookAheadCount).reduce((0, WordPair(first: 0, second: UInt.max)), { (compare, lookAhead) in
-                    let slot = Int((key &+ lookAhead) % UInt64(blockCount))
-                    let entry = entries[slot].load(ordering: .relaxed)
-                    return entry.second < compare.1.second ? (slot,entry) : compare
-                })
-                guard entries[slot].compareExchange(expected: entry, desired: inFlightKey, ordering: .relaxed).exchanged else {
-                    continue // another thread stole the slot
-                }
-                let dest = bytes.baseAddress?.advanced(by: blockCount * MemoryLayout<WordPair>.size + blockSize * slot)
-                value.withUnsafeBytes {
-                    let destBuffer = UnsafeMutableRawBufferPointer(start: UnsafeMutableRawPointer(mutating: dest), count: $0.count)
-                    $0.copyBytes(to: destBuffer)
-                }
-                guard entries[slot].compareExchange(expected: inFlightKey, desired: committedKey, ordering: .relaxed).exchanged else {
-                    continue // another thread stole the slot
-                }
-                return UnsafeRawBufferPointer(start: dest, count: blockSize)
+                let (target, victim) = selectSlot(entries, key: key, slots: slots, now: now)
+                guard let chosen = target ?? victim else {
+                    continue
+                }
+                let written = value.withUnsafeBytes { value in
+                    write(entries, sequences, dataStart: dataStart, slot: chosen.slot, entry: chosen.entry, key: key, value: value, now: now)
+                }
+                guard written else {
+                    continue
+                }
+                if target == nil {
+                    // Evicted an entry. All other entries with reference bits get a second chance
+                    for i in 0..<lookAheadCount {
+                        let slot = slots.slot(i)
+                        let entry = entries[slot].load(ordering: .relaxed)
+                        guard entry.isCommitted && entry.isReferenced else {
+                            continue
+                        }
+                        let cleared = WordPair(first: entry.first, second: AtomicBlockCacheEntryState.committed(accessTime: entry.accessTime, referenced: false))
+                        _ = entries[slot].compareExchange(expected: entry, desired: cleared, ordering: .relaxed)
+                    }
+                }
+                return
             }
         }
     }
     
+    /// Keys stored in the home slots of `count` consecutive keys. Nil for slots without a committed entry. Returns nil if the run would wrap around the end of the cache. Used for admission policies of `setRun`
+    func homeSlotKeys(key: UInt64, count: Int) -> [UInt64?]? {
+        let blockCount = blockCount
+        return data.withMutableUnsafeBytes { bytes in
+            let entries = regions(bytes, blockCount: blockCount).entries
+            let home = probe(key: key, blockCount: blockCount).slot(0)
+            guard home + count <= blockCount else {
+                return nil
+            }
+            return (home ..< home + count).map { slot in
+                let entry = entries[slot].load(ordering: .relaxed)
+                return entry.isCommitted ? UInt64(entry.first) : nil
+            }
+        }
+    }
+    
+    /**
+     Store `count` consecutive blocks in the home slots of their keys. Consecutive keys have consecutive home slots, therefore the run can afterwards be read with a single `withData(key:count:)`.
+     Entries in these slots are replaced regardless of their eviction priority. Returns false if the run would wrap around the end of the cache or a slot is written concurrently. Blocks written before remain cached.
+     */
+    @discardableResult
+    func setRun(key: UInt64, count: Int, value: UnsafeRawBufferPointer) -> Bool {
+        let now = AtomicBlockCacheClock.now()
+        let blockCount = blockCount
+        let blockSize = blockSize
+        return data.withMutableUnsafeBytes { bytes in
+            let (entries, sequences, dataStart) = regions(bytes, blockCount: blockCount)
+            let home = probe(key: key, blockCount: blockCount).slot(0)
+            guard home + count <= blockCount else {
+                return false
+            }
+            for i in 0..<count {
+                let block = UnsafeRawBufferPointer(rebasing: value[i * blockSize ..< min((i + 1) * blockSize, value.count)])
+                let written = (0..<Self.maxReadAttempts).contains { _ in
+                    write(entries, sequences, dataStart: dataStart, slot: home + i, entry: entries[home + i].load(ordering: .relaxed), key: key &+ UInt64(i), value: block, now: now)
+                }
+                guard written else {
+                    return false
+                }
+            }
+            return true
+        }
+    }
+    
+    /// Find the slot of a committed key
+    @inline(__always) fileprivate func find(_ entries: UnsafeMutableBufferPointer<Atomic<WordPair>>, key: UInt64, blockCount: Int) -> (slot: Int, entry: WordPair)? {
+        let slots = probe(key: key, blockCount: blockCount)
+        for i in 0..<lookAheadCount {
+            let slot = slots.slot(i)
+            let entry = entries[slot].load(ordering: .relaxed)
+            // ignore any entries that are being modified right now
+            if entry.first == key && entry.isCommitted {
+                return (slot, entry)
+            }
+        }
+        return nil
+    }
+    
     /// Prefetch data
     func prefetch(key: UInt64) {
-        let lookAheadCount: UInt64 = 1024
         let blockCount = blockCount
         data.withMutableUnsafeBytes { bytes in
-            let entries = bytes.assumingMemoryBound(to: Atomic<WordPair>.self)
-            for lookAhead in 0..<lookAheadCount {
-                let slot = (key &+ lookAhead) % UInt64(blockCount)
-                while true {
-                    let entry = entries[Int(slot)].load(ordering: .relaxed)
-                    // check if keys match
-                    // ignore any entries that are being modified right now
-                    guard entry.first == key && entry.second & 0x1 == 1 else {
-                        break
-                    }
-                    let offset = blockCount * MemoryLayout<WordPair>.size + blockSize * Int(slot)
-                    data.prefetchData(offset: offset, count: blockSize)
-                    return
+            let entries = regions(bytes, blockCount: blockCount).entries
+            guard let found = find(entries, key: key, blockCount: blockCount) else {
+                return
+            }
+            let offset = blockCount * Self.slotOverhead + blockSize * found.slot
+            data.prefetchData(offset: offset, count: blockSize)
+        }
+    }
+    
+    /// Prefetch the memory of `ptr` if it points into this cache, e.g. data passed to `withData`. Pointers to other memory are ignored
+    func prefetch(data ptr: UnsafeRawBufferPointer) {
+        guard let pointer = ptr.baseAddress else {
+            return
+        }
+        let offset = data.withMutableUnsafeBytes { bytes -> Int? in
+            let start = UnsafeRawPointer(bytes.baseAddress!)
+            guard pointer >= start, pointer + ptr.count <= start + bytes.count else {
+                return nil
+            }
+            return start.distance(to: pointer)
+        }
+        guard let offset else {
+            return
+        }
+        data.prefetchData(offset: offset, count: ptr.count)
+    }
+    
+    /// Find key in cache, updates the access time and returns the location of the memory region
+    fileprivate func lookup(key: UInt64, maxAccessedAgeInSeconds: UInt) -> SeqlockRead? {
+        let now = AtomicBlockCacheClock.now()
+        let blockCount = blockCount
+        return data.withMutableUnsafeBytes { bytes in
+            let (entries, sequences, dataStart) = regions(bytes, blockCount: blockCount)
+            while true {
+                guard let slot = find(entries, key: key, blockCount: blockCount)?.slot else {
+                    return nil
+                }
+                guard let sequenceSum = sequenceSum(sequences, slot: slot, count: 1) else {
+                    return nil // slot is being written
+                }
+                // The entry must be checked again after the sequence number has been read. Otherwise, it could belong to data that was written afterwards
+                let entry = entries[slot].load(ordering: .acquiring)
+                guard entry.first == key && entry.isCommitted else {
+                    continue
+                }
+                // Check if cached entry is not older than requested
+                guard entry.accessTime &+ maxAccessedAgeInSeconds >= now else {
+                    return nil
                 }
+                guard touch(entries, slot: slot, entry: entry, now: now) else {
+                    continue // Another thread changed the key or started an update
+                }
+                let dest = UnsafeRawBufferPointer(start: dataStart.advanced(by: blockSize * slot), count: blockSize)
+                return SeqlockRead(data: dest, slot: slot, count: 1, sequenceSum: sequenceSum)
             }
         }
     }
     
-    /// Find key in cache, updates the LRU timestamp and returns a pointer to the memory region. There is a slight chance, that data is modified while reading, but it should practically never happen
-    func get(key: UInt64, maxAccessedAgeInSeconds: UInt) -> UnsafeRawBufferPointer? {
-        let time = UInt(Date().timeIntervalSince1970 * 1_000_000_000)
-        let lookAheadCount: UInt64 = 1024
+    /// Return the location if all keys are available sequentially in the cache
+    fileprivate func lookup(key: UInt64, count: UInt64) -> SeqlockRead? {
+        let now = AtomicBlockCacheClock.now()
         let blockCount = blockCount
         return data.withMutableUnsafeBytes { bytes in
-            let entries = bytes.assumingMemoryBound(to: Atomic<WordPair>.self)
-            for lookAhead in 0..<lookAheadCount {
-                let slot = Int((key &+ lookAhead) % UInt64(blockCount))
-                while true {
-                    let entry = entries[slot].load(ordering: .relaxed)
+            let (entries, sequences, dataStart) = regions(bytes, blockCount: blockCount)
+            outer: while true {
+                guard let slot = find(entries, key: key, blockCount: blockCount)?.slot else {
+                    return nil
+                }
+                guard slot + Int(count) <= blockCount else {
+                    return nil // Key range would hit the end of the cache block
+                }
+                guard let sequenceSum = sequenceSum(sequences, slot: slot, count: Int(count)) else {
+                    return nil // a slot is being written
+                }
+                // Entries are checked after sequence numbers have been read
+                for i in 0..<Int(count) {
+                    let entry = entries[slot + i].load(ordering: .acquiring)
                     // check if keys match
                     // ignore any entries that are being modified right now
-                    guard entry.first == key && entry.second & 0x1 == 1 else {
-                        break
-                    }
-                    
-                    // Check if cached entry is not older than requested
-                    guard entry.second >= time - maxAccessedAgeInSeconds * 1_000_000_000 else {
+                    guard entry.first == key &+ UInt64(i) && entry.isCommitted else {
                         return nil
                     }
-                    
-                    // Update last modified timestamp
-                    let updateTimestamp = WordPair(first: UInt(key), second: time | 0x1)
-                    let updated = entries[slot].compareExchange(expected: entry, desired: updateTimestamp, ordering: .relaxed)
-                    guard updated.exchanged || (updated.original.first == key && updated.original.second & 0x1 == 1 ) else {
-                        // Another thread changed the key or started an update
-                        continue
+                    guard touch(entries, slot: slot + i, entry: entry, now: now) else {
+                        continue outer // Another thread changed the key or started an update
                     }
-                    
-                    // Get data pointer and execute closure on data
-                    // There is a slight chance, that data is modified while reading, but it should practically never happen
-                    let dest = bytes.baseAddress?.advanced(by: blockCount * MemoryLayout<WordPair>.size + blockSize * slot)
-                    return UnsafeRawBufferPointer(start: dest, count: blockSize)
                 }
+                let dest = UnsafeRawBufferPointer(start: dataStart.advanced(by: blockSize * slot), count: blockSize * Int(count))
+                return SeqlockRead(data: dest, slot: slot, count: Int(count), sequenceSum: sequenceSum)
             }
-            return nil
         }
     }
     
-    /// Return if all keys are available sequentially in the cache
-    func get(key: UInt64, count: UInt64) -> UnsafeRawBufferPointer? {
-        let time = UInt(Date().timeIntervalSince1970 * 1_000_000_000)
-        let lookAheadCount: UInt64 = 1024
-        let blockCount = blockCount
-        return data.withMutableUnsafeBytes { bytes in
-            let entries = bytes.assumingMemoryBound(to: Atomic<WordPair>.self)
-            outer: for lookAhead in 0..<lookAheadCount {
-                let slot = UInt64(key &+ lookAhead) % UInt64(blockCount)
-                if slot + count > blockCount {
-                    continue // Key range would hit the end of the cache block
-                }
-                for i in 0..<count {
-                    let slot = Int((slot &+ i) % UInt64(blockCount))
-                    let key = (key &+ UInt64(i))
-                    while true {
-                        let entry = entries[slot].load(ordering: .relaxed)
-                        // check if keys match
-                        // ignore any entries that are being modified right now
-                        guard entry.first == key && entry.second & 0x1 == 1 else {
-                            continue outer
-                        }
-                        // Update last modified timestamp
-                        let updateTimestamp = WordPair(first: UInt(key), second: time | 0x1)
-                        let updated = entries[slot].compareExchange(expected: entry, desired: updateTimestamp, ordering: .relaxed)
-                        guard updated.exchanged || (updated.original.first == key && updated.original.second & 0x1 == 1 ) else {
-                            // Another thread changed the key or started an update
-                            continue
-                        }
-                        // Slot ok
-                        break
-                    }
+    /// Execute `body` with a consistent view of cached data. Returns nil if the key is not cached or has not been accessed within `maxAccessedAgeInSeconds`. Updates the access time.
+    /// `body` is called without copying data. If the block is overwritten concurrently, `body` is called again and must not have side effects besides its return value.
+    func withData<R>(key: UInt64, maxAccessedAgeInSeconds: UInt, _ body: (UnsafeRawBufferPointer) throws -> R) rethrows -> R? {
+        for _ in 0..<Self.maxReadAttempts {
+            guard let read = lookup(key: key, maxAccessedAgeInSeconds: maxAccessedAgeInSeconds) else {
+                return nil
+            }
+            do {
+                let result = try body(read.data)
+                if isUnchanged(read) {
+                    return result
+                }
+            } catch {
+                if isUnchanged(read) {
+                    throw error
                 }
-                // Get data pointer and execute closure on data
-                // There is a slight chance, that data is modified while reading, but it should practically never happen
-                let dest = bytes.baseAddress?.advanced(by: blockCount * MemoryLayout<WordPair>.size + blockSize * Int(slot))
-                return UnsafeRawBufferPointer(start: dest, count: blockSize * Int(count))
             }
-            return nil
         }
+        return nil
+    }
+    
+    /// Execute `body` with a consistent view of `count` sequentially cached keys. Returns nil if not all keys are available sequentially.
+    /// `body` is called without copying data. If a block is overwritten concurrently, `body` is called again and must not have side effects besides its return value.
+    func withData<R>(key: UInt64, count: UInt64, _ body: (UnsafeRawBufferPointer) throws -> R) rethrows -> R? {
+        for _ in 0..<Self.maxReadAttempts {
+            guard let read = lookup(key: key, count: count) else {
+                return nil
+            }
+            do {
+                let result = try body(read.data)
+                if isUnchanged(read) {
+                    return result
+                }
+            } catch {
+                if isUnchanged(read) {
+                    throw error
+                }
+            }
+        }
+        return nil
+    }
+    
+    /// Check if a key is cached and has been accessed within `maxAccessedAgeInSeconds`. Updates the access time.
+    func contains(key: UInt64, maxAccessedAgeInSeconds: UInt) -> Bool {
+        return lookup(key: key, maxAccessedAgeInSeconds: maxAccessedAgeInSeconds) != nil
     }
     
-    /// Delete a key (or range) if it older than a specified number of seconds
+    /// Return if all keys are available sequentially in the cache. Updates the access time.
+    func contains(key: UInt64, count: UInt64) -> Bool {
+        return lookup(key: key, count: count) != nil
+    }
+    
+    /// Delete a key (or range) if it has not been accessed for a specified number of seconds
     @discardableResult
     func delete(key: UInt64, count: UInt64, olderThanSeconds: UInt) -> Int {
-        let time = UInt(Date().timeIntervalSince1970 * 1_000_000_000)
-        let olderThan = time - (olderThanSeconds * 1_000_000_000)
-        let lookAheadCount: UInt64 = 1024
+        let now = AtomicBlockCacheClock.now()
         let blockCount = blockCount
         return data.withMutableUnsafeBytes { bytes in
-            let entries = bytes.assumingMemoryBound(to: Atomic<WordPair>.self)
+            let entries = regions(bytes, blockCount: blockCount).entries
+            let slots = probe(key: key, blockCount: blockCount)
             var deleted = 0
-            for lookAhead in 0..<count + lookAheadCount {
-                let slot = Int((key &+ lookAhead) % UInt64(blockCount))
+            // Keys of the range are located between the home bucket of the first key and the look ahead of the last key
+            for i in 0..<min(Int(count) + lookAheadCount + Self.bucketWidth, blockCount) {
+                var slot = slots.bucketStart + i
+                while slot >= blockCount {
+                    slot -= blockCount
+                }
                 let entry = entries[slot].load(ordering: .relaxed)
                 // check if key matches from key..<key+count
                 let keyDistance = entry.first &- UInt(key)
-                guard keyDistance >= 0 && keyDistance < count else {
+                guard entry.isCommitted && keyDistance < count else {
                     continue
                 }
-                guard entry.second <= olderThan else {
+                guard entry.accessTime &+ olderThanSeconds <= now else {
                     continue
                 }
-                entries[slot].store(.init(first: 0, second: 0), ordering: .relaxed)
+                guard entries[slot].compareExchange(expected: entry, desired: .init(first: 0, second: 0), ordering: .relaxed).exchanged else {
+                    continue // accessed or modified concurrently
+                }
                 deleted += 1
             }
             return deleted
@@ -269,30 +621,34 @@ public struct AtomicBlockCache<Backend: AtomicBlockCacheStorable>: Sendable {
             accessed_3hours = 0,
             accessed_24hours = 0
         
-        let now = UInt(Date().timeIntervalSince1970 * 1_000_000_000)
-        
+        let now = AtomicBlockCacheClock.now()
+        let blockCount = blockCount
         return data.withMutableUnsafeBytes { bytes in
-            let entries = bytes.assumingMemoryBound(to: Atomic<WordPair>.self)
+            let entries = regions(bytes, blockCount: blockCount).entries
             for block in 0..<blockCount {
-                let time = entries[block].load(ordering: .relaxed).second
-                if time == 0 {
+                let entry = entries[block].load(ordering: .relaxed)
+                if entry.second == 0 {
                     free += blockSize
                     continue
                 }
                 used += blockSize
-                if time > now - 900 * 1_000_000_000 {
+                guard entry.isCommitted else {
+                    continue
+                }
+                let age = now &- entry.accessTime
+                if age < 900 {
                     accessed_15min += blockSize
                 }
-                if time > now - 1800 * 1_000_000_000 {
+                if age < 1800 {
                     accessed_30min += blockSize
                 }
-                if time > now - 3_600 * 1_000_000_000 {
+                if age < 3_600 {
                     accessed_60min += blockSize
                 }
-                if time > now - 10_800 * 1_000_000_000 {
+                if age < 10_800 {
                     accessed_3hours += blockSize
                 }
-                if time > now - 86_400 * 1_000_000_000 {
+                if age < 86_400 {
                     accessed_24hours += blockSize
                 }
             }
@@ -309,6 +665,82 @@ public struct AtomicBlockCache<Backend: AtomicBlockCacheStorable>: Sendable {
     }
 }
 
+/// Slot order for a lookup. Starts at the home slot and wraps inside `lookAheadCount` slots starting at the home bucket
+fileprivate struct AtomicBlockCacheProbe {
+    let bucketStart: Int
+    let offset: Int
+    let mask: Int
+    let blockCount: Int
+    
+    /// Caches with fewer blocks than `lookAheadCount` wrap more than once. Division is only required past the end of the cache
+    @inline(__always) func slot(_ i: Int) -> Int {
+        let slot = bucketStart + ((offset + i) & mask)
+        return slot >= blockCount ? slot % blockCount : slot
+    }
+}
+
+/// Encoding of the 64 bit entry state
+fileprivate enum AtomicBlockCacheEntryState {
+    /// In-flight entries older than this are considered abandoned by a terminated process and may be taken over by another writer.
+    /// Copying one block takes microseconds. Only a stopped process could still write afterwards
+    static let inFlightTimeoutSeconds: UInt = 600
+    
+    @inline(__always) static func committed(accessTime: UInt, referenced: Bool) -> UInt {
+        return (accessTime << 2) | (referenced ? 0x2 : 0) | 0x1
+    }
+    
+    @inline(__always) static func inFlight(sequence: UInt64, startTime: UInt) -> UInt {
+        return (startTime << 31) | (UInt(sequence & 0x3fff_ffff) << 1)
+    }
+}
+
+fileprivate extension WordPair {
+    var isCommitted: Bool {
+        return second & 0x1 == 1
+    }
+    
+    var isInFlight: Bool {
+        return second != 0 && second & 0x1 == 0
+    }
+    
+    /// In-flight entry whose writer did not finish within `AtomicBlockCacheEntryState.inFlightTimeoutSeconds`
+    func isAbandoned(now: UInt) -> Bool {
+        return isInFlight && (second >> 31) &+ AtomicBlockCacheEntryState.inFlightTimeoutSeconds < now
+    }
+    
+    var isReferenced: Bool {
+        return second & 0x2 == 0x2
+    }
+    
+    /// Last access time in seconds. Only valid for committed entries
+    var accessTime: UInt {
+        return second >> 2
+    }
+    
+    /// Lower values are evicted first. Unreferenced entries before referenced entries, older before newer. In-flight entries last
+    var evictionPriority: UInt {
+        guard isCommitted else {
+            return .max
+        }
+        return (isReferenced ? 1 << 62 : 0) | accessTime
+    }
+}
+
+/**
+ Coarse wall clock in seconds for access times. Access times are stored in the cache file and need to survive restarts, therefore a monotonic clock cannot be used.
+ */
+enum AtomicBlockCacheClock {
+    @inline(__always) static func now() -> UInt {
+        #if os(Linux)
+        var time = timespec()
+        clock_gettime(CLOCK_REALTIME_COARSE, &time)
+        return UInt(time.tv_sec)
+        #else
+        return UInt(time(nil))
+        #endif
+    }
+}
+
 struct AtomicBlockCacheStatistics {
     static let zero = AtomicBlockCacheStatistics(used: 0, free: 0, accessed_15min: 0, accessed_30min: 0, accessed_60min: 0, accessed_3hours: 0, accessed_24hours: 0)
 
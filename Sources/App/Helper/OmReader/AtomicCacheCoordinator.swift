@@ -1,52 +1,231 @@
 import Foundation
+import OmFileFormat
 
 /**
  Coordinate concurrent requests for the same cache key. The atomic block cache is accessed in parallel.
  Requests are only isolated if they need to be fetched from the backend
+ 
+ Optionally, a small in-memory hot tier is used in front of the large mmaped cache. Data from the backend is only stored in the mmaped cache.
+ Runs of blocks are promoted to the hot tier on a later access if TinyLFU estimates a higher access frequency than for the blocks that would be evicted.
+ Cold scans over historical data therefore do not displace frequently used blocks like the latest model runs.
+ 
+ The mmaped cache can optionally store blocks LZ4 compressed in smaller pages. See `CompressedBlockCache`.
  */
 final actor AtomicCacheCoordinator<Backend: AtomicBlockCacheStorable> {
     typealias Key = UInt64
+    /// Large cache tier. Usually an mmaped file on SSD. Contains pages instead of blocks if `compressed` is set
     nonisolated let cache: AtomicBlockCache<Backend>
-    private var queue: [Key: [CheckedContinuation<UnsafeRawBufferPointer, any Error>]] = [:]
+    /// Compressed view on `cache`
+    nonisolated let compressed: CompressedBlockCache<Backend>?
+    /// Small anonymous memory tier for frequently accessed blocks
+    nonisolated let hot: AtomicBlockCache<DataAsClass>?
+    /// Access frequencies for hot tier admission
+    nonisolated let sketch: FrequencySketch?
+    private var queue: [Key: [CheckedContinuation<Void, any Error>]] = [:]
     
-    init(cache: AtomicBlockCache<Backend>) {
+    /// `hotTierSize` in bytes. Set to 0 to disable the hot tier
+    /// If `compressedBlockSize` is set, blocks of this size are stored compressed and `cache` must use a block size of `CompressedBlockCache.pageSize(blockSize:)`
+    init(cache: AtomicBlockCache<Backend>, hotTierSize: Int = 0, compressedBlockSize: Int? = nil) {
         self.cache = cache
         self.queue = .init()
-    }    
+        let compressed = compressedBlockSize.map { CompressedBlockCache(pages: cache, blockSize: $0) }
+        self.compressed = compressed
+        let blockSize = compressed?.blockSize ?? cache.blockSize
+        let hotBlockCount = hotTierSize / (blockSize + AtomicBlockCache<DataAsClass>.slotOverhead)
+        if hotBlockCount >= AtomicBlockCache<DataAsClass>.defaultLookAheadCount {
+            let data = DataAsClass(data: Data(count: hotBlockCount * (blockSize + AtomicBlockCache<DataAsClass>.slotOverhead)))
+            self.hot = AtomicBlockCache(data: data, blockSize: blockSize)
+            self.sketch = FrequencySketch(capacity: hotBlockCount)
+        } else {
+            self.hot = nil
+            self.sketch = nil
+        }
+    }
+    
+    /// Size of uncompressed blocks
+    nonisolated var blockSize: Int {
+        return compressed?.blockSize ?? cache.blockSize
+    }
+    
+    /// Read from the cold tier. Compressed blocks are decompressed into a per-thread buffer
+    nonisolated private func coldWithData<R>(key: Key, count: Int, _ body: (UnsafeRawBufferPointer) throws -> R) rethrows -> R? {
+        if let compressed {
+            return try compressed.withData(key: key, count: UInt64(count), body)
+        }
+        return try cache.withData(key: key, count: UInt64(count), body)
+    }
+    
+    nonisolated private func coldSet<DataIn: ContiguousBytes>(key: Key, value: DataIn) {
+        if let compressed {
+            compressed.set(key: key, value: value)
+            return
+        }
+        cache.set(key: key, value: value)
+    }
+    
+    nonisolated private func coldContains(key: Key, count: Int) -> Bool {
+        if let compressed {
+            return compressed.contains(key: key, count: UInt64(count))
+        }
+        return cache.contains(key: key, count: UInt64(count))
+    }
+    
+    /// Execute `body` with `count` sequentially cached keys from the hot or cold tier without copying. Runs of blocks read from the cold tier may be promoted to the hot tier as a whole.
+    /// `body` may be called more than once if data is modified concurrently.
+    nonisolated func withData<R>(key: Key, count: Int, _ body: (UnsafeRawBufferPointer) throws -> R) rethrows -> R? {
+        guard let hot, let sketch else {
+            return try coldWithData(key: key, count: count, body)
+        }
+        for i in 0..<count {
+            sketch.increment(key: key &+ UInt64(i))
+        }
+        if let result = try hot.withData(key: key, count: UInt64(count), body) {
+            OmMetrics.blockCacheHotHitsTotal.add(count, ordering: .relaxed)
+            return result
+        }
+        guard let result = try coldWithData(key: key, count: count, body) else {
+            return nil
+        }
+        OmMetrics.blockCacheColdHitsTotal.add(count, ordering: .relaxed)
+        promoteIfFrequent(key: key, count: count, hot: hot, sketch: sketch)
+        return result
+    }
+    
+    /**
+     TinyLFU admission: Copy a run of `count` blocks from the cold to the hot tier if the least frequent block of the run has been accessed more often than each block it would replace.
+     Runs are promoted as a whole into the home slots of their keys. The run is then contiguous in the hot tier and a sequential read can be served without copying. Replaced blocks are written back to the cold tier if they were evicted there.
+     */
+    nonisolated private func promoteIfFrequent(key: Key, count: Int, hot: AtomicBlockCache<DataAsClass>, sketch: FrequencySketch) {
+        let frequency = (0..<count).reduce(Int.max) { min($0, sketch.frequency(key: key &+ UInt64($1))) }
+        // Blocks accessed only once are never promoted
+        guard frequency >= 2 else {
+            return
+        }
+        // Runs that would wrap around the end of the hot tier cannot be stored contiguously
+        guard let residents = hot.homeSlotKeys(key: key, count: count) else {
+            return
+        }
+        // Blocks of the same run already in the hot tier are overwritten and not evicted
+        let victims = residents.compactMap { $0 }.filter { $0 &- key >= UInt64(count) }
+        guard victims.allSatisfy({ frequency > sketch.frequency(key: $0) }) else {
+            OmMetrics.blockCacheAdmissionsRejectedTotal.add(1, ordering: .relaxed)
+            return
+        }
+        for victim in victims {
+            if !coldContains(key: victim, count: 1), let data = hot.withData(key: victim, count: 1, { Data($0) }) {
+                coldSet(key: victim, value: data)
+                OmMetrics.blockCacheDemotionsTotal.add(1, ordering: .relaxed)
+            }
+        }
+        guard let data = coldWithData(key: key, count: count, { Data($0) }) else {
+            return
+        }
+        let promoted = data.withUnsafeBytes { data in
+            hot.setRun(key: key, count: count, value: data)
+        }
+        if promoted {
+            OmMetrics.blockCachePromotionsTotal.add(count, ordering: .relaxed)
+        }
+    }
+    
+    /// Check if all keys are cached sequentially in one tier
+    nonisolated func contains(key: Key, count: Int) -> Bool {
+        return hot?.contains(key: key, count: UInt64(count)) == true || coldContains(key: key, count: count)
+    }
+    
+    /// Check if a key is cached in any tier and has been accessed within `maxAccessedAgeInSeconds`
+    nonisolated func contains(key: Key, maxAccessedAgeInSeconds: UInt) -> Bool {
+        if hot?.contains(key: key, maxAccessedAgeInSeconds: maxAccessedAgeInSeconds) == true {
+            return true
+        }
+        if let compressed {
+            return compressed.contains(key: key, maxAccessedAgeInSeconds: maxAccessedAgeInSeconds)
+        }
+        return cache.contains(key: key, maxAccessedAgeInSeconds: maxAccessedAgeInSeconds)
+    }
+    
+    /// Delete keys in all tiers. Returns the number of deleted entries. For compressed blocks, each page is counted
+    @discardableResult
+    nonisolated func delete(key: Key, count: Int, olderThanSeconds: UInt) -> Int {
+        let deletedHot = hot?.delete(key: key, count: UInt64(count), olderThanSeconds: olderThanSeconds) ?? 0
+        if let compressed {
+            return deletedHot + compressed.delete(key: key, count: UInt64(count), olderThanSeconds: olderThanSeconds)
+        }
+        return deletedHot + cache.delete(key: key, count: UInt64(count), olderThanSeconds: olderThanSeconds)
+    }
+    
+    /// Prefetch a range of keys from the cold tier into memory. Returns false if not all keys are cached sequentially in a tier
+    nonisolated func prefetch(key: Key, count: Int) -> Bool {
+        if hot?.contains(key: key, count: UInt64(count)) == true {
+            return true
+        }
+        if let compressed {
+            return compressed.prefetch(key: key, count: UInt64(count))
+        }
+        /// The location is only returned after the seqlock check succeeded. The mmaped region stays valid as long as the cache exists, the prefetch is only a hint
+        guard let location = cache.withData(key: key, count: UInt64(count), { $0 }) else {
+            return false
+        }
+        cache.prefetch(data: location)
+        return true
+    }
     
     /**
      Fetch a range of keys. If consecutive keys are missing, fetch them in one call from the backend
      E.g. Two 64kb HTTP requests can be combined into a single 128kb request
+
+     Cached blocks are copied into a scratch buffer inside `withData`. `dataCallback` is only called after the seqlock check succeeded and therefore exactly once per key with consistent data.
+     If `readCached` is false, cached blocks are only checked for presence and `dataCallback` is only called for blocks fetched from the backend. Used to preload blocks.
      */
     nonisolated func get<T: ContiguousBytes & Sendable>(
         key keyStart: Key,
         count: Int,
+        readCached: Bool = true,
         provider: @Sendable (_ key: Key, _ count: Int) async throws -> T,
         dataCallback: @Sendable (Key, UnsafeRawBufferPointer) -> ()
     ) async throws {
+        let scratch = UnsafeMutableRawBufferPointer.allocate(byteCount: readCached ? blockSize : 0, alignment: 64)
+        defer { scratch.deallocate() }
         /// Check if blocks are already cached
         for i in 0..<count {
             let key = keyStart &+ UInt64(i)
-            guard let value = cache.get(key: key, count: 1) else {
+            guard readCachedBlock(key: key, readCached: readCached, scratch: scratch, dataCallback: dataCallback) else {
                 /// Use actor isolation to ensure data is only fetched once for a given key
-                try await getIsolated(key: key, count: count - i, provider: provider, dataCallback: dataCallback)
+                try await getIsolated(key: key, count: count - i, readCached: readCached, provider: provider, dataCallback: dataCallback)
                 return
             }
-            dataCallback(key, value)
         }
     }
     
+    /// Copy a cached block to `scratch` and call `dataCallback` once the read is consistent. Returns false if the block is not cached
+    nonisolated private func readCachedBlock(key: Key, readCached: Bool, scratch: UnsafeMutableRawBufferPointer, dataCallback: (Key, UnsafeRawBufferPointer) -> ()) -> Bool {
+        guard readCached else {
+            return contains(key: key, count: 1)
+        }
+        guard let count = withData(key: key, count: 1, { data -> Int in
+            UnsafeMutableRawBufferPointer(rebasing: scratch[0 ..< data.count]).copyMemory(from: data)
+            return data.count
+        }) else {
+            return false
+        }
+        dataCallback(key, UnsafeRawBufferPointer(rebasing: scratch[0 ..< count]))
+        return true
+    }
+    
     private func getIsolated<T: ContiguousBytes & Sendable>(
         key keyStart: Key,
         count: Int,
+        readCached: Bool,
         provider: (_ key: Key, _ count: Int) async throws -> T,
         dataCallback: @Sendable (Key, UnsafeRawBufferPointer) -> ()
     ) async throws {
+        let scratch = UnsafeMutableRawBufferPointer.allocate(byteCount: readCached ? blockSize : 0, alignment: 64)
+        defer { scratch.deallocate() }
         
         /// The start position if a range of keys is fetched from the backend
         var keyFetchStart: Int? = nil
         
-        let blockSize = cache.blockSize
+        let blockSize = blockSize
 
         /// Loop over keys, check:
         /// 1. if they are cached
@@ -54,10 +233,8 @@ final actor AtomicCacheCoordinator<Backend: AtomicBlockCacheStorable> {
         /// 3. need to be fetched from backend
         for i in 0..<count {
             let key = (keyStart &+ UInt64(i))
-            let cachedValue = cache.get(key: key, count: 1)
-            let cached = cachedValue != nil
+            let cached = contains(key: key, count: 1)
             let queued = queue[key] != nil
-            var queuedValue: UnsafeRawBufferPointer? = nil
             let isLast = i == count-1
             let cachedOrQueued = cached || queued
             
@@ -75,10 +252,9 @@ final actor AtomicCacheCoordinator<Backend: AtomicBlockCacheStorable> {
             /// The queued call can fail and we need to fail all previously blocked keys
             if queued {
                 do {
-                    let value = try await withCheckedThrowingContinuation(isolation: self) { continuation in
+                    try await withCheckedThrowingContinuation(isolation: self) { continuation in
                         queue[key, default: []].append(continuation)
                     }
-                    queuedValue = value
                 } catch {
                     // If the queued fetch fails, fail all previously blocked keys
                     if let offset = keyFetchStart {
@@ -103,6 +279,7 @@ final actor AtomicCacheCoordinator<Backend: AtomicBlockCacheStorable> {
                 do {
                     /// Contains data for all keys in `toFetch`. Needs to be chunked
                     let fetched = try await provider(fetchStart, count)
+                    OmMetrics.blockCacheMissesTotal.add(count, ordering: .relaxed)
                     fetched.withUnsafeBytes({fetched in
                         let nBlocks = fetched.count.divideRoundedUp(divisor: blockSize)
                         assert(count == nBlocks)
@@ -110,11 +287,12 @@ final actor AtomicCacheCoordinator<Backend: AtomicBlockCacheStorable> {
                             let key = fetchStart &+ UInt64(block)
                             let blockRange = block * blockSize ..< min((block + 1) * blockSize, fetched.count)
                             let blockData = UnsafeRawBufferPointer(rebasing: fetched[blockRange])
-                            let cachedBlock = cache.set(key: key, value: blockData)
+                            coldSet(key: key, value: blockData)
+                            sketch?.increment(key: key)
                             queue.removeValue(forKey: key)?.forEach({
-                                $0.resume(with: .success(cachedBlock))
+                                $0.resume(with: .success(()))
                             })
-                            dataCallback(key, cachedBlock)
+                            dataCallback(key, blockData)
                         }
                     })
                 } catch {
@@ -129,12 +307,17 @@ final actor AtomicCacheCoordinator<Backend: AtomicBlockCacheStorable> {
                 keyFetchStart = nil
             }
             
-            if let cachedValue {
-                dataCallback(key, cachedValue)
-            }
-            
-            if let queuedValue {
-                dataCallback(key, queuedValue)
+            /// Read blocks that were cached or fetched by another call. The block might have been evicted in the meantime and is then fetched again.
+            if cachedOrQueued {
+                guard !readCachedBlock(key: key, readCached: readCached, scratch: scratch, dataCallback: dataCallback) else {
+                    continue
+                }
+                let fetched = try await provider(key, 1)
+                OmMetrics.blockCacheMissesTotal.add(1, ordering: .relaxed)
+                fetched.withUnsafeBytes { fetched in
+                    coldSet(key: key, value: fetched)
+                    dataCallback(key, fetched)
+                }
             }
         }
     }
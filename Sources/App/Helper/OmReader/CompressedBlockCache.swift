@@ -0,0 +1,325 @@
+import Foundation
+import CHelper
+import NIO
+import Synchronization
+
+/// Codec of a block stored in `CompressedBlockCache`
+enum BlockCacheCodec: UInt8 {
+    /// Block did not compress well enough and is stored as is
+    case none = 0
+    case lz4 = 1
+}
+
+/// Header at the beginning of every page. Pages are self-describing, so that pages of different writes can be detected.
+fileprivate struct CompressedBlockPageHeader {
+    /// Random tag of the write. All pages of a block must have the same tag
+    let tag: UInt32
+    let compressedLength: UInt32
+    let uncompressedLength: UInt32
+    let codec: UInt8
+    let pageCount: UInt8
+    let page: UInt8
+
+    static let size = 16
+
+    init(tag: UInt32, compressedLength: UInt32, uncompressedLength: UInt32, codec: UInt8, pageCount: UInt8, page: UInt8) {
+        self.tag = tag
+        self.compressedLength = compressedLength
+        self.uncompressedLength = uncompressedLength
+        self.codec = codec
+        self.pageCount = pageCount
+        self.page = page
+    }
+
+    init(_ data: UnsafeRawBufferPointer) {
+        tag = data.loadUnaligned(fromByteOffset: 0, as: UInt32.self)
+        compressedLength = data.loadUnaligned(fromByteOffset: 4, as: UInt32.self)
+        uncompressedLength = data.loadUnaligned(fromByteOffset: 8, as: UInt32.self)
+        codec = data[12]
+        pageCount = data[13]
+        page = data[14]
+    }
+
+    func store(to data: UnsafeMutableRawBufferPointer) {
+        data.storeBytes(of: tag, toByteOffset: 0, as: UInt32.self)
+        data.storeBytes(of: compressedLength, toByteOffset: 4, as: UInt32.self)
+        data.storeBytes(of: uncompressedLength, toByteOffset: 8, as: UInt32.self)
+        data[12] = codec
+        data[13] = pageCount
+        data[14] = page
+        data[15] = 0
+    }
+}
+
+/// Reusable buffers to compress and decompress blocks. One instance per thread.
+/// Buffers larger than `maxRetainedBytes` are only used for one read and freed afterwards, so that large multi block reads do not keep memory on every thread.
+fileprivate final class CompressedBlockScratch: @unchecked Sendable {
+    static let maxRetainedBytes = 1024 * 1024
+
+    private(set) var compressed = UnsafeMutableRawBufferPointer(start: nil, count: 0)
+    private(set) var decompressed = UnsafeMutableRawBufferPointer(start: nil, count: 0)
+
+    /// Grow buffers if required. Previous content is not preserved
+    func reserve(compressed compressedCount: Int, decompressed decompressedCount: Int) {
+        if compressed.count < compressedCount {
+            compressed.deallocate()
+            compressed = .allocate(byteCount: compressedCount, alignment: 64)
+        }
+        if decompressed.count < decompressedCount {
+            decompressed.deallocate()
+            decompressed = .allocate(byteCount: decompressedCount, alignment: 64)
+        }
+    }
+
+    /// Free buffers larger than `maxCount`
+    func trim(maxCount: Int) {
+        if compressed.count > maxCount {
+            compressed.deallocate()
+            compressed = UnsafeMutableRawBufferPointer(start: nil, count: 0)
+        }
+        if decompressed.count > maxCount {
+            decompressed.deallocate()
+            decompressed = UnsafeMutableRawBufferPointer(start: nil, count: 0)
+        }
+    }
+
+    deinit {
+        compressed.deallocate()
+        decompressed.deallocate()
+    }
+
+    static let threadLocal = ThreadSpecificVariable<CompressedBlockScratch>()
+
+    /// Use the scratch buffers of the current thread. Nested calls get a new instance
+    static func with<R>(_ body: (CompressedBlockScratch) throws -> R) rethrows -> R {
+        let scratch = threadLocal.currentValue ?? CompressedBlockScratch()
+        threadLocal.currentValue = nil
+        defer {
+            scratch.trim(maxCount: maxRetainedBytes)
+            threadLocal.currentValue = scratch
+        }
+        return try body(scratch)
+    }
+}
+
+/// Codec and stored size of cached blocks. Collected per fetch by `OmReaderBlockCache`
+struct BlockCacheCompressionStatistics: Sendable, Equatable {
+    /// Number of blocks stored with LZ4
+    var lz4Blocks = 0
+    /// Number of blocks stored as is, because they did not compress
+    var uncompressedBlocks = 0
+    /// Size of all pages used by the blocks including headers
+    var storedBytes = 0
+    /// Size of the blocks after decompression
+    var uncompressedBytes = 0
+
+    /// Uncompressed size divided by stored size. 1 if no block was found
+    var ratio: Double {
+        return storedBytes > 0 ? Double(uncompressedBytes) / Double(storedBytes) : 1
+    }
+
+    mutating func add(_ other: BlockCacheCompressionStatistics) {
+        lz4Blocks += other.lz4Blocks
+        uncompressedBlocks += other.uncompressedBlocks
+        storedBytes += other.storedBytes
+        uncompressedBytes += other.uncompressedBytes
+    }
+}
+
+/**
+ Store blocks compressed with LZ4 in an `AtomicBlockCache` with smaller pages. A block uses as many pages as required for the compressed data.
+ Sparse or regular blocks take one or two pages instead of the full block size, which increases the number of blocks that fit into the cache.
+
+ Page `i` of a block is stored with key `key * pagesPerBlock + i`. Consecutive blocks therefore use consecutive keys like in the uncompressed cache.
+ Pages are evicted independently. If any page of a block is missing or belongs to a different write, the block is treated as not cached.
+
+ Reads copy the compressed pages into a per-thread scratch buffer and decompress into a second per-thread buffer. Data passed to `withData` is only valid inside the closure.
+ Scratch buffers above 1 MB are freed after each read.
+ */
+struct CompressedBlockCache<Backend: AtomicBlockCacheStorable>: Sendable {
+    /// Underlaying cache for pages
+    let pages: AtomicBlockCache<Backend>
+
+    /// Size of uncompressed blocks
+    let blockSize: Int
+
+    /// Each block can use up to 8 pages. If a block is stored uncompressed, it uses all pages
+    static var pagesPerBlock: Int {
+        return 8
+    }
+
+    /// Page size to store blocks of `blockSize` bytes. Uncompressed blocks and page headers fit exactly into `pagesPerBlock` pages
+    static func pageSize(blockSize: Int) -> Int {
+        return blockSize.divideRoundedUp(divisor: pagesPerBlock) + CompressedBlockPageHeader.size
+    }
+
+    /// `pages` must use a block size of `pageSize(blockSize:)`
+    init(pages: AtomicBlockCache<Backend>, blockSize: Int) {
+        precondition(pages.blockSize == Self.pageSize(blockSize: blockSize), "Page size does not match block size")
+        self.pages = pages
+        self.blockSize = blockSize
+    }
+
+    var pagePayload: Int {
+        return pages.blockSize - CompressedBlockPageHeader.size
+    }
+
+    @inline(__always) func pageKey(_ key: UInt64, page: Int) -> UInt64 {
+        return key &* UInt64(Self.pagesPerBlock) &+ UInt64(page)
+    }
+
+    /// Compress and store a block. Blocks that would use all pages are stored uncompressed
+    func set<DataIn: ContiguousBytes>(key: UInt64, value: DataIn) {
+        value.withUnsafeBytes { bytes in
+            let block = UnsafeRawBufferPointer(rebasing: bytes[0 ..< min(bytes.count, blockSize)])
+            let pagePayload = pagePayload
+            let maxCompressed = pagePayload * (Self.pagesPerBlock - 1)
+            CompressedBlockScratch.with { scratch in
+                scratch.reserve(compressed: max(maxCompressed, block.count), decompressed: pages.blockSize)
+                let compressedLength = block.count == 0 ? 0 : lz4CompressBlock(block.baseAddress!.assumingMemoryBound(to: UInt8.self), block.count, scratch.compressed.baseAddress!.assumingMemoryBound(to: UInt8.self), maxCompressed)
+                let codec: BlockCacheCodec = compressedLength > 0 ? .lz4 : .none
+                let stored: UnsafeRawBufferPointer
+                switch codec {
+                case .lz4:
+                    stored = UnsafeRawBufferPointer(rebasing: scratch.compressed[0 ..< compressedLength])
+                case .none:
+                    stored = block
+                }
+                let pageCount = max(1, stored.count.divideRoundedUp(divisor: pagePayload))
+                let tag = UInt32.random(in: 0 ... .max)
+                let page = UnsafeMutableRawBufferPointer(rebasing: scratch.decompressed[0 ..< pages.blockSize])
+                for i in 0..<pageCount {
+                    let chunk = stored.count == 0 ? stored : UnsafeRawBufferPointer(rebasing: stored[i * pagePayload ..< min((i + 1) * pagePayload, stored.count)])
+                    CompressedBlockPageHeader(tag: tag, compressedLength: UInt32(stored.count), uncompressedLength: UInt32(block.count), codec: codec.rawValue, pageCount: UInt8(pageCount), page: UInt8(i)).store(to: page)
+                    UnsafeMutableRawBufferPointer(rebasing: page[CompressedBlockPageHeader.size ..< CompressedBlockPageHeader.size + chunk.count]).copyMemory(from: chunk)
+                    pages.set(key: pageKey(key, page: i), value: UnsafeRawBufferPointer(rebasing: page[0 ..< CompressedBlockPageHeader.size + chunk.count]))
+                }
+                OmMetrics.blockCacheCompressedBytesTotal.add(pageCount * pages.blockSize, ordering: .relaxed)
+                OmMetrics.blockCacheUncompressedBytesTotal.add(block.count, ordering: .relaxed)
+            }
+        }
+    }
+
+    /// Read header and copy all pages of a block into `scratch.compressed`. Returns nil if any page is missing or pages belong to different writes
+    fileprivate func gatherPages(key: UInt64, scratch: CompressedBlockScratch) -> CompressedBlockPageHeader? {
+        let pagePayload = pagePayload
+        guard let header = pages.withData(key: pageKey(key, page: 0), count: 1, { (page) -> CompressedBlockPageHeader? in
+            let header = CompressedBlockPageHeader(page)
+            guard header.page == 0, header.pageCount >= 1, Int(header.pageCount) <= Self.pagesPerBlock, Int(header.uncompressedLength) <= blockSize, Int(header.compressedLength) <= Int(header.pageCount) * pagePayload else {
+                return nil
+            }
+            scratch.reserve(compressed: Int(header.pageCount) * pagePayload, decompressed: 0)
+            let chunk = min(Int(header.compressedLength), pagePayload)
+            UnsafeMutableRawBufferPointer(rebasing: scratch.compressed[0 ..< chunk]).copyMemory(from: UnsafeRawBufferPointer(rebasing: page[CompressedBlockPageHeader.size ..< CompressedBlockPageHeader.size + chunk]))
+            return header
+        }) ?? nil else {
+            return nil
+        }
+        for i in 1 ..< Int(header.pageCount) {
+            let valid = pages.withData(key: pageKey(key, page: i), count: 1) { (page) -> Bool in
+                let pageHeader = CompressedBlockPageHeader(page)
+                guard pageHeader.tag == header.tag, pageHeader.page == i, pageHeader.compressedLength == header.compressedLength else {
+                    return false
+                }
+                let range = i * pagePayload ..< min((i + 1) * pagePayload, Int(header.compressedLength))
+                UnsafeMutableRawBufferPointer(rebasing: scratch.compressed[range]).copyMemory(from: UnsafeRawBufferPointer(rebasing: page[CompressedBlockPageHeader.size ..< CompressedBlockPageHeader.size + range.count]))
+                return true
+            }
+            guard valid == true else {
+                return nil
+            }
+        }
+        return header
+    }
+
+    /// Decompress `count` sequential blocks into a per-thread buffer and call `body`. Returns nil if any block is not cached.
+    /// Like `AtomicBlockCache`, the buffer always has `count * blockSize` bytes. Bytes after a shorter last block are undefined.
+    func withData<R>(key: UInt64, count: UInt64, _ body: (UnsafeRawBufferPointer) throws -> R) rethrows -> R? {
+        return try CompressedBlockScratch.with { scratch in
+            let blockSize = blockSize
+            scratch.reserve(compressed: 0, decompressed: Int(count) * blockSize)
+            let output = scratch.decompressed
+            for i in 0..<Int(count) {
+                guard let header = gatherPages(key: key &+ UInt64(i), scratch: scratch) else {
+                    return nil
+                }
+                let dest = UnsafeMutableRawBufferPointer(rebasing: output[i * blockSize ..< (i + 1) * blockSize])
+                switch BlockCacheCodec(rawValue: header.codec) {
+                case .lz4:
+                    let decompressed = lz4DecompressBlock(scratch.compressed.baseAddress!.assumingMemoryBound(to: UInt8.self), Int(header.compressedLength), dest.baseAddress!.assumingMemoryBound(to: UInt8.self), Int(header.uncompressedLength))
+                    guard decompressed == Int(header.uncompressedLength) else {
+                        return nil
+                    }
+                case .none:
+                    guard header.compressedLength == header.uncompressedLength else {
+                        return nil
+                    }
+                    dest.copyMemory(from: UnsafeRawBufferPointer(rebasing: scratch.compressed[0 ..< Int(header.compressedLength)]))
+                case nil:
+                    return nil
+                }
+            }
+            return try body(UnsafeRawBufferPointer(rebasing: output[0 ..< Int(count) * blockSize]))
+        }
+    }
+
+    /// Codec and stored size of `count` sequential blocks. Only the header of the first page is read. Blocks that are not cached are skipped
+    func compressionStatistics(key: UInt64, count: UInt64) -> BlockCacheCompressionStatistics {
+        var statistics = BlockCacheCompressionStatistics()
+        for i in 0..<count {
+            guard let header = pages.withData(key: pageKey(key &+ i, page: 0), count: 1, { CompressedBlockPageHeader($0) }) else {
+                continue
+            }
+            switch BlockCacheCodec(rawValue: header.codec) {
+            case .lz4:
+                statistics.lz4Blocks += 1
+            case .none:
+                statistics.uncompressedBlocks += 1
+            case nil:
+                continue
+            }
+            statistics.storedBytes += Int(header.pageCount) * pages.blockSize
+            statistics.uncompressedBytes += Int(header.uncompressedLength)
+        }
+        return statistics
+    }
+
+    /// Check if all pages of `count` sequential blocks are cached
+    func contains(key: UInt64, count: UInt64) -> Bool {
+        for i in 0..<count {
+            guard let pageCount = pages.withData(key: pageKey(key &+ i, page: 0), count: 1, { CompressedBlockPageHeader($0).pageCount }) else {
+                return false
+            }
+            for page in 1 ..< max(1, Int(pageCount)) {
+                guard pages.contains(key: pageKey(key &+ i, page: page), count: 1) else {
+                    return false
+                }
+            }
+        }
+        return true
+    }
+
+    /// Check if the first page of a block has been accessed within `maxAccessedAgeInSeconds`
+    func contains(key: UInt64, maxAccessedAgeInSeconds: UInt) -> Bool {
+        return pages.contains(key: pageKey(key, page: 0), maxAccessedAgeInSeconds: maxAccessedAgeInSeconds)
+    }
+
+    /// Delete all pages of `count` sequential blocks. Returns the number of deleted pages
+    @discardableResult
+    func delete(key: UInt64, count: UInt64, olderThanSeconds: UInt) -> Int {
+        return pages.delete(key: pageKey(key, page: 0), count: count &* UInt64(Self.pagesPerBlock), olderThanSeconds: olderThanSeconds)
+    }
+
+    /// Prefetch all pages of `count` sequential blocks. Returns false if not all blocks are cached
+    func prefetch(key: UInt64, count: UInt64) -> Bool {
+        guard contains(key: key, count: count) else {
+            return false
+        }
+        for i in 0..<count {
+            for page in 0..<Self.pagesPerBlock {
+                pages.prefetch(key: pageKey(key &+ i, page: page))
+            }
+        }
+        return true
+    }
+}
@@ -0,0 +1,159 @@
+import Foundation
+import NIOConcurrencyHelpers
+
+/**
+ In-memory LRU cache for decompressed chunks. The block cache only stores compressed bytes, therefore every read of a hot chunk would decompress it again.
+
+ Keys combine the file version with the chunk position, so that modified files never return stale data. See `RemoteFileManager.withVersion`.
+ Entries are only admitted after repeated access, tracked by a `FrequencySketch`. Chunks read only once do not evict frequently used chunks.
+
+ The cache is split into shards with a lock and an LRU list each. The size of each shard is limited in bytes.
+ */
+final class DecompressedChunkCache: Sendable {
+    /// LRU list linked by index. Evicted slots are reused
+    fileprivate struct Shard {
+        var index = [UInt64: Int]()
+        var keys = [UInt64]()
+        var values = [[Float]]()
+        var prev = [Int]()
+        var next = [Int]()
+        var free = [Int]()
+        /// Most recently used entry
+        var head = -1
+        /// Least recently used entry
+        var tail = -1
+        var bytes = 0
+
+        mutating func get(key: UInt64) -> [Float]? {
+            guard let i = index[key] else {
+                return nil
+            }
+            moveToFront(i)
+            return values[i]
+        }
+
+        mutating func set(key: UInt64, value: [Float], capacity: Int) {
+            if let i = index[key] {
+                bytes += (value.count - values[i].count) * MemoryLayout<Float>.stride
+                values[i] = value
+                moveToFront(i)
+            } else {
+                let i: Int
+                if let slot = free.popLast() {
+                    i = slot
+                    keys[i] = key
+                    values[i] = value
+                } else {
+                    i = keys.count
+                    keys.append(key)
+                    values.append(value)
+                    prev.append(-1)
+                    next.append(-1)
+                }
+                index[key] = i
+                bytes += value.count * MemoryLayout<Float>.stride
+                pushFront(i)
+            }
+            while bytes > capacity, tail != -1 {
+                let i = tail
+                unlink(i)
+                index.removeValue(forKey: keys[i])
+                bytes -= values[i].count * MemoryLayout<Float>.stride
+                values[i] = []
+                free.append(i)
+                OmMetrics.chunkCacheEvictionsTotal.add(1, ordering: .relaxed)
+            }
+        }
+
+        private mutating func moveToFront(_ i: Int) {
+            guard head != i else {
+                return
+            }
+            unlink(i)
+            pushFront(i)
+        }
+
+        private mutating func pushFront(_ i: Int) {
+            prev[i] = -1
+            next[i] = head
+            if head != -1 {
+                prev[head] = i
+            }
+            head = i
+            if tail == -1 {
+                tail = i
+            }
+        }
+
+        private mutating func unlink(_ i: Int) {
+            if prev[i] != -1 {
+                next[prev[i]] = next[i]
+            } else {
+                head = next[i]
+            }
+            if next[i] != -1 {
+                prev[next[i]] = prev[i]
+            } else {
+                tail = prev[i]
+            }
+            prev[i] = -1
+            next[i] = -1
+        }
+    }
+
+    /// Maximum size of all decompressed chunks in bytes
+    let capacityBytes: Int
+
+    /// Chunks larger than this are not cached
+    let maxEntryBytes: Int
+
+    private let shards: [NIOLockedValueBox<Shard>]
+
+    private let sketch: FrequencySketch
+
+    /// `expectedEntryBytes` is used to size the frequency sketch
+    init(capacityBytes: Int, shardCount: Int = 16, expectedEntryBytes: Int = 64 * 1024) {
+        let shardCount = Swift.max(shardCount, 1).nextPowerOf2
+        self.capacityBytes = capacityBytes
+        self.maxEntryBytes = capacityBytes / shardCount / 8
+        self.shards = (0..<shardCount).map { _ in NIOLockedValueBox(Shard()) }
+        self.sketch = FrequencySketch(capacity: Swift.max(capacityBytes / expectedEntryBytes, 16))
+    }
+
+    /// Bytes currently used by all shards
+    var usedBytes: Int {
+        return shards.reduce(0) { $0 + $1.withLockedValue { $0.bytes } }
+    }
+
+    @inline(__always) private func shard(key: UInt64) -> NIOLockedValueBox<Shard> {
+        // splitmix64 finaliser
+        var x = key &+ 0x9E37_79B9_7F4A_7C15
+        x = (x ^ (x >> 30)) &* 0xBF58_476D_1CE4_E5B9
+        x = (x ^ (x >> 27)) &* 0x94D0_49BB_1331_11EB
+        x = x ^ (x >> 31)
+        return shards[Int(x & UInt64(shards.count - 1))]
+    }
+
+    /// Get a decompressed chunk and record the access for admission
+    func get(key: UInt64) -> [Float]? {
+        sketch.increment(key: key)
+        guard let value = shard(key: key).withLockedValue({ $0.get(key: key) }) else {
+            OmMetrics.chunkCacheMissesTotal.add(1, ordering: .relaxed)
+            return nil
+        }
+        OmMetrics.chunkCacheHitsTotal.add(1, ordering: .relaxed)
+        OmMetrics.chunkCacheBytesSavedTotal.add(value.count * MemoryLayout<Float>.stride, ordering: .relaxed)
+        return value
+    }
+
+    /// True if a chunk of `bytes` was accessed repeatedly and should be decompressed entirely and stored
+    func shouldAdmit(key: UInt64, bytes: Int) -> Bool {
+        return bytes <= maxEntryBytes && sketch.frequency(key: key) >= 2
+    }
+
+    /// Store a decompressed chunk. Least recently used chunks of the same shard are evicted
+    func set(key: UInt64, value: [Float]) {
+        let capacity = capacityBytes / shards.count
+        shard(key: key).withLockedValue { $0.set(key: key, value: value, capacity: capacity) }
+    }
+}
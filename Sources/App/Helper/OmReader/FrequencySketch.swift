@@ -0,0 +1,91 @@
+import Foundation
+import Synchronization
+
+/**
+ Approximate access frequency of cache keys for TinyLFU admission. Count-min sketch with 4 bit counters and 4 hash functions.
+
+ Each 64 bit word holds 16 counters and is updated with compare-and-swap. Saturated counters are not written again, therefore very hot keys do not cause cache line contention.
+ After `sampleSize` increments all counters are halved, so that the frequency of keys that are no longer accessed decays.
+ */
+final class FrequencySketch: @unchecked Sendable {
+    private let bytes: UnsafeMutableRawBufferPointer
+
+    private let table: UnsafeMutableBufferPointer<Atomic<UInt64>>
+
+    /// Number of increments before all counters are halved
+    let sampleSize: Int
+
+    private let additions = Atomic<Int>(0)
+
+    /// `capacity` should be the number of keys in the cache that uses this sketch
+    init(capacity: Int) {
+        let words = Swift.max(capacity, 16).nextPowerOf2
+        let bytes = UnsafeMutableRawBufferPointer.allocate(byteCount: words * MemoryLayout<UInt64>.stride, alignment: 64)
+        bytes.initializeMemory(as: UInt8.self, repeating: 0)
+        self.bytes = bytes
+        self.table = bytes.assumingMemoryBound(to: Atomic<UInt64>.self)
+        self.sampleSize = 10 * Swift.max(capacity, 16)
+    }
+
+    deinit {
+        bytes.deallocate()
+    }
+
+    /// Word index and bit shift of the counter for hash function `i`
+    @inline(__always) private func position(key: UInt64, _ i: Int) -> (word: Int, shift: UInt64) {
+        // splitmix64 finaliser with a different seed for each hash function
+        var x = key &+ UInt64(i + 1) &* 0x9E37_79B9_7F4A_7C15
+        x = (x ^ (x >> 30)) &* 0xBF58_476D_1CE4_E5B9
+        x = (x ^ (x >> 27)) &* 0x94D0_49BB_1331_11EB
+        x = x ^ (x >> 31)
+        return (Int(truncatingIfNeeded: x) & (table.count - 1), (x >> 60) * 4)
+    }
+
+    /// Estimated number of accesses of `key` since the last reset. Maximum 15
+    func frequency(key: UInt64) -> Int {
+        var frequency = 15
+        for i in 0..<4 {
+            let (word, shift) = position(key: key, i)
+            let counter = Int((table[word].load(ordering: .relaxed) >> shift) & 0xF)
+            frequency = Swift.min(frequency, counter)
+        }
+        return frequency
+    }
+
+    /// Record an access to `key`
+    func increment(key: UInt64) {
+        var added = false
+        for i in 0..<4 {
+            let (word, shift) = position(key: key, i)
+            var value = table[word].load(ordering: .relaxed)
+            while (value >> shift) & 0xF < 15 {
+                let exchange = table[word].compareExchange(expected: value, desired: value &+ (1 << shift), ordering: .relaxed)
+                if exchange.exchanged {
+                    added = true
+                    break
+                }
+                value = exchange.original
+            }
+        }
+        guard added else {
+            return
+        }
+        if additions.wrappingAdd(1, ordering: .relaxed).newValue % sampleSize == 0 {
+            reset()
+        }
+    }
+
+    /// Halve all counters
+    private func reset() {
+        for word in 0..<table.count {
+            var value = table[word].load(ordering: .relaxed)
+            while true {
+                let exchange = table[word].compareExchange(expected: value, desired: (value >> 1) & 0x7777_7777_7777_7777, ordering: .relaxed)
+                if exchange.exchanged {
+                    break
+                }
+                value = exchange.original
+            }
+        }
+    }
+}
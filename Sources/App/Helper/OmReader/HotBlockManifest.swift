@@ -0,0 +1,119 @@
+import Foundation
+import NIOConcurrencyHelpers
+
+/**
+ List of recently accessed blocks of remote files. Written periodically next to the block cache file.
+
+ All API processes on a host share the block cache and the manifest. Each process merges its active blocks into the existing manifest, entries of other processes are kept until they are older than `maxAgeSeconds`.
+ After a restart, the blocks are loaded again by `RemoteFileManager`. If a remote file was modified in the meantime, the new file version is fetched. Blocks that are still cached are not downloaded again.
+ */
+struct HotBlockManifest: Codable, Sendable {
+    struct File: Codable, Sendable {
+        let url: String
+        /// Consecutive ranges of block numbers
+        let blocks: [Range<Int>]
+        /// Unix timestamp when the blocks were last reported as active. Nil for manifests of older versions
+        var lastAccess: Int?
+    }
+
+    /// Block size of the cache. Manifests written with a different block size are ignored
+    let blockSize: Int
+    let files: [File]
+    /// Unix timestamp of the last write by any process
+    var updated: Int?
+
+    /// Read a manifest. Returns nil if the file is missing, invalid or written with a different block size
+    static func read(path: String, blockSize: Int) -> HotBlockManifest? {
+        guard FileManager.default.fileExists(atPath: path), let manifest = try? HotBlockManifest.readFrom(path: path) else {
+            return nil
+        }
+        return manifest.blockSize == blockSize ? manifest : nil
+    }
+
+    /// Add active blocks of this process. Blocks of the same file are combined. Entries older than `maxAgeSeconds` are removed
+    func merged(with active: [File], now: Int, maxAgeSeconds: Int) -> HotBlockManifest {
+        var files = [String: File]()
+        for file in self.files + active.map({ File(url: $0.url, blocks: $0.blocks, lastAccess: now) }) {
+            guard let lastAccess = file.lastAccess, lastAccess >= now - maxAgeSeconds else {
+                continue
+            }
+            guard let existing = files[file.url] else {
+                files[file.url] = file
+                continue
+            }
+            files[file.url] = File(url: file.url, blocks: Self.union(existing.blocks + file.blocks), lastAccess: max(lastAccess, existing.lastAccess ?? 0))
+        }
+        return HotBlockManifest(blockSize: blockSize, files: files.values.sorted(by: { $0.url < $1.url }), updated: now)
+    }
+
+    /// Sort and combine overlapping or adjacent ranges
+    static func union(_ ranges: [Range<Int>]) -> [Range<Int>] {
+        var result = [Range<Int>]()
+        for range in ranges.sorted(by: { $0.lowerBound < $1.lowerBound }) {
+            if let last = result.last, last.upperBound >= range.lowerBound {
+                result[result.count - 1] = last.lowerBound ..< max(last.upperBound, range.upperBound)
+                continue
+            }
+            result.append(range)
+        }
+        return result
+    }
+
+    /**
+     Merge active blocks into the manifest at `path`. Read, merge and write are guarded by an exclusive lock on `path.lock`, because multiple processes update the same manifest.
+     The manifest is replaced if it was written with a different block size.
+     */
+    static func update(path: String, blockSize: Int, active: [File], now: Int, maxAgeSeconds: Int) async throws {
+        try await withLock(path: "\(path).lock", nonBlocking: false) {
+            let existing = read(path: path, blockSize: blockSize) ?? HotBlockManifest(blockSize: blockSize, files: [])
+            try existing.merged(with: active, now: now, maxAgeSeconds: maxAgeSeconds).writeTo(path: path)
+        }
+    }
+
+    /// Execute `fn` while holding an exclusive `flock` on `path`. With `nonBlocking`, returns nil if another process holds the lock
+    @discardableResult
+    static func withLock<T>(path: String, nonBlocking: Bool, _ fn: () async throws -> T) async throws -> T? {
+        let fd = open(path, O_RDWR | O_CREAT, 0o644)
+        guard fd != -1 else {
+            throw HotBlockManifestError.cannotLockFile(file: path, error: String(cString: strerror(errno)))
+        }
+        defer { close(fd) }
+        guard flock(fd, nonBlocking ? LOCK_EX | LOCK_NB : LOCK_EX) == 0 else {
+            if nonBlocking && errno == EWOULDBLOCK {
+                return nil
+            }
+            throw HotBlockManifestError.cannotLockFile(file: path, error: String(cString: strerror(errno)))
+        }
+        return try await fn()
+    }
+}
+
+enum HotBlockManifestError: Error {
+    case cannotLockFile(file: String, error: String)
+}
+
+/// Limit the download throughput of cache warm-up. Concurrent callers are delayed in order so that the total rate stays below `bytesPerSecond`
+final class ByteRateLimiter: Sendable {
+    /// 0 disables the limit
+    let bytesPerSecond: Int
+
+    private let nextAvailable = NIOLockedValueBox(ContinuousClock.now)
+
+    init(bytesPerSecond: Int) {
+        self.bytesPerSecond = bytesPerSecond
+    }
+
+    /// Wait until `bytes` can be transferred
+    func wait(bytes: Int) async throws {
+        guard bytesPerSecond > 0 else {
+            return
+        }
+        let duration = Duration.seconds(Double(bytes) / Double(bytesPerSecond))
+        let start = nextAvailable.withLockedValue { next -> ContinuousClock.Instant in
+            let start = Swift.max(next, ContinuousClock.now)
+            next = start + duration
+            return start
+        }
+        try await Task.sleep(until: start, clock: .continuous)
+    }
+}
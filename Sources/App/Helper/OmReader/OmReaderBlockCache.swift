@@ -1,6 +1,14 @@
 import OmFileFormat
 import Foundation
+import NIOConcurrencyHelpers
 
+/// Statistics of `OmReaderBlockCache.fetch` calls. Zero-copy reads of cached blocks are not counted
+struct OmReaderBlockCacheFetchStatistics: Sendable, Equatable {
+    var fetches = 0
+    var blocks = 0
+    /// Codec and compression ratio of fetched blocks. Only set if the cache stores blocks compressed
+    var compression = BlockCacheCompressionStatistics()
+}
 
 /**
  Chunk data into blocks of 64k and store blocks in a KV cache.
@@ -11,23 +19,28 @@ import Foundation
  Cache keys are linear for 8MB (super block). Linear cache keys can be stored linearly by the underlaying atomic cache. This is the default AWS S3 `multipart_chunksize`.
  Consecutive reads of blocks are merged together. E.g. Two 64 kb reads are merged to a single 128 kb read. This reduces latency if data across multiple blocks is read.
  Only reads within the 8MB super block are merged to optimise for AWS S3 multipart chunk size.
+ 
+ Backend requests of concurrent readers can additionally be merged by `OmReaderRangeCoalescer` if they are close to each other.
  */
 final class OmReaderBlockCache<Backend: OmFileReaderBackend, Cache: AtomicBlockCacheStorable>: OmFileReaderBackend, Sendable {
     let backend: Backend
     private let cache: AtomicCacheCoordinator<Cache>
     let cacheKey: UInt64
+    private let coalescer: OmReaderRangeCoalescer<Backend>
+    private let statistics = NIOLockedValueBox(OmReaderBlockCacheFetchStatistics())
     
     typealias DataType = Data
     
-    init(backend: Backend, cache: AtomicCacheCoordinator<Cache>, cacheKey: UInt64) {
+    init(backend: Backend, cache: AtomicCacheCoordinator<Cache>, cacheKey: UInt64, coalescing: OmReaderRangeCoalescing = .disabled) {
         self.backend = backend
         self.cache = cache
         self.cacheKey = cacheKey
+        self.coalescer = OmReaderRangeCoalescer(backend: backend, options: coalescing)
     }
     
     /// Number of  64 kb block to form a super block. Aligned to 8MB.
     @inlinable var superBlockLength: Int {
-        return 8*1024*1024 / cache.cache.blockSize
+        return 8*1024*1024 / cache.blockSize
     }
     
     /// Calculate cache key for block. 100 blocks are stored consecutive in cache.
@@ -36,7 +49,7 @@ final class OmReaderBlockCache<Backend: OmFileReaderBackend, Cache: AtomicBlockC
     }
     
     func prefetchData(offset: Int, count: Int) async throws {
-        let blockSize = cache.cache.blockSize
+        let blockSize = cache.blockSize
         let dataRange = offset ..< (offset + count)
         let fileSize = self.backend.count
         let blocks = dataRange.divideRoundedUp(divisor: blockSize)
@@ -44,30 +57,22 @@ final class OmReaderBlockCache<Backend: OmFileReaderBackend, Cache: AtomicBlockC
         
         /// Check if all blocks are available sequentially in cache
         let sameSuperBlock = superBlocks.count == 1
-        if sameSuperBlock, let ptr = cache.cache.get(key: calculateCacheKey(block: blocks.lowerBound), count: UInt64(blocks.count)) {
-            let offset = cache.cache.data.withMutableUnsafeBytes { data in
-                data.distance(from: data.startIndex, to: ptr.startIndex)
-            }
-            cache.cache.data.prefetchData(offset: offset, count: ptr.count)
+        if sameSuperBlock, cache.prefetch(key: calculateCacheKey(block: blocks.lowerBound), count: blocks.count) {
             return
         }
         /// Prefetch data from the HTTP backend in a detached task
         Task {
             for superBlock in superBlocks {
-                let superKey = cacheKey.addFnv1aHash(UInt64(superBlock))
                 let blocks = (superBlock * superBlockLength ..< (superBlock + 1) * superBlockLength).clamped(to: blocks)
-                let keyStart = superKey &+ UInt64(blocks.lowerBound)
+                let keyStart = calculateCacheKey(block: blocks.lowerBound)
                 //print("withData blocks \(blocks)")
-                try await cache.get(key: keyStart, count: blocks.count, provider: ({ (key, count) in
+                try await cache.get(key: keyStart, count: blocks.count, readCached: false, provider: ({ (key, count) in
                     let block = blocks.lowerBound + Int(key &- keyStart)
                     let fileRange = block * blockSize ..< min((block + count) * blockSize, fileSize)
-                    return try await backend.getData(offset: fileRange.lowerBound, count: fileRange.count)
-                }), dataCallback: {(_, value) in
-                    let offset = cache.cache.data.withMutableUnsafeBytes { data in
-                        data.distance(from: data.startIndex, to: value.startIndex)
-                    }
-                    cache.cache.data.prefetchData(offset: offset, count: value.count)
-                })
+                    return try await coalescer.getData(offset: fileRange.lowerBound, count: fileRange.count)
+                }), dataCallback: { _,_ in })
+                // Blocks that were already cached are prefetched in the tier that holds them
+                _ = cache.prefetch(key: keyStart, count: blocks.count)
             }
         }
     }
@@ -76,42 +81,47 @@ final class OmReaderBlockCache<Backend: OmFileReaderBackend, Cache: AtomicBlockC
         return backend.count
     }
     
-    fileprivate enum DataOwnership {
-        /// Only usable for a short time. Must not be freed.
-        case borrowed(UnsafeRawBufferPointer)
-        
-        /// Must be freed after use
-        case owned(UnsafeRawBufferPointer)
+    /// If all blocks are available sequentially in cache, call `fn` directly on cached data (zero-copy). `fn` may be called again if data is modified concurrently.
+    fileprivate func withCachedData<T>(offset: Int, count: Int, fn: (UnsafeRawBufferPointer) throws -> T) rethrows -> T? {
+        let blockSize = cache.blockSize
+        let dataRange = offset ..< (offset + count)
+        let blocks = dataRange.divideRoundedUp(divisor: blockSize)
+        let superBlocks = dataRange.divideRoundedUp(divisor: blockSize * superBlockLength)
+        guard superBlocks.count == 1 else {
+            return nil
+        }
+        return try cache.withData(key: calculateCacheKey(block: blocks.lowerBound), count: blocks.count) { ptr in
+            let blockRange = blocks.lowerBound * blockSize ..< blocks.upperBound * blockSize
+            let range = dataRange.intersect(fileTime: blockRange)!
+            return try fn(UnsafeRawBufferPointer(rebasing: ptr[range.file]))
+        }
     }
     
-    /// Fetch data from cache or backend. If data is cached, return a temporary pointer. Otherwise allocate a new buffer which must be freed afterwards
-    fileprivate func fetch(offset: Int, count: Int) async throws -> DataOwnership {
-        let blockSize = cache.cache.blockSize
+    /// Fetch statistics accumulated over all calls to `withData` and `getData` that were not served zero-copy
+    func fetchStatistics() -> OmReaderBlockCacheFetchStatistics {
+        return statistics.withLockedValue { $0 }
+    }
+    
+    /// Fetch data from cache or backend into a new buffer which must be freed afterwards
+    fileprivate func fetch(offset: Int, count: Int) async throws -> UnsafeRawBufferPointer {
+        let blockSize = cache.blockSize
         let dataRange = offset ..< (offset + count)
         let fileSize = self.backend.count
         let blocks = dataRange.divideRoundedUp(divisor: blockSize)
         let superBlocks = dataRange.divideRoundedUp(divisor: blockSize * superBlockLength)
         //print("withData superBlocks \(superBlocks), \(blocks.count) blocks \(blocks), offset \(offset), count \(count)")
         
-        /// Check if all blocks are available sequentially in cache
-        let sameSuperBlock = superBlocks.count == 1
-        if sameSuperBlock, let ptr = cache.cache.get(key: calculateCacheKey(block: blocks.lowerBound), count: UInt64(blocks.count)) {
-            let blockRange = blocks.lowerBound * blockSize ..< blocks.upperBound * blockSize
-            let range = dataRange.intersect(fileTime: blockRange)!
-            return .borrowed(UnsafeRawBufferPointer(rebasing: ptr[range.file]))
-        }
-        
         let data = UnsafeMutableRawBufferPointer.allocate(byteCount: count, alignment: 1)
+        var compression = BlockCacheCompressionStatistics()
         do {
             for superBlock in superBlocks {
-                let superKey = cacheKey.addFnv1aHash(UInt64(superBlock))
                 let blocks = (superBlock * superBlockLength ..< (superBlock + 1) * superBlockLength).clamped(to: blocks)
-                let keyStart = superKey &+ UInt64(blocks.lowerBound)
+                let keyStart = calculateCacheKey(block: blocks.lowerBound)
                 //print("withData blocks \(blocks)")
                 try await cache.get(key: keyStart, count: blocks.count, provider: ({ (key, count) in
                     let block = blocks.lowerBound + Int(key &- keyStart)
                     let fileRange = block * blockSize ..< min((block + count) * blockSize, fileSize)
-                    return try await backend.getData(offset: fileRange.lowerBound, count: fileRange.count)
+                    return try await coalescer.getData(offset: fileRange.lowerBound, count: fileRange.count)
                 }), dataCallback: {(key, value) in
                     let block = blocks.lowerBound + Int(key &- keyStart)
                     let fileRange = block * blockSize ..< min((block + 1) * blockSize, fileSize)
@@ -119,53 +129,69 @@ final class OmReaderBlockCache<Backend: OmFileReaderBackend, Cache: AtomicBlockC
                     let dest = UnsafeMutableRawBufferPointer(rebasing: data[range.array])
                     value[range.file].copyBytes(to: dest)
                 })
+                if let compressed = cache.compressed {
+                    compression.add(compressed.compressionStatistics(key: keyStart, count: UInt64(blocks.count)))
+                }
             }
         } catch {
             data.deallocate()
             throw error
         }
-        return .owned(UnsafeRawBufferPointer(data))
+        statistics.withLockedValue {
+            $0.fetches += 1
+            $0.blocks += blocks.count
+            $0.compression.add(compression)
+        }
+        return UnsafeRawBufferPointer(data)
     }
     
     /// Execute a closure with retrieved data. If data is cached, the underlaying data is used to call be closure (zero-copy).
     func withData<T: Sendable>(offset: Int, count: Int, fn: @Sendable (UnsafeRawBufferPointer) throws -> T) async throws -> T {
-        switch try await fetch(offset: offset, count: count) {
-        case .borrowed(let data):
-            return try fn(data)
-        case .owned(let data):
-            defer { data.deallocate() }
-            return try fn(data)
+        if let result = try withCachedData(offset: offset, count: count, fn: fn) {
+            return result
         }
+        let data = try await fetch(offset: offset, count: count)
+        defer { data.deallocate() }
+        return try fn(data)
     }
     
     /// Get a exclusive `Data` object which is retrained independent from the underlaying cache.
     func getData(offset: Int, count: Int) async throws -> Data {
-        switch try await fetch(offset: offset, count: count) {
-        case .borrowed(let data):
-            // Copy data
-            return Data(data)
-        case .owned(let data):
-            // Reuse existing buffer
-            let ptr = UnsafeMutableRawPointer(mutating: data.baseAddress!)
-            return Data(bytesNoCopy: ptr, count: count, deallocator: .free)
+        if let data = withCachedData(offset: offset, count: count, fn: { Data($0) }) {
+            return data
         }
+        // Reuse existing buffer
+        let data = try await fetch(offset: offset, count: count)
+        let ptr = UnsafeMutableRawPointer(mutating: data.baseAddress!)
+        return Data(bytesNoCopy: ptr, count: count, deallocator: .free)
     }
     
     /// Which blocks have been accessed recently. When a file is modified on the remote server, use a list of blocks to preload the new file.
     func listOfActiveBlocks(maxAgeSeconds: UInt) -> [Int] {
-        // TODO: return consecutive blocks as [Range]
-        
+        return listOfActiveBlockRanges(maxAgeSeconds: maxAgeSeconds).flatMap { $0 }
+    }
+    
+    /// Recently accessed blocks as consecutive ranges of block numbers. Used for the hot block manifest.
+    func listOfActiveBlockRanges(maxAgeSeconds: UInt) -> [Range<Int>] {
         let totalCount = self.backend.count
-        let blockSize = cache.cache.blockSize
-        let blocks = 0..<totalCount.divideRoundedUp(divisor: blockSize)
-        return blocks.compactMap({ block in
-            return cache.cache.get(key: calculateCacheKey(block: block), maxAccessedAgeInSeconds: maxAgeSeconds).map{_ in block}
-        })
+        let blockSize = cache.blockSize
+        var ranges = [Range<Int>]()
+        for block in 0..<totalCount.divideRoundedUp(divisor: blockSize) {
+            guard cache.contains(key: calculateCacheKey(block: block), maxAccessedAgeInSeconds: maxAgeSeconds) else {
+                continue
+            }
+            if let last = ranges.last, last.upperBound == block {
+                ranges[ranges.count - 1] = last.lowerBound ..< block + 1
+                continue
+            }
+            ranges.append(block ..< block + 1)
+        }
+        return ranges
     }
     
     /// Remove cached data blocks that are older then a couple of seconds. Return the number of deleted blocks
     func deleteCachedBlocks(olderThanSeconds: UInt) -> Int {
-        let blockSize = cache.cache.blockSize
+        let blockSize = cache.blockSize
         let dataRange = 0..<backend.count
         let blocks = dataRange.divideRoundedUp(divisor: blockSize)
         let superBlocks = dataRange.divideRoundedUp(divisor: blockSize * superBlockLength)
@@ -173,30 +199,45 @@ final class OmReaderBlockCache<Backend: OmFileReaderBackend, Cache: AtomicBlockC
         for superBlock in superBlocks {
             let superKey = cacheKey.addFnv1aHash(UInt64(superBlock))
             let blocks = (superBlock * superBlockLength ..< (superBlock + 1) * superBlockLength).clamped(to: blocks)
-            deletedCount += cache.cache.delete(key: superKey, count: UInt64(blocks.count), olderThanSeconds: olderThanSeconds)
+            deletedCount += cache.delete(key: superKey, count: blocks.count, olderThanSeconds: olderThanSeconds)
         }
         return deletedCount
     }
     
     /// Load list of blocks into cache. This is used to prefetch data after rotating files.
-    func preloadBlocks(blocks: [Int]) async throws {
-        // TODO: preload consecutive blocks as [Range<Int>]
-        
-        let blockSize = cache.cache.blockSize
+    /// Consecutive blocks within a super block are fetched with one request. Ranges are loaded concurrently, so that the coalescer can merge nearby ranges.
+    /// Downloads are delayed by `limiter` to limit the impact on API requests. Blocks that are already cached are not downloaded.
+    func preloadBlocks(blocks: [Int], nConcurrent: Int = 4, limiter: ByteRateLimiter? = nil) async throws {
+        let blockSize = cache.blockSize
         let totalCount = self.backend.count
         let totalBlockCount = totalCount.divideRoundedUp(divisor: blockSize)
-        for block in blocks {
-            guard block < totalBlockCount else {
-                /// The list of blocks is from an older file revision.
-                /// The new file could be smaller and contain fewer blocks.
+        let superBlockLength = superBlockLength
+        
+        /// The list of blocks is from an older file revision.
+        /// The new file could be smaller and contain fewer blocks.
+        var ranges = [Range<Int>]()
+        for block in blocks.filter({ $0 < totalBlockCount }).sorted() {
+            if let last = ranges.last, last.upperBound == block, last.lowerBound / superBlockLength == block / superBlockLength {
+                ranges[ranges.count - 1] = last.lowerBound ..< block + 1
                 continue
             }
-            let blockRange = block * blockSize ..< min((block + 1) * blockSize, totalCount)
-            let _ = try await cache.get(
-                key: calculateCacheKey(block: block),
-                count: 1,
-                provider: ({ _,_ in
-                    return try await backend.getData(offset: blockRange.lowerBound, count: blockRange.count)
+            if let last = ranges.last, last.contains(block) {
+                continue
+            }
+            ranges.append(block ..< block + 1)
+        }
+        try await ranges.foreachConcurrent(nConcurrent: nConcurrent) { blocks in
+            let keyStart = self.calculateCacheKey(block: blocks.lowerBound)
+            try await self.cache.get(
+                key: keyStart,
+                count: blocks.count,
+                readCached: false,
+                provider: ({ key, count in
+                    let block = blocks.lowerBound + Int(key &- keyStart)
+                    let fileRange = block * blockSize ..< min((block + count) * blockSize, totalCount)
+                    try await limiter?.wait(bytes: fileRange.count)
+                    OmMetrics.blockCachePreloadBytesTotal.add(fileRange.count, ordering: .relaxed)
+                    return try await self.coalescer.getData(offset: fileRange.lowerBound, count: fileRange.count)
                 }),
                 dataCallback: { _,_ in }
             )
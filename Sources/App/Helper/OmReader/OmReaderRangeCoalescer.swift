@@ -0,0 +1,115 @@
+import Foundation
+import OmFileFormat
+
+/// Settings to merge backend range requests
+struct OmReaderRangeCoalescing: Sendable {
+    /// Ranges with a gap of up to this number of bytes are merged. Bytes in the gap are downloaded and discarded
+    let maxGap: Int
+
+    /// Maximum size of a merged request. Single requests larger than this are not split
+    let maxSize: Int
+
+    /// Time to wait for further requests before requests are sent to the backend. With zero, only requests that are enqueued before the flush task runs are merged
+    let window: Duration
+
+    /// Send every request directly to the backend
+    static let disabled = OmReaderRangeCoalescing(maxGap: 0, maxSize: 0, window: .zero)
+
+    var isEnabled: Bool {
+        return maxSize > 0
+    }
+}
+
+/// Part of a backend response. Multiple slices may share the same merged response without copying
+struct OmReaderRangeSlice<DataType: ContiguousBytes & Sendable>: ContiguousBytes, Sendable {
+    let data: DataType
+    let range: Range<Int>
+
+    func withUnsafeBytes<R>(_ body: (UnsafeRawBufferPointer) throws -> R) rethrows -> R {
+        return try data.withUnsafeBytes { bytes in
+            try body(UnsafeRawBufferPointer(rebasing: bytes[range.clamped(to: 0..<bytes.count)]))
+        }
+    }
+}
+
+/**
+ Merge concurrent range requests to the same backend file. The first request waits `window` for further requests. Without a window, the flush runs in a new task, so requests issued at the same time, e.g. by `mapConcurrent`, are still merged without adding latency.
+ All waiting requests are then sorted and adjacent or nearby ranges are combined into one backend request as long as the gap is at most `maxGap` and the merged range at most `maxSize`.
+ The response is shared by all merged requests.
+
+ This reduces the number of HTTP GET requests if many requests read neighbouring chunks of the same file, e.g. multi-location requests.
+ */
+final actor OmReaderRangeCoalescer<Backend: OmFileReaderBackend> {
+    typealias Slice = OmReaderRangeSlice<Backend.DataType>
+
+    let backend: Backend
+    let options: OmReaderRangeCoalescing
+
+    private var pending: [(range: Range<Int>, continuation: CheckedContinuation<Slice, any Error>)] = []
+
+    init(backend: Backend, options: OmReaderRangeCoalescing) {
+        self.backend = backend
+        self.options = options
+    }
+
+    /// Get data from the backend. The request may be merged with other concurrent requests
+    nonisolated func getData(offset: Int, count: Int) async throws -> Slice {
+        guard options.isEnabled else {
+            return Slice(data: try await backend.getData(offset: offset, count: count), range: 0..<count)
+        }
+        return try await enqueue(range: offset ..< offset + count)
+    }
+
+    private func enqueue(range: Range<Int>) async throws -> Slice {
+        return try await withCheckedThrowingContinuation(isolation: self) { continuation in
+            pending.append((range, continuation))
+            guard pending.count == 1 else {
+                return
+            }
+            let window = options.window
+            Task {
+                if window > .zero {
+                    try? await Task.sleep(for: window)
+                }
+                await self.flush()
+            }
+        }
+    }
+
+    /// Merge all pending requests and send them to the backend
+    private func flush() {
+        let requests = pending.sorted(by: { $0.range.lowerBound < $1.range.lowerBound })
+        pending.removeAll(keepingCapacity: true)
+
+        var groups = [(range: Range<Int>, requests: [(range: Range<Int>, continuation: CheckedContinuation<Slice, any Error>)])]()
+        for request in requests {
+            if let last = groups.last,
+               request.range.lowerBound - last.range.upperBound <= options.maxGap,
+               max(request.range.upperBound, last.range.upperBound) - last.range.lowerBound <= options.maxSize {
+                groups[groups.count - 1].range = last.range.lowerBound ..< max(request.range.upperBound, last.range.upperBound)
+                groups[groups.count - 1].requests.append(request)
+                continue
+            }
+            groups.append((request.range, [request]))
+        }
+        OmMetrics.backendRangeRequestsTotal.add(groups.count, ordering: .relaxed)
+        OmMetrics.backendRangeRequestsCoalescedTotal.add(requests.count - groups.count, ordering: .relaxed)
+
+        let backend = backend
+        for group in groups {
+            Task {
+                do {
+                    let data = try await backend.getData(offset: group.range.lowerBound, count: group.range.count)
+                    for request in group.requests {
+                        let start = request.range.lowerBound - group.range.lowerBound
+                        request.continuation.resume(returning: Slice(data: data, range: start ..< start + request.range.count))
+                    }
+                } catch {
+                    for request in group.requests {
+                        request.continuation.resume(throwing: error)
+                    }
+                }
+            }
+        }
+    }
+}
@@ -123,6 +123,9 @@ struct GenericReader<Domain: GenericDomain, Variable: GenericVariable>: GenericR
     let logger: Logger
     
     let httpClient: HTTPClient?
+    
+    /// Read grid points of all locations of a request together
+    let batch: OmFileSplitterBatch?
 
     var modelDtSeconds: Int {
         return domain.dtSeconds
@@ -130,9 +133,12 @@ struct GenericReader<Domain: GenericDomain, Variable: GenericVariable>: GenericR
 
     /// Initialise reader to read a single grid-point
     public init(domain: Domain, position: Int, options: GenericReaderOptions) async throws {
+        ApiResponseDependencies.record(domain: domain.domainRegistry, client: options.httpClient)
         self.domain = domain
         self.position = position
-        if let elevationFile = await domain.getStaticFile(type: .elevation, httpClient: options.httpClient, logger: options.logger) {
+        if let elevationIndex = await domain.getElevationIndex(httpClient: options.httpClient, logger: options.logger) {
+            self.modelElevation = elevationIndex.read(gridpoint: position)
+        } else if let elevationFile = await domain.getStaticFile(type: .elevation, httpClient: options.httpClient, logger: options.logger) {
             self.modelElevation = try await domain.grid.readElevation(gridpoint: position, elevationFile: elevationFile)
         } else {
             self.modelElevation = .noData
@@ -144,21 +150,30 @@ struct GenericReader<Domain: GenericDomain, Variable: GenericVariable>: GenericR
         self.omFileSplitter = OmFileSplitter(domain)
         self.logger = options.logger
         self.httpClient = options.httpClient
+        self.batch = options.batch
     }
 
     /// Return nil, if the coordinates are outside the domain grid
     public init?(domain: Domain, lat: Float, lon: Float, elevation: Float, mode: GridSelectionMode, options: GenericReaderOptions) async throws {
         // check if coordinates are in domain, otherwise return nil
-        let elevationFile = await domain.getStaticFile(type: .elevation, httpClient: options.httpClient, logger: options.logger)
-        guard let gridpoint = try await domain.grid.findPoint(lat: lat, lon: lon, elevation: elevation, elevationFile: elevationFile, mode: mode) else {
+        let gridpoint: (gridpoint: Int, gridElevation: ElevationOrSea)?
+        if let elevationIndex = await domain.getElevationIndex(httpClient: options.httpClient, logger: options.logger) {
+            gridpoint = domain.grid.findPoint(lat: lat, lon: lon, elevation: elevation, elevationIndex: elevationIndex, mode: mode)
+        } else {
+            let elevationFile = await domain.getStaticFile(type: .elevation, httpClient: options.httpClient, logger: options.logger)
+            gridpoint = try await domain.grid.findPoint(lat: lat, lon: lon, elevation: elevation, elevationFile: elevationFile, mode: mode)
+        }
+        guard let gridpoint else {
             return nil
         }
+        ApiResponseDependencies.record(domain: domain.domainRegistry, client: options.httpClient)
         self.domain = domain
         self.position = gridpoint.gridpoint
         self.modelElevation = gridpoint.gridElevation
         self.targetElevation = elevation.isNaN ? gridpoint.gridElevation.numeric : elevation
         self.logger = options.logger
         self.httpClient = options.httpClient
+        self.batch = options.batch
 
         omFileSplitter = OmFileSplitter(domain)
 
@@ -168,7 +183,7 @@ struct GenericReader<Domain: GenericDomain, Variable: GenericVariable>: GenericR
     /// Prefetch data asynchronously. At the time `read` is called, it might already by in the kernel page cache.
     func prefetchData(variable: Variable, time: TimerangeDtAndSettings) async throws {
         if time.dtSeconds == domain.dtSeconds {
-            try await omFileSplitter.willNeed(variable: variable.omFileName.file, location: position..<position + 1, level: time.ensembleMemberLevel, time: time, logger: logger, httpClient: httpClient)
+            try await omFileSplitter.willNeed(variable: variable.omFileName.file, location: position..<position + 1, level: time.ensembleMemberLevel, time: time, logger: logger, httpClient: httpClient, batch: batch)
             return
         }
 
@@ -177,12 +192,12 @@ struct GenericReader<Domain: GenericDomain, Variable: GenericVariable>: GenericR
             time.time.forAggregationTo(modelDt: domain.dtSeconds, interpolation: interpolationType) :
             time.time.forInterpolationTo(modelDt: domain.dtSeconds, interpolation: interpolationType)
 
-        try await omFileSplitter.willNeed(variable: variable.omFileName.file, location: position..<position + 1, level: time.ensembleMemberLevel, time: time.with(time: timeRead), logger: logger, httpClient: httpClient)
+        try await omFileSplitter.willNeed(variable: variable.omFileName.file, location: position..<position + 1, level: time.ensembleMemberLevel, time: time.with(time: timeRead), logger: logger, httpClient: httpClient, batch: batch)
     }
 
     /// Read
     private func readRaw(variable: Variable, time: TimerangeDtAndSettings) async throws -> [Float] {
-        return try await omFileSplitter.read(variable: variable, location: position..<position + 1, level: time.ensembleMemberLevel, time: time, logger: logger, httpClient: httpClient)
+        return try await omFileSplitter.read(variable: variable, location: position..<position + 1, level: time.ensembleMemberLevel, time: time, logger: logger, httpClient: httpClient, batch: batch)
     }
     
     /// Scale and apply elevation correction. Must be done after temporal interpolation to preserve scaling
@@ -2,15 +2,11 @@ import Foundation
 
 /// A generic reader that caches all file system reads
 final class GenericReaderCached<Domain: GenericDomain, Variable: GenericVariable>: GenericReaderProtocol where Variable: Hashable {
-    private var cache: [VariableAndTime: DataAndUnit]
+    /// Cached reads in insertion order. A reader only holds a few dozen variables, therefore a linear search comparing the variable first is faster than hashing the full time range for every lookup.
+    /// Data arrays are shared with the caller and not copied.
+    private var cache: [(variable: Variable, time: TimerangeDtAndSettings, data: DataAndUnit)]
     let reader: GenericReader<Domain, Variable>
 
-    /// Used as key for cache
-    struct VariableAndTime: Hashable {
-        let variable: Variable
-        let time: TimerangeDtAndSettings
-    }
-
     /// Elevation of the grid point
     var modelElevation: ElevationOrSea {
         return reader.modelElevation
@@ -42,15 +38,16 @@ final class GenericReaderCached<Domain: GenericDomain, Variable: GenericVariable
 
     public init(reader: GenericReader<Domain, Variable>) {
         self.reader = reader
-        self.cache = .init()
+        self.cache = []
+        self.cache.reserveCapacity(16)
     }
 
     func get(variable: Variable, time: TimerangeDtAndSettings) async throws -> DataAndUnit {
-        if let value = cache[VariableAndTime(variable: variable, time: time)] {
-            return value
+        if let entry = cache.first(where: { $0.variable == variable && $0.time == time }) {
+            return entry.data
         }
         let data = try await reader.get(variable: variable, time: time)
-        cache[VariableAndTime(variable: variable, time: time)] = data
+        cache.append((variable, time, data))
         return data
     }
     func getStatic(type: ReaderStaticVariable) async throws -> Float? {
@@ -26,6 +26,9 @@ struct GenericReaderOptions {
     let logger: Logger
     
     let httpClient: HTTPClient?
+    
+    /// Combine grid point reads of all locations of an API request. See `OmFileSplitterBatch`
+    var batch: OmFileSplitterBatch? = nil
 
     public init(tilt: Float? = nil, azimuth: Float? = nil, logger: Logger, httpClient: HTTPClient?) throws {
         /// Tilt of a solar panel for GTI calculation. 0° horizontal, 90° vertical. Throws out of bounds error.
@@ -20,6 +20,7 @@ public enum Zensun {
     /// (~0.06° in equivalent zenith angle). ~28ns per timestep / location.
     public static func calculateClearSkyRadiationBackwardsAveraged(grid: any Gridable, locationRange: some RandomAccessCollection<Int>, timerange: TimerangeDt) -> Array2DFastTime {
         var out = Array2DFastTime(nLocations: locationRange.count, nTime: timerange.count)
+        let coordinates = grid.getCoordinates(gridpoints: locationRange)
 
         for (t, timestamp) in timerange.enumerated() {
             let decang = timestamp.getSunDeclination()
@@ -45,8 +46,9 @@ public enum Zensun {
             
             assert(p10 > p1)
 
-            for (i, gridpoint) in locationRange.enumerated() {
-                let (lat, lon) = grid.getCoordinates(gridpoint: gridpoint)
+            for i in 0..<locationRange.count {
+                let lat = coordinates.latitude[i]
+                let lon = coordinates.longitude[i]
                 let t0 = (90 - lat).degreesToRadians                     // colatitude of point
 
                 /// longitude of point
@@ -103,6 +105,7 @@ public enum Zensun {
     /// Considers sun elevation also during night. Do not use for DNI, because DNI only needs the sun elevation during sunlight
     public static func calculateRadiationBackwardsAveraged(grid: any Gridable, locationRange: some RandomAccessCollection<Int>, timerange: TimerangeDt) -> Array2DFastTime {
         var out = Array2DFastTime(nLocations: locationRange.count, nTime: timerange.count)
+        let coordinates = grid.getCoordinates(gridpoints: locationRange)
 
         for (t, timestamp) in timerange.enumerated() {
             let decang = timestamp.getSunDeclination()
@@ -128,8 +131,9 @@ public enum Zensun {
             
             assert(p10 > p1)
 
-            for (i, gridpoint) in locationRange.enumerated() {
-                let (lat, lon) = grid.getCoordinates(gridpoint: gridpoint)
+            for i in 0..<locationRange.count {
+                let lat = coordinates.latitude[i]
+                let lon = coordinates.longitude[i]
                 let t0 = (90 - lat).degreesToRadians                     // colatitude of point
 
                 /// longitude of point
@@ -176,6 +180,7 @@ public enum Zensun {
     public static func calculateSunElevationBackwards(grid: any Gridable, timerange: TimerangeDt, yrange: Range<Int>? = nil) -> Array2DFastTime {
         let yrange = yrange ?? 0..<grid.ny
         var out = Array2DFastTime(nLocations: yrange.count * grid.nx, nTime: timerange.count)
+        let coordinates = grid.getCoordinates(gridpoints: yrange.lowerBound * grid.nx ..< yrange.upperBound * grid.nx)
 
         for (t, timestamp) in timerange.enumerated() {
             let decang = timestamp.getSunDeclination()
@@ -196,41 +201,38 @@ public enum Zensun {
 
             let p10 = lonsun0.degreesToRadians
 
-            var l = 0
-            for indexY in yrange {
-                for indexX in 0..<grid.nx {
-                    let (lat, lon) = grid.getCoordinates(gridpoint: indexY * grid.nx + indexX)
-                    let t0 = (90 - lat).degreesToRadians                     // colatitude of point
-
-                    /// longitude of point
-                    var p0 = lon.degreesToRadians
-                    if p0 < p1 - .pi {
-                        p0 += 2 * .pi
-                    }
-                    if p0 > p1 + .pi {
-                        p0 -= 2 * .pi
-                    }
+            for l in coordinates.latitude.indices {
+                let lat = coordinates.latitude[l]
+                let lon = coordinates.longitude[l]
+                let t0 = (90 - lat).degreesToRadians                     // colatitude of point
 
-                    // limit p1 and p10 to sunrise/set
-                    let arg = -(cos(t0) * cos(t1)) / (sin(t0) * sin(t1))
-                    let carg = arg > 1 || arg < -1 ? .pi : acos(arg)
-                    let sunrise = p0 + carg
-                    let sunset = p0 - carg
-                    let p1_l = min(sunrise, p10)
-                    let p10_l = max(sunset, p1)
-
-                    // solve integral to get sun elevation dt
-                    // integral(cos(t0) cos(t1) + sin(t0) sin(t1) cos(p - p0)) dp = sin(t0) sin(t1) sin(p - p0) + p cos(t0) cos(t1) + constant
-                    let left = sin(t0) * sin(t1) * sin(p1_l - p0) + p1_l * cos(t0) * cos(t1)
-                    let right = sin(t0) * sin(t1) * sin(p10_l - p0) + p10_l * cos(t0) * cos(t1)
-                    /// Can get close to 0 if limited by sunrise/set
-                    let pDelta = p1_l - p10_l
-                    /// sun elevation (`zz = sin(alpha)`)
-                    let zz = (left - right) / (pDelta < 0 ? min(-0.001, pDelta) : max(0.001, pDelta))
-
-                    out[l, t] = zz
-                    l += 1
+                /// longitude of point
+                var p0 = lon.degreesToRadians
+                if p0 < p1 - .pi {
+                    p0 += 2 * .pi
+                }
+                if p0 > p1 + .pi {
+                    p0 -= 2 * .pi
                 }
+
+                // limit p1 and p10 to sunrise/set
+                let arg = -(cos(t0) * cos(t1)) / (sin(t0) * sin(t1))
+                let carg = arg > 1 || arg < -1 ? .pi : acos(arg)
+                let sunrise = p0 + carg
+                let sunset = p0 - carg
+                let p1_l = min(sunrise, p10)
+                let p10_l = max(sunset, p1)
+
+                // solve integral to get sun elevation dt
+                // integral(cos(t0) cos(t1) + sin(t0) sin(t1) cos(p - p0)) dp = sin(t0) sin(t1) sin(p - p0) + p cos(t0) cos(t1) + constant
+                let left = sin(t0) * sin(t1) * sin(p1_l - p0) + p1_l * cos(t0) * cos(t1)
+                let right = sin(t0) * sin(t1) * sin(p10_l - p0) + p10_l * cos(t0) * cos(t1)
+                /// Can get close to 0 if limited by sunrise/set
+                let pDelta = p1_l - p10_l
+                /// sun elevation (`zz = sin(alpha)`)
+                let zz = (left - right) / (pDelta < 0 ? min(-0.001, pDelta) : max(0.001, pDelta))
+
+                out[l, t] = zz
             }
         }
         return out
@@ -260,6 +262,7 @@ public enum Zensun {
         var out = [Float]()
         let yrange = yrange ?? 0..<grid.ny
         out.reserveCapacity(yrange.count * grid.nx * timerange.count)
+        let coordinates = grid.getCoordinates(gridpoints: yrange.lowerBound * grid.nx ..< yrange.upperBound * grid.nx)
 
         for timestamp in timerange {
             let rsun = timestamp.getSunRadius()
@@ -275,17 +278,16 @@ public enum Zensun {
             let lonsun = -15.0 * (ut - 12.0 + eqtime)
             let p1 = lonsun.degreesToRadians
 
-            for indexY in yrange {
-                for indexX in 0..<grid.nx {
-                    let (lat, lon) = grid.getCoordinates(gridpoint: indexY * grid.nx + indexX)
+            for i in coordinates.latitude.indices {
+                let lat = coordinates.latitude[i]
+                let lon = coordinates.longitude[i]
 
-                    let t0 = (90 - lat).degreesToRadians
-                    let p0 = lon.degreesToRadians
-                    /// sun elevation (`zz = sin(alpha)`)
-                    let zz = cos(t0) * cos(t1) + sin(t0) * sin(t1) * cos(p1 - p0)
-                    let solfac = zz / rsun_square
-                    out.append(solfac)
-                }
+                let t0 = (90 - lat).degreesToRadians
+                let p0 = lon.degreesToRadians
+                /// sun elevation (`zz = sin(alpha)`)
+                let zz = cos(t0) * cos(t1) + sin(t0) * sin(t1) * cos(p1 - p0)
+                let solfac = zz / rsun_square
+                out.append(solfac)
             }
         }
         return out
@@ -309,6 +311,7 @@ public enum Zensun {
     /// 2d field. Calculate scaling factor from backwards to instant radiation factor
     public static func backwardsAveragedToInstantFactor(grid: any Gridable, locationRange: Range<Int>, timerange: TimerangeDt) -> Array2DFastTime {
         var out = Array2DFastTime(nLocations: locationRange.count, nTime: timerange.count)
+        let coordinates = grid.getCoordinates(gridpoints: locationRange)
 
         for (t, timestamp) in timerange.enumerated() {
             /// fractional day number with 12am 1jan = 1
@@ -322,8 +325,9 @@ public enum Zensun {
 
             let lonsun = -15.0 * (ut - 12.0 + eqtime)
 
-            for (i, gridpoint) in locationRange.enumerated() {
-                let (latitude, longitude) = grid.getCoordinates(gridpoint: gridpoint)
+            for i in 0..<locationRange.count {
+                let latitude = coordinates.latitude[i]
+                let longitude = coordinates.longitude[i]
                 /// longitude of sun
                 let p1 = lonsun.degreesToRadians
 
@@ -393,6 +397,7 @@ public enum Zensun {
 
         for (i, gridpoint) in locationRange.enumerated() {
             var ktPrevious = Float.nan
+            let (latitude, longitude) = grid.getCoordinates(gridpoint: gridpoint)
 
             for (t, timestamp) in timerange.enumerated() {
                 let pos = i * timerange.count + t
@@ -414,7 +419,6 @@ public enum Zensun {
                 let lonsun = -15.0 * (ut - 12.0 + eqtime)
                 let lonsunScan = -15.0 * (utScan - 12.0 + eqtime)
 
-                let (latitude, longitude) = grid.getCoordinates(gridpoint: gridpoint)
                 /// longitude of sun
                 let p1 = lonsun.degreesToRadians
                 let p1Scan = lonsunScan.degreesToRadians
@@ -156,6 +156,14 @@ extension Request {
         return (headers.first(name: "X-Forwarded-Proto") == "https" ? "https" : nil) ?? url.scheme ?? "http"
     }
 
+    /// Use `OpenMeteo.apiResponseCache` if enabled. Cached responses still return their query weight for rate limiting
+    fileprivate func withResponseCache(salt: Int, fn: () async throws -> (response: Response, weight: Float)) async throws -> (response: Response, weight: Float) {
+        guard let cache = OpenMeteo.apiResponseCache else {
+            return try await fn()
+        }
+        return try await cache.response(for: self, salt: salt, fn: fn)
+    }
+
     /// fn params: hostname, unlockSlot, numberOfLocationsMaximum, params
     @discardableResult
     func withApiParameter<T: ForecastapiResponder>(_ subdomain: String, alias: [String] = [], fn: (ApiRequestInfo, ApiQueryParameter) async throws -> T) async throws -> Response {
@@ -163,9 +171,11 @@ extension Request {
         guard let host = headers[.host].first(where: { $0.contains("open-meteo.com") }) else {
             // localhost or not an openmeteo host
             let params = try parseApiParams()
-            let responder = try await fn(ApiRequestInfo(host: nil, numberOfLocationsMaximum: nil), params)
-            let weight = responder.calculateQueryWeight()
-            return try await responder.response(format: params.formatWithOptions, concurrencySlot: nil, prefetch: weight < 10, logger: logger)
+            return try await withResponseCache(salt: 0) {
+                let responder = try await fn(ApiRequestInfo(host: nil, numberOfLocationsMaximum: nil), params)
+                let weight = responder.calculateQueryWeight()
+                return (try await responder.response(format: params.formatWithOptions, concurrencySlot: nil, prefetch: weight < 10, encoding: ResponseContentEncoding(acceptEncoding: headers[.acceptEncoding]), logger: logger), weight)
+            }.response
         }
         let isDevNode = host.contains("eu0") || host.contains("us0")
         let isFreeApi = host.starts(with: subdomain) || alias.contains(where: { host.starts(with: $0) }) == true || isDevNode
@@ -189,9 +199,9 @@ extension Request {
             }
             if isCFWorker {
                 OmMetrics.requestsCloudflareWorkersTotal.add(1, ordering: .relaxed)
-                try await RateLimiter.instance.check(int64: slot)
+                try RateLimiter.instance.check(int64: slot)
             } else {
-                try await RateLimiter.instance.check(address: address)
+                try RateLimiter.instance.check(address: address)
             }
             try await ConcurrencyGroupLimiter.instance.wait(slot: slot, maxConcurrent: RateLimiter.concurrencyLimit, maxConcurrentHard: RateLimiter.concurrencyLimitHard)
             let response: Response
@@ -208,24 +218,28 @@ extension Request {
                     await ConcurrencyGroupLimiter.instance.release(slot: slot)
                     return self.redirect(to: url)
                 }
-                let responder = try await fn(ApiRequestInfo(host: host, numberOfLocationsMaximum: OpenMeteo.numberOfLocationsMaximum), params)
-                let weight = responder.calculateQueryWeight()
-                guard weight <= RateLimiter.limitHourly else {
-                    throw ForecastApiError.generic(message: "Your API call requests too much data. Please reduce the number of variables, locations and/or weather models.")
+                let result = try await withResponseCache(salt: OpenMeteo.numberOfLocationsMaximum) {
+                    let responder = try await fn(ApiRequestInfo(host: host, numberOfLocationsMaximum: OpenMeteo.numberOfLocationsMaximum), params)
+                    let weight = responder.calculateQueryWeight()
+                    guard weight <= RateLimiter.limitHourly else {
+                        throw ForecastApiError.generic(message: "Your API call requests too much data. Please reduce the number of variables, locations and/or weather models.")
+                    }
+                    return (try await responder.response(format: params.formatWithOptions, concurrencySlot: slot, prefetch: weight < 10, encoding: ResponseContentEncoding(acceptEncoding: headers[.acceptEncoding]), logger: logger), weight)
                 }
-                response = try await responder.response(format: params.formatWithOptions, concurrencySlot: slot, prefetch: weight < 10, logger: logger)
+                response = result.response
+                let weight = result.weight
                 if isCFWorker {
-                    await RateLimiter.instance.increment(int64: slot, count: weight)
+                    RateLimiter.instance.increment(int64: slot, count: weight)
                 } else {
-                    await RateLimiter.instance.increment(address: address, count: weight)
+                    RateLimiter.instance.increment(address: address, count: weight)
                 }
             } catch {
                 // In an error case, also increment to API rate limiter by 1
                 // Some users do infinite retries on errors!
                 if isCFWorker {
-                    await RateLimiter.instance.increment(int64: slot, count: 1)
+                    RateLimiter.instance.increment(int64: slot, count: 1)
                 } else {
-                    await RateLimiter.instance.increment(address: address, count: 1)
+                    RateLimiter.instance.increment(address: address, count: 1)
                 }
                 OmMetrics.requestsErrorThrownTotal.add(1, ordering: .relaxed)
                 await ConcurrencyGroupLimiter.instance.release(slot: slot)
@@ -256,10 +270,13 @@ extension Request {
         try await ConcurrencyGroupLimiter.instance.wait(slot: slot, maxConcurrent: maxConcurrent, maxConcurrentHard: resNode ? 1024 : 256)
         let response: Response
         do {
-            let responder = try await fn(ApiRequestInfo(host: host, numberOfLocationsMaximum: numberOfLocationsMaximum), params)
-            let weight = responder.calculateQueryWeight()
-            response = try await responder.response(format: params.formatWithOptions, concurrencySlot: slot, prefetch: weight < 10, logger: logger)
-            await ApiKeyManager.instance.increment(apikey: String.SubSequence(apikey), weight: weight)
+            let result = try await withResponseCache(salt: numberOfLocationsMaximum) {
+                let responder = try await fn(ApiRequestInfo(host: host, numberOfLocationsMaximum: numberOfLocationsMaximum), params)
+                let weight = responder.calculateQueryWeight()
+                return (try await responder.response(format: params.formatWithOptions, concurrencySlot: slot, prefetch: weight < 10, encoding: ResponseContentEncoding(acceptEncoding: headers[.acceptEncoding]), logger: logger), weight)
+            }
+            response = result.response
+            await ApiKeyManager.instance.increment(apikey: String.SubSequence(apikey), weight: result.weight)
         }
         catch {
             await ConcurrencyGroupLimiter.instance.release(slot: slot)
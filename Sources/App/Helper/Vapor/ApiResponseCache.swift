@@ -0,0 +1,405 @@
+import Foundation
+import Vapor
+import NIOConcurrencyHelpers
+
+/**
+ Combine identical API requests and keep small encoded responses for a short time. Popular locations, e.g. widgets for major cities, cause thousands of identical requests per minute.
+
+ Keys are FNV hashes of host, path and sorted query parameters without API keys. While a response is computed, all model domains that are read are recorded in `ApiResponseDependencies`.
+ A cached response is only returned as long as the latest run of each of these domains did not change according to its `meta.json`. Otherwise it is computed again.
+ Concurrent identical requests wait for the first request and share its encoded bytes. Responses that cannot be cached, e.g. heavy requests, are remembered and following identical requests do not wait anymore.
+ Memory is limited by a byte budget and least recently used responses are evicted first. Expired responses are removed periodically.
+ */
+final class ApiResponseCache: Sendable {
+    struct CachedResponse: Sendable {
+        let status: HTTPResponseStatus
+        let headers: HTTPHeaders
+        let body: ByteBuffer
+        /// Query weight used for rate limiting
+        let weight: Float
+        /// Run of each domain that was read to compute the response
+        let runs: [DomainRegistry: Int]
+        let client: HTTPClient?
+
+        /// New response sharing the cached bytes
+        var response: Response {
+            return Response(status: status, headers: headers, body: .init(buffer: body))
+        }
+    }
+
+    fileprivate enum Entry {
+        /// Response is being computed by another request
+        case pending(EventLoopFuture<CachedResponse?>)
+        case ready(CachedResponse, expires: Timestamp, lastAccess: Int)
+        /// The last response was not cacheable. Compute identical requests directly without waiting
+        case uncacheable(expires: Timestamp)
+    }
+
+    fileprivate enum Lookup {
+        case hit(CachedResponse)
+        case wait(EventLoopFuture<CachedResponse?>)
+        case compute(EventLoopPromise<CachedResponse?>)
+        case bypass
+    }
+
+    fileprivate struct State {
+        var entries = [UInt64: Entry]()
+        var bytes = 0
+        var accessCounter = 0
+        var lastSweep = Timestamp(0)
+
+        /// Remove expired responses and least recently used responses until `bytes` is below `target`
+        mutating func evict(now: Timestamp, target: Int) {
+            lastSweep = now
+            var ready = [(key: UInt64, lastAccess: Int, bytes: Int)]()
+            for (key, entry) in entries {
+                switch entry {
+                case .pending:
+                    continue
+                case .uncacheable(let expires):
+                    if expires <= now {
+                        entries.removeValue(forKey: key)
+                    }
+                case .ready(let cached, let expires, let lastAccess):
+                    if expires <= now {
+                        entries.removeValue(forKey: key)
+                        bytes -= cached.body.readableBytes
+                        continue
+                    }
+                    ready.append((key, lastAccess, cached.body.readableBytes))
+                }
+            }
+            for entry in ready.sorted(by: { $0.lastAccess < $1.lastAccess }) {
+                guard bytes > target else {
+                    break
+                }
+                entries.removeValue(forKey: entry.key)
+                bytes -= entry.bytes
+                OmMetrics.apiResponseCacheEvictionsTotal.add(1, ordering: .relaxed)
+            }
+        }
+    }
+
+    /// Maximum size of all cached response bodies
+    let capacityBytes: Int
+
+    /// Responses larger than this are not cached
+    let maxEntryBytes: Int
+
+    /// Responses are cached for this duration, even if no new data is detected. Forecasts depend on the current time as well
+    let ttlSeconds: Int
+
+    /// Only responses with a smaller query weight are cached
+    let maxWeight: Float
+
+    private let state = NIOLockedValueBox(State())
+
+    init(capacityBytes: Int, ttlSeconds: Int, maxWeight: Float = 1) {
+        self.capacityBytes = capacityBytes
+        self.maxEntryBytes = capacityBytes / 16
+        self.ttlSeconds = ttlSeconds
+        self.maxWeight = maxWeight
+    }
+
+    /// Bytes used by cached response bodies
+    var usedBytes: Int {
+        return state.withLockedValue { $0.bytes }
+    }
+
+    /// Hash of the request. Returns nil for requests that should not be cached. `salt` separates requests with the same URL but different limits, e.g. the number of locations per API key
+    static func key(request: Request, salt: Int) -> UInt64? {
+        guard request.method == .GET, let query = request.url.query else {
+            return nil
+        }
+        let separator = UInt64(UInt8(ascii: "&"))
+        var hash = UInt64.fnvOffsetBasis
+            .addFnv1aHash(request.headers[.host].first ?? "")
+            .addFnv1aHash(separator)
+            .addFnv1aHash(request.url.path)
+        for parameter in query.split(separator: "&").sorted() where !parameter.hasPrefix("apikey=") {
+            hash = hash.addFnv1aHash(separator).addFnv1aHash(String(parameter))
+        }
+        let encoding = ResponseContentEncoding(acceptEncoding: request.headers[.acceptEncoding])?.rawValue ?? ""
+        return hash
+            .addFnv1aHash(separator)
+            .addFnv1aHash(encoding)
+            .addFnv1aHash(UInt64(bitPattern: Int64(salt)))
+    }
+
+    /// Return a cached response or compute it using `fn`. `fn` returns the response and the query weight. Errors are not cached
+    func response(for request: Request, salt: Int = 0, fn: () async throws -> (response: Response, weight: Float)) async throws -> (response: Response, weight: Float) {
+        guard let key = Self.key(request: request, salt: salt) else {
+            return try await fn()
+        }
+        while true {
+            let now = Timestamp.now()
+            let lookup = state.withLockedValue { state -> Lookup in
+                switch state.entries[key] {
+                case .pending(let future):
+                    return .wait(future)
+                case .ready(let cached, let expires, _) where expires > now:
+                    state.accessCounter += 1
+                    state.entries[key] = .ready(cached, expires: expires, lastAccess: state.accessCounter)
+                    return .hit(cached)
+                case .ready(let cached, _, _):
+                    state.bytes -= cached.body.readableBytes
+                case .uncacheable(let expires) where expires > now:
+                    return .bypass
+                case .uncacheable, .none:
+                    break
+                }
+                let promise = request.eventLoop.makePromise(of: CachedResponse?.self)
+                state.entries[key] = .pending(promise.futureResult)
+                return .compute(promise)
+            }
+
+            switch lookup {
+            case .hit(let cached):
+                guard await Self.runs(domains: cached.runs.keys, client: cached.client, logger: request.logger) == cached.runs else {
+                    // A new model run is available. Drop the response unless it was already replaced
+                    state.withLockedValue { state in
+                        guard case .ready(let current, _, _) = state.entries[key], current.runs == cached.runs else {
+                            return
+                        }
+                        state.entries.removeValue(forKey: key)
+                        state.bytes -= current.body.readableBytes
+                    }
+                    continue
+                }
+                OmMetrics.apiResponseCacheHitsTotal.add(1, ordering: .relaxed)
+                return (cached.response, cached.weight)
+            case .wait(let future):
+                if let cached = try? await future.get() {
+                    OmMetrics.apiResponseCacheSharedTotal.add(1, ordering: .relaxed)
+                    return (cached.response, cached.weight)
+                }
+                // The first request failed or was not cacheable. Look up again to compute directly
+                continue
+            case .bypass:
+                OmMetrics.apiResponseCacheMissesTotal.add(1, ordering: .relaxed)
+                return try await fn()
+            case .compute(let promise):
+                OmMetrics.apiResponseCacheMissesTotal.add(1, ordering: .relaxed)
+                do {
+                    let dependencies = ApiResponseDependencies()
+                    let capture = ApiResponseCapture(maxBytes: maxEntryBytes)
+                    let (response, weight) = try await ApiResponseDependencies.$current.withValue(dependencies) {
+                        try await ApiResponseCapture.$current.withValue(capture) {
+                            try await fn()
+                        }
+                    }
+                    let recorded = dependencies.recorded
+                    let runs = await Self.runs(domains: recorded.domains, client: recorded.client, logger: request.logger)
+                    guard response.status == .ok, weight <= maxWeight else {
+                        store(key: key, cached: nil, now: now, promise: promise)
+                        return (response, weight)
+                    }
+                    var responseHeaders = response.headers
+                    responseHeaders.remove(name: .transferEncoding)
+                    responseHeaders.remove(name: .contentLength)
+                    let headers = responseHeaders
+                    let status = response.status
+                    let cached = { @Sendable (body: ByteBuffer) -> CachedResponse in
+                        CachedResponse(status: status, headers: headers, body: body, weight: weight, runs: runs, client: recorded.client)
+                    }
+                    if let body = response.body.buffer {
+                        store(key: key, cached: body.readableBytes <= maxEntryBytes ? cached(body) : nil, now: now, promise: promise)
+                        return (response, weight)
+                    }
+                    guard capture.isAttached else {
+                        store(key: key, cached: nil, now: now, promise: promise)
+                        return (response, weight)
+                    }
+                    // The body is sent to the client while it is streamed. The response is cached once the stream completed successfully
+                    capture.onComplete { body in
+                        self.store(key: key, cached: body.map(cached), now: now, promise: promise)
+                    }
+                    return (response, weight)
+                } catch {
+                    state.withLockedValue { _ = $0.entries.removeValue(forKey: key) }
+                    promise.succeed(nil)
+                    throw error
+                }
+            }
+        }
+    }
+
+    /// Insert a computed response or remember that it is not cacheable. Requests waiting for `promise` continue afterwards
+    private func store(key: UInt64, cached: CachedResponse?, now: Timestamp, promise: EventLoopPromise<CachedResponse?>) {
+        state.withLockedValue { state in
+            guard let cached else {
+                state.entries[key] = .uncacheable(expires: now.add(ttlSeconds))
+                return
+            }
+            state.accessCounter += 1
+            state.bytes += cached.body.readableBytes
+            state.entries[key] = .ready(cached, expires: now.add(ttlSeconds), lastAccess: state.accessCounter)
+            if state.bytes > capacityBytes {
+                state.evict(now: now, target: capacityBytes * 9 / 10)
+            } else if state.lastSweep.add(ttlSeconds) < now {
+                state.evict(now: now, target: capacityBytes)
+            }
+        }
+        promise.succeed(cached)
+    }
+
+    /// Latest run of each domain based on the modification time of its `meta.json`. Domains without meta data use 0
+    private static func runs<S: Sequence>(domains: S, client: HTTPClient?, logger: Logger) async -> [DomainRegistry: Int] where S.Element == DomainRegistry {
+        var runs = [DomainRegistry: Int]()
+        for domain in domains {
+            let meta = try? await RemoteFileManager.instance.get(file: ModelUpdateMetaFile(domain: domain), client: client, logger: logger)
+            runs[domain] = meta?.last_run_modification_time ?? 0
+        }
+        return runs
+    }
+}
+
+/**
+ Copy of a streamed response body while it is sent to the client. Set as task local value by `ApiResponseCache` and attached to the body by `Response.Body(cacheableStream:)`.
+
+ Bytes are only buffered up to `maxBytes`. Larger bodies are streamed without buffering and are not cached. Each response has its own capture, so an error while streaming one response does not affect others.
+ If the response is released without being streamed, e.g. because the client disconnected, the capture completes as failed.
+ */
+final class ApiResponseCapture: Sendable {
+    @TaskLocal static var current: ApiResponseCapture?
+
+    private struct State {
+        var attached = false
+        /// Set to nil once `maxBytes` is exceeded
+        var buffer: ByteBuffer? = ByteBuffer()
+        var finished = false
+        var completion: (@Sendable (ByteBuffer?) -> Void)?
+    }
+
+    let maxBytes: Int
+
+    private let state = NIOLockedValueBox(State())
+
+    init(maxBytes: Int) {
+        self.maxBytes = maxBytes
+    }
+
+    deinit {
+        finish(failed: true)
+    }
+
+    /// True if a streamed body was created while this capture was set
+    var isAttached: Bool {
+        return state.withLockedValue { $0.attached }
+    }
+
+    fileprivate func attach() {
+        state.withLockedValue { $0.attached = true }
+    }
+
+    fileprivate func append(_ data: ByteBuffer) {
+        state.withLockedValue { state in
+            guard let buffer = state.buffer, !state.finished else {
+                return
+            }
+            guard buffer.readableBytes + data.readableBytes <= maxBytes else {
+                state.buffer = nil
+                return
+            }
+            state.buffer?.writeImmutableBuffer(data)
+        }
+    }
+
+    /// Complete the capture. The body is only passed to the completion handler if streaming did not fail and the body did not exceed `maxBytes`. Only the first call has an effect
+    func finish(failed: Bool) {
+        let result = state.withLockedValue { state -> (completion: (@Sendable (ByteBuffer?) -> Void)?, body: ByteBuffer?)? in
+            guard !state.finished else {
+                return nil
+            }
+            state.finished = true
+            if failed {
+                state.buffer = nil
+            }
+            let completion = state.completion
+            state.completion = nil
+            return (completion, state.buffer)
+        }
+        if let result {
+            result.completion?(result.body)
+        }
+    }
+
+    /// Call `fn` with the captured body or nil once streaming completed. Called immediately if streaming already completed
+    func onComplete(_ fn: @escaping @Sendable (ByteBuffer?) -> Void) {
+        let finished = state.withLockedValue { state -> ByteBuffer?? in
+            guard state.finished else {
+                state.completion = fn
+                return .none
+            }
+            return .some(state.buffer)
+        }
+        if case .some(let body) = finished {
+            fn(body)
+        }
+    }
+}
+
+/// Forwards all writes to the client and copies them into an `ApiResponseCapture`
+struct ApiResponseCaptureWriter: AsyncBodyStreamWriter {
+    let writer: any AsyncBodyStreamWriter
+    let capture: ApiResponseCapture
+
+    func write(_ result: BodyStreamResult) async throws {
+        switch result {
+        case .buffer(let buffer):
+            capture.append(buffer)
+        case .end:
+            capture.finish(failed: false)
+        case .error:
+            capture.finish(failed: true)
+        }
+        do {
+            try await writer.write(result)
+        } catch {
+            capture.finish(failed: true)
+            throw error
+        }
+    }
+}
+
+extension Response.Body {
+    /// Streamed body that is copied into `ApiResponseCapture.current` if the response is computed for `ApiResponseCache`
+    init(cacheableStream stream: @escaping @Sendable (any AsyncBodyStreamWriter) async throws -> ()) {
+        guard let capture = ApiResponseCapture.current else {
+            self.init(asyncStream: stream)
+            return
+        }
+        capture.attach()
+        self.init(asyncStream: { writer in
+            do {
+                try await stream(ApiResponseCaptureWriter(writer: writer, capture: capture))
+            } catch {
+                capture.finish(failed: true)
+                throw error
+            }
+        })
+    }
+}
+
+/**
+ Model domains read while computing an API response. Set as task local value by `ApiResponseCache` and filled by `GenericReader`.
+ */
+final class ApiResponseDependencies: Sendable {
+    @TaskLocal static var current: ApiResponseDependencies?
+
+    private let state = NIOLockedValueBox((domains: Set<DomainRegistry>(), client: HTTPClient?.none))
+
+    var recorded: (domains: Set<DomainRegistry>, client: HTTPClient?) {
+        return state.withLockedValue { $0 }
+    }
+
+    /// Record that a domain was read by the current task
+    static func record(domain: DomainRegistry, client: HTTPClient?) {
+        current?.state.withLockedValue { state in
+            state.domains.insert(domain)
+            if state.client == nil {
+                state.client = client
+            }
+        }
+    }
+}
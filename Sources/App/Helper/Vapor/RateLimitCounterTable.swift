@@ -0,0 +1,145 @@
+import Foundation
+import Synchronization
+
+/**
+ Fixed capacity counter table for rate limiting. Thread safe without locks or actor hops.
+
+ Each slot is a 128 bit atomic `WordPair` with the 64 bit key and a 64 bit value. The value stores the window number in the upper 32 bits and the usage as fixed point number in the lower 32 bits.
+ Counters of a previous window are treated as zero and the slot can be taken by any other key. Counters therefore decay at the end of each window without clearing the table.
+
+ Slots are split into shards selected by the key hash. Each shard is a separate allocation, so that concurrent updates on different shards do not share cache lines.
+ Within a shard, linear probing checks up to `lookAheadCount` slots. If all slots are used in the current window, the slot with the lowest usage is overwritten.
+ The new key inherits the usage of the evicted slot, similar to the Space-Saving algorithm. Usage is therefore overestimated, but never underestimated: A client cannot reset its counter by forcing its slot to be evicted with requests from other addresses.
+ A key that is missing in a fully used neighbourhood reports the lowest usage of the neighbourhood for the same reason.
+ */
+final class RateLimitCounterTable: @unchecked Sendable {
+    /// Window length in seconds. Windows are aligned to unix time, e.g. hourly windows start at full hours
+    let windowSeconds: Int
+
+    /// Number of slots in each shard. Always a power of 2
+    let slotsPerShard: Int
+
+    private let shards: [UnsafeMutableRawBufferPointer]
+
+    /// Maximum number of slots to check for a key
+    static let lookAheadCount = 16
+
+    /// Fixed point scale for usage counters. Allows fractional weights and a maximum usage of 4 million per window
+    static let scale: Float = 1024
+
+    var capacity: Int {
+        return shards.count * slotsPerShard
+    }
+
+    /// `capacity` is the total number of slots and rounded up to fill all shards
+    init(windowSeconds: Int, capacity: Int, shardCount: Int = System.coreCount) {
+        let shardCount = Swift.max(shardCount, 1).nextPowerOf2
+        self.windowSeconds = windowSeconds
+        let slotsPerShard = Swift.max(capacity / shardCount, Self.lookAheadCount).nextPowerOf2
+        self.slotsPerShard = slotsPerShard
+        self.shards = (0..<shardCount).map { _ in
+            let bytes = UnsafeMutableRawBufferPointer.allocate(byteCount: slotsPerShard * MemoryLayout<WordPair>.stride, alignment: 128)
+            bytes.initializeMemory(as: UInt8.self, repeating: 0)
+            return bytes
+        }
+    }
+
+    deinit {
+        shards.forEach { $0.deallocate() }
+    }
+
+    /// Current usage of `key`. If `key` is not stored and all slots of its neighbourhood are used, the lowest usage in the neighbourhood is returned, because `key` may have been evicted
+    func usage(key: UInt64, now: Int) -> Float {
+        let window = UInt64(now / windowSeconds)
+        let (entries, start) = position(key: key)
+        var lowest = UInt64.max
+        for lookAhead in 0..<Self.lookAheadCount {
+            let slot = (start + lookAhead) & (slotsPerShard - 1)
+            let entry = entries[slot].load(ordering: .relaxed)
+            guard UInt64(entry.second) >> 32 == window else {
+                lowest = 0
+                continue
+            }
+            let value = UInt64(entry.second) & 0xFFFF_FFFF
+            if UInt64(entry.first) == key {
+                return Float(value) / Self.scale
+            }
+            lowest = Swift.min(lowest, value)
+        }
+        return Float(lowest) / Self.scale
+    }
+
+    /// Add `count` to the usage of `key`. Saturates at the maximum counter value
+    func add(key: UInt64, count: Float, now: Int) {
+        let window = UInt64(now / windowSeconds)
+        let increment = UInt64(Swift.max(0, Swift.min(Float(UInt32.max), (count * Self.scale).rounded())))
+        let (entries, start) = position(key: key)
+        outer: while true {
+            /// First slot with a counter from a previous window
+            var expired: (slot: Int, entry: WordPair)? = nil
+            /// Slot with the lowest usage in the current window
+            var lowest: (slot: Int, entry: WordPair)? = nil
+            for lookAhead in 0..<Self.lookAheadCount {
+                let slot = (start + lookAhead) & (slotsPerShard - 1)
+                let entry = entries[slot].load(ordering: .relaxed)
+                guard UInt64(entry.second) >> 32 == window else {
+                    if expired == nil {
+                        expired = (slot, entry)
+                    }
+                    continue
+                }
+                let value = UInt64(entry.second) & 0xFFFF_FFFF
+                if UInt64(entry.first) == key {
+                    let desired = WordPair(first: entry.first, second: UInt((window << 32) | Swift.min(value + increment, 0xFFFF_FFFF)))
+                    guard entries[slot].compareExchange(expected: entry, desired: desired, ordering: .relaxed).exchanged else {
+                        continue outer // another thread updated the slot
+                    }
+                    return
+                }
+                if lowest.map({ value < UInt64($0.entry.second) & 0xFFFF_FFFF }) ?? true {
+                    lowest = (slot, entry)
+                }
+            }
+            // Key not found. Take an expired slot or evict the slot with the lowest usage and inherit its usage
+            guard let target = expired ?? lowest else {
+                return
+            }
+            let inherited = expired == nil ? UInt64(target.entry.second) & 0xFFFF_FFFF : 0
+            let desired = WordPair(first: UInt(key), second: UInt((window << 32) | Swift.min(inherited + increment, 0xFFFF_FFFF)))
+            guard entries[target.slot].compareExchange(expected: target.entry, desired: desired, ordering: .relaxed).exchanged else {
+                continue // another thread took the slot
+            }
+            return
+        }
+    }
+
+    /// Number of keys with usage in the current window
+    func activeKeys(now: Int) -> Int {
+        let window = UInt64(now / windowSeconds)
+        return shards.reduce(0) { count, bytes in
+            let entries = bytes.assumingMemoryBound(to: Atomic<WordPair>.self)
+            return count + (0..<slotsPerShard).count(where: {
+                UInt64(entries[$0].load(ordering: .relaxed).second) >> 32 == window
+            })
+        }
+    }
+
+    /// Select shard and start slot. IPv4 addresses are sequential and need to be mixed before they can be used as a hash
+    @inline(__always) private func position(key: UInt64) -> (UnsafeMutableBufferPointer<Atomic<WordPair>>, Int) {
+        // splitmix64 finaliser
+        var x = key &+ 0x9E37_79B9_7F4A_7C15
+        x = (x ^ (x >> 30)) &* 0xBF58_476D_1CE4_E5B9
+        x = (x ^ (x >> 27)) &* 0x94D0_49BB_1331_11EB
+        x = x ^ (x >> 31)
+        let shard = Int(x & UInt64(shards.count - 1))
+        let start = Int(truncatingIfNeeded: x >> 32) & (slotsPerShard - 1)
+        return (shards[shard].assumingMemoryBound(to: Atomic<WordPair>.self), start)
+    }
+}
+
+extension Int {
+    /// Round up to the next power of 2. Value must be positive
+    var nextPowerOf2: Int {
+        return 1 << (Int.bitWidth - (self - 1).leadingZeroBitCount)
+    }
+}
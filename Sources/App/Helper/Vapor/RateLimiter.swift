@@ -1,12 +1,15 @@
 import Foundation
 import Vapor
 import NIO
+import Synchronization
 
 /**
  Limit API request rate for the free API.
  Count how many calls have been made by a given IP address.
+
+ Counters are kept in lock-free `RateLimitCounterTable`s and can be checked and updated from any thread without awaiting an actor.
  */
-final actor RateLimiter {
+final class RateLimiter: @unchecked Sendable {
     private static let limitDaily = Float(Environment.get("CALL_LIMIT_DAILY").flatMap(Int.init) ?? 10_000)
 
     static let limitHourly = Float(Environment.get("CALL_LIMIT_HOURLY").flatMap(Int.init) ?? 5_000)
@@ -19,20 +22,24 @@ final actor RateLimiter {
     
     static let concurrencyLimitTotal = Environment.get("CONCURRENCY_LIMIT_TOTAL").flatMap(Int.init) ?? 4096
 
-    private var dailyPerIPv4 = [UInt32: Float]()
-
-    private var dailyPerIPv6 = [Int: Float]()
+    /// Number of counter slots per window. Each slot uses 16 bytes
+    private static let capacity = Environment.get("RATE_LIMITER_CAPACITY").flatMap(Int.init) ?? 262_144
 
-    private var hourlyPerIPv4 = [UInt32: Float]()
+    /// IPv4 addresses are stored with this tag to not collide with IPv6 hashes or worker slots
+    private static let ipv4Tag: UInt64 = 1 << 32
 
-    private var hourlyPerIPv6 = [Int: Float]()
+    private let daily = RateLimitCounterTable(windowSeconds: 24 * 3600, capacity: RateLimiter.capacity)
 
-    private var minutelyPerIPv4 = [UInt32: Float]()
+    private let hourly = RateLimitCounterTable(windowSeconds: 3600, capacity: RateLimiter.capacity)
 
-    private var minutelyPerIPv6 = [Int: Float]()
+    private let minutely = RateLimitCounterTable(windowSeconds: 60, capacity: RateLimiter.capacity)
     
-    /// List of IP addresses / networks to disable rate limited
-    var allowlistedIPs: CIDR?
+    /// List of IP addresses / networks to disable rate limited. Only modified once per hour
+    /// An immutable snapshot is swapped atomically on reload, so that `check` does not need a lock
+    private let allowlistedIPs = Atomic<Unmanaged<AllowlistSnapshot>?>(nil)
+
+    /// Snapshot replaced by the last reload. It is released one reload later, long after all readers of it finished. Only accessed by `publish`
+    private var retiredAllowlist: Unmanaged<AllowlistSnapshot>? = nil
     
     /// See https://www.cloudflare.com/en-gb/ips/
     /// Last updated 2026-02-19
@@ -44,47 +51,44 @@ final actor RateLimiter {
         if let ipAllowlistPath = Environment.get("IP_ALLOWLIST_PATH") {
             do {
                 let cidr = try CIDR(filename: ipAllowlistPath)
-                allowlistedIPs = cidr
+                publish(allowlist: cidr)
                 print("IP allow list loaded \(cidr.ips.count) address ranges")
             } catch {
                 print("Failed to load allowlisted IPs from \(ipAllowlistPath): \(error)")
             }
-        } else {
-            allowlistedIPs = nil
         }
     }
 
-    /// Called every minute from a life cycle handler
+    /// Called every minute from a life cycle handler. Counters expire by themselves at the end of each window
     func minutelyCallback() {
         let now = Timestamp.now().timeIntervalSince1970
-        minutelyPerIPv4.removeAll(keepingCapacity: true)
-        minutelyPerIPv6.removeAll(keepingCapacity: true)
         if (now % 3600) < 60 {
             if let path = Environment.get("IP_ALLOWLIST_PATH") {
                 do {
                     let allowlistedIPs = try CIDR(filename: path)
-                    if self.allowlistedIPs != allowlistedIPs {
-                        self.allowlistedIPs = allowlistedIPs
+                    if self.allowlistedIPs.load(ordering: .acquiring)?.takeUnretainedValue().cidr != allowlistedIPs {
+                        publish(allowlist: allowlistedIPs)
                     }
                 } catch {
                     print("Failed to load allowlisted IPs from \(path): \(error)")
                 }
             }
-            hourlyPerIPv4.removeAll(keepingCapacity: true)
-            hourlyPerIPv6.removeAll(keepingCapacity: true)
-        }
-        if (now % (24 * 3600)) < 60 {
-            dailyPerIPv4.removeAll(keepingCapacity: true)
-            dailyPerIPv6.removeAll(keepingCapacity: true)
         }
     }
 
+    /// Replace the allow list. Only called from `init` and `minutelyCallback`, which do not run concurrently
+    private func publish(allowlist cidr: CIDR) {
+        let previous = allowlistedIPs.exchange(Unmanaged.passRetained(AllowlistSnapshot(cidr: cidr)), ordering: .acquiringAndReleasing)
+        retiredAllowlist?.release()
+        retiredAllowlist = previous
+    }
+
     /// Check if the current IP address is over quota and throw an error. If not return.
     func check(address: SocketAddress) throws {
         guard Self.limitDaily > 0 || Self.limitHourly > 0 || Self.limitMinutely > 0 else {
             return
         }
-        if allowlistedIPs?.contains(address) == true {
+        if let allowlist = allowlistedIPs.load(ordering: .acquiring), allowlist.takeUnretainedValue().cidr.contains(address) {
             return // always allow this IP address
         }
         switch address {
@@ -101,30 +105,24 @@ final actor RateLimiter {
     }
     
     func check(uint32 ip: UInt32) throws {
-        if Self.limitMinutely > 0, let usageMinutely = minutelyPerIPv4[ip], usageMinutely >= Self.limitMinutely {
-            OmMetrics.limiterMinutelyExceededTotal.add(1, ordering: .relaxed)
-            throw RateLimitError.minutelyExceeded
-        }
-        if Self.limitHourly > 0, let usageHourly = hourlyPerIPv4[ip], usageHourly >= Self.limitHourly {
-            OmMetrics.limiterHourlyExceededTotal.add(1, ordering: .relaxed)
-            throw RateLimitError.hourlyExceeded
-        }
-        if Self.limitDaily > 0, let usageDaily = dailyPerIPv4[ip], usageDaily >= Self.limitDaily {
-            OmMetrics.limiterDailyExceededTotal.add(1, ordering: .relaxed)
-            throw RateLimitError.dailyExceeded
-        }
+        try check(key: UInt64(ip) | Self.ipv4Tag)
     }
     
     func check(int64 ip: Int) throws {
-        if Self.limitMinutely > 0, let usageMinutely = minutelyPerIPv6[ip], usageMinutely >= Self.limitMinutely {
+        try check(key: UInt64(bitPattern: Int64(ip)))
+    }
+    
+    private func check(key: UInt64) throws {
+        let now = Timestamp.now().timeIntervalSince1970
+        if Self.limitMinutely > 0, minutely.usage(key: key, now: now) >= Self.limitMinutely {
             OmMetrics.limiterMinutelyExceededTotal.add(1, ordering: .relaxed)
             throw RateLimitError.minutelyExceeded
         }
-        if Self.limitHourly > 0, let usageHourly = hourlyPerIPv6[ip], usageHourly >= Self.limitHourly {
+        if Self.limitHourly > 0, hourly.usage(key: key, now: now) >= Self.limitHourly {
             OmMetrics.limiterHourlyExceededTotal.add(1, ordering: .relaxed)
             throw RateLimitError.hourlyExceeded
         }
-        if Self.limitDaily > 0, let usageDaily = dailyPerIPv6[ip], usageDaily >= Self.limitDaily {
+        if Self.limitDaily > 0, daily.usage(key: key, now: now) >= Self.limitDaily {
             OmMetrics.limiterDailyExceededTotal.add(1, ordering: .relaxed)
             throw RateLimitError.dailyExceeded
         }
@@ -150,30 +148,36 @@ final actor RateLimiter {
     }
     
     func increment(uint32 ip: UInt32, count: Float) {
-        if Self.limitMinutely > 0 {
-            minutelyPerIPv4[ip] = count + (minutelyPerIPv4[ip] ?? 0)
-        }
-        if Self.limitHourly > 0 {
-            hourlyPerIPv4[ip] = count + (hourlyPerIPv4[ip] ?? 0)
-        }
-        if Self.limitDaily > 0 {
-            dailyPerIPv4[ip] = count + (dailyPerIPv4[ip] ?? 0)
-        }
+        increment(key: UInt64(ip) | Self.ipv4Tag, count: count)
     }
     
     func increment(int64 ip: Int, count: Float) {
+        increment(key: UInt64(bitPattern: Int64(ip)), count: count)
+    }
+    
+    private func increment(key: UInt64, count: Float) {
+        let now = Timestamp.now().timeIntervalSince1970
         if Self.limitMinutely > 0 {
-            minutelyPerIPv6[ip] = count + (minutelyPerIPv6[ip] ?? 0)
+            minutely.add(key: key, count: count, now: now)
         }
         if Self.limitHourly > 0 {
-            hourlyPerIPv6[ip] = count + (hourlyPerIPv6[ip] ?? 0)
+            hourly.add(key: key, count: count, now: now)
         }
         if Self.limitDaily > 0 {
-            dailyPerIPv6[ip] = count + (dailyPerIPv6[ip] ?? 0)
+            daily.add(key: key, count: count, now: now)
         }
     }
 }
 
+/// Immutable allow list published by `RateLimiter`
+fileprivate final class AllowlistSnapshot: @unchecked Sendable {
+    let cidr: CIDR
+
+    init(cidr: CIDR) {
+        self.cidr = cidr
+    }
+}
+
 extension CIDR {
     /// Check if the IP is explicitly listed
     func contains(_ socket: SocketAddress) -> Bool {
@@ -230,7 +234,7 @@ extension Request {
         }
         /// Free API
         if headers[.host].contains(where: { $0.contains("open-meteo.com") && !$0.starts(with: "customer-") }) {
-            await RateLimiter.instance.increment(address: address, count: weight)
+            RateLimiter.instance.increment(address: address, count: weight)
         }
     }
 }
@@ -0,0 +1,372 @@
+import Foundation
+import Vapor
+
+extension ForecastapiResult {
+    /**
+     Arrow IPC streaming format for bulk analytics clients. Each location and section (current, minutely_15, hourly, ...) is written as a separate IPC stream with one schema and one record batch.
+     Streams are concatenated. Clients read streams until the response is consumed, e.g. `while f.tell() < size: pyarrow.ipc.open_stream(f).read_all()`.
+
+     Location information and the section name are stored as schema metadata. The first column `time` is a UTC timestamp in seconds.
+     Float columns are copied straight from the result arrays without text formatting. Missing values remain `NaN`.
+     */
+    func toArrowResponse(concurrencySlot: Int?, encoding: ResponseContentEncoding? = nil, logger: Logger) throws -> Response {
+        let response = Response(body: .init(cacheableStream: { writer in
+            try await writer.submit(concurrencySlot: concurrencySlot, logger: logger) {
+                var b = BufferAndAsyncWriter(writer: writer, encoding: encoding)
+                for location in results {
+                    guard let first = location.results.first else {
+                        continue
+                    }
+                    let metadata: [(String, String)] = [
+                        ("location_id", "\(location.locationId)"),
+                        ("latitude", "\(first.latitude)"),
+                        ("longitude", "\(first.longitude)"),
+                        ("elevation", first.elevation.map({ $0.isFinite ? "\($0)" : "NaN" }) ?? "NaN"),
+                        ("utc_offset_seconds", "\(location.utc_offset_seconds)"),
+                        ("timezone", location.timezone.identifier),
+                        ("timezone_abbreviation", location.timezone.abbreviation)
+                    ]
+                    if let current = try await location.current(variables: variables.currentVariables) {
+                        let columns = current.columns.map { ArrowColumn(name: $0.variable, data: .float([$0.value])) }
+                        try await b.writeArrowStream(time: CollectionOfOne(current.time), count: 1, columns: columns, metadata: metadata + [("section", current.name)])
+                    }
+                    try await location.minutely15(variables: variables.minutely15Variables)?.writeArrow(into: &b, metadata: metadata)
+                    try await location.hourly(variables: variables.hourlyVariables)?.writeArrow(into: &b, metadata: metadata)
+                    try await location.daily(variables: variables.dailyVariables)?.writeArrow(into: &b, metadata: metadata)
+                    try await location.weekly(variables: variables.weeklyVariables)?.writeArrow(into: &b, metadata: metadata)
+                    try await location.monthly(variables: variables.monthlyVariables)?.writeArrow(into: &b, metadata: metadata)
+                }
+                try await b.flush()
+                try await b.end()
+            }
+        }, count: -1))
+        response.headers.replaceOrAdd(name: .contentType, value: "application/vnd.apache.arrow.stream")
+        response.setContentEncoding(encoding)
+        return response
+    }
+}
+
+extension ApiSectionString {
+    fileprivate func writeArrow(into b: inout BufferAndAsyncWriter, metadata: [(String, String)]) async throws {
+        let columns = self.columns.map { ArrowColumn(name: $0.variable, data: $0.data) }
+        try await b.writeArrowStream(time: time, count: time.count, columns: columns, metadata: metadata + [("section", name)])
+    }
+}
+
+fileprivate struct ArrowColumn {
+    let name: String
+    let data: ApiArray
+
+    /// Number of missing timestamps. Float columns keep NaN and do not use a validity bitmap
+    var nullCount: Int {
+        switch data {
+        case .float:
+            return 0
+        case .timestamp(let values):
+            return values.reduce(0) { $0 + ($1.isNoData ? 1 : 0) }
+        }
+    }
+}
+
+extension BufferAndAsyncWriter {
+    /// Number of values written before checking if the buffer should be flushed
+    private static let arrowChunkSize = 16 * 1024
+
+    /// Write schema, one record batch and the end-of-stream marker. The body is streamed column by column
+    fileprivate mutating func writeArrowStream<Time: Sequence<Timestamp>>(time: Time, count: Int, columns: [ArrowColumn], metadata: [(String, String)]) async throws {
+        let types = columns.map { column -> (name: String, type: ArrowIpc.ColumnType) in
+            switch column.data {
+            case .float:
+                return (column.name, .float32)
+            case .timestamp:
+                return (column.name, .timestamp)
+            }
+        }
+        let schema = ArrowIpc.schema(columns: [("time", .timestamp)] + types, metadata: metadata)
+        buffer.writeArrowMessage(schema)
+
+        // Body layout: per column an optional validity bitmap and the values. All buffers are padded to 8 bytes
+        var nodes = [(length: Int, nullCount: Int)]()
+        var buffers = [(offset: Int, length: Int)]()
+        var bodyLength = 0
+        func addColumn(nullCount: Int, elementSize: Int) {
+            nodes.append((count, nullCount))
+            let validityLength = nullCount > 0 ? count.divideRoundedUp(divisor: 8) : 0
+            buffers.append((bodyLength, validityLength))
+            bodyLength += validityLength.ceil(to: 8)
+            buffers.append((bodyLength, count * elementSize))
+            bodyLength += (count * elementSize).ceil(to: 8)
+        }
+        let nullCounts = columns.map { $0.nullCount }
+        addColumn(nullCount: 0, elementSize: MemoryLayout<Int64>.size)
+        for (column, nullCount) in zip(columns, nullCounts) {
+            switch column.data {
+            case .float:
+                addColumn(nullCount: 0, elementSize: MemoryLayout<Float>.size)
+            case .timestamp:
+                addColumn(nullCount: nullCount, elementSize: MemoryLayout<Int64>.size)
+            }
+        }
+        buffer.writeArrowMessage(ArrowIpc.recordBatch(length: count, nodes: nodes, buffers: buffers, bodyLength: bodyLength))
+
+        for (i, t) in time.enumerated() {
+            buffer.writeInteger(Int64(t.timeIntervalSince1970), endianness: .little)
+            if i % Self.arrowChunkSize == Self.arrowChunkSize - 1 {
+                try await flushIfRequired()
+            }
+        }
+        buffer.writeRepeatingByte(0, count: (count * 8).ceil(to: 8) - count * 8)
+        for (column, nullCount) in zip(columns, nullCounts) {
+            switch column.data {
+            case .float(let values):
+                // Memory layout of `[Float]` is identical to Arrow float32 on little endian systems
+                for start in stride(from: 0, to: values.count, by: Self.arrowChunkSize) {
+                    let end = Swift.min(start + Self.arrowChunkSize, values.count)
+                    values[start..<end].withUnsafeBytes { _ = buffer.writeBytes($0) }
+                    try await flushIfRequired()
+                }
+                buffer.writeRepeatingByte(0, count: (count * 4).ceil(to: 8) - count * 4)
+            case .timestamp(let values):
+                if nullCount > 0 {
+                    let validityLength = count.divideRoundedUp(divisor: 8)
+                    for byte in 0..<validityLength {
+                        var bits: UInt8 = 0
+                        for bit in 0..<Swift.min(8, count - byte * 8) where !values[byte * 8 + bit].isNoData {
+                            bits |= 1 << bit
+                        }
+                        buffer.writeInteger(bits)
+                    }
+                    buffer.writeRepeatingByte(0, count: validityLength.ceil(to: 8) - validityLength)
+                }
+                for (i, t) in values.enumerated() {
+                    buffer.writeInteger(t.isNoData ? 0 : Int64(t.timeIntervalSince1970), endianness: .little)
+                    if i % Self.arrowChunkSize == Self.arrowChunkSize - 1 {
+                        try await flushIfRequired()
+                    }
+                }
+            }
+            try await flushIfRequired()
+        }
+        buffer.writeArrowEndOfStream()
+        try await flushIfRequired()
+    }
+}
+
+extension ByteBuffer {
+    /// Write an encapsulated Arrow IPC message: continuation marker, metadata length and the metadata padded to 8 bytes. The message body must follow
+    mutating func writeArrowMessage(_ metadata: [UInt8]) {
+        let paddedLength = metadata.count.ceil(to: 8)
+        writeInteger(UInt32.max, endianness: .little)
+        writeInteger(Int32(paddedLength), endianness: .little)
+        writeBytes(metadata)
+        writeRepeatingByte(0, count: paddedLength - metadata.count)
+    }
+
+    /// Continuation marker followed by a zero metadata length
+    mutating func writeArrowEndOfStream() {
+        writeInteger(UInt32.max, endianness: .little)
+        writeInteger(Int32(0), endianness: .little)
+    }
+}
+
+/// Metadata messages of the Arrow IPC format (`Message.fbs` and `Schema.fbs`). Only columns of type float32 and timestamp without dictionaries or compression are supported
+enum ArrowIpc {
+    enum ColumnType {
+        case float32
+        /// Seconds since 1970 in UTC
+        case timestamp
+    }
+
+    /// `MetadataVersion.V5`
+    private static let metadataVersion: Int16 = 4
+
+    /// `MessageHeader` union types
+    private static let headerSchema: UInt8 = 1
+    private static let headerRecordBatch: UInt8 = 3
+
+    /// `Type` union types
+    private static let typeFloatingPoint: UInt8 = 3
+    private static let typeTimestamp: UInt8 = 10
+
+    /// `Precision.SINGLE`
+    private static let precisionSingle: Int16 = 1
+
+    private static func message(headerType: UInt8, bodyLength: Int, header: (inout ArrowFlatBufferEncoder, Int?) -> Void) -> [UInt8] {
+        var e = ArrowFlatBufferEncoder()
+        // Root offset
+        e.append(UInt32(0))
+        let message = e.table([.int16(metadataVersion), .uint8(headerType), .offset, .int64(Int64(bodyLength))], referencedFrom: 0)
+        header(&e, message[2])
+        return e.bytes
+    }
+
+    /// Schema message with nullable columns and key-value metadata
+    static func schema(columns: [(name: String, type: ColumnType)], metadata: [(String, String)]) -> [UInt8] {
+        return message(headerType: headerSchema, bodyLength: 0) { e, position in
+            // endianness defaults to little
+            let schema = e.table([.absent, .offset, .offset], referencedFrom: position)
+            let fields = e.offsetVector(count: columns.count, referencedFrom: schema[1])
+            for (column, fieldPosition) in zip(columns, fields) {
+                let typeType: UInt8 = column.type == .float32 ? typeFloatingPoint : typeTimestamp
+                // name, nullable, type_type, type, dictionary, children
+                let field = e.table([.offset, .uint8(1), .uint8(typeType), .offset, .absent, .offset], referencedFrom: fieldPosition)
+                e.string(column.name, referencedFrom: field[0])
+                switch column.type {
+                case .float32:
+                    e.table([.int16(precisionSingle)], referencedFrom: field[3])
+                case .timestamp:
+                    // unit defaults to seconds
+                    let timestamp = e.table([.absent, .offset], referencedFrom: field[3])
+                    e.string("UTC", referencedFrom: timestamp[1])
+                }
+                // Readers require the children vector to be present
+                e.offsetVector(count: 0, referencedFrom: field[5])
+            }
+            let keyValues = e.offsetVector(count: metadata.count, referencedFrom: schema[2])
+            for ((key, value), keyValuePosition) in zip(metadata, keyValues) {
+                let keyValue = e.table([.offset, .offset], referencedFrom: keyValuePosition)
+                e.string(key, referencedFrom: keyValue[0])
+                e.string(value, referencedFrom: keyValue[1])
+            }
+        }
+    }
+
+    /// Record batch message. `nodes` contains one entry per column, `buffers` the validity and value buffers of each column relative to the start of the body
+    static func recordBatch(length: Int, nodes: [(length: Int, nullCount: Int)], buffers: [(offset: Int, length: Int)], bodyLength: Int) -> [UInt8] {
+        return message(headerType: headerRecordBatch, bodyLength: bodyLength) { e, position in
+            let recordBatch = e.table([.int64(Int64(length)), .offset, .offset], referencedFrom: position)
+            e.structVector(nodes.map { ($0.length, $0.nullCount) }, referencedFrom: recordBatch[1])
+            e.structVector(buffers.map { ($0.offset, $0.length) }, referencedFrom: recordBatch[2])
+        }
+    }
+}
+
+/// Minimal FlatBuffers encoder writing front to back. Child objects are appended after their parent and the offset in the parent is updated once the child position is known
+fileprivate struct ArrowFlatBufferEncoder {
+    enum Field {
+        case absent
+        case uint8(UInt8)
+        case int16(Int16)
+        case int32(Int32)
+        case int64(Int64)
+        /// Reference to a table, string or vector that is written afterwards
+        case offset
+
+        var size: Int {
+            switch self {
+            case .absent:
+                return 0
+            case .uint8:
+                return 1
+            case .int16:
+                return 2
+            case .int32, .offset:
+                return 4
+            case .int64:
+                return 8
+            }
+        }
+    }
+
+    var bytes = [UInt8]()
+
+    mutating func pad(to alignment: Int) {
+        while bytes.count % alignment != 0 {
+            bytes.append(0)
+        }
+    }
+
+    mutating func append<T: FixedWidthInteger>(_ value: T) {
+        withUnsafeBytes(of: value.littleEndian) { bytes.append(contentsOf: $0) }
+    }
+
+    mutating func set<T: FixedWidthInteger>(_ value: T, at position: Int) {
+        withUnsafeBytes(of: value.littleEndian) { bytes.replaceSubrange(position ..< position + MemoryLayout<T>.size, with: $0) }
+    }
+
+    /// Point the offset field at `position` to the current end of the buffer
+    mutating func setOffset(at position: Int?) {
+        guard let position else {
+            return
+        }
+        set(UInt32(bytes.count - position), at: position)
+    }
+
+    /// Write a vtable followed by the table. Fields are ordered by size to keep them aligned. Returns the positions of `offset` fields
+    @discardableResult
+    mutating func table(_ fields: [Field], referencedFrom: Int?) -> [Int?] {
+        let order = fields.indices.filter { fields[$0].size > 0 }.sorted { fields[$0].size == fields[$1].size ? $0 < $1 : fields[$0].size > fields[$1].size }
+        var fieldOffsets = [Int](repeating: 0, count: fields.count)
+        // Table starts with the signed offset to its vtable
+        var tableSize = 4
+        for i in order {
+            tableSize = tableSize.ceil(to: fields[i].size)
+            fieldOffsets[i] = tableSize
+            tableSize += fields[i].size
+        }
+        pad(to: 2)
+        let vtable = bytes.count
+        append(UInt16(4 + 2 * fields.count))
+        append(UInt16(tableSize))
+        for offset in fieldOffsets {
+            append(UInt16(offset))
+        }
+        pad(to: 8)
+        let table = bytes.count
+        setOffset(at: referencedFrom)
+        append(Int32(table - vtable))
+        bytes.append(contentsOf: repeatElement(0, count: tableSize - 4))
+        var positions = [Int?](repeating: nil, count: fields.count)
+        for i in order {
+            let position = table + fieldOffsets[i]
+            switch fields[i] {
+            case .absent:
+                break
+            case .uint8(let value):
+                set(value, at: position)
+            case .int16(let value):
+                set(value, at: position)
+            case .int32(let value):
+                set(value, at: position)
+            case .int64(let value):
+                set(value, at: position)
+            case .offset:
+                positions[i] = position
+            }
+        }
+        return positions
+    }
+
+    /// Zero terminated string with length prefix
+    mutating func string(_ value: String, referencedFrom: Int?) {
+        pad(to: 4)
+        setOffset(at: referencedFrom)
+        append(UInt32(value.utf8.count))
+        bytes.append(contentsOf: value.utf8)
+        bytes.append(0)
+    }
+
+    /// Vector of offsets. Returns the position of each element
+    @discardableResult
+    mutating func offsetVector(count: Int, referencedFrom: Int?) -> [Int] {
+        pad(to: 4)
+        setOffset(at: referencedFrom)
+        append(UInt32(count))
+        let start = bytes.count
+        bytes.append(contentsOf: repeatElement(0, count: 4 * count))
+        return (0..<count).map { start + 4 * $0 }
+    }
+
+    /// Vector of structs with two 64 bit integers like `FieldNode` and `Buffer`. Elements are aligned to 8 bytes
+    mutating func structVector(_ values: [(Int, Int)], referencedFrom: Int?) {
+        while (bytes.count + 4) % 8 != 0 {
+            bytes.append(0)
+        }
+        setOffset(at: referencedFrom)
+        append(UInt32(values.count))
+        for (a, b) in values {
+            append(Int64(a))
+            append(Int64(b))
+        }
+    }
+}
@@ -4,10 +4,10 @@ import Vapor
 
 extension ForecastapiResult {
     /// Streaming CSV format. Once 3kb of text is accumulated, flush to next handler -> response compressor
-    func toCsvResponse(concurrencySlot: Int?, withLocationHeader: Bool = true, logger: Logger) throws -> Response {
-        let response = Response(body: .init(asyncStream: { writer in
-            try await writer.submit(concurrencySlot: concurrencySlot, logger: logger) {
-                var b = BufferAndAsyncWriter(writer: writer)
+    func toCsvResponse(concurrencySlot: Int?, withLocationHeader: Bool = true, encoding: ResponseContentEncoding? = nil, logger: Logger) throws -> Response {
+        let response = Response(body: .init(cacheableStream: { writer in
+            try await writer.submit(concurrencySlot: concurrencySlot, encoding: encoding, logger: logger) {
+                var b = BufferAndAsyncWriter(writer: writer, encoding: encoding)
                 let multiLocation = results.count > 1
 
                 if withLocationHeader {
@@ -52,6 +52,7 @@ extension ForecastapiResult {
 
         response.headers.replaceOrAdd(name: .contentType, value: "text/csv; charset=utf-8")
         response.headers.replaceOrAdd(name: .contentDisposition, value: "attachment; filename=\"open-meteo-\(results.first?.results.first?.formatedCoordinatesFilename ?? "").csv\"")
+        response.setContentEncoding(encoding)
         return response
     }
 }
@@ -80,11 +81,8 @@ extension ApiSectionSingle {
         }
         b.buffer.writeString(time)
         for e in columns {
-            if e.value.isFinite {
-                b.buffer.writeString(",\(e.value.formatted(decimals: e.unit.significantDigits))")
-            } else {
-                b.buffer.writeString(",NaN")
-            }
+            b.buffer.writeString(",")
+            b.buffer.writeFloat(e.value, decimals: e.unit.significantDigits, nan: "NaN")
         }
         b.buffer.writeString("\n")
         try await b.flushIfRequired()
@@ -110,19 +108,18 @@ extension ApiSectionString {
             b.buffer.writeString("\n")
         }
 
-        for (i, time) in time.iterate(format: timeformat, utc_offset_seconds: utc_offset_seconds, quotedString: false, onlyDate: time.dtSeconds >= 86400).enumerated() {
+        var formatter = TimestampBufferFormatter(format: timeformat, utc_offset_seconds: utc_offset_seconds, quotedString: false, onlyDate: time.dtSeconds >= 86400)
+        for (i, timestamp) in time.enumerated() {
             if let location_id {
-                b.buffer.writeString("\(location_id),")
+                b.buffer.writeDecimal(location_id)
+                b.buffer.writeString(",")
             }
-            b.buffer.writeString(time)
+            formatter.write(timestamp, into: &b.buffer)
             for e in columns {
                 switch e.data {
                 case .float(let a):
-                    if a[i].isFinite {
-                        b.buffer.writeString(",\(a[i].formatted(decimals: e.unit.significantDigits))")
-                    } else {
-                        b.buffer.writeString(",NaN")
-                    }
+                    b.buffer.writeString(",")
+                    b.buffer.writeFloat(a[i], decimals: e.unit.significantDigits, nan: "NaN")
                 case .timestamp(let a):
                     if a[i].isNoData {
                         b.buffer.writeString(",")
@@ -2,6 +2,7 @@ import Foundation
 import Vapor
 import FlatBuffers
 import OpenMeteoSdk
+import CHelper
 
 protocol FlatBuffersVariable: RawRepresentableString {
     func getFlatBuffersMeta() -> FlatBufferVariableMeta
@@ -9,7 +10,7 @@ protocol FlatBuffersVariable: RawRepresentableString {
 
 protocol ForecastapiResponder {
     func calculateQueryWeight() -> Float
-    func response(format: ForecastResultFormatWithOptions?, concurrencySlot: Int?, prefetch: Bool, logger: Logger) async throws -> Response
+    func response(format: ForecastResultFormatWithOptions?, concurrencySlot: Int?, prefetch: Bool, encoding: ResponseContentEncoding?, logger: Logger) async throws -> Response
 }
 
 protocol ModelFlatbufferSerialisable {
@@ -202,7 +203,8 @@ struct ForecastapiResult<Model: ModelFlatbufferSerialisable>: ForecastapiRespond
 
     /// Output the given result set with a specified format
     /// timestamp and fixedGenerationTime are used to overwrite dynamic fields in unit tests
-    func response(format: ForecastResultFormatWithOptions?, concurrencySlot: Int? = nil, prefetch: Bool = true, logger: Logger) async throws -> Response {
+    /// If `encoding` is set, streamed responses are compressed before they are sent to the client
+    func response(format: ForecastResultFormatWithOptions?, concurrencySlot: Int? = nil, prefetch: Bool = true, encoding: ResponseContentEncoding? = nil, logger: Logger) async throws -> Response {
         if case .xlsx = format, results.count > 100 {
             throw ForecastApiError.generic(message: "XLSX supports only up to 100 locations")
         }
@@ -215,23 +217,25 @@ struct ForecastapiResult<Model: ModelFlatbufferSerialisable>: ForecastapiRespond
         }
         switch format ?? .json() {
         case .json(let fixedGenerationTime):
-            return try toJsonResponse(fixedGenerationTime: fixedGenerationTime, concurrencySlot: concurrencySlot, logger: logger)
+            return try toJsonResponse(fixedGenerationTime: fixedGenerationTime, concurrencySlot: concurrencySlot, encoding: encoding, logger: logger)
         case .xlsx(let timestamp, let locationInformation):
             switch locationInformation {
             case .omit:
-                return try await toXlsxResponse(timestamp: timestamp, withLocationHeader: false)
+                return try toXlsxResponse(timestamp: timestamp, withLocationHeader: false, concurrencySlot: concurrencySlot, logger: logger)
             case .section:
-                return try await toXlsxResponse(timestamp: timestamp, withLocationHeader: true)
+                return try toXlsxResponse(timestamp: timestamp, withLocationHeader: true, concurrencySlot: concurrencySlot, logger: logger)
             }
         case .csv(let locationInformation):
             switch locationInformation {
                 case .omit:
-                return try toCsvResponse(concurrencySlot: concurrencySlot, withLocationHeader: false, logger: logger)
+                return try toCsvResponse(concurrencySlot: concurrencySlot, withLocationHeader: false, encoding: encoding, logger: logger)
                 case .section:
-                return try toCsvResponse(concurrencySlot: concurrencySlot, withLocationHeader: true, logger: logger)
+                return try toCsvResponse(concurrencySlot: concurrencySlot, withLocationHeader: true, encoding: encoding, logger: logger)
             }
         case .flatbuffers(let fixedGenerationTime):
-            return try toFlatbuffersResponse(fixedGenerationTime: fixedGenerationTime, concurrencySlot: concurrencySlot, logger: logger)
+            return try toFlatbuffersResponse(fixedGenerationTime: fixedGenerationTime, concurrencySlot: concurrencySlot, encoding: encoding, logger: logger)
+        case .arrow:
+            return try toArrowResponse(concurrencySlot: concurrencySlot, encoding: encoding, logger: logger)
         }
     }
 
@@ -354,7 +358,7 @@ enum ForecastResultFormat: String, Codable {
     case xlsx
     case csv
     case flatbuffers
-
+    case arrow
 }
 
 enum ForecastResultFormatWithOptions {
@@ -365,6 +369,8 @@ enum ForecastResultFormatWithOptions {
     case csv(locationInformation: OutputLocationInformation = .section)
     /// fixedGenerationTime is used to overwrite dynamic fields in unit tests
     case flatbuffers(fixedGenerationTime: Double? = nil)
+    /// Arrow IPC stream with one record batch per location and section
+    case arrow
 }
 
 /// Simplify flush commands
@@ -372,14 +378,26 @@ struct BufferAndAsyncWriter{
     let writer: any AsyncBodyStreamWriter
     var buffer: ByteBuffer
 
-    @inlinable init(writer: any AsyncBodyStreamWriter) {
+    /// If set, data is compressed before it is sent to `writer`
+    let compressor: ResponseCompressor?
+
+    /// Compressed output waiting to be sent
+    var compressed: ByteBuffer
+
+    /// Flush threshold. Compression uses a larger window, because zlib emits data in blocks anyway and small writes reduce compression ratio
+    let flushThreshold: Int
+
+    @inlinable init(writer: any AsyncBodyStreamWriter, encoding: ResponseContentEncoding? = nil) {
         self.writer = writer
-        self.buffer = ByteBufferAllocator().buffer(capacity: 4 * 1024)
+        self.compressor = encoding.map { ResponseCompressor(encoding: $0) }
+        self.flushThreshold = encoding == nil ? 3 * 1024 : 64 * 1024
+        self.buffer = ByteBufferAllocator().buffer(capacity: flushThreshold + 1024)
+        self.compressed = ByteBufferAllocator().buffer(capacity: encoding == nil ? 0 : 32 * 1024)
     }
 
     /// Check if enough data has been written to the buffer and flush if required
     @inlinable mutating func flushIfRequired() async throws {
-        if buffer.writerIndex > 3 * 1024 {
+        if buffer.writerIndex > flushThreshold {
             try await flush()
         }
     }
@@ -388,14 +406,74 @@ struct BufferAndAsyncWriter{
         guard buffer.writerIndex > 0 else {
             return
         }
+        if let compressor {
+            compressor.compress(buffer, into: &compressed, finish: false)
+            buffer.moveWriterIndex(to: 0)
+            try await writeCompressed()
+            return
+        }
         let bufferCopy = buffer
         try await writer.writeBuffer(bufferCopy)
         buffer.moveWriterIndex(to: 0)
     }
 
+    /// Send compressed data if zlib produced any output
+    @inlinable mutating func writeCompressed() async throws {
+        guard compressed.writerIndex > 0 else {
+            return
+        }
+        let bufferCopy = compressed
+        try await writer.writeBuffer(bufferCopy)
+        compressed.moveWriterIndex(to: 0)
+    }
+
     @inlinable mutating func end() async throws {
+        if let compressor {
+            compressor.compress(buffer, into: &compressed, finish: true)
+            buffer.moveWriterIndex(to: 0)
+            try await writeCompressed()
+        }
         try await writer.write(.end)
     }
+
+    /// Append a column of floats with a fixed number of decimals, separated by `separator`. Non finite values are written as `nan`.
+    /// Values are formatted in chunks directly into the buffer, flushing in between.
+    mutating func writeFloatColumn(_ values: [Float], decimals: Int, nan: StaticString, separator: UInt8 = UInt8(ascii: ",")) async throws {
+        let chunkSize = 1024
+        for start in stride(from: 0, to: values.count, by: chunkSize) {
+            if start > 0 {
+                buffer.writeInteger(separator)
+            }
+            let end = Swift.min(start + chunkSize, values.count)
+            values.withUnsafeBufferPointer { ptr in
+                buffer.writeFloats(UnsafeBufferPointer(rebasing: ptr[start..<end]), decimals: decimals, nan: nan, separator: separator)
+            }
+            try await flushIfRequired()
+        }
+    }
+}
+
+extension ByteBuffer {
+    /// Write floats with a fixed number of decimals using `formatFloatColumn` from CHelper. Output is identical to `Float.formatted(decimals:)`, but does not allocate a string per value
+    @discardableResult
+    mutating func writeFloats(_ values: UnsafeBufferPointer<Float>, decimals: Int, nan: StaticString, separator: UInt8 = UInt8(ascii: ",")) -> Int {
+        guard let base = values.baseAddress, values.count > 0 else {
+            return 0
+        }
+        let nanLength = nan.utf8CodeUnitCount
+        let capacity = values.count * (Int(FLOAT_FORMAT_MAX_BYTES) + nanLength)
+        return writeWithUnsafeMutableBytes(minimumWritableBytes: capacity) { out in
+            return formatFloatColumn(base, values.count, Int32(decimals), nan.utf8Start, nanLength, separator, out.baseAddress!.assumingMemoryBound(to: UInt8.self))
+        }
+    }
+
+    /// Write a single float with a fixed number of decimals. Non finite values are written as `nan`
+    @discardableResult
+    mutating func writeFloat(_ value: Float, decimals: Int, nan: StaticString) -> Int {
+        return withUnsafePointer(to: value) {
+            writeFloats(UnsafeBufferPointer(start: $0, count: 1), decimals: decimals, nan: nan)
+        }
+    }
 }
 
 extension Timestamp {
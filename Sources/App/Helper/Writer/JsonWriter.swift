@@ -3,7 +3,8 @@ import Vapor
 
 extension AsyncBodyStreamWriter {
     /// Execute async code and capture any errors. In case of error, print the error to the output stream
-    func submit(concurrencySlot: Int?, logger: Logger, _ task: @escaping () async throws -> Void) async throws {
+    /// If the body is compressed with `encoding`, plain text would corrupt the compressed stream. The stream is aborted instead, so that the client detects an incomplete response
+    func submit(concurrencySlot: Int?, encoding: ResponseContentEncoding? = nil, logger: Logger, _ task: @escaping () async throws -> Void) async throws {
         if let concurrencySlot {
             try await ConcurrencyGroupLimiter.instance.wait(slot: concurrencySlot, maxConcurrent: .max, maxConcurrentHard: .max)
         }
@@ -16,8 +17,15 @@ extension AsyncBodyStreamWriter {
             if let concurrencySlot {
                 await ConcurrencyGroupLimiter.instance.release(slot: concurrencySlot)
             }
+            OmMetrics.requestsStreamingErrorsTotal.add(1, ordering: .relaxed)
+            // The error text below completes the stream normally. It must not be cached
+            (self as? ApiResponseCaptureWriter)?.capture.finish(failed: true)
             logger.info("Error during streaming. Error \(error)")
             do {
+                if encoding != nil {
+                    try await write(.error(error))
+                    return
+                }
                 try await write(.buffer(.init(string: "Unexpected error while streaming data: \(error)")))
                 try await write(.end)
             } catch {
@@ -34,12 +42,12 @@ extension ForecastapiResult {
      Memory footprint is therefore much smaller and fits better into L2/L3 caches.
      Additionally code is fully async, to not block the a thread for almost a second to generate a JSON response...
      */
-    func toJsonResponse(fixedGenerationTime: Double?, concurrencySlot: Int?, logger: Logger) throws -> Response {
+    func toJsonResponse(fixedGenerationTime: Double?, concurrencySlot: Int?, encoding: ResponseContentEncoding? = nil, logger: Logger) throws -> Response {
         // First excution outside stream, to capture potential errors better
         // var first = try self.first?()
-        let response = Response(body: .init(asyncStream: { writer in
-            try await writer.submit(concurrencySlot: concurrencySlot, logger: logger) {
-                var b = BufferAndAsyncWriter(writer: writer)
+        let response = Response(body: .init(cacheableStream: { writer in
+            try await writer.submit(concurrencySlot: concurrencySlot, encoding: encoding, logger: logger) {
+                var b = BufferAndAsyncWriter(writer: writer, encoding: encoding)
                 /// For multiple locations, create an array of results
                 let isMultiPoint = results.count > 1
                 if isMultiPoint {
@@ -63,6 +71,7 @@ extension ForecastapiResult {
             }
         }))
         response.headers.replaceOrAdd(name: .contentType, value: "application/json; charset=utf-8")
+        response.setContentEncoding(encoding)
         return response
     }
 }
@@ -136,16 +145,7 @@ extension ForecastapiResult.PerLocation {
             b.buffer.writeString("\"time\":[")
 
             // Write time axis
-            var firstValue = true
-            for time in section.time.iterate(format: timeformat, utc_offset_seconds: utc_offset_seconds, quotedString: true, onlyDate: section.time.dtSeconds >= 86400) {
-                if firstValue {
-                    firstValue = false
-                } else {
-                    b.buffer.writeString(",")
-                }
-                b.buffer.writeString(time)
-                try await b.flushIfRequired()
-            }
+            try await b.writeTimeColumn(section.time, format: timeformat, utc_offset_seconds: utc_offset_seconds, quotedString: true, onlyDate: section.time.dtSeconds >= 86400)
             b.buffer.writeString("]")
 
             /// Write data
@@ -153,32 +153,11 @@ extension ForecastapiResult.PerLocation {
                 b.buffer.writeString(",")
                 b.buffer.writeString("\"\(e.variable)\":")
                 b.buffer.writeString("[")
-                var firstValue = true
                 switch e.data {
                 case .float(let floats):
-                    for v in floats {
-                        if firstValue {
-                            firstValue = false
-                        } else {
-                            b.buffer.writeString(",")
-                        }
-                        if v.isFinite {
-                            b.buffer.writeString(v.formatted(decimals: e.unit.significantDigits))
-                        } else {
-                            b.buffer.writeString("null")
-                        }
-                        try await b.flushIfRequired()
-                    }
+                    try await b.writeFloatColumn(floats, decimals: e.unit.significantDigits, nan: "null")
                 case .timestamp(let timestamps):
-                    for time in timestamps.iterate(format: timeformat, utc_offset_seconds: utc_offset_seconds, quotedString: true, onlyDate: false) {
-                        if firstValue {
-                            firstValue = false
-                        } else {
-                            b.buffer.writeString(",")
-                        }
-                        b.buffer.writeString(time)
-                        try await b.flushIfRequired()
-                    }
+                    try await b.writeTimeColumn(timestamps, format: timeformat, utc_offset_seconds: utc_offset_seconds, quotedString: true, onlyDate: false)
                 }
                 b.buffer.writeString("]")
                 try await b.flushIfRequired()
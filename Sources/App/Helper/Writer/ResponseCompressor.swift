@@ -0,0 +1,166 @@
+import Foundation
+import CZlib
+import NIOCore
+import Vapor
+import NIOConcurrencyHelpers
+
+/// Content encoding negotiated from the `Accept-Encoding` request header.
+/// zstd is not offered, because libzstd is not a dependency of this package.
+enum ResponseContentEncoding: String, Sendable {
+    case gzip
+    case deflate
+
+    /// Select the preferred encoding. Encodings with `q=0` are ignored. An explicit entry for an encoding takes precedence over the wildcard `*`. gzip is preferred over deflate.
+    init?(acceptEncoding: [String]) {
+        var gzip: Float? = nil
+        var deflate: Float? = nil
+        var wildcard: Float? = nil
+        for value in acceptEncoding {
+            for part in value.split(separator: ",") {
+                let parameters = part.split(separator: ";").map { $0.trimmingCharacters(in: .whitespaces).lowercased() }
+                guard let name = parameters.first else {
+                    continue
+                }
+                let q = parameters.dropFirst().first(where: { $0.starts(with: "q=") }).flatMap { Float($0.dropFirst(2)) } ?? 1
+                switch name {
+                case "gzip", "x-gzip":
+                    gzip = max(gzip ?? 0, q)
+                case "deflate":
+                    deflate = max(deflate ?? 0, q)
+                case "*":
+                    wildcard = max(wildcard ?? 0, q)
+                default:
+                    break
+                }
+            }
+        }
+        if (gzip ?? wildcard ?? 0) > 0 {
+            self = .gzip
+        } else if (deflate ?? wildcard ?? 0) > 0 {
+            self = .deflate
+        } else {
+            return nil
+        }
+    }
+
+    /// zlib window bits. `gzip` adds 16 for the gzip wrapper, `deflate` uses the zlib wrapper as required by HTTP
+    fileprivate var windowBits: Int32 {
+        switch self {
+        case .gzip:
+            return 15 | 16
+        case .deflate:
+            return 15
+        }
+    }
+}
+
+/// Initialised zlib deflate context. Only used by one request at a time.
+fileprivate struct DeflateContext: @unchecked Sendable {
+    let zstream: UnsafeMutablePointer<z_stream>
+}
+
+/// Pool of deflate contexts. Allocating the deflate state costs around 270 KB per request, which is avoided by `deflateReset` and reuse.
+/// Swift tasks may resume on any thread, therefore the pool is shared with a lock instead of thread local storage.
+fileprivate enum DeflateContextPool {
+    /// Keep at most this number of idle contexts per encoding
+    static let maxIdle = 2 * System.coreCount
+
+    static let gzip = NIOLockedValueBox<[DeflateContext]>([])
+    static let deflate = NIOLockedValueBox<[DeflateContext]>([])
+
+    static func pool(for encoding: ResponseContentEncoding) -> NIOLockedValueBox<[DeflateContext]> {
+        switch encoding {
+        case .gzip:
+            return gzip
+        case .deflate:
+            return deflate
+        }
+    }
+}
+
+/**
+ Streaming zlib compressor for HTTP responses. Output is produced incrementally and can be sent to the client after each `compress` call.
+ */
+final class ResponseCompressor {
+    let encoding: ResponseContentEncoding
+    private let context: DeflateContext
+
+    init(encoding: ResponseContentEncoding) {
+        self.encoding = encoding
+        if let context = DeflateContextPool.pool(for: encoding).withLockedValue({ $0.popLast() }) {
+            self.context = context
+            return
+        }
+        let zstream = UnsafeMutablePointer<z_stream>.allocate(capacity: 1)
+        zstream.pointee.zalloc = nil
+        zstream.pointee.zfree = nil
+        zstream.pointee.opaque = nil
+        // Compression level 6 is the zlib default and a good trade-off between ratio and CPU time
+        let ret = deflateInit2_(zstream, 6, Z_DEFLATED, encoding.windowBits, 8, Z_DEFAULT_STRATEGY, ZLIB_VERSION, Int32(MemoryLayout<z_stream>.size))
+        guard ret == Z_OK else {
+            fatalError("deflateInit2 failed, \(ret)")
+        }
+        self.context = DeflateContext(zstream: zstream)
+    }
+
+    /// Compress all readable bytes of `input` and append compressed data to `output`. Set `finish` to terminate the stream.
+    func compress(_ input: ByteBuffer, into output: inout ByteBuffer, finish: Bool) {
+        let zstream = context.zstream
+        input.withUnsafeReadableBytes { input in
+            zstream.pointee.next_in = UnsafeMutablePointer(mutating: input.bindMemory(to: Bytef.self).baseAddress)
+            zstream.pointee.avail_in = uInt(input.count)
+            while true {
+                var ret = Z_OK
+                output.writeWithUnsafeMutableBytes(minimumWritableBytes: Swift.max(4096, input.count / 4)) { ptr in
+                    zstream.pointee.next_out = ptr.baseAddress?.assumingMemoryBound(to: Bytef.self)
+                    zstream.pointee.avail_out = uInt(ptr.count)
+                    ret = deflate(zstream, finish ? Z_FINISH : Z_NO_FLUSH)
+                    return ptr.count - Int(zstream.pointee.avail_out)
+                }
+                if ret == Z_STREAM_END {
+                    break
+                }
+                guard ret == Z_OK || ret == Z_BUF_ERROR else {
+                    fatalError("deflate loop error, \(ret)")
+                }
+                // Without finish, all input is consumed once output space is left
+                if !finish && zstream.pointee.avail_in == 0 && zstream.pointee.avail_out > 0 {
+                    break
+                }
+            }
+            zstream.pointee.next_in = nil
+        }
+    }
+
+    deinit {
+        let zstream = context.zstream
+        guard deflateReset(zstream) == Z_OK else {
+            deflateEnd(zstream)
+            zstream.deallocate()
+            return
+        }
+        let returned = DeflateContextPool.pool(for: encoding).withLockedValue { pool in
+            guard pool.count < DeflateContextPool.maxIdle else {
+                return false
+            }
+            pool.append(context)
+            return true
+        }
+        if !returned {
+            deflateEnd(zstream)
+            zstream.deallocate()
+        }
+    }
+}
+
+extension Response {
+    /// Set `Content-Encoding` for a body compressed by `BufferAndAsyncWriter` and disable compression in the HTTP server
+    func setContentEncoding(_ encoding: ResponseContentEncoding?) {
+        guard let encoding else {
+            return
+        }
+        headers.replaceOrAdd(name: .contentEncoding, value: encoding.rawValue)
+        headers.add(name: .vary, value: "Accept-Encoding")
+        headers.responseCompression = .disable
+    }
+}
@@ -0,0 +1,130 @@
+import Foundation
+import NIOCore
+
+/**
+ Write time axes as ISO8601 or unix timestamps directly into a `ByteBuffer` without creating a string per timestamp.
+
+ The `YYYY-MM-DD` part is calculated once per day and copied for every following timestamp of the same day. Hour and minute are written as 2 digits.
+ Output is identical to `Sequence<Timestamp>.iterate(format:utc_offset_seconds:quotedString:onlyDate:)`.
+ */
+struct TimestampBufferFormatter {
+    let format: Timeformat
+    let utc_offset_seconds: Int
+    let quotedString: Bool
+    let onlyDate: Bool
+
+    /// Start of the day in local time for which `datePrefix` was calculated
+    private var cachedDay = Int.min
+
+    /// `YYYY-MM-` as little endian bytes
+    private var datePrefix: UInt64 = 0
+
+    /// `DD` as little endian bytes
+    private var dateDay: UInt16 = 0
+
+    /// Years with more than 4 digits are formatted using strings
+    private var dateIsValid = false
+
+    init(format: Timeformat, utc_offset_seconds: Int, quotedString: Bool, onlyDate: Bool) {
+        self.format = format
+        self.utc_offset_seconds = utc_offset_seconds
+        self.quotedString = quotedString
+        self.onlyDate = onlyDate
+    }
+
+    /// Two ASCII digits as little endian bytes
+    @inline(__always) private static func twoDigits(_ value: Int) -> UInt16 {
+        return UInt16(0x30 + value / 10) | UInt16(0x30 + value % 10) << 8
+    }
+
+    private mutating func updateDate(day: Int) {
+        cachedDay = day
+        var time = day
+        var t = tm()
+        gmtime_r(&time, &t)
+        let year = Int(t.tm_year + 1900)
+        dateIsValid = (0...9999).contains(year)
+        let yearHigh = UInt64(Self.twoDigits(year / 100 % 100))
+        let yearLow = UInt64(Self.twoDigits(year % 100))
+        let month = UInt64(Self.twoDigits(Int(t.tm_mon + 1)))
+        datePrefix = yearHigh | yearLow << 16 | UInt64(UInt8(ascii: "-")) << 32 | month << 40 | UInt64(UInt8(ascii: "-")) << 56
+        dateDay = Self.twoDigits(Int(t.tm_mday))
+    }
+
+    /// Write a single timestamp. Missing timestamps are written as `null`
+    mutating func write(_ raw: Timestamp, into buffer: inout ByteBuffer) {
+        if raw.isNoData {
+            buffer.writeStaticString("null")
+            return
+        }
+        switch format {
+        case .unixtime:
+            buffer.writeDecimal(raw.timeIntervalSince1970)
+        case .iso8601:
+            let time = raw.timeIntervalSince1970 + utc_offset_seconds
+            let secondOfDay = time.moduloPositive(86400)
+            if cachedDay != time - secondOfDay {
+                updateDate(day: time - secondOfDay)
+            }
+            guard dateIsValid else {
+                let element = raw.add(utc_offset_seconds)
+                let iso = onlyDate ? element.iso8601_YYYY_MM_dd : element.iso8601_YYYY_MM_dd_HH_mm
+                buffer.writeString(quotedString ? "\"\(iso)\"" : iso)
+                return
+            }
+            if quotedString {
+                buffer.writeInteger(UInt8(ascii: "\""))
+            }
+            buffer.writeInteger(datePrefix, endianness: .little)
+            buffer.writeInteger(dateDay, endianness: .little)
+            if !onlyDate {
+                buffer.writeInteger(UInt8(ascii: "T"))
+                buffer.writeInteger(Self.twoDigits(secondOfDay / 3600), endianness: .little)
+                buffer.writeInteger(UInt8(ascii: ":"))
+                buffer.writeInteger(Self.twoDigits(time.moduloPositive(3600) / 60), endianness: .little)
+            }
+            if quotedString {
+                buffer.writeInteger(UInt8(ascii: "\""))
+            }
+        }
+    }
+}
+
+extension BufferAndAsyncWriter {
+    /// Write a time axis separated by `separator`. Flushes in between
+    mutating func writeTimeColumn<S: Sequence<Timestamp>>(_ time: S, format: Timeformat, utc_offset_seconds: Int, quotedString: Bool, onlyDate: Bool, separator: UInt8 = UInt8(ascii: ",")) async throws {
+        var formatter = TimestampBufferFormatter(format: format, utc_offset_seconds: utc_offset_seconds, quotedString: quotedString, onlyDate: onlyDate)
+        var firstValue = true
+        for t in time {
+            if firstValue {
+                firstValue = false
+            } else {
+                buffer.writeInteger(separator)
+            }
+            formatter.write(t, into: &buffer)
+            try await flushIfRequired()
+        }
+    }
+}
+
+extension ByteBuffer {
+    /// Write an integer as decimal ASCII digits without creating a string
+    @discardableResult
+    mutating func writeDecimal(_ value: Int) -> Int {
+        return writeWithUnsafeMutableBytes(minimumWritableBytes: 20) { out in
+            var v = value.magnitude
+            var length = 0
+            repeat {
+                out[length] = UInt8(ascii: "0") + UInt8(v % 10)
+                v /= 10
+                length += 1
+            } while v > 0
+            if value < 0 {
+                out[length] = UInt8(ascii: "-")
+                length += 1
+            }
+            UnsafeMutableRawBufferPointer(rebasing: out[0..<length]).reverse()
+            return length
+        }
+    }
+}
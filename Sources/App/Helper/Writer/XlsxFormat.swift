@@ -1,14 +1,35 @@
 import Foundation
 import CZlib
 import NIOCore
+import Vapor
 
 /// Create a simple excel sheet with exactly one sheet and the bare minimum to make it work in office applications
 /// Please note that XLSX only support up to 16k columns
 public final class XlsxWriter {
-    let sheet_xml: GzipStream
+    let sheet_xml: ParallelGzipStream
+
+    /// If set, compressed sheet data is streamed to the client while rows are written
+    let zip: ZipStreamWriter?
 
     private(set) var isFirstRow: Bool = true
 
+    static let sheet_header = """
+        <?xml version="1.0" encoding="UTF-8" standalone="yes"?>
+        <worksheet xmlns="http://schemas.openxmlformats.org/spreadsheetml/2006/main" xmlns:r="http://schemas.openxmlformats.org/officeDocument/2006/relationships"><sheetData>
+        """
+
+    static let sheet_footer = "</sheetData></worksheet>"
+
+    static var staticFiles: [(path: String, compressed: ByteBuffer)] {
+        return [
+            (path: "[Content_Types].xml", compressed: Self.content_type),
+            (path: "xl/workbook.xml", compressed: Self.workbook_xml),
+            (path: "xl/_rels/workbook.xml.rels", compressed: Self.workbook_xml_rels),
+            (path: "_rels/.rels", compressed: Self.rels),
+            (path: "xl/styles.xml", compressed: Self.styles_xml)
+        ]
+    }
+
     static var workbook_xml: ByteBuffer {
         let workbook_xml = try! GzipStream(level: 6, chunkCapacity: 512)
         workbook_xml.write("""
@@ -54,12 +75,50 @@ public final class XlsxWriter {
         return styles_xml.finish()
     }
 
+    /// Collect the entire workbook in memory. Call `write(timestamp:)` to get the XLSX file
     public init() throws {
-        sheet_xml = try GzipStream(level: 6, chunkCapacity: 4096)
-        sheet_xml.write( """
-        <?xml version="1.0" encoding="UTF-8" standalone="yes"?>
-        <worksheet xmlns="http://schemas.openxmlformats.org/spreadsheetml/2006/main" xmlns:r="http://schemas.openxmlformats.org/officeDocument/2006/relationships"><sheetData>
-        """)
+        sheet_xml = ParallelGzipStream(level: 6)
+        zip = nil
+        sheet_xml.write(Self.sheet_header)
+    }
+
+    /// Stream the workbook to `writer`. Static parts are sent immediately and the sheet is sent while it is compressed. Call `finish()` at the end.
+    init(streamTo writer: any AsyncBodyStreamWriter, timestamp: Timestamp) async throws {
+        sheet_xml = ParallelGzipStream(level: 6, gzipHeader: false)
+        let zip = ZipStreamWriter(writer: writer, timestamp: timestamp)
+        for (path, compressed) in Self.staticFiles {
+            try await zip.write(path: path, compressed: compressed)
+        }
+        try await zip.startEntry(path: "xl/worksheets/sheet1.xml")
+        self.zip = zip
+        sheet_xml.write(Self.sheet_header)
+    }
+
+    /// Compress full chunks in the background and send compressed sheet data to the client once enough data is available
+    func flushIfRequired() async throws {
+        guard let zip else {
+            return
+        }
+        // Abort early instead of sending gigabytes that cannot be stored without ZIP64
+        guard sheet_xml.uncompressedSize <= ZipStreamWriter.maxSize else {
+            throw ZipStreamError.zipTooLarge
+        }
+        await sheet_xml.compressInBackground()
+        guard sheet_xml.writebuffer.readableBytes >= 64 * 1024 else {
+            return
+        }
+        try await zip.writeEntryData(sheet_xml.takeCompressed())
+    }
+
+    /// Finish the sheet and write the ZIP central directory. Does not end the stream.
+    func finish() async throws {
+        guard let zip else {
+            fatalError("XlsxWriter is not streaming")
+        }
+        sheet_xml.write(Self.sheet_footer)
+        try await zip.writeEntryData(sheet_xml.finishInBackground())
+        try await zip.endEntry(crc: sheet_xml.crc32, uncompressedSize: sheet_xml.uncompressedSize)
+        try await zip.finish()
     }
 
     public func startRow() {
@@ -97,14 +156,10 @@ public final class XlsxWriter {
     }
 
     func write(timestamp: Timestamp = .now()) -> ByteBuffer {
-        sheet_xml.write("</sheetData></worksheet>")
+        precondition(zip == nil, "XlsxWriter is streaming")
+        sheet_xml.write(Self.sheet_footer)
 
-        return ZipWriter.zip(files: [
-            (path: "[Content_Types].xml", compressed: Self.content_type),
-            (path: "xl/workbook.xml", compressed: Self.workbook_xml),
-            (path: "xl/_rels/workbook.xml.rels", compressed: Self.workbook_xml_rels),
-            (path: "_rels/.rels", compressed: Self.rels),
-            (path: "xl/styles.xml", compressed: Self.styles_xml),
+        return ZipWriter.zip(files: Self.staticFiles + [
             (path: "xl/worksheets/sheet1.xml", compressed: sheet_xml.finish())
         ], timestamp: timestamp)
     }
@@ -115,6 +170,8 @@ enum ZipStreamError: Error {
     case zlibInsufficientMemory
     case zlibVersionError
     case deflateInitFailed(code: Int32)
+    /// ZIP64 is not supported. Archives are limited to 4 GB and 65535 entries
+    case zipTooLarge
 }
 
 /// Gzip Stream compressor w
@@ -198,6 +255,245 @@ public final class GzipStream {
     }
 }
 
+/**
+ Gzip compressor that splits the input into independent chunks and compresses them in parallel like `pigz`.
+
+ Each chunk is deflated with the last 32 KB of the previous chunk as dictionary and terminated with `Z_SYNC_FLUSH`. The concatenated chunks form one valid deflate stream. The CRC of each chunk is merged with `crc32_combine`.
+ If all data fits into one chunk, the deflate stream is identical to `GzipStream`. Without `gzipHeader` the output is a raw deflate stream as used in ZIP files.
+
+ Streaming users call `compressInBackground()` regularly. Full chunks are then compressed as tasks on the shared `executor` and appended in order once they complete. Compressed data can be consumed with `takeCompressed()`.
+ At most `nConcurrent` chunks per stream are compressed at the same time. The shared executor limits compression of all requests to a part of the CPU cores and never blocks threads of the cooperative pool.
+ Without `compressInBackground()`, chunks are compressed on the calling thread. Memory is bounded by `chunkSize * nConcurrent` uncompressed bytes plus their compressed output.
+ */
+public final class ParallelGzipStream {
+    /// Shared by all streams. Compression of large XLSX responses must not occupy all cores of the API server
+    static let executor = LimitedConcurrencyExecutor(maxConcurrency: Swift.max(1, System.coreCount / 2))
+
+    let level: Int32
+    let chunkSize: Int
+    let nConcurrent: Int
+    let gzipHeader: Bool
+
+    /// Chunk that is currently filled by `write`
+    var current: ByteBuffer
+
+    /// Full chunks waiting to be compressed
+    var pending: [ByteBuffer]
+
+    /// Chunks that are compressed in the background. Ordered by their position in the stream
+    var compressing: [(task: Task<(compressed: ByteBuffer, crc: uLong), Never>, size: Int)] = []
+
+    /// Last 32 KB of the previous chunk. Used as dictionary for the next chunk.
+    var dictionary: ByteBuffer?
+
+    /// Combined CRC32 of all compressed chunks
+    var crc: uLong
+
+    /// Total uncompressed size. Gzip stores it modulo 2^32
+    var uncompressedSize: Int = 0
+
+    /// Compressed output including gzip header
+    var writebuffer: ByteBuffer
+
+    /// Deflate window size of 32 KB
+    static let windowSize = 32 * 1024
+
+    /// CRC32 of all compressed data
+    var crc32: UInt32 {
+        return UInt32(truncatingIfNeeded: crc)
+    }
+
+    public init(level: Int32 = 6, chunkSize: Int = 128 * 1024, nConcurrent: Int = 4, gzipHeader: Bool = true) {
+        precondition(chunkSize >= Self.windowSize)
+        precondition(nConcurrent > 0)
+        self.level = level
+        self.chunkSize = chunkSize
+        self.nConcurrent = nConcurrent
+        self.gzipHeader = gzipHeader
+        self.current = ByteBufferAllocator().buffer(capacity: chunkSize)
+        self.pending = []
+        self.pending.reserveCapacity(nConcurrent)
+        self.crc = crc32(0, nil, 0)
+        self.writebuffer = ByteBufferAllocator().buffer(capacity: 4096)
+        if gzipHeader {
+            // gzip header: magic, deflate, no flags, no mtime, no extra flags, unix
+            writebuffer.writeBytes([0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03])
+        }
+    }
+
+    public func write(_ str: String) {
+        str.utf8.withContiguousStorageIfAvailable { body in
+            write(data: UnsafeRawBufferPointer(body))
+        } ?? {
+            var str = str
+            str.withUTF8({ body in
+                write(data: UnsafeRawBufferPointer(body))
+            })
+        }()
+    }
+
+    /// Append data to the current chunk. Without background compression, `nConcurrent` full chunks are compressed on the calling thread
+    func write(data: UnsafeRawBufferPointer) {
+        var offset = 0
+        while offset < data.count {
+            let count = Swift.min(data.count - offset, chunkSize - current.readableBytes)
+            current.writeBytes(UnsafeRawBufferPointer(rebasing: data[offset ..< offset + count]))
+            offset += count
+            if current.readableBytes == chunkSize {
+                pending.append(current)
+                current = ByteBufferAllocator().buffer(capacity: chunkSize)
+                if pending.count >= nConcurrent && compressing.isEmpty {
+                    compressPending(finish: false)
+                }
+            }
+        }
+    }
+
+    /// Return all compressed data produced so far and clear the output buffer
+    public func takeCompressed() -> ByteBuffer {
+        let data = writebuffer
+        writebuffer = ByteBufferAllocator().buffer(capacity: data.capacity)
+        return data
+    }
+
+    /// flush and return data. If `takeCompressed` was used, only the remaining data is returned
+    public func finish() -> ByteBuffer {
+        precondition(compressing.isEmpty, "Use finishInBackground() after compressInBackground()")
+        if current.readableBytes > 0 || pending.isEmpty {
+            pending.append(current)
+        }
+        compressPending(finish: true)
+        writeTrailer()
+        return writebuffer
+    }
+
+    /// Start compression of all full chunks in the background. Waits for the oldest chunks once more than `nConcurrent` chunks are compressed and appends them to the output.
+    func compressInBackground() async {
+        startPending(finish: false)
+        while compressing.count > nConcurrent {
+            await collectOldest()
+        }
+    }
+
+    /// Compress remaining data, wait for all chunks and return the remaining output
+    func finishInBackground() async -> ByteBuffer {
+        if current.readableBytes > 0 || pending.isEmpty {
+            pending.append(current)
+        }
+        startPending(finish: true)
+        while !compressing.isEmpty {
+            await collectOldest()
+        }
+        writeTrailer()
+        return writebuffer
+    }
+
+    private func writeTrailer() {
+        if gzipHeader {
+            writebuffer.writeInteger(crc32, endianness: .little)
+            writebuffer.writeInteger(UInt32(truncatingIfNeeded: uncompressedSize), endianness: .little)
+        }
+    }
+
+    /// Dictionary for the chunk after `chunk`
+    private func nextDictionary(after chunk: ByteBuffer) -> ByteBuffer? {
+        guard chunk.readableBytes >= Self.windowSize else {
+            return dictionary
+        }
+        return chunk.getSlice(at: chunk.writerIndex - Self.windowSize, length: Self.windowSize)
+    }
+
+    /// Append a compressed chunk to the output
+    private func append(compressed: ByteBuffer, crc chunkCrc: uLong, size: Int) {
+        writebuffer.writeImmutableBuffer(compressed)
+        crc = crc32_combine(crc, chunkCrc, .init(size))
+        uncompressedSize += size
+    }
+
+    /// Compress all pending chunks on the calling thread and append them in order to the output
+    private func compressPending(finish: Bool) {
+        for (i, chunk) in pending.enumerated() {
+            let result = Self.deflate(chunk: chunk, dictionary: dictionary, level: level, finish: finish && i == pending.count - 1)
+            dictionary = nextDictionary(after: chunk)
+            append(compressed: result.compressed, crc: result.crc, size: chunk.readableBytes)
+        }
+        pending.removeAll(keepingCapacity: true)
+    }
+
+    /// Start a task on the shared executor for each pending chunk
+    private func startPending(finish: Bool) {
+        let level = level
+        for (i, chunk) in pending.enumerated() {
+            let dictionary = dictionary
+            let isLast = finish && i == pending.count - 1
+            let task = Task {
+                await Self.executor.execute {
+                    Self.deflate(chunk: chunk, dictionary: dictionary, level: level, finish: isLast)
+                }
+            }
+            compressing.append((task, chunk.readableBytes))
+            self.dictionary = nextDictionary(after: chunk)
+        }
+        pending.removeAll(keepingCapacity: true)
+    }
+
+    /// Wait for the oldest chunk in the background and append it to the output
+    private func collectOldest() async {
+        let oldest = compressing.removeFirst()
+        let result = await oldest.task.value
+        append(compressed: result.compressed, crc: result.crc, size: oldest.size)
+    }
+
+    /// Raw deflate a single chunk. Terminates with `Z_SYNC_FLUSH` or `Z_FINISH` for the last chunk
+    static func deflate(chunk: ByteBuffer, dictionary: ByteBuffer?, level: Int32, finish: Bool) -> (compressed: ByteBuffer, crc: uLong) {
+        let zstream = UnsafeMutablePointer<z_stream>.allocate(capacity: 1)
+        zstream.pointee.zalloc = nil
+        zstream.pointee.zfree = nil
+        zstream.pointee.opaque = nil
+        let ret = deflateInit2_(zstream, level, Z_DEFLATED, -15, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY, ZLIB_VERSION, Int32(MemoryLayout<z_stream>.size))
+        guard ret == Z_OK else {
+            fatalError("deflateInit2 failed, \(ret)")
+        }
+        defer {
+            CZlib.deflateEnd(zstream)
+            zstream.deallocate()
+        }
+        if let dictionary {
+            dictionary.withUnsafeReadableBytes { ptr in
+                guard CZlib.deflateSetDictionary(zstream, ptr.bindMemory(to: Bytef.self).baseAddress, uInt(ptr.count)) == Z_OK else {
+                    fatalError("deflateSetDictionary failed")
+                }
+            }
+        }
+        /// `deflateBound` does not account for the sync flush marker
+        var out = ByteBufferAllocator().buffer(capacity: Int(deflateBound(zstream, uLong(chunk.readableBytes))) + 16)
+        let crc = chunk.withUnsafeReadableBytes { input in
+            zstream.pointee.next_in = UnsafeMutablePointer(mutating: input.bindMemory(to: Bytef.self).baseAddress)
+            zstream.pointee.avail_in = uInt(input.count)
+            while true {
+                if out.writableBytes == 0 {
+                    out.reserveCapacity(minimumWritableBytes: out.writerIndex)
+                }
+                var ret = Z_OK
+                out.writeWithUnsafeMutableBytes(minimumWritableBytes: 0) { ptr in
+                    zstream.pointee.next_out = ptr.baseAddress?.assumingMemoryBound(to: Bytef.self)
+                    zstream.pointee.avail_out = uInt(ptr.count)
+                    ret = CZlib.deflate(zstream, finish ? Z_FINISH : Z_SYNC_FLUSH)
+                    return ptr.count - Int(zstream.pointee.avail_out)
+                }
+                if ret == Z_STREAM_END || (ret == Z_OK && !finish && zstream.pointee.avail_out > 0) {
+                    break
+                }
+                guard ret == Z_OK || ret == Z_BUF_ERROR else {
+                    fatalError("deflate loop error, \(ret)")
+                }
+            }
+            return crc32(0, input.bindMemory(to: Bytef.self).baseAddress, uInt(input.count))
+        }
+        return (out, crc)
+    }
+}
+
 fileprivate extension Data {
     mutating func append(_ value: UInt32) {
         Swift.withUnsafeBytes(of: value) {
@@ -212,76 +508,243 @@ fileprivate extension Data {
 }
 
 public enum ZipWriter {
-    /// compressed input data must be gzip compressed with correct gzip headers
-    public static func zip(files: [(path: String, compressed: ByteBuffer)], timestamp: Timestamp = .now()) -> ByteBuffer {
-        let totalSize = files.reduce(22, {
-            $0 + $1.path.count * 2 + $1.compressed.writerIndex - 18 + 30 + 46
-        })
-        var out = ByteBufferAllocator().buffer(capacity: totalSize)
+    /// Metadata of a file inside a ZIP archive
+    struct Entry {
+        let path: String
+        let compressionMethod: UInt8
+        let crc: UInt32
+        let compressedSize: Int
+        let uncompressedSize: Int
+        let localHeaderOffset: Int
+        /// Set general purpose bit 3. CRC and sizes follow the compressed data in a data descriptor
+        let hasDataDescriptor: Bool
+
+        var bitflag: UInt16 {
+            return hasDataDescriptor ? 0x0008 : 0x0000
+        }
+
+        /// Read CRC and sizes from a gzip compressed buffer with 10 byte header and 8 byte trailer
+        init(path: String, gzipCompressed compressed: ByteBuffer, localHeaderOffset: Int) {
+            self.path = path
+            self.compressionMethod = compressed.getInteger(at: 2, as: UInt8.self)!
+            self.crc = compressed.getInteger(at: compressed.writerIndex - 8, endianness: .little, as: UInt32.self)!
+            self.compressedSize = compressed.writerIndex - 10 - 8
+            self.uncompressedSize = Int(compressed.getInteger(at: compressed.writerIndex - 4, endianness: .little, as: UInt32.self)!)
+            self.localHeaderOffset = localHeaderOffset
+            self.hasDataDescriptor = false
+        }
 
+        init(path: String, compressionMethod: UInt8, crc: UInt32, compressedSize: Int, uncompressedSize: Int, localHeaderOffset: Int, hasDataDescriptor: Bool) {
+            self.path = path
+            self.compressionMethod = compressionMethod
+            self.crc = crc
+            self.compressedSize = compressedSize
+            self.uncompressedSize = uncompressedSize
+            self.localHeaderOffset = localHeaderOffset
+            self.hasDataDescriptor = hasDataDescriptor
+        }
+    }
+
+    /// ZIP stores time and date in MS-DOS format
+    static func dosTimeAndDate(_ timestamp: Timestamp) -> (time: UInt16, date: UInt16) {
         let date = timestamp.toComponents()
         let modificationDate = UInt16(date.day) | ((UInt16(date.month) << 5)) | ((UInt16(date.year - 1980) << 9))
         let modificationTime = UInt16(timestamp.second) | ((UInt16(timestamp.minute) << 5)) | ((UInt16(timestamp.hour) << 11))
+        return (modificationTime, modificationDate)
+    }
 
-        // print local file header and compressed data
-        var localHeaderOffsets = [Int]()
-        localHeaderOffsets.reserveCapacity(files.count)
-
-        for (path, compressed) in files {
-            localHeaderOffsets.append(out.writerIndex)
-            out.writeInteger(UInt32(0x04034b50), endianness: .little) // local fileheader signature
-            out.writeInteger(UInt16(0x0014), endianness: .little) // version
-            out.writeInteger(UInt16(0x0000), endianness: .little) // bitflag
-            out.writeData([(compressed.getInteger(at: 2) as UInt8?)!, 0]) // compression method, lzma
-            out.writeInteger(modificationTime, endianness: .little)
-            out.writeInteger(modificationDate, endianness: .little)
-            out.writeInteger((compressed.getInteger(at: compressed.writerIndex - 8) as UInt32?)!) // crc
-            out.writeInteger(UInt32(compressed.writerIndex - 10 - 8), endianness: .little) // compressed size
-            out.writeInteger((compressed.getInteger(at: compressed.writerIndex - 4) as UInt32?)!) // uncompressed size
-            out.writeInteger(UInt16(path.count), endianness: .little) // filename length
-            out.writeInteger(UInt16(0x0000), endianness: .little) // extra field length
-            out.writeString(path) // filename
-            var payload = compressed.getSlice(at: 10, length: compressed.writerIndex - 8 - 10)!
-            out.writeBuffer(&payload) // compressed payload without header
-        }
+    /// Local file header. With a data descriptor, CRC and sizes are set to 0
+    static func writeLocalHeader(into out: inout ByteBuffer, entry: Entry, time: (time: UInt16, date: UInt16)) {
+        out.writeInteger(UInt32(0x04034b50), endianness: .little) // local fileheader signature
+        out.writeInteger(UInt16(0x0014), endianness: .little) // version
+        out.writeInteger(entry.bitflag, endianness: .little) // bitflag
+        out.writeData([entry.compressionMethod, 0]) // compression method, lzma
+        out.writeInteger(time.time, endianness: .little)
+        out.writeInteger(time.date, endianness: .little)
+        out.writeInteger(entry.hasDataDescriptor ? 0 : entry.crc, endianness: .little) // crc
+        out.writeInteger(entry.hasDataDescriptor ? 0 : UInt32(entry.compressedSize), endianness: .little) // compressed size
+        out.writeInteger(entry.hasDataDescriptor ? 0 : UInt32(entry.uncompressedSize), endianness: .little) // uncompressed size
+        out.writeInteger(UInt16(entry.path.utf8.count), endianness: .little) // filename length
+        out.writeInteger(UInt16(0x0000), endianness: .little) // extra field length
+        out.writeString(entry.path) // filename
+    }
 
-        let centralDirOffset = out.writerIndex
+    /// Data descriptor after compressed data if bit 3 is set
+    static func writeDataDescriptor(into out: inout ByteBuffer, entry: Entry) {
+        out.writeInteger(UInt32(0x08074b50), endianness: .little) // signature
+        out.writeInteger(entry.crc, endianness: .little)
+        out.writeInteger(UInt32(entry.compressedSize), endianness: .little)
+        out.writeInteger(UInt32(entry.uncompressedSize), endianness: .little)
+    }
 
-        // print central directory header
-        for (i, (path, compressed)) in files.enumerated() {
+    /// Central directory headers and end of central directory record
+    static func writeCentralDirectory(into out: inout ByteBuffer, entries: [Entry], centralDirOffset: Int, time: (time: UInt16, date: UInt16)) {
+        let start = out.writerIndex
+        for entry in entries {
             out.writeInteger(UInt32(0x02014b50), endianness: .little) // signature
             out.writeInteger(UInt16(0x0000), endianness: .little) // version generated by
             out.writeInteger(UInt16(0x0014), endianness: .little) // version needed
-            out.writeInteger(UInt16(0x0000), endianness: .little) // bit flag
-            out.writeData([(compressed.getInteger(at: 2) as UInt8?)!, 0]) // compression method, lzma
-            out.writeInteger(modificationTime, endianness: .little)
-            out.writeInteger(modificationDate, endianness: .little)
-            out.writeInteger((compressed.getInteger(at: compressed.writerIndex - 8) as UInt32?)!) // crc
-            out.writeInteger(UInt32(compressed.writerIndex - 10 - 8), endianness: .little) // compressed size
-            out.writeInteger((compressed.getInteger(at: compressed.writerIndex - 4) as UInt32?)!) // uncompressed size
-            out.writeInteger(UInt16(path.count), endianness: .little) // filename length
+            out.writeInteger(entry.bitflag, endianness: .little) // bit flag
+            out.writeData([entry.compressionMethod, 0]) // compression method, lzma
+            out.writeInteger(time.time, endianness: .little)
+            out.writeInteger(time.date, endianness: .little)
+            out.writeInteger(entry.crc, endianness: .little) // crc
+            out.writeInteger(UInt32(entry.compressedSize), endianness: .little) // compressed size
+            out.writeInteger(UInt32(entry.uncompressedSize), endianness: .little) // uncompressed size
+            out.writeInteger(UInt16(entry.path.utf8.count), endianness: .little) // filename length
             out.writeInteger(UInt16(0x0000), endianness: .little) // extra field length
             out.writeInteger(UInt16(0x0000), endianness: .little) // comment length
             out.writeInteger(UInt16(0x0000), endianness: .little) // disk number start
             out.writeInteger(UInt16(0x0000), endianness: .little) // internal attributes
             out.writeInteger(UInt32(0x0000), endianness: .little) // external attributes
-            out.writeInteger(UInt32(localHeaderOffsets[i]), endianness: .little)
-            out.writeString(path) // filename
+            out.writeInteger(UInt32(entry.localHeaderOffset), endianness: .little)
+            out.writeString(entry.path) // filename
         }
 
-        let centralDirSize = out.writerIndex - centralDirOffset
+        let centralDirSize = out.writerIndex - start
 
         // end central directory
         out.writeInteger(UInt32(0x06054b50), endianness: .little) // sig
         out.writeInteger(UInt16(0x0000), endianness: .little) // number of disks
         out.writeInteger(UInt16(0x0000), endianness: .little) // number of disks start
-        out.writeInteger(UInt16(files.count), endianness: .little) // number disk entries
-        out.writeInteger(UInt16(files.count), endianness: .little) // number central directory entries
+        out.writeInteger(UInt16(entries.count), endianness: .little) // number disk entries
+        out.writeInteger(UInt16(entries.count), endianness: .little) // number central directory entries
         out.writeInteger(UInt32(centralDirSize), endianness: .little)
         out.writeInteger(UInt32(centralDirOffset), endianness: .little)
         out.writeInteger(UInt16(0x00), endianness: .little) // zip comment length
+    }
+
+    /// compressed input data must be gzip compressed with correct gzip headers
+    public static func zip(files: [(path: String, compressed: ByteBuffer)], timestamp: Timestamp = .now()) -> ByteBuffer {
+        let totalSize = files.reduce(22, {
+            $0 + $1.path.utf8.count * 2 + $1.compressed.writerIndex - 18 + 30 + 46
+        })
+        var out = ByteBufferAllocator().buffer(capacity: totalSize)
+        let time = dosTimeAndDate(timestamp)
+
+        // print local file header and compressed data
+        var entries = [Entry]()
+        entries.reserveCapacity(files.count)
+
+        for (path, compressed) in files {
+            let entry = Entry(path: path, gzipCompressed: compressed, localHeaderOffset: out.writerIndex)
+            writeLocalHeader(into: &out, entry: entry, time: time)
+            var payload = compressed.getSlice(at: 10, length: entry.compressedSize)!
+            out.writeBuffer(&payload) // compressed payload without header
+            entries.append(entry)
+        }
+
+        // print central directory header
+        let centralDirOffset = out.writerIndex
+        writeCentralDirectory(into: &out, entries: entries, centralDirOffset: centralDirOffset, time: time)
 
         precondition(totalSize == out.writerIndex)
         return out
     }
 }
+
+/**
+ Stream a ZIP archive to an `AsyncBodyStreamWriter` without knowing file sizes up front.
+
+ Entries with unknown size set general purpose bit 3. CRC and sizes are appended as data descriptor after the compressed data and repeated in the central directory at the end.
+ Only the entry metadata is kept in memory.
+
+ ZIP64 records are not written. Sizes and offsets must fit into 32 bits and the number of entries into 16 bits. Otherwise `ZipStreamError.zipTooLarge` is thrown as soon as a limit is exceeded, before an invalid archive is completed.
+ */
+final class ZipStreamWriter {
+    let writer: any AsyncBodyStreamWriter
+    let time: (time: UInt16, date: UInt16)
+
+    /// Entries which are completely written
+    private var entries = [ZipWriter.Entry]()
+
+    /// Bytes sent to the writer so far
+    private var offset = 0
+
+    /// Entry which is currently streamed
+    private var current: (path: String, localHeaderOffset: Int, compressedSize: Int)?
+
+    /// Largest size or offset without ZIP64
+    static let maxSize = Int(UInt32.max)
+
+    /// Largest number of entries without ZIP64
+    static let maxEntries = Int(UInt16.max)
+
+    init(writer: any AsyncBodyStreamWriter, timestamp: Timestamp) {
+        self.writer = writer
+        self.time = ZipWriter.dosTimeAndDate(timestamp)
+    }
+
+    private func send(_ buffer: ByteBuffer) async throws {
+        guard buffer.readableBytes > 0 else {
+            return
+        }
+        // The central directory offset and all local header offsets must fit into 32 bits
+        guard offset + buffer.readableBytes <= Self.maxSize else {
+            throw ZipStreamError.zipTooLarge
+        }
+        offset += buffer.readableBytes
+        try await writer.writeBuffer(buffer)
+    }
+
+    /// Write a complete file. Compressed input data must be gzip compressed with correct gzip headers
+    func write(path: String, compressed: ByteBuffer) async throws {
+        precondition(current == nil, "Another entry is currently streamed")
+        guard entries.count < Self.maxEntries else {
+            throw ZipStreamError.zipTooLarge
+        }
+        let entry = ZipWriter.Entry(path: path, gzipCompressed: compressed, localHeaderOffset: offset)
+        var out = ByteBufferAllocator().buffer(capacity: 30 + path.utf8.count + entry.compressedSize)
+        ZipWriter.writeLocalHeader(into: &out, entry: entry, time: time)
+        var payload = compressed.getSlice(at: 10, length: entry.compressedSize)!
+        out.writeBuffer(&payload) // compressed payload without header
+        entries.append(entry)
+        try await send(out)
+    }
+
+    /// Start a file with unknown size. Data must be raw deflate compressed.
+    func startEntry(path: String) async throws {
+        precondition(current == nil, "Another entry is currently streamed")
+        guard entries.count < Self.maxEntries else {
+            throw ZipStreamError.zipTooLarge
+        }
+        let entry = ZipWriter.Entry(path: path, compressionMethod: UInt8(Z_DEFLATED), crc: 0, compressedSize: 0, uncompressedSize: 0, localHeaderOffset: offset, hasDataDescriptor: true)
+        var out = ByteBufferAllocator().buffer(capacity: 30 + path.utf8.count)
+        ZipWriter.writeLocalHeader(into: &out, entry: entry, time: time)
+        current = (path, offset, 0)
+        try await send(out)
+    }
+
+    /// Send compressed data of the current entry
+    func writeEntryData(_ data: ByteBuffer) async throws {
+        guard current != nil else {
+            fatalError("No ZIP entry started")
+        }
+        current?.compressedSize += data.readableBytes
+        try await send(data)
+    }
+
+    /// Finish the current entry with a data descriptor
+    func endEntry(crc: UInt32, uncompressedSize: Int) async throws {
+        guard let current else {
+            fatalError("No ZIP entry started")
+        }
+        guard uncompressedSize <= Self.maxSize else {
+            throw ZipStreamError.zipTooLarge
+        }
+        let entry = ZipWriter.Entry(path: current.path, compressionMethod: UInt8(Z_DEFLATED), crc: crc, compressedSize: current.compressedSize, uncompressedSize: uncompressedSize, localHeaderOffset: current.localHeaderOffset, hasDataDescriptor: true)
+        self.current = nil
+        var out = ByteBufferAllocator().buffer(capacity: 16)
+        ZipWriter.writeDataDescriptor(into: &out, entry: entry)
+        entries.append(entry)
+        try await send(out)
+    }
+
+    /// Write the central directory. Does not end the stream.
+    func finish() async throws {
+        precondition(current == nil, "ZIP entry has not been finished")
+        var out = ByteBufferAllocator().buffer(capacity: entries.reduce(22, { $0 + 46 + $1.path.utf8.count }))
+        ZipWriter.writeCentralDirectory(into: &out, entries: entries, centralDirOffset: offset, time: time)
+        try await send(out)
+    }
+}
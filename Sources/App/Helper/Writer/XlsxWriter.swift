@@ -3,10 +3,23 @@ import Vapor
 
 
 extension ForecastapiResult {
-    func toXlsxResponse(timestamp: Timestamp, withLocationHeader: Bool = true) async throws -> Response {
+    /// Streaming XLSX format. Compressed sheet data is sent to the client while rows are generated. Memory is constant regardless of the number of rows.
+    func toXlsxResponse(timestamp: Timestamp, withLocationHeader: Bool = true, concurrencySlot: Int?, logger: Logger) throws -> Response {
+        let response = Response(body: .init(cacheableStream: { writer in
+            try await writer.submit(concurrencySlot: concurrencySlot, logger: logger) {
+                try await writeXlsx(into: writer, timestamp: timestamp, withLocationHeader: withLocationHeader)
+                try await writer.write(.end)
+            }
+        }, count: -1))
+        response.headers.replaceOrAdd(name: .contentType, value: "application/vnd.openxmlformats-officedocument.spreadsheetml.sheet")
+        response.headers.replaceOrAdd(name: .contentDisposition, value: "attachment; filename=\"open-meteo-\(results.first?.results.first?.formatedCoordinatesFilename ?? "").xlsx\"")
+        return response
+    }
+
+    fileprivate func writeXlsx(into writer: any AsyncBodyStreamWriter, timestamp: Timestamp, withLocationHeader: Bool) async throws {
         let multiLocation = results.count > 1
 
-        let sheet = try XlsxWriter()
+        let sheet = try await XlsxWriter(streamTo: writer, timestamp: timestamp)
         if withLocationHeader {
             sheet.startRow()
             if multiLocation {
@@ -35,6 +48,7 @@ extension ForecastapiResult {
                 sheet.write(location.timezone.identifier)
                 sheet.write(location.timezone.abbreviation)
                 sheet.endRow()
+                try await sheet.flushIfRequired()
             }
         }
 
@@ -57,16 +71,12 @@ extension ForecastapiResult {
             try await location.monthly(variables: variables.monthlyVariables)?.writeXlsx(into: sheet, utc_offset_seconds: location.utc_offset_seconds, location_id: multiLocation ? location.locationId : nil)
         }
 
-        let data = sheet.write(timestamp: timestamp)
-        let response = Response(body: .init(buffer: data))
-        response.headers.replaceOrAdd(name: .contentType, value: "application/vnd.openxmlformats-officedocument.spreadsheetml.sheet")
-        response.headers.replaceOrAdd(name: .contentDisposition, value: "attachment; filename=\"open-meteo-\(results.first?.results.first?.formatedCoordinatesFilename ?? "").xlsx\"")
-        return response
+        try await sheet.finish()
     }
 }
 
 extension ApiSectionString {
-    fileprivate func writeXlsx(into sheet: XlsxWriter, utc_offset_seconds: Int, location_id: Int?) throws {
+    fileprivate func writeXlsx(into sheet: XlsxWriter, utc_offset_seconds: Int, location_id: Int?) async throws {
         if location_id == nil || location_id == 0 {
             if !sheet.isFirstRow {
                 sheet.startRow()
@@ -102,12 +112,13 @@ extension ApiSectionString {
                 }
             }
             sheet.endRow()
+            try await sheet.flushIfRequired()
         }
     }
 }
 
 extension ApiSectionSingle {
-    fileprivate func writeXlsx(into sheet: XlsxWriter, utc_offset_seconds: Int, location_id: Int?) throws {
+    fileprivate func writeXlsx(into sheet: XlsxWriter, utc_offset_seconds: Int, location_id: Int?) async throws {
         if location_id == nil || location_id == 0 {
             if !sheet.isFirstRow {
                 sheet.startRow()
@@ -133,5 +144,6 @@ extension ApiSectionSingle {
             sheet.write(e.value, significantDigits: e.unit.significantDigits)
         }
         sheet.endRow()
+        try await sheet.flushIfRequired()
     }
 }
@@ -32,22 +32,75 @@ enum OpenMeteo {
     static let dataBlockCacheInitialized = Atomic(false)
 
     static let dataBlockCache: AtomicCacheCoordinator<MmapFile> = { () -> AtomicCacheCoordinator<MmapFile> in
-        let cacheFile = Environment.get("CACHE_FILE") ?? "\(dataDirectory)/cache.bin"
         let cacheSize = try! ByteSizeParser.parseSizeStringToBytes(Environment.get("CACHE_SIZE") ?? "10GB")
         let blockSize = try! ByteSizeParser.parseSizeStringToBytes(Environment.get("BLOCK_SIZE") ?? "64KB")
-        let blockCount = cacheSize / (blockSize + 2 * MemoryLayout<Int64>.size)
-        let cache = AtomicCacheCoordinator(cache: try! AtomicBlockCache(file: cacheFile, blockSize: blockSize, blockCount: blockCount))
+        /// Optional in-memory tier for frequently accessed blocks. Disabled by default
+        let hotTierSize = try! ByteSizeParser.parseSizeStringToBytes(Environment.get("CACHE_HOT_SIZE") ?? "0MB")
+        /// `CACHE_COMPRESSION=lz4` stores blocks compressed in smaller pages. Uses a different cache file, because the layout is not compatible
+        let cache: AtomicCacheCoordinator<MmapFile>
+        switch Environment.get("CACHE_COMPRESSION") {
+        case "lz4":
+            let cacheFile = Environment.get("CACHE_FILE") ?? "\(dataDirectory)/cache_lz4.bin"
+            let pageSize = CompressedBlockCache<MmapFile>.pageSize(blockSize: blockSize)
+            let pageCount = cacheSize / (pageSize + AtomicBlockCache<MmapFile>.slotOverhead)
+            cache = AtomicCacheCoordinator(cache: try! AtomicBlockCache(file: cacheFile, blockSize: pageSize, blockCount: pageCount), hotTierSize: hotTierSize, compressedBlockSize: blockSize)
+        case .none, "none":
+            let cacheFile = Environment.get("CACHE_FILE") ?? "\(dataDirectory)/cache.bin"
+            let blockCount = cacheSize / (blockSize + AtomicBlockCache<MmapFile>.slotOverhead)
+            cache = AtomicCacheCoordinator(cache: try! AtomicBlockCache(file: cacheFile, blockSize: blockSize, blockCount: blockCount), hotTierSize: hotTierSize)
+        case .some(let codec):
+            fatalError("Unsupported CACHE_COMPRESSION '\(codec)'. Supported: lz4, none")
+        }
         dataBlockCacheInitialized.store(true, ordering: .relaxed)
         return cache
     }()
     
+    /// In-memory cache for decompressed chunks of frequently read grid points. `CHUNK_CACHE_SIZE=0MB` disables the cache (default)
+    static let decompressedChunkCache: DecompressedChunkCache? = {
+        let cacheSize = try! ByteSizeParser.parseSizeStringToBytes(Environment.get("CHUNK_CACHE_SIZE") ?? "0MB")
+        return cacheSize > 0 ? DecompressedChunkCache(capacityBytes: cacheSize) : nil
+    }()
+    
+    /// Combine identical API requests and cache small responses. `API_RESPONSE_CACHE_SIZE=0MB` disables the cache (default). `API_RESPONSE_CACHE_TTL` in seconds
+    static let apiResponseCache: ApiResponseCache? = {
+        let cacheSize = try! ByteSizeParser.parseSizeStringToBytes(Environment.get("API_RESPONSE_CACHE_SIZE") ?? "0MB")
+        let ttlSeconds = Environment.get("API_RESPONSE_CACHE_TTL").flatMap(Int.init) ?? 60
+        return cacheSize > 0 ? ApiResponseCache(capacityBytes: cacheSize, ttlSeconds: ttlSeconds) : nil
+    }()
+    
+    /// Keep decoded elevation files in memory for grid point selection. `ELEVATION_INDEX_SIZE=0MB` disables the index (default)
+    static let elevationIndexCache: ElevationIndexCache? = {
+        let cacheSize = try! ByteSizeParser.parseSizeStringToBytes(Environment.get("ELEVATION_INDEX_SIZE") ?? "0MB")
+        return cacheSize > 0 ? ElevationIndexCache(capacityBytes: cacheSize) : nil
+    }()
+    
+    /// Merge nearby range requests to remote files. `RANGE_COALESCE_MAX_SIZE=0MB` disables merging. `RANGE_COALESCE_WINDOW_MS` delays backend requests to merge more of them (default 0)
+    static let remoteRangeCoalescing: OmReaderRangeCoalescing = {
+        let maxGap = try! ByteSizeParser.parseSizeStringToBytes(Environment.get("RANGE_COALESCE_MAX_GAP") ?? "256KB")
+        let maxSize = try! ByteSizeParser.parseSizeStringToBytes(Environment.get("RANGE_COALESCE_MAX_SIZE") ?? "8MB")
+        let windowMs = Environment.get("RANGE_COALESCE_WINDOW_MS").flatMap(Int.init) ?? 0
+        return OmReaderRangeCoalescing(maxGap: maxGap, maxSize: maxSize, window: .milliseconds(windowMs))
+    }()
+    
+    /// Recently accessed blocks of remote files are written to this file every 5 minutes and preloaded after a restart
+    static let hotBlockManifestFile: String = {
+        return Environment.get("CACHE_HOT_BLOCKS_FILE") ?? "\(dataDirectory)/cache_hot_blocks.json"
+    }()
+
+    /// Limit downloads to warm up the cache after restarts and file modifications. `CACHE_WARMUP_BYTES_PER_SECOND=0MB` disables the limit
+    static let cacheWarmupLimiter: ByteRateLimiter = {
+        let bytesPerSecond = try! ByteSizeParser.parseSizeStringToBytes(Environment.get("CACHE_WARMUP_BYTES_PER_SECOND") ?? "100MB")
+        return ByteRateLimiter(bytesPerSecond: bytesPerSecond)
+    }()
+
     /// Cache remote file meta data if `REMOTE_DATA_DIRECTORY` is set. 1 MB => 12k files
+    /// Keys are hashed URLs without sequential runs. A probe window of 64 slots keeps entries of frequently used files when the cache is almost full
     static let fileMetaCache: AtomicBlockCache<MmapFile> = { () -> AtomicBlockCache<MmapFile> in
         let cacheFile = Environment.get("CACHE_META_FILE") ?? "\(dataDirectory)/cache_file_meta.bin"
         let cacheSize = try! ByteSizeParser.parseSizeStringToBytes(Environment.get("CACHE_META_SIZE") ?? "1MB")
         let blockSize = MemoryLayout<HttpMetaCache.Entry>.stride
-        let blockCount = cacheSize / (blockSize + 2 * MemoryLayout<Int64>.size)
-        return try! AtomicBlockCache(file: cacheFile, blockSize: blockSize, blockCount: blockCount)
+        let blockCount = cacheSize / (blockSize + AtomicBlockCache<MmapFile>.slotOverhead)
+        return try! AtomicBlockCache(file: cacheFile, blockSize: blockSize, blockCount: blockCount, lookAheadCount: 64)
     }()
     
     /// Data directory with trailing slash
@@ -263,7 +316,7 @@ public func configure(_ app: Application) throws {
         initialDelay: .seconds(Int64(60 - Timestamp.now().second)),
         delay: .seconds(60)
     ) { _ in
-        await RateLimiter.instance.minutelyCallback()
+        RateLimiter.instance.minutelyCallback()
     }
 
     // register routes
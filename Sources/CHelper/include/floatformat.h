@@ -0,0 +1,14 @@
+#ifndef _CHELPER_FLOATFORMAT_
+#define _CHELPER_FLOATFORMAT_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Maximum number of bytes written for a single finite value including the separator
+#define FLOAT_FORMAT_MAX_BYTES 32
+
+/// Format `count` floats with a fixed number of `decimals` (0 to 7) into `out`. Values are separated by `separator`, non finite values are written as `nan_text`.
+/// Output matches `Float.formatted(decimals:)`. `out` must hold at least `count * (FLOAT_FORMAT_MAX_BYTES + nan_len)` bytes. Returns the number of bytes written
+size_t formatFloatColumn(const float* values, size_t count, int32_t decimals, const uint8_t* nan_text, size_t nan_len, uint8_t separator, uint8_t* out);
+
+#endif // _CHELPER_FLOATFORMAT_
@@ -0,0 +1,13 @@
+#ifndef _CHELPER_LZ4BLOCK_
+#define _CHELPER_LZ4BLOCK_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Compress `src` into the LZ4 block format. Returns the compressed size or 0 if the output does not fit into `dst_capacity`
+size_t lz4CompressBlock(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_capacity);
+
+/// Decompress a LZ4 block. All reads and writes are bounds checked. Returns the decompressed size or -1 if the input is malformed or the output does not fit
+ptrdiff_t lz4DecompressBlock(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_capacity);
+
+#endif // _CHELPER_LZ4BLOCK_
@@ -0,0 +1,55 @@
+#ifndef _CHELPER_PROJECTION_
+#define _CHELPER_PROJECTION_
+
+#include <stddef.h>
+
+/// Batched map projections on a sphere. Arrays are structure of arrays with `count` elements. Angles are in degrees, x/y in metres (degrees for rotated lat/lon).
+/// Results are identical to the scalar Swift implementations of `Projectable`. Constants are precomputed once per projection.
+
+/// Lambert conformal conic. `lambda0` in radians
+typedef struct {
+  float rho0;
+  float F;
+  float n;
+  float lambda0;
+  float R;
+} LambertConformalConicParams;
+
+void lambertConformalConicForward(LambertConformalConicParams p, size_t count, const float* latitude, const float* longitude, float* x, float* y);
+void lambertConformalConicInverse(LambertConformalConicParams p, size_t count, const float* x, const float* y, float* latitude, float* longitude);
+
+/// Stereographic. `lambda0` in radians
+typedef struct {
+  float lambda0;
+  float sinPhi1;
+  float cosPhi1;
+  float R;
+} StereographicParams;
+
+void stereographicForward(StereographicParams p, size_t count, const float* latitude, const float* longitude, float* x, float* y);
+void stereographicInverse(StereographicParams p, size_t count, const float* x, const float* y, float* latitude, float* longitude);
+
+/// Lambert azimuthal equal-area. `lambda0` in radians
+typedef struct {
+  float lambda0;
+  float sinPhi1;
+  float cosPhi1;
+  float R;
+} LambertAzimuthalEqualAreaParams;
+
+void lambertAzimuthalEqualAreaForward(LambertAzimuthalEqualAreaParams p, size_t count, const float* latitude, const float* longitude, float* x, float* y);
+void lambertAzimuthalEqualAreaInverse(LambertAzimuthalEqualAreaParams p, size_t count, const float* x, const float* y, float* latitude, float* longitude);
+
+/// Rotated lat/lon. `theta` is the rotation around the y-axis, `phi` around the z-axis, both in radians
+typedef struct {
+  float sinTheta;
+  float cosTheta;
+  float sinPhi;
+  float cosPhi;
+  float phi;
+} RotatedLatLonParams;
+
+void rotatedLatLonForward(RotatedLatLonParams p, size_t count, const float* latitude, const float* longitude, float* x, float* y);
+void rotatedLatLonInverse(RotatedLatLonParams p, size_t count, const float* x, const float* y, float* latitude, float* longitude);
+
+#endif // _CHELPER_PROJECTION_
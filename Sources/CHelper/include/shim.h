@@ -3,6 +3,9 @@
 
 #include <stddef.h>
 #include "spa.h"
+#include "lz4block.h"
+#include "floatformat.h"
+#include "projection.h"
 
 void windirectionFast(const size_t num_points, const float* ys, const float* xs, float* out);
 
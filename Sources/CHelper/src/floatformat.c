@@ -0,0 +1,102 @@
+#include <math.h>
+#include <string.h>
+#include "floatformat.h"
+
+/// Fixed decimal formatting for JSON and CSV output. Digits are written two at a time using a lookup table. No allocations and no locale dependent printf.
+
+static const char digit_pairs[201] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+static const uint64_t pow10_table[8] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000};
+
+/// Write an unsigned integer without leading zeros. Returns the number of bytes written
+static inline size_t format_uint(uint64_t value, uint8_t* out) {
+  uint8_t tmp[20];
+  uint8_t* p = tmp + sizeof(tmp);
+  while (value >= 100) {
+    const size_t i = (size_t)(value % 100) * 2;
+    value /= 100;
+    p -= 2;
+    p[0] = digit_pairs[i];
+    p[1] = digit_pairs[i + 1];
+  }
+  if (value >= 10) {
+    const size_t i = (size_t)value * 2;
+    p -= 2;
+    p[0] = digit_pairs[i];
+    p[1] = digit_pairs[i + 1];
+  } else {
+    *--p = (uint8_t)('0' + value);
+  }
+  const size_t len = (size_t)(tmp + sizeof(tmp) - p);
+  memcpy(out, p, len);
+  return len;
+}
+
+/// Write exactly `len` digits including leading zeros
+static inline void format_uint_padded(uint64_t value, size_t len, uint8_t* out) {
+  uint8_t* p = out + len;
+  while (len >= 2) {
+    const size_t i = (size_t)(value % 100) * 2;
+    value /= 100;
+    p -= 2;
+    p[0] = digit_pairs[i];
+    p[1] = digit_pairs[i + 1];
+    len -= 2;
+  }
+  if (len == 1) {
+    *--p = (uint8_t)('0' + value % 10);
+  }
+}
+
+/// Convert a rounded non-negative float to an integer. Values outside of the 64 bit range are clamped
+static inline uint64_t to_uint64(float value) {
+  return value < 9.2233720e18f ? (uint64_t)value : (uint64_t)INT64_MAX;
+}
+
+size_t formatFloatColumn(const float* values, size_t count, int32_t decimals, const uint8_t* nan_text, size_t nan_len, uint8_t separator, uint8_t* out) {
+  uint8_t* p = out;
+  if (decimals > 7) {
+    decimals = 7;
+  }
+  const uint64_t factor = pow10_table[decimals > 0 ? decimals : 0];
+  for (size_t i = 0; i < count; i++) {
+    if (i > 0) {
+      *p++ = separator;
+    }
+    const float v = values[i];
+    if (!isfinite(v)) {
+      memcpy(p, nan_text, nan_len);
+      p += nan_len;
+      continue;
+    }
+    if (decimals <= 0) {
+      // Same as `String(Int(value.rounded()))`. Negative zero is written as "0"
+      const float rounded = roundf(v);
+      if (rounded < 0) {
+        *p++ = '-';
+      }
+      p += format_uint(to_uint64(fabsf(rounded)), p);
+      continue;
+    }
+    // Sign is based on the unrounded value like `Float.formatted(decimals:)`
+    if (v < 0) {
+      *p++ = '-';
+    }
+    const uint64_t scaled = to_uint64(roundf(fabsf(v) * (float)factor));
+    p += format_uint(scaled / factor, p);
+    *p++ = '.';
+    format_uint_padded(scaled % factor, (size_t)decimals, p);
+    p += decimals;
+  }
+  return (size_t)(p - out);
+}
@@ -0,0 +1,179 @@
+#include <string.h>
+#include "lz4block.h"
+
+/// Minimal LZ4 block format codec for compressed cache pages. Output is compatible with `LZ4_decompress_safe`.
+/// Greedy matching with a single hash table like the LZ4 fast mode. Offsets are limited to 64 KB.
+
+#define LZ4_MIN_MATCH 4
+#define LZ4_HASH_LOG 12
+/// The last 5 bytes are always literals
+#define LZ4_LAST_LITERALS 5
+/// The last match must start at least 12 bytes before the end of the block
+#define LZ4_MF_LIMIT 12
+#define LZ4_MAX_OFFSET 65535
+
+static inline uint32_t lz4_read32(const uint8_t* p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static inline uint32_t lz4_hash(uint32_t sequence) {
+  return (sequence * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+/// Write the remainder of a literal or match length that did not fit into the token
+static inline uint8_t* lz4_write_length(uint8_t* op, size_t length) {
+  while (length >= 255) {
+    *op++ = 255;
+    length -= 255;
+  }
+  *op++ = (uint8_t)length;
+  return op;
+}
+
+size_t lz4CompressBlock(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_capacity) {
+  uint32_t table[1 << LZ4_HASH_LOG];
+  memset(table, 0, sizeof(table));
+
+  const uint8_t* ip = src;
+  const uint8_t* anchor = src;
+  const uint8_t* const iend = src + src_size;
+  uint8_t* op = dst;
+  uint8_t* const oend = dst + dst_capacity;
+
+  if (src_size > LZ4_MF_LIMIT) {
+    const uint8_t* const mflimit = iend - LZ4_MF_LIMIT;
+    const uint8_t* const matchlimit = iend - LZ4_LAST_LITERALS;
+    size_t misses = 0;
+    while (ip <= mflimit) {
+      const uint32_t sequence = lz4_read32(ip);
+      const uint32_t h = lz4_hash(sequence);
+      const uint8_t* match = src + table[h];
+      table[h] = (uint32_t)(ip - src);
+      if (match >= ip || ip - match > LZ4_MAX_OFFSET || lz4_read32(match) != sequence) {
+        // Skip faster through incompressible data
+        ip += 1 + (misses++ >> 6);
+        continue;
+      }
+      misses = 0;
+      while (ip > anchor && match > src && ip[-1] == match[-1]) {
+        ip--;
+        match--;
+      }
+      const uint8_t* end = ip + LZ4_MIN_MATCH;
+      const uint8_t* ref = match + LZ4_MIN_MATCH;
+      while (end < matchlimit && *end == *ref) {
+        end++;
+        ref++;
+      }
+      const size_t literals = (size_t)(ip - anchor);
+      const size_t matchLength = (size_t)(end - ip) - LZ4_MIN_MATCH;
+      const size_t offset = (size_t)(ip - match);
+      if ((size_t)(oend - op) < 1 + literals + literals / 255 + 1 + 2 + matchLength / 255 + 1) {
+        return 0;
+      }
+      uint8_t* token = op++;
+      if (literals >= 15) {
+        *token = 15 << 4;
+        op = lz4_write_length(op, literals - 15);
+      } else {
+        *token = (uint8_t)(literals << 4);
+      }
+      memcpy(op, anchor, literals);
+      op += literals;
+      *op++ = (uint8_t)(offset & 0xFF);
+      *op++ = (uint8_t)(offset >> 8);
+      if (matchLength >= 15) {
+        *token |= 15;
+        op = lz4_write_length(op, matchLength - 15);
+      } else {
+        *token |= (uint8_t)matchLength;
+      }
+      ip = end;
+      anchor = ip;
+      if (ip <= mflimit) {
+        table[lz4_hash(lz4_read32(ip - 2))] = (uint32_t)(ip - 2 - src);
+      }
+    }
+  }
+
+  const size_t literals = (size_t)(iend - anchor);
+  if ((size_t)(oend - op) < 1 + literals + literals / 255 + 1) {
+    return 0;
+  }
+  if (literals >= 15) {
+    *op++ = 15 << 4;
+    op = lz4_write_length(op, literals - 15);
+  } else {
+    *op++ = (uint8_t)(literals << 4);
+  }
+  memcpy(op, anchor, literals);
+  op += literals;
+  return (size_t)(op - dst);
+}
+
+/// Read the remainder of a length. Returns 0 on a truncated input
+static inline int lz4_read_length(const uint8_t** ip, const uint8_t* iend, size_t* length) {
+  uint8_t b;
+  do {
+    if (*ip >= iend) {
+      return 0;
+    }
+    b = *(*ip)++;
+    *length += b;
+  } while (b == 255);
+  return 1;
+}
+
+ptrdiff_t lz4DecompressBlock(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_capacity) {
+  const uint8_t* ip = src;
+  const uint8_t* const iend = src + src_size;
+  uint8_t* op = dst;
+  uint8_t* const oend = dst + dst_capacity;
+
+  while (ip < iend) {
+    const uint8_t token = *ip++;
+    size_t literals = token >> 4;
+    if (literals == 15 && !lz4_read_length(&ip, iend, &literals)) {
+      return -1;
+    }
+    if ((size_t)(iend - ip) < literals || (size_t)(oend - op) < literals) {
+      return -1;
+    }
+    memcpy(op, ip, literals);
+    op += literals;
+    ip += literals;
+    if (ip == iend) {
+      // The last sequence only contains literals
+      break;
+    }
+    if (iend - ip < 2) {
+      return -1;
+    }
+    const size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+    ip += 2;
+    if (offset == 0 || offset > (size_t)(op - dst)) {
+      return -1;
+    }
+    size_t matchLength = token & 15;
+    if (matchLength == 15 && !lz4_read_length(&ip, iend, &matchLength)) {
+      return -1;
+    }
+    matchLength += LZ4_MIN_MATCH;
+    if ((size_t)(oend - op) < matchLength) {
+      return -1;
+    }
+    const uint8_t* match = op - offset;
+    if (offset >= matchLength) {
+      memcpy(op, match, matchLength);
+      op += matchLength;
+    } else {
+      // Overlapping copy repeats the last `offset` bytes
+      for (size_t i = 0; i < matchLength; i++) {
+        *op++ = *match++;
+      }
+    }
+  }
+  return op - dst;
+}
@@ -0,0 +1,125 @@
+#include <math.h>
+#include "projection.h"
+
+/// Results must match the scalar Swift code bit by bit, otherwise grid point lookups could differ at cell boundaries.
+/// Fast-math flags of this target would allow contractions and reciprocal divisions, therefore use strict IEEE semantics in this file.
+#ifdef __clang__
+#pragma float_control(precise, on)
+#pragma clang fp contract(off)
+#endif
+
+/// `Float.pi` in Swift is rounded towards zero
+static const float pi = 0x1.921fb4p+1f;
+
+static inline float degreesToRadians(float degrees) {
+  return degrees * pi / 180;
+}
+
+static inline float radiansToDegrees(float radians) {
+  return radians * 180 / pi;
+}
+
+void lambertConformalConicForward(LambertConformalConicParams p, size_t count, const float* latitude, const float* longitude, float* x, float* y) {
+  for (size_t i = 0; i < count; i++) {
+    const float phi = degreesToRadians(latitude[i]);
+    const float lambda = degreesToRadians(longitude[i]);
+    const float theta = p.n * (lambda - p.lambda0);
+    const float rho = p.F / powf(tanf(pi / 4 + phi / 2), p.n);
+    x[i] = p.R * rho * sinf(theta);
+    y[i] = p.R * (p.rho0 - rho * cosf(theta));
+  }
+}
+
+void lambertConformalConicInverse(LambertConformalConicParams p, size_t count, const float* x, const float* y, float* latitude, float* longitude) {
+  const float sign = p.n > 0 ? 1 : -1;
+  for (size_t i = 0; i < count; i++) {
+    const float xs = x[i] / p.R;
+    const float ys = y[i] / p.R;
+    const float theta = p.n >= 0 ? atan2f(xs, p.rho0 - ys) : atan2f(-1 * xs, ys - p.rho0);
+    const float rho = sign * sqrtf(powf(xs, 2) + powf(p.rho0 - ys, 2));
+    const float phi = 2 * atanf(powf(p.F / rho, 1 / p.n)) - pi / 2;
+    const float lambda = radiansToDegrees(p.lambda0 + theta / p.n);
+    latitude[i] = radiansToDegrees(phi);
+    longitude[i] = lambda > 180 ? lambda - 360 : lambda;
+  }
+}
+
+void stereographicForward(StereographicParams p, size_t count, const float* latitude, const float* longitude, float* x, float* y) {
+  for (size_t i = 0; i < count; i++) {
+    const float phi = degreesToRadians(latitude[i]);
+    const float lambda = degreesToRadians(longitude[i]);
+    const float sinPhi = sinf(phi);
+    const float cosPhi = cosf(phi);
+    const float cosLambda = cosf(lambda - p.lambda0);
+    const float k = 2 * p.R / (1 + p.sinPhi1 * sinPhi + p.cosPhi1 * cosPhi * cosLambda);
+    x[i] = k * cosPhi * sinf(lambda - p.lambda0);
+    y[i] = k * (p.cosPhi1 * sinPhi - p.sinPhi1 * cosPhi * cosLambda);
+  }
+}
+
+void stereographicInverse(StereographicParams p, size_t count, const float* x, const float* y, float* latitude, float* longitude) {
+  for (size_t i = 0; i < count; i++) {
+    const float rho = sqrtf(x[i] * x[i] + y[i] * y[i]);
+    const float c = 2 * atan2f(rho, 2 * p.R);
+    const float sinC = sinf(c);
+    const float cosC = cosf(c);
+    const float phi = asinf(cosC * p.sinPhi1 + (y[i] * sinC * p.cosPhi1) / rho);
+    const float lambda = p.lambda0 + atan2f(x[i] * sinC, rho * p.cosPhi1 * cosC - y[i] * p.sinPhi1 * sinC);
+    latitude[i] = radiansToDegrees(phi);
+    longitude[i] = radiansToDegrees(lambda);
+  }
+}
+
+void lambertAzimuthalEqualAreaForward(LambertAzimuthalEqualAreaParams p, size_t count, const float* latitude, const float* longitude, float* x, float* y) {
+  for (size_t i = 0; i < count; i++) {
+    const float lambda = degreesToRadians(longitude[i]);
+    const float phi = degreesToRadians(latitude[i]);
+    const float sinPhi = sinf(phi);
+    const float cosPhi = cosf(phi);
+    const float cosLambda = cosf(lambda - p.lambda0);
+    const float k = sqrtf(2 / (1 + p.sinPhi1 * sinPhi + p.cosPhi1 * cosPhi * cosLambda));
+    x[i] = p.R * k * cosPhi * sinf(lambda - p.lambda0);
+    y[i] = p.R * k * (p.cosPhi1 * sinPhi - p.sinPhi1 * cosPhi * cosLambda);
+  }
+}
+
+void lambertAzimuthalEqualAreaInverse(LambertAzimuthalEqualAreaParams p, size_t count, const float* x, const float* y, float* latitude, float* longitude) {
+  for (size_t i = 0; i < count; i++) {
+    const float xs = x[i] / p.R;
+    const float ys = y[i] / p.R;
+    const float rho = sqrtf(xs * xs + ys * ys);
+    const float c = 2 * asinf(0.5f * rho);
+    const float sinC = sinf(c);
+    const float cosC = cosf(c);
+    const float phi = asinf(cosC * p.sinPhi1 + (ys * sinC * p.cosPhi1) / rho);
+    const float lambda = p.lambda0 + atanf((xs * sinC / (rho * p.cosPhi1 * cosC - ys * p.sinPhi1 * sinC)));
+    latitude[i] = radiansToDegrees(phi);
+    longitude[i] = radiansToDegrees(lambda);
+  }
+}
+
+void rotatedLatLonForward(RotatedLatLonParams p, size_t count, const float* latitude, const float* longitude, float* x, float* y) {
+  for (size_t i = 0; i < count; i++) {
+    const float lon = degreesToRadians(longitude[i]);
+    const float lat = degreesToRadians(latitude[i]);
+    const float cx = cosf(lon) * cosf(lat);
+    const float cy = sinf(lon) * cosf(lat);
+    const float cz = sinf(lat);
+    const float x2 = p.cosTheta * p.cosPhi * cx + p.cosTheta * p.sinPhi * cy + p.sinTheta * cz;
+    const float y2 = -p.sinPhi * cx + p.cosPhi * cy;
+    const float z2 = -p.sinTheta * p.cosPhi * cx - p.sinTheta * p.sinPhi * cy + p.cosTheta * cz;
+    x[i] = -1 * radiansToDegrees(atan2f(y2, x2));
+    y[i] = -1 * radiansToDegrees(asinf(z2));
+  }
+}
+
+void rotatedLatLonInverse(RotatedLatLonParams p, size_t count, const float* x, const float* y, float* latitude, float* longitude) {
+  for (size_t i = 0; i < count; i++) {
+    const float lon = degreesToRadians(x[i]);
+    const float lat = degreesToRadians(y[i]);
+    const float lat2 = -1 * asinf(p.cosTheta * sinf(lat) - cosf(lon) * p.sinTheta * cosf(lat));
+    const float lon2 = -1 * (atan2f(sinf(lon), tanf(lat) * p.sinTheta + cosf(lon) * p.cosTheta) - p.phi);
+    latitude[i] = radiansToDegrees(lat2);
+    longitude[i] = fmodf(radiansToDegrees(lon2) + 180, 360) - 180;
+  }
+}
@@ -172,4 +172,116 @@ import VaporTesting
             #expect(params.end_minutely_15 == [])
         }
     }
+
+    @Test func apiResponseCache() async throws {
+        try await withApp { app in
+            func request(_ uri: String) -> Request {
+                return Request(application: app, method: .GET, url: URI(string: uri), on: app.eventLoopGroup.next())
+            }
+            let key = ApiResponseCache.key(request: request("/v1/forecast?latitude=52&longitude=13&hourly=temperature_2m"), salt: 0)
+            #expect(key != nil)
+            #expect(key == ApiResponseCache.key(request: request("/v1/forecast?hourly=temperature_2m&longitude=13&latitude=52&apikey=abc"), salt: 0))
+            #expect(key != ApiResponseCache.key(request: request("/v1/forecast?latitude=52&longitude=14&hourly=temperature_2m"), salt: 0))
+            #expect(key != ApiResponseCache.key(request: request("/v1/forecast?latitude=52&longitude=13&hourly=temperature_2m"), salt: 10_000))
+
+            let cache = ApiResponseCache(capacityBytes: 1024 * 1024, ttlSeconds: 60)
+            var calls = 0
+            for _ in 0..<3 {
+                let result = try await cache.response(for: request("/v1/forecast?latitude=52&longitude=13")) {
+                    calls += 1
+                    // Readers record model domains to validate the cached response against new model runs
+                    #expect(ApiResponseDependencies.current != nil)
+                    return (Response(status: .ok, body: .init(string: "cached")), 0.5)
+                }
+                #expect(result.response.body.string == "cached")
+                #expect(result.weight == 0.5)
+            }
+            #expect(calls == 1)
+            #expect(cache.usedBytes == 6)
+
+            // Errors and heavy requests are not cached
+            await #expect(throws: ForecastApiError.self) {
+                _ = try await cache.response(for: request("/v1/forecast?latitude=1")) {
+                    throw ForecastApiError.generic(message: "error")
+                }
+            }
+            for _ in 0..<2 {
+                _ = try await cache.response(for: request("/v1/forecast?latitude=2")) {
+                    calls += 1
+                    return (Response(status: .ok, body: .init(string: "heavy")), 20)
+                }
+            }
+            #expect(calls == 3)
+            #expect(cache.usedBytes == 6)
+
+            // Streamed bodies are sent while they are copied. They are cached after the stream completed
+            for _ in 0..<2 {
+                let result = try await cache.response(for: request("/v1/forecast?latitude=3")) {
+                    calls += 1
+                    return (Response(status: .ok, body: .init(cacheableStream: { writer in
+                        try await writer.write(.buffer(.init(string: "stream")))
+                        try await writer.write(.end)
+                    })), 0.5)
+                }
+                #expect(try await result.response.body.collect(on: app.eventLoopGroup.next()).get()?.readableBytes == 6)
+            }
+            #expect(calls == 4)
+            #expect(cache.usedBytes == 12)
+
+            // Each response tracks its own streaming errors. The error text is delivered but not cached
+            for _ in 0..<2 {
+                let result = try await cache.response(for: request("/v1/forecast?latitude=4")) {
+                    calls += 1
+                    return (Response(status: .ok, body: .init(cacheableStream: { writer in
+                        try await writer.submit(concurrencySlot: nil, logger: app.logger) {
+                            throw ForecastApiError.generic(message: "error")
+                        }
+                    })), 0.5)
+                }
+                #expect(try await result.response.body.collect(on: app.eventLoopGroup.next()).get() != nil)
+            }
+            #expect(calls == 6)
+
+            // Bodies larger than `maxEntryBytes` are streamed completely without buffering
+            let large = ByteBuffer(repeating: 0, count: cache.maxEntryBytes / 2 + 1)
+            for _ in 0..<2 {
+                let result = try await cache.response(for: request("/v1/forecast?latitude=5")) {
+                    calls += 1
+                    return (Response(status: .ok, body: .init(cacheableStream: { writer in
+                        try await writer.write(.buffer(large))
+                        try await writer.write(.buffer(large))
+                        try await writer.write(.end)
+                    })), 0.5)
+                }
+                #expect(try await result.response.body.collect(on: app.eventLoopGroup.next()).get()?.readableBytes == large.readableBytes * 2)
+            }
+            #expect(calls == 8)
+            #expect(cache.usedBytes == 12)
+        }
+    }
+
+    @Test func batchTimezoneResolution() async throws {
+        let berlin = try TimeZone.initWithFallback("Europe/Berlin")
+        let newYork = try TimeZone.initWithFallback("America/New_York")
+        let locations: [(Float, Float)] = [(52.52, 13.41), (40.71, -74.01), (52.52, 13.41)]
+        let coordinates = try await locations.asyncMap {
+            try await CoordinatesAndElevation(latitude: $0.0, longitude: $0.1, locationId: 0, elevation: .nan, logger: Logger(label: "test"), httpClient: nil)
+        }
+        let summer = Date(timeIntervalSince1970: Double(Timestamp(2024, 7, 1).timeIntervalSince1970))
+        let winter = Date(timeIntervalSince1970: Double(Timestamp(2024, 1, 1).timeIntervalSince1970))
+
+        let single = try TimeZoneOrAuto.resolve([.timezone(berlin)], coordinates: coordinates, now: summer)
+        #expect(single.map(\.utcOffsetSeconds) == [7200, 7200, 7200])
+        #expect(single.map(\.identifier) == ["Europe/Berlin", "Europe/Berlin", "Europe/Berlin"])
+
+        // Cached offsets must follow daylight saving time transitions
+        let mixed = try TimeZoneOrAuto.resolve([.timezone(berlin), .timezone(newYork), .timezone(berlin)], coordinates: coordinates, now: winter)
+        #expect(mixed.map(\.utcOffsetSeconds) == [3600, -5 * 3600, 3600])
+        #expect(try TimezoneWithOffset.cached(identifier: "America/New_York", now: summer).utcOffsetSeconds == -4 * 3600)
+        #expect(TimezoneWithOffset.cached(timezone: berlin, now: summer).abbreviation == TimezoneWithOffset(timezone: berlin, now: summer).abbreviation)
+
+        #expect(throws: ForecastApiError.self) {
+            _ = try TimeZoneOrAuto.resolve([.timezone(berlin), .timezone(newYork)], coordinates: coordinates)
+        }
+    }
 }
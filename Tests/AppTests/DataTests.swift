@@ -185,6 +185,84 @@ extension InlineArray {
         #expect(arraysEqual(values2.max(by: 3), [3.0, .nan], accuracy: 0.01))
     }
 
+    @Test func gribSyncWord() {
+        let data: [UInt8] = Array("xxGRGxGRIBGRIB".utf8)
+        data.withUnsafeBytes { ptr in
+            #expect(GribAsyncStreamHelper.findSyncWord(memory: ptr) == 6)
+            #expect(GribAsyncStreamHelper.findSyncWord(memory: UnsafeRawBufferPointer(rebasing: ptr[7...])) == 3)
+            #expect(GribAsyncStreamHelper.findSyncWord(memory: UnsafeRawBufferPointer(rebasing: ptr[0..<9])) == nil)
+        }
+    }
+
+    /// Minimal GRIB2 message with a constant field of 2x2 points. `forecastTime` identifies the message
+    static func gribMessage(forecastTime: UInt32) -> [UInt8] {
+        var b = [UInt8]()
+        func u16(_ v: UInt16) { b += [UInt8(v >> 8), UInt8(v & 0xff)] }
+        func u32(_ v: UInt32) { b += [UInt8(v >> 24), UInt8((v >> 16) & 0xff), UInt8((v >> 8) & 0xff), UInt8(v & 0xff)] }
+        // Section 0: indicator, discipline 0, edition 2, total length
+        b += Array("GRIB".utf8) + [0, 0, 0, 2]
+        u32(0); u32(179)
+        // Section 1: identification
+        u32(21); b += [1]; u16(98); u16(0); b += [4, 0, 1]; u16(2024); b += [1, 1, 0, 0, 0, 0, 1]
+        // Section 3: regular lat/lon grid with 2x2 points
+        u32(72); b += [3, 0]; u32(4); b += [0, 0]; u16(0)
+        b += [6, 0]; u32(0); b += [0]; u32(0); b += [0]; u32(0)
+        u32(2); u32(2); u32(0); u32(0xffffffff)
+        u32(1_000_000); u32(0); b += [48]; u32(0); u32(1_000_000); u32(1_000_000); u32(1_000_000); b += [0]
+        // Section 4: temperature at the surface
+        u32(34); b += [4]; u16(0); u16(0)
+        b += [0, 0, 2, 0, 0]; u16(0); b += [0, 1]; u32(forecastTime); b += [1, 0]; u32(0); b += [255, 255]; u32(0xffffffff)
+        // Section 5: simple packing with 0 bits per value
+        u32(21); b += [5]; u32(4); u16(0); u32(Float(273.15).bitPattern); u16(0); u16(0); b += [0, 0]
+        // Section 6: no bitmap, section 7: no data, section 8: end
+        u32(6); b += [6, 255]
+        u32(5); b += [7]
+        b += Array("7777".utf8)
+        precondition(b.count == 179)
+        return b
+    }
+
+    /// Split `data` into buffers of `chunkSize` bytes
+    static func byteStream(_ data: [UInt8], chunkSize: Int) -> AsyncStream<ByteBuffer> {
+        return AsyncStream { continuation in
+            for start in stride(from: 0, to: data.count, by: chunkSize) {
+                continuation.yield(ByteBuffer(bytes: data[start..<min(start + chunkSize, data.count)]))
+            }
+            continuation.finish()
+        }
+    }
+
+    @Test(arguments: [1, 7, 100, 1000])
+    func gribSplitMessagesAcrossBuffers(chunkSize: Int) async throws {
+        let messages = (0..<5).map { Self.gribMessage(forecastTime: UInt32($0)) }
+        // Data in front of messages is skipped
+        let data = Array("xxGRxx".utf8) + messages.joined()
+        var splitter = GribMessageSplitter(iterator: Self.byteStream(data, chunkSize: chunkSize).makeAsyncIterator())
+        var result = [[UInt8]]()
+        while let message = try await splitter.next() {
+            result.append(Array(message.readableBytesView))
+        }
+        #expect(result == messages)
+    }
+
+    @Test func gribTruncatedMessage() async throws {
+        let data = Self.gribMessage(forecastTime: 0) + Self.gribMessage(forecastTime: 1)[0..<100]
+        var splitter = GribMessageSplitter(iterator: Self.byteStream(data, chunkSize: 64).makeAsyncIterator())
+        #expect(try await splitter.next()?.readableBytes == 179)
+        await #expect(throws: GribAsyncStreamError.self) {
+            _ = try await splitter.next()
+        }
+    }
+
+    @Test func gribParallelDecodeOrder() async throws {
+        let data = (0..<20).flatMap { Self.gribMessage(forecastTime: UInt32($0)) }
+        var forecastTimes = [String]()
+        for try await message in Self.byteStream(data, chunkSize: 50).decodeGrib(nConcurrent: 4) {
+            forecastTimes.append(message.get(attribute: "forecastTime") ?? "")
+        }
+        #expect(forecastTimes == (0..<20).map { "\($0)" })
+    }
+
     /*func testGribDecode() throws {
         let file = "/Users/patrick/Downloads/_mars-bol-webmars-private-svc-blue-010-7a527896970b09a4fc90fa37bf98d3ff-wvAa7C.grib"
         //let file = "/Users/patrick/Downloads/Z__C_RJTD_20240909060000_MSM_GPV_Rjp_Lsurf_FH00-15_grib2.bin"
@@ -870,4 +948,79 @@ extension InlineArray {
         #expect(pos8.x == 4.8300066)
         #expect(pos8.y == 3.3899925)
     }
+
+    @Test func elevationIndexGridpointSelection() async throws {
+        let grid = RegularGrid(nx: 4, ny: 3, latMin: 0, lonMin: 0, dx: 0.1, dy: 0.1)
+        let index = ElevationIndex(nx: 4, elevation: [
+            -999, -999, 10, 20,
+            -999, 500, 900, 1000,
+            .nan, 300, 1200, 9999
+        ])
+        #expect(index.read(x: 1..<3, y: 1..<3) == [500, 900, 300, 1200])
+
+        let sea = try #require(grid.findPointInSea(lat: 0.1, lon: 0.2, elevationIndex: index))
+        #expect(sea.gridpoint == 1)
+        #expect(sea.gridElevation.isSea)
+
+        let terrain = try #require(grid.findPointTerrainOptimised(lat: 0.1, lon: 0.2, elevation: 480, elevationIndex: index))
+        #expect(terrain.gridpoint == 5)
+        #expect(terrain.gridElevation.numeric == 500)
+
+        #expect(grid.findPoint(lat: 0.2, lon: 0, elevation: .nan, elevationIndex: index, mode: .nearest) == nil)
+
+        let logger = Logger(label: "elevationIndex")
+        let locations: [(Float, Float, Float)] = [(0.1, 0.2, 480), (0.1, 0.2, 850), (5, 5, 0)]
+        let coordinates = try await locations.asyncMap {
+            try await CoordinatesAndElevation(latitude: $0.0, longitude: $0.1, locationId: 0, elevation: $0.2, logger: logger, httpClient: nil)
+        }
+        let points = coordinates.map {
+            grid.findPoint(lat: $0.latitude, lon: $0.longitude, elevation: $0.elevation, elevationIndex: index, mode: .land)
+        }
+        #expect(points.map { $0?.gridpoint } == [5, 6, nil])
+        #expect(points[1]?.gridElevation.numeric == 900)
+    }
+
+    @Test(.enabled(if: !FileManager.default.fileExists(atPath: DomainRegistry.dmi_harmonie_arome_europe.directory)))
+    func elevationIndexCacheFailure() async {
+        let cache = ElevationIndexCache(capacityBytes: 1024 * 1024 * 1024)
+        let logger = Logger(label: "elevationIndex")
+        // Without an elevation file the build fails. The reserved memory is released
+        #expect(await cache.get(domain: DmiDomain.harmonie_arome_europe, httpClient: nil, logger: logger) == nil)
+        #expect(cache.usedBytes == 0)
+    }
+
+    @Test func batchedProjections() {
+        let grids: [any Gridable] = [
+            ProjectionGrid(nx: 935, ny: 824, latitude: 18.14503...45.405453, longitude: 217.10745...349.8256, projection: StereographicProjection(latitude: 90, longitude: 249, radius: 6371229)),
+            ProjectionGrid(nx: 2540, ny: 1290, latitude: 39.626034...47.876457, longitude: -133.62952...(-40.708557), projection: RotatedLatLonProjection(latitude: -36.0885, longitude: 245.305)),
+            ProjectionGrid(nx: 1069, ny: 1069, latitude: 20.29228...63.769516, longitude: -17.485962...74.10509, projection: LambertConformalConicProjection(λ0: 8, ϕ0: 50, ϕ1: 50, ϕ2: 50, radius: 6371229)),
+            ProjectionGrid(nx: 1042, ny: 970, latitudeProjectionOrigin: -1036000, longitudeProjectionOrigin: -1158000, dx: 2000, dy: 2000, projection: LambertAzimuthalEqualAreaProjection(λ0: -2.5, ϕ1: 54.9, radius: 6371229))
+        ]
+        for grid in grids {
+            let gridpoints = Array(stride(from: 0, to: grid.count, by: 997))
+            let batched = grid.getCoordinates(gridpoints: gridpoints)
+            for (i, gridpoint) in gridpoints.enumerated() {
+                /// Batched kernels must be bit identical to the scalar code to keep grid cell boundaries stable
+                let scalar = grid.getCoordinates(gridpoint: gridpoint)
+                #expect(batched.latitude[i] == scalar.latitude)
+                #expect(batched.longitude[i] == scalar.longitude)
+            }
+        }
+
+        let projection = LambertConformalConicProjection(λ0: -97.5, ϕ0: 0, ϕ1: 38.5, ϕ2: 38.5, radius: 6370.997)
+        let latitude: [Float] = [20, 35.5, 47.1, 60]
+        let longitude: [Float] = [-120, -97.5, -80.3, -60]
+        let forward = projection.forward(latitude: latitude, longitude: longitude)
+        let inverse = projection.inverse(x: forward.x, y: forward.y)
+        for i in latitude.indices {
+            let scalar = projection.forward(latitude: latitude[i], longitude: longitude[i])
+            #expect(forward.x[i] == scalar.x)
+            #expect(forward.y[i] == scalar.y)
+            let scalarInverse = projection.inverse(x: forward.x[i], y: forward.y[i])
+            #expect(inverse.latitude[i] == scalarInverse.latitude)
+            #expect(inverse.longitude[i] == scalarInverse.longitude)
+            #expect(inverse.latitude[i].isApproximatelyEqual(to: latitude[i], absoluteTolerance: 0.001))
+            #expect(inverse.longitude[i].isApproximatelyEqual(to: longitude[i], absoluteTolerance: 0.001))
+        }
+    }
 }
@@ -3,6 +3,7 @@ import Foundation
 import Testing
 import VaporTesting
 import OmFileFormat
+import Synchronization
 
 @Suite struct OmReaderTests {
     @Test func metaCache() throws {
@@ -108,6 +109,180 @@ import OmFileFormat
         })
     }
 
+    /// Concurrent nearby range requests are merged into one backend request
+    @Test func rangeCoalescer() async throws {
+        let backend = CountingReaderBackend(count: 4096)
+        let coalescer = OmReaderRangeCoalescer(backend: backend, options: .init(maxGap: 100, maxSize: 1000, window: .milliseconds(20)))
+        let ranges = [0..<10, 15..<20, 500..<510, 2000..<2010]
+        let values = try await ranges.mapConcurrent(nConcurrent: ranges.count, body: { range in
+            try await coalescer.getData(offset: range.lowerBound, count: range.count).withUnsafeBytes { [UInt8]($0) }
+        })
+        for (range, value) in zip(ranges, values) {
+            #expect(value == range.map { UInt8(truncatingIfNeeded: $0) })
+        }
+        #expect(backend.requests.load(ordering: .relaxed) == 3)
+    }
+
+    /// Hot block manifests are ignored if the block size changed. The rate limiter delays concurrent callers
+    @Test func hotBlockManifest() async throws {
+        let file = "hot_blocks_test.json"
+        try FileManager.default.removeItemIfExists(at: file)
+        defer { try! FileManager.default.removeItem(atPath: file) }
+        #expect(HotBlockManifest.read(path: file, blockSize: 65536) == nil)
+        try HotBlockManifest(blockSize: 65536, files: [.init(url: "https://example.com/a.om", blocks: [0..<2, 5..<6])]).writeTo(path: file)
+        let manifest = try #require(HotBlockManifest.read(path: file, blockSize: 65536))
+        #expect(manifest.files.map(\.url) == ["https://example.com/a.om"])
+        #expect(manifest.files.first?.blocks == [0..<2, 5..<6])
+        #expect(HotBlockManifest.read(path: file, blockSize: 4096) == nil)
+
+        // Blocks of other processes are merged and expire after `maxAgeSeconds`
+        try await HotBlockManifest.update(path: file, blockSize: 65536, active: [.init(url: "https://example.com/a.om", blocks: [1..<4]), .init(url: "https://example.com/b.om", blocks: [0..<1])], now: 1000, maxAgeSeconds: 900)
+        try await HotBlockManifest.update(path: file, blockSize: 65536, active: [.init(url: "https://example.com/a.om", blocks: [8..<9])], now: 1800, maxAgeSeconds: 900)
+        let merged = try #require(HotBlockManifest.read(path: file, blockSize: 65536))
+        #expect(merged.updated == 1800)
+        #expect(merged.files.map(\.url) == ["https://example.com/a.om", "https://example.com/b.om"])
+        #expect(merged.files.first?.blocks == [1..<4, 8..<9])
+        #expect(merged.merged(with: [], now: 2000, maxAgeSeconds: 900).files.map(\.url) == ["https://example.com/a.om"])
+        try FileManager.default.removeItemIfExists(at: "\(file).lock")
+
+        let limiter = ByteRateLimiter(bytesPerSecond: 1000)
+        let start = ContinuousClock.now
+        try await (0..<3).foreachConcurrent(nConcurrent: 3) { _ in
+            try await limiter.wait(bytes: 50)
+        }
+        // The third caller starts after 100 bytes have been transferred
+        #expect(ContinuousClock.now - start >= .milliseconds(100))
+    }
+
+    /// Chunks are admitted after repeated access and evicted in LRU order
+    @Test func decompressedChunkCache() {
+        // 1 shard with space for 8 chunks of 100 floats. Entries up to 1/8 of the shard
+        let cache = DecompressedChunkCache(capacityBytes: 3200, shardCount: 1)
+        #expect(cache.maxEntryBytes == 400)
+        let chunk = { (i: Int) in [Float](repeating: Float(i), count: 100) }
+        #expect(cache.get(key: 1) == nil)
+        #expect(cache.shouldAdmit(key: 1, bytes: 400) == false)
+        #expect(cache.get(key: 1) == nil)
+        #expect(cache.shouldAdmit(key: 1, bytes: 400) == true)
+        #expect(cache.shouldAdmit(key: 1, bytes: 401) == false)
+        for key in 1...8 {
+            cache.set(key: UInt64(key), value: chunk(key))
+        }
+        #expect(cache.usedBytes == 3200)
+        // Key 1 is least recently used and evicted first
+        #expect(cache.get(key: 2) == chunk(2))
+        cache.set(key: 9, value: chunk(9))
+        #expect(cache.get(key: 1) == nil)
+        #expect(cache.get(key: 2) == chunk(2))
+        cache.set(key: 10, value: chunk(10))
+        #expect(cache.get(key: 3) == nil)
+        #expect(cache.get(key: 10) == chunk(10))
+        #expect(cache.usedBytes == 3200)
+    }
+
+    /// Registered grid points are read together with one call
+    @Test func omFileSplitterBatch() async throws {
+        let batch = OmFileSplitterBatch()
+        let time = TimerangeDt(start: Timestamp(2024, 1, 1), nTime: 24, dtSeconds: 3600).toSettings()
+        let key = OmFileSplitterBatch.Key(domain: .copernicus_dem90, variable: "temperature_2m", level: 0, time: time)
+        let single = OmFileSplitterBatch.Key(domain: .copernicus_dem90, variable: "relative_humidity_2m", level: 0, time: time)
+        for location in [7, 3, 5] {
+            batch.register(key: key, location: location)
+        }
+        batch.register(key: single, location: 3)
+        let calls = Atomic<Int>(0)
+        let fn: @Sendable ([Int]) async throws -> [[Float]] = { locations in
+            calls.add(1, ordering: .relaxed)
+            #expect(locations == [3, 5, 7])
+            return locations.map { [Float($0)] }
+        }
+        #expect(try await batch.read(key: key, location: 5, fn: fn) == [5])
+        #expect(try await batch.read(key: key, location: 7, fn: fn) == [7])
+        #expect(try await batch.read(key: key, location: 3, fn: fn) == [3])
+        #expect(calls.load(ordering: .relaxed) == 1)
+        // Data is released once returned
+        #expect(try await batch.read(key: key, location: 5, fn: fn) == nil)
+        #expect(try await batch.read(key: key, location: 4, fn: fn) == nil)
+        #expect(try await batch.read(key: single, location: 3, fn: fn) == nil)
+    }
+
+    /// Cancelling the request cancels the shared read
+    @Test func omFileSplitterBatchCancel() async throws {
+        let batch = OmFileSplitterBatch()
+        let time = TimerangeDt(start: Timestamp(2024, 1, 1), nTime: 24, dtSeconds: 3600).toSettings()
+        let key = OmFileSplitterBatch.Key(domain: .copernicus_dem90, variable: "temperature_2m", level: 0, time: time)
+        batch.register(key: key, location: 1)
+        batch.register(key: key, location: 2)
+        let request = Task {
+            try await batch.read(key: key, location: 1, fn: { locations in
+                try await Task.sleep(for: .seconds(60))
+                return locations.map { [Float($0)] }
+            })
+        }
+        try await Task.sleep(for: .milliseconds(10))
+        request.cancel()
+        let start = ContinuousClock.now
+        await #expect(throws: CancellationError.self) {
+            try await request.value
+        }
+        #expect(ContinuousClock.now - start < .seconds(10))
+    }
+
+    /// Reads with a constant stride predict the next read within the file bounds and the budget
+    @Test func readAhead() {
+        // Budget for 3 reads of 10 floats per second
+        let readAhead = OmFileReadAhead(bytesPerSecond: 3 * 10 * 4, requiredStrides: 2)
+        let key = OmFileReadAhead.Key(file: .staticFile(domain: .copernicus_dem90, variable: "test"), level: 0)
+        func record(_ location: Range<Int>, _ time: Range<Int>, now: Int = 0) -> OmFileReadAhead.Window? {
+            return readAhead.record(key: key, window: .init(location: location, time: time), nx: 10, nLocations: 100, nTime: 100, now: now)
+        }
+        // Sweep over time
+        #expect(record(5..<6, 0..<10) == nil)
+        #expect(record(5..<6, 10..<20) == nil)
+        #expect(record(5..<6, 20..<30) == .init(location: 5..<6, time: 30..<40))
+        #expect(record(5..<6, 30..<40) == .init(location: 5..<6, time: 40..<50))
+        // Budget exhausted
+        #expect(record(5..<6, 40..<50) == .init(location: 5..<6, time: 50..<60))
+        #expect(record(5..<6, 50..<60) == nil)
+        #expect(record(5..<6, 60..<70, now: 1) == .init(location: 5..<6, time: 70..<80))
+        #expect(record(5..<6, 70..<80, now: 1) == .init(location: 5..<6, time: 80..<90))
+        // End of file
+        #expect(record(5..<6, 80..<90, now: 2) == .init(location: 5..<6, time: 90..<100))
+        #expect(record(5..<6, 90..<100, now: 2) == nil)
+
+        // Sweep over locations must not cross rows
+        #expect(record(0..<3, 0..<10, now: 3) == nil)
+        #expect(record(3..<6, 0..<10, now: 3) == nil)
+        #expect(record(6..<9, 0..<10, now: 3) == nil)
+        #expect(record(10..<13, 0..<10, now: 3) == nil)
+
+        // Different sizes reset the stride
+        #expect(record(20..<21, 0..<10, now: 4) == nil)
+        #expect(record(21..<22, 0..<10, now: 4) == nil)
+        #expect(record(22..<24, 0..<10, now: 4) == nil)
+        #expect(record(24..<26, 0..<10, now: 4) == nil)
+        #expect(record(26..<28, 0..<10, now: 4) == .init(location: 28..<30, time: 0..<10))
+    }
+
+    /// State is shared by all clients of a file. Interleaved or short sweeps must not be predicted
+    @Test func readAheadConsistentStrides() {
+        let readAhead = OmFileReadAhead(bytesPerSecond: 1024 * 1024)
+        let key = OmFileReadAhead.Key(file: .staticFile(domain: .copernicus_dem90, variable: "test"), level: 0)
+        func record(_ location: Range<Int>, _ time: Range<Int>) -> OmFileReadAhead.Window? {
+            return readAhead.record(key: key, window: .init(location: location, time: time), nx: 100, nLocations: 100, nTime: 1000, now: 0)
+        }
+        // Two clients sweep over time at different locations
+        for t in stride(from: 0, to: 100, by: 10) {
+            #expect(record(5..<6, t..<t + 10) == nil)
+            #expect(record(50..<51, t..<t + 10) == nil)
+        }
+        // A single client is predicted after three identical strides
+        #expect(record(5..<6, 200..<210) == nil)
+        #expect(record(5..<6, 210..<220) == nil)
+        #expect(record(5..<6, 220..<230) == nil)
+        #expect(record(5..<6, 230..<240) == .init(location: 5..<6, time: 240..<250))
+    }
+
     @Test func blockCacheConcurrent() async throws {
         let url = "https://openmeteo.s3.amazonaws.com/data/dwd_icon_d2_eps/static/HSURF.om"
         let readFn = try await OmHttpReaderBackend(client: .shared, logger: .init(label: "logger"), url: url)!
@@ -131,46 +306,261 @@ import OmFileFormat
         #expect(value?.first == 214)
     }*/
 
+    /// A cache file opened by several processes is shared and only reset by the first process
+    @Test func keyValueCacheFileShared() throws {
+        let file = "cache64_shared.bin"
+        try FileManager.default.removeItemIfExists(at: file)
+        defer { try! FileManager.default.removeItem(atPath: file) }
+        let cache = try AtomicBlockCache(file: file, blockSize: 64, blockCount: 50)
+        cache.set(key: 234923, value: Data(repeating: 123, count: 64))
+
+        // Another user of the same file sees cached data. A different configuration must not reset the file while it is in use
+        let shared = try AtomicBlockCache(file: file, blockSize: 64, blockCount: 50)
+        #expect(shared.withData(key: 234923, maxAccessedAgeInSeconds: 10, { $0.data }) == Data(repeating: 123, count: 64))
+        #expect(throws: AtomicBlockCacheError.self) {
+            _ = try AtomicBlockCache(file: file, blockSize: 128, blockCount: 50)
+        }
+        #expect(throws: AtomicBlockCacheError.self) {
+            _ = try AtomicBlockCache(file: file, blockSize: 64, blockCount: 50, lookAheadCount: 64)
+        }
+        #expect(cache.withData(key: 234923, maxAccessedAgeInSeconds: 10, { $0.data }) == Data(repeating: 123, count: 64))
+    }
+
     @Test func keyValueCache() async throws {
-        let data = DataAsClass(data: Data(repeating: 0, count: (64 + 16)*50))
+        let data = DataAsClass(data: Data(repeating: 0, count: (64 + 24)*50))
         let cache = AtomicBlockCache(data: data, blockSize: 64)
         cache.set(key: 234923, value: Data(repeating: 123, count: 64))
         cache.set(key: 234923+50, value: Data(repeating: 142, count: 64))
-        #expect(cache.get(key: 234923, maxAccessedAgeInSeconds: 10)!.data == Data(repeating: 123, count: 64))
-        #expect(cache.get(key: 234923+50, maxAccessedAgeInSeconds: 10)!.data == Data(repeating: 142, count: 64))
+        #expect(cache.withData(key: 234923, maxAccessedAgeInSeconds: 10, { $0.data }) == Data(repeating: 123, count: 64))
+        #expect(cache.withData(key: 234923+50, maxAccessedAgeInSeconds: 10, { $0.data }) == Data(repeating: 142, count: 64))
         #expect(cache.blockCount == 50)
 
+        // Caches with fewer blocks than the look ahead window must not probe past the end
+        let small = AtomicBlockCache(data: DataAsClass(data: Data(repeating: 0, count: (64 + 24)*3)), blockSize: 64)
+        for i in 0..<10 {
+            small.set(key: UInt64(i), value: Data(repeating: UInt8(i), count: 64))
+        }
+        #expect(small.withData(key: 9, maxAccessedAgeInSeconds: 10, { $0.data }) == Data(repeating: 9, count: 64))
+
         for i in 0..<50 {
             cache.set(key: UInt64(1000+i), value: Data(repeating: UInt8(123+i), count: 64))
         }
-        for i in 0..<50 {
-            #expect(cache.get(key: UInt64(1000+i), maxAccessedAgeInSeconds: 10)!.data == Data(repeating: UInt8(123+i), count: 64))
+        // Accessed keys have the reference bit set and survive a scan of new keys
+        #expect(cache.withData(key: 234923, maxAccessedAgeInSeconds: 10, { $0.data }) == Data(repeating: 123, count: 64))
+        #expect(cache.withData(key: 234923+50, maxAccessedAgeInSeconds: 10, { $0.data }) == Data(repeating: 142, count: 64))
+        for i in 0..<46 {
+            #expect(cache.withData(key: UInt64(1000+i), maxAccessedAgeInSeconds: 10, { $0.data }) == Data(repeating: UInt8(123+i), count: 64))
         }
-        // Cache got overwritten
-        #expect(cache.get(key: 234923, maxAccessedAgeInSeconds: 10) == nil)
-        #expect(cache.get(key: 234923+50, maxAccessedAgeInSeconds: 10) == nil)
+        // Keys 1046 and 1047 were evicted by keys 1048 and 1049 which wrap around the end of the cache
+        #expect(cache.withData(key: 1046, maxAccessedAgeInSeconds: 10, { $0.data }) == nil)
+        #expect(cache.withData(key: 1047, maxAccessedAgeInSeconds: 10, { $0.data }) == nil)
 
         // First 23 keys are sequentially in cache
-        #expect(cache.get(key: 1000, count: 23) != nil)
-        #expect(cache.get(key: 1022, count: 2) == nil)
+        #expect(cache.contains(key: 1000, count: 23))
+        #expect(!cache.contains(key: 1022, count: 2))
         // Key 1023 is offset by 2 slots
-        #expect(cache.get(key: 1023, count: 25) != nil)
-        // Keys 1048 until 1050 are sequentially in cache again, but offset by 2 and wraps at the end of the cache
-        #expect(cache.get(key: 1048, count: 2) != nil)
+        #expect(cache.contains(key: 1023, count: 23))
+        // Keys 1048 until 1050 are sequentially in cache again at the end of the cache
+        #expect(cache.contains(key: 1048, count: 2))
 
         #expect(cache.delete(key: 1000, count: 2, olderThanSeconds: 10) == 0)
         #expect(cache.delete(key: 1000, count: 2, olderThanSeconds: 0) == 2)
-        #expect(cache.get(key: 1000, count: 2) == nil)
+        #expect(!cache.contains(key: 1000, count: 2))
         
-        // Test key delete across last cached block
-        #expect(cache.get(key: 1047, count: 2) == nil)
-        #expect(cache.get(key: 1047, count: 1) != nil)
-        #expect(cache.get(key: 1048, count: 1) != nil)
-        #expect(cache.delete(key: 1047, count: 2, olderThanSeconds: 0) == 2)
-        #expect(cache.get(key: 1047, count: 1) == nil)
-        #expect(cache.get(key: 1048, count: 1) == nil)
+        // Test key delete at the end of the cache
+        #expect(cache.contains(key: 1048, count: 1))
+        #expect(cache.contains(key: 1049, count: 1))
+        #expect(cache.delete(key: 1048, count: 2, olderThanSeconds: 0) == 2)
+        #expect(!cache.contains(key: 1048, count: 1))
+        #expect(!cache.contains(key: 1049, count: 1))
         
         cache.set(key: .max, value: Data(repeating: 123, count: 64))
-        #expect(cache.get(key: .max, maxAccessedAgeInSeconds: 10)!.data == Data(repeating: 123, count: 64))
+        #expect(cache.withData(key: .max, maxAccessedAgeInSeconds: 10, { $0.data }) == Data(repeating: 123, count: 64))
+    }
+    
+    /// Concurrent writers overwrite a small cache while readers verify content hashes. A reader must never see a partially written block.
+    @Test func keyValueCacheConcurrentStress() {
+        let blockSize = 256
+        let data = DataAsClass(data: Data(repeating: 0, count: (blockSize + AtomicBlockCache<DataAsClass>.slotOverhead) * 16))
+        let cache = AtomicBlockCache(data: data, blockSize: blockSize)
+        
+        /// Block layout: key, write counter, payload, hash of all previous bytes
+        func hash(_ bytes: UnsafeRawBufferPointer) -> UInt64 {
+            return bytes.reduce(0xcbf29ce484222325, { ($0 ^ UInt64($1)) &* 0x100000001b3 })
+        }
+        let corrupted = Atomic(0)
+        let hits = Atomic(0)
+        DispatchQueue.concurrentPerform(iterations: 8) { thread in
+            var block = [UInt8](repeating: 0, count: blockSize)
+            var rng = SystemRandomNumberGenerator()
+            for i in 0..<20_000 {
+                let key = UInt64.random(in: 0..<64, using: &rng)
+                if thread % 2 == 0 {
+                    block.withUnsafeMutableBytes { block in
+                        block.storeBytes(of: key, as: UInt64.self)
+                        block.storeBytes(of: UInt64(thread * 1_000_000 + i), toByteOffset: 8, as: UInt64.self)
+                        for j in 16 ..< blockSize - 8 {
+                            block[j] = UInt8(truncatingIfNeeded: i &+ j &* thread)
+                        }
+                        block.storeBytes(of: hash(UnsafeRawBufferPointer(rebasing: block[0 ..< blockSize - 8])), toByteOffset: blockSize - 8, as: UInt64.self)
+                    }
+                    cache.set(key: key, value: block)
+                } else {
+                    let valid = cache.withData(key: key, count: 1) { data in
+                        return data.loadUnaligned(as: UInt64.self) == key && data.loadUnaligned(fromByteOffset: blockSize - 8, as: UInt64.self) == hash(UnsafeRawBufferPointer(rebasing: data[0 ..< blockSize - 8]))
+                    }
+                    guard let valid else {
+                        continue
+                    }
+                    hits.add(1, ordering: .relaxed)
+                    if !valid {
+                        corrupted.add(1, ordering: .relaxed)
+                    }
+                }
+            }
+        }
+        #expect(hits.load(ordering: .relaxed) > 0)
+        #expect(corrupted.load(ordering: .relaxed) == 0)
+    }
+    
+    @Test func frequencySketch() {
+        let sketch = FrequencySketch(capacity: 64)
+        #expect(sketch.frequency(key: 1) == 0)
+        for _ in 0..<5 {
+            sketch.increment(key: 1)
+        }
+        sketch.increment(key: 2)
+        #expect(sketch.frequency(key: 1) >= 5)
+        #expect(sketch.frequency(key: 2) >= 1)
+        for _ in 0..<100 {
+            sketch.increment(key: 3)
+        }
+        #expect(sketch.frequency(key: 3) == 15)
+        
+        // Frequencies are halved after `sampleSize` increments
+        for key in 1000..<UInt64(1000 + sketch.sampleSize) {
+            sketch.increment(key: key)
+        }
+        #expect(sketch.frequency(key: 3) < 15)
+    }
+    
+    @Test func tieredBlockCache() {
+        let blockSize = 256
+        let data = DataAsClass(data: Data(repeating: 0, count: (blockSize + AtomicBlockCache<DataAsClass>.slotOverhead) * 64))
+        let coordinator = AtomicCacheCoordinator(cache: AtomicBlockCache(data: data, blockSize: blockSize), hotTierSize: (blockSize + AtomicBlockCache<DataAsClass>.slotOverhead) * 16)
+        guard let hot = coordinator.hot else {
+            Issue.record("Hot tier not enabled")
+            return
+        }
+        coordinator.cache.set(key: 1, value: [UInt8](repeating: 1, count: blockSize))
+        coordinator.cache.set(key: 2, value: [UInt8](repeating: 2, count: blockSize))
+        
+        // A single access does not promote a block
+        #expect(coordinator.withData(key: 1, count: 1, { $0[0] }) == 1)
+        #expect(!hot.contains(key: 1, count: 1))
+        
+        // The second access promotes the block to the hot tier
+        #expect(coordinator.withData(key: 1, count: 1, { $0[0] }) == 1)
+        #expect(hot.contains(key: 1, count: 1))
+        #expect(coordinator.withData(key: 1, count: 1, { $0[0] }) == 1)
+        #expect(!hot.contains(key: 2, count: 1))
+        
+        #expect(coordinator.contains(key: 1, count: 1))
+        #expect(coordinator.contains(key: 2, count: 1))
+        #expect(!coordinator.contains(key: 3, count: 1))
+        #expect(coordinator.delete(key: 1, count: 1, olderThanSeconds: 0) == 2)
+        #expect(!coordinator.contains(key: 1, count: 1))
+        
+        // Runs of blocks are promoted as a whole and can be read from the hot tier without copying
+        for i in 0..<3 {
+            coordinator.cache.set(key: 20 + UInt64(i), value: [UInt8](repeating: UInt8(20 + i), count: blockSize))
+            // Occupy the home slots of the run with rarely used blocks
+            hot.set(key: 4 + UInt64(i), value: [UInt8](repeating: UInt8(4 + i), count: blockSize))
+        }
+        #expect(coordinator.withData(key: 20, count: 3, { $0[blockSize * 2] }) == 22)
+        #expect(coordinator.withData(key: 20, count: 3, { $0[blockSize * 2] }) == 22)
+        #expect(hot.contains(key: 20, count: 3))
+        #expect(hot.withData(key: 20, count: 3, { $0[blockSize] }) == 21)
+        // Replaced blocks are written back to the cold tier
+        #expect(!hot.contains(key: 4, count: 1))
+        #expect(coordinator.cache.withData(key: 5, count: 1, { $0[0] }) == 5)
+    }
+    
+    @Test func compressedBlockCache() {
+        let blockSize = 1024
+        let pageSize = CompressedBlockCache<DataAsClass>.pageSize(blockSize: blockSize)
+        #expect(pageSize == 144)
+        let data = DataAsClass(data: Data(repeating: 0, count: (pageSize + AtomicBlockCache<DataAsClass>.slotOverhead) * 256))
+        let cache = CompressedBlockCache(pages: AtomicBlockCache(data: data, blockSize: pageSize), blockSize: blockSize)
+        
+        let sparse = [UInt8]((0..<blockSize).map { $0 < 900 ? 0 : UInt8(truncatingIfNeeded: $0) })
+        let random = [UInt8]((0..<blockSize).map { _ in UInt8.random(in: 0...255) })
+        let partial = [UInt8](repeating: 7, count: 100)
+        cache.set(key: 10, value: sparse)
+        cache.set(key: 11, value: random)
+        cache.set(key: 20, value: partial)
+        
+        // Sparse blocks use 1 or 2 pages, random data all 8 pages
+        #expect(cache.pages.contains(key: cache.pageKey(10, page: 0), count: 1))
+        #expect(!cache.pages.contains(key: cache.pageKey(10, page: 2), count: 1))
+        #expect(cache.pages.contains(key: cache.pageKey(11, page: 7), count: 1))
+        
+        #expect(cache.withData(key: 10, count: 1, { Array($0) }) == sparse)
+        #expect(cache.withData(key: 11, count: 1, { Array($0) }) == random)
+        #expect(cache.withData(key: 10, count: 2, { Array($0) }) == sparse + random)
+        #expect(cache.withData(key: 20, count: 1, { Array($0[0..<100]) }) == partial)
+        #expect(cache.withData(key: 12, count: 1, { $0.count }) == nil)
+        #expect(cache.contains(key: 10, count: 2))
+        #expect(!cache.contains(key: 10, count: 3))
+        
+        // Codec and ratio of cached blocks. Block 12 is not cached
+        let statistics = cache.compressionStatistics(key: 10, count: 3)
+        #expect(statistics.lz4Blocks == 1)
+        #expect(statistics.uncompressedBlocks == 1)
+        #expect(statistics.uncompressedBytes == 2 * blockSize)
+        #expect(statistics.storedBytes == cache.pages.blockSize * 8 + (cache.pages.contains(key: cache.pageKey(10, page: 1), count: 1) ? 2 : 1) * cache.pages.blockSize)
+        #expect(statistics.ratio > 1)
+        
+        // A missing page invalidates the block
+        cache.pages.delete(key: cache.pageKey(11, page: 3), count: 1, olderThanSeconds: 0)
+        #expect(cache.withData(key: 11, count: 1, { $0.count }) == nil)
+        #expect(!cache.contains(key: 11, count: 1))
+        
+        // Nested reads use separate scratch buffers
+        let nested = cache.withData(key: 10, count: 1) { outer in
+            return cache.withData(key: 20, count: 1, { $0[0] }).map { (outer[1000], $0) }
+        }
+        #expect(nested?.0 == sparse[1000])
+        #expect(nested?.1 == 7)
+        
+        // Coordinator reads and writes compressed blocks
+        let coordinator = AtomicCacheCoordinator(cache: AtomicBlockCache(data: DataAsClass(data: Data(repeating: 0, count: (pageSize + AtomicBlockCache<DataAsClass>.slotOverhead) * 64)), blockSize: pageSize), compressedBlockSize: blockSize)
+        #expect(coordinator.blockSize == blockSize)
+        coordinator.compressed?.set(key: 5, value: sparse)
+        #expect(coordinator.withData(key: 5, count: 1, { Array($0) }) == sparse)
+        #expect(coordinator.contains(key: 5, count: 1))
+    }
+}
+
+/// Backend with generated data that counts requests
+fileprivate final class CountingReaderBackend: OmFileReaderBackend, Sendable {
+    typealias DataType = Data
+    let count: Int
+    let requests = Atomic(0)
+    
+    init(count: Int) {
+        self.count = count
+    }
+    
+    func prefetchData(offset: Int, count: Int) async throws {
+    }
+    
+    func getData(offset: Int, count: Int) async throws -> Data {
+        requests.add(1, ordering: .relaxed)
+        return Data((offset ..< offset + count).map { UInt8(truncatingIfNeeded: $0) })
+    }
+    
+    func withData<T>(offset: Int, count: Int, fn: @Sendable (UnsafeRawBufferPointer) throws -> T) async throws -> T {
+        return try await getData(offset: offset, count: count).withUnsafeBytes(fn)
     }
 }
@@ -5,6 +5,7 @@ import Testing
 import VaporTesting
 @preconcurrency import SwiftEccodes
 import OpenMeteoSdk
+import CZlib
 
 
 struct DummyDataProvider: ModelFlatbufferSerialisable {
@@ -422,8 +423,9 @@ struct DummyDataProvider: ModelFlatbufferSerialisable {
         )
 
         /// needs to set a timestamp, because of zip compression headers
-        let xlsx = await drainData(try data.response(format: .xlsx(timestamp: Timestamp(2022, 7, 13), locationInformation: .section), logger: logger)).sha256
-        #expect(xlsx == "6efa5ee262cef5073ef5fb27f05beb235db21db163eca31c4b4175b0c96d9b03")
+        let xlsx = await drainData(try data.response(format: .xlsx(timestamp: Timestamp(2022, 7, 13), locationInformation: .section), logger: logger))
+        #expect(xlsx.sha256 == "5be4b1ac6f2b5620396b0a4a60532612182843769b8c3a8975c42fca3944a377")
+        #expect(try Self.unzip(ByteBuffer(data: xlsx))["xl/worksheets/sheet1.xml"]?.hasSuffix(XlsxWriter.sheet_footer) == true)
 
         let flatbuffers = await drainData(try data.response(format: .flatbuffers(fixedGenerationTime: 12), logger: logger))
         //print(flatbuffers.hex)
@@ -693,8 +695,9 @@ struct DummyDataProvider: ModelFlatbufferSerialisable {
             """)
 
         /// needs to set a timestamp, because of zip compression headers
-        let xlsx = await drainData(try data.response(format: .xlsx(timestamp: Timestamp(2022, 7, 13), locationInformation: .section), logger: logger)).sha256
-        #expect(xlsx == "6e30672c1461d2b1c4196f860e311cb742957392acd66c0e63b76f9c0656d3ce")
+        let xlsx = await drainData(try data.response(format: .xlsx(timestamp: Timestamp(2022, 7, 13), locationInformation: .section), logger: logger))
+        #expect(xlsx.sha256 == "28562aa697519b7b6ac0a4c196113ffbe4a1b4c9d7667dcddc638be6ebf7b9f9")
+        #expect(try Self.unzip(ByteBuffer(data: xlsx))["xl/worksheets/sheet1.xml"]?.hasSuffix(XlsxWriter.sheet_footer) == true)
 
         let flatbuffers = await drainData(try data.response(format: .flatbuffers(fixedGenerationTime: 12), logger: logger))
         //print(flatbuffers.hex)
@@ -715,6 +718,119 @@ struct DummyDataProvider: ModelFlatbufferSerialisable {
         #expect(data.readData(length: data.writerIndex)!.sha256 == "987fff4d1b6ba45e799e204c55ca03a53794e6479c5c497c0c4fa279f0f6c0f6")
     }
 
+    /// Inflate gzip (`windowBits` 15 | 16) or raw deflate (`windowBits` -15) data. Returns nil if the data is invalid, truncated or followed by other data
+    static func inflate(_ input: ByteBuffer, windowBits: Int32) -> ByteBuffer? {
+        var stream = z_stream()
+        guard inflateInit2_(&stream, windowBits, ZLIB_VERSION, Int32(MemoryLayout<z_stream>.size)) == Z_OK else {
+            return nil
+        }
+        defer { inflateEnd(&stream) }
+        var out = ByteBuffer()
+        return input.withUnsafeReadableBytes { ptr -> ByteBuffer? in
+            stream.next_in = UnsafeMutablePointer(mutating: ptr.bindMemory(to: Bytef.self).baseAddress)
+            stream.avail_in = uInt(ptr.count)
+            while true {
+                var ret = Z_OK
+                out.writeWithUnsafeMutableBytes(minimumWritableBytes: 64 * 1024) { out in
+                    stream.next_out = out.baseAddress?.assumingMemoryBound(to: Bytef.self)
+                    stream.avail_out = uInt(out.count)
+                    ret = CZlib.inflate(&stream, Z_NO_FLUSH)
+                    return out.count - Int(stream.avail_out)
+                }
+                if ret == Z_STREAM_END {
+                    return stream.avail_in == 0 ? out : nil
+                }
+                guard ret == Z_OK else {
+                    return nil
+                }
+            }
+        }
+    }
+
+    /// Independent ZIP reader. Entries are located through the central directory and must be stored back to back with their local headers and data descriptors. Every entry is inflated and checked against its CRC and sizes
+    static func unzip(_ zip: ByteBuffer) throws -> [String: String] {
+        func u16(_ at: Int) throws -> Int {
+            return Int(try #require(zip.getInteger(at: at, endianness: .little, as: UInt16.self)))
+        }
+        func u32(_ at: Int) throws -> Int {
+            return Int(try #require(zip.getInteger(at: at, endianness: .little, as: UInt32.self)))
+        }
+        // End of central directory record without comment
+        let end = zip.writerIndex - 22
+        #expect(try u32(end) == 0x06054b50)
+        let count = try u16(end + 10)
+        let centralDirSize = try u32(end + 12)
+        let centralDirOffset = try u32(end + 16)
+        #expect(centralDirOffset + centralDirSize == end)
+
+        var files = [String: String]()
+        var position = centralDirOffset
+        var nextLocalHeader = 0
+        for _ in 0..<count {
+            #expect(try u32(position) == 0x02014b50)
+            let flags = try u16(position + 8)
+            let method = try u16(position + 10)
+            let crc = try u32(position + 16)
+            let compressedSize = try u32(position + 20)
+            let uncompressedSize = try u32(position + 24)
+            let nameLength = try u16(position + 28)
+            let localHeader = try u32(position + 42)
+            let name = try #require(zip.getString(at: position + 46, length: nameLength))
+            position += try 46 + nameLength + u16(position + 30) + u16(position + 32)
+
+            #expect(localHeader == nextLocalHeader)
+            #expect(try u32(localHeader) == 0x04034b50)
+            #expect(try u16(localHeader + 6) == flags)
+            #expect(try u16(localHeader + 8) == method)
+            #expect(method == Int(Z_DEFLATED))
+            #expect(try zip.getString(at: localHeader + 30, length: u16(localHeader + 26)) == name)
+            let dataStart = try localHeader + 30 + u16(localHeader + 26) + u16(localHeader + 28)
+            if flags & 0x08 != 0 {
+                // CRC and sizes are zero in the local header and follow the data in a data descriptor
+                #expect(try u32(localHeader + 14) == 0)
+                let descriptor = dataStart + compressedSize
+                #expect(try u32(descriptor) == 0x08074b50)
+                #expect(try u32(descriptor + 4) == crc)
+                #expect(try u32(descriptor + 8) == compressedSize)
+                #expect(try u32(descriptor + 12) == uncompressedSize)
+                nextLocalHeader = descriptor + 16
+            } else {
+                #expect(try u32(localHeader + 14) == crc)
+                #expect(try u32(localHeader + 18) == compressedSize)
+                #expect(try u32(localHeader + 22) == uncompressedSize)
+                nextLocalHeader = dataStart + compressedSize
+            }
+            let data = try #require(inflate(try #require(zip.getSlice(at: dataStart, length: compressedSize)), windowBits: -15))
+            #expect(data.readableBytes == uncompressedSize)
+            #expect(data.withUnsafeReadableBytes { crc32(0, $0.bindMemory(to: Bytef.self).baseAddress, uInt($0.count)) } == uLong(crc))
+            files[name] = data.getString(at: data.readerIndex, length: data.readableBytes)
+        }
+        #expect(nextLocalHeader == centralDirOffset)
+        return files
+    }
+
+    /// Streamed XLSX with a sheet larger than one compression chunk must be a valid ZIP archive
+    @Test func xlsxStreamedZip() async throws {
+        let writer = CollectingBodyStreamWriter()
+        let xlsx = try await XlsxWriter(streamTo: writer, timestamp: Timestamp(2022, 7, 13))
+        for row in 0..<50_000 {
+            xlsx.startRow()
+            xlsx.write(row)
+            xlsx.write(Float(row % 977) / 10, significantDigits: 1)
+            xlsx.endRow()
+            if row % 1000 == 0 {
+                try await xlsx.flushIfRequired()
+            }
+        }
+        try await xlsx.finish()
+        let files = try Self.unzip(writer.buffer)
+        #expect(Set(files.keys) == Set(XlsxWriter.staticFiles.map { $0.path } + ["xl/worksheets/sheet1.xml"]))
+        let sheet = try #require(files["xl/worksheets/sheet1.xml"])
+        #expect(sheet.utf8.count > 1024 * 1024)
+        #expect(sheet.hasPrefix(XlsxWriter.sheet_header))
+        #expect(sheet.hasSuffix("<row><c><v>49999</v></c><c><v>17.2</v></c></row>\(XlsxWriter.sheet_footer)"))
+    }
+
     @Test func gzipStream() throws {
         let hello = try GzipStream(level: 6, chunkCapacity: 512)
         hello.write("Hello")
@@ -727,4 +843,321 @@ struct DummyDataProvider: ModelFlatbufferSerialisable {
 
         #expect(zip.readData(length: zip.writerIndex)!.sha256 == "443f2602754152053754ff14b49218858bd555e74b5d8dc8d5e16fc85c7cdcce")
     }
+
+    @Test func parallelGzipStream() throws {
+        let text = (0..<20_000).map { "<c><v>\($0 % 977)</v></c>" }.joined()
+
+        // Single chunk is identical to a regular deflate stream
+        let single = try GzipStream(level: 6, chunkCapacity: 512)
+        single.write(text)
+        let singleGz = single.finish()
+        let parallelSingle = ParallelGzipStream(level: 6, chunkSize: 1024 * 1024, nConcurrent: 2)
+        parallelSingle.write(text)
+        let parallelSingleGz = parallelSingle.finish()
+        #expect(singleGz.getSlice(at: 10, length: singleGz.readableBytes - 10) == parallelSingleGz.getSlice(at: 10, length: parallelSingleGz.readableBytes - 10))
+
+        // Multiple chunks combine CRC and size correctly
+        let parallel = ParallelGzipStream(level: 6, chunkSize: 32 * 1024, nConcurrent: 3)
+        parallel.write(text)
+        let parallelGz = parallel.finish()
+        #expect(singleGz.getSlice(at: singleGz.writerIndex - 8, length: 8) == parallelGz.getSlice(at: parallelGz.writerIndex - 8, length: 8))
+        #expect(parallelGz.readableBytes < text.utf8.count / 4)
+    }
+
+    /// Concatenated chunks must inflate to the original input with a standard gzip decoder
+    @Test func parallelGzipStreamInflate() async throws {
+        let text = (0..<50_000).map { "<c><v>\($0 % 977)</v></c>" }.joined()
+        let parallel = ParallelGzipStream(level: 6, chunkSize: 32 * 1024, nConcurrent: 3)
+        parallel.write(text)
+        let gzip = parallel.finish()
+        #expect(text.utf8.count > 8 * 32 * 1024)
+        #expect(Self.inflate(gzip, windowBits: 15 | 16).map { String(buffer: $0) } == text)
+
+        // Raw deflate for ZIP entries, compressed in background tasks
+        let raw = ParallelGzipStream(level: 6, chunkSize: 32 * 1024, nConcurrent: 2, gzipHeader: false)
+        raw.write(text)
+        await raw.compressInBackground()
+        var deflated = raw.takeCompressed()
+        var remaining = await raw.finishInBackground()
+        deflated.writeBuffer(&remaining)
+        #expect(Self.inflate(deflated, windowBits: -15).map { String(buffer: $0) } == text)
+        #expect(raw.uncompressedSize == text.utf8.count)
+        #expect(raw.crc32 == text.utf8.withContiguousStorageIfAvailable { UInt32(crc32(0, $0.baseAddress, uInt($0.count))) })
+    }
+
+    @Test func parallelGzipStreamBackground() async throws {
+        let text = (0..<20_000).map { "<c><v>\($0 % 977)</v></c>" }.joined()
+        let parallel = ParallelGzipStream(level: 6, chunkSize: 32 * 1024, nConcurrent: 2)
+        parallel.write(text)
+        let parallelGz = parallel.finish()
+
+        // Compressed in background tasks and consumed while writing. Output is identical
+        let background = ParallelGzipStream(level: 6, chunkSize: 32 * 1024, nConcurrent: 2)
+        var streamed = ByteBuffer()
+        for row in stride(from: 0, to: 20_000, by: 1000) {
+            background.write((row ..< row + 1000).map { "<c><v>\($0 % 977)</v></c>" }.joined())
+            await background.compressInBackground()
+            var data = background.takeCompressed()
+            streamed.writeBuffer(&data)
+        }
+        var remaining = await background.finishInBackground()
+        streamed.writeBuffer(&remaining)
+        #expect(streamed == parallelGz)
+    }
+
+    @Test func responseCompressor() throws {
+        #expect(ResponseContentEncoding(acceptEncoding: ["gzip, deflate, br"]) == .gzip)
+        #expect(ResponseContentEncoding(acceptEncoding: ["deflate", "gzip;q=0"]) == .deflate)
+        #expect(ResponseContentEncoding(acceptEncoding: ["br"]) == nil)
+        #expect(ResponseContentEncoding(acceptEncoding: ["gzip;q=0, *"]) == .deflate)
+        #expect(ResponseContentEncoding(acceptEncoding: ["*;q=0.5"]) == .gzip)
+        #expect(ResponseContentEncoding(acceptEncoding: ["gzip;q=0, deflate;q=0, *"]) == nil)
+        #expect(ResponseContentEncoding(acceptEncoding: []) == nil)
+
+        let text = (0..<20_000).map { "\($0 % 977)," }.joined()
+        var input = ByteBuffer(string: text)
+        var output = ByteBuffer()
+        let compressor = ResponseCompressor(encoding: .gzip)
+        compressor.compress(input.readSlice(length: 10_000)!, into: &output, finish: false)
+        compressor.compress(input, into: &output, finish: true)
+        // gzip magic header and uncompressed size in trailer
+        #expect(output.getInteger(at: 0, endianness: .big, as: UInt16.self) == 0x1f8b)
+        #expect(output.getInteger(at: output.writerIndex - 4, endianness: .little, as: UInt32.self) == UInt32(text.utf8.count))
+        #expect(output.readableBytes < text.utf8.count / 2)
+    }
+
+    @Test func writeFloats() {
+        let values: [Float] = [0, 1.25, -0.04, -0.4, -3.5, 12345.678, 0.05, 999.99, .nan, .infinity, -1e12, 7e-5]
+        for decimals in 0...4 {
+            var buffer = ByteBuffer()
+            values.withUnsafeBufferPointer { ptr in
+                buffer.writeFloats(ptr, decimals: decimals, nan: "null")
+            }
+            let expected = values.map { $0.isFinite ? $0.formatted(decimals: decimals) : "null" }.joined(separator: ",")
+            #expect(buffer.readString(length: buffer.readableBytes) == expected)
+        }
+        var buffer = ByteBuffer()
+        buffer.writeFloat(.nan, decimals: 1, nan: "NaN")
+        buffer.writeString(";")
+        buffer.writeFloat(-2.25, decimals: 1, nan: "NaN")
+        #expect(buffer.readString(length: buffer.readableBytes) == "NaN;-2.3")
+    }
+
+    @Test func timestampBufferFormatter() {
+        let hourly = TimerangeDt(start: Timestamp(2023, 12, 31, 20), nTime: 30, dtSeconds: 3600)
+        let daily = TimerangeDt(start: Timestamp(1960, 2, 27), nTime: 4, dtSeconds: 86400)
+        let sparse = [Timestamp(2024, 2, 29, 23, 45), .noData, Timestamp(0), Timestamp(1900, 1, 1, 0, 15)]
+        for format in [Timeformat.iso8601, .unixtime] {
+            for utcOffset in [0, -9000, 19800] {
+                for quoted in [true, false] {
+                    for (time, onlyDate) in [(Array(hourly), false), (Array(daily), true), (sparse, false)] {
+                        var buffer = ByteBuffer()
+                        var formatter = TimestampBufferFormatter(format: format, utc_offset_seconds: utcOffset, quotedString: quoted, onlyDate: onlyDate)
+                        for t in time {
+                            formatter.write(t, into: &buffer)
+                            buffer.writeString(",")
+                        }
+                        let expected = time.iterate(format: format, utc_offset_seconds: utcOffset, quotedString: quoted, onlyDate: onlyDate).map { "\($0)," }.joined()
+                        #expect(buffer.readString(length: buffer.readableBytes) == expected)
+                    }
+                }
+            }
+        }
+        var buffer = ByteBuffer()
+        buffer.writeDecimal(-1234567)
+        buffer.writeDecimal(0)
+        #expect(buffer.readString(length: buffer.readableBytes) == "-12345670")
+    }
+
+    @Test func arrowIpcMessages() {
+        let schema = ArrowIpc.schema(columns: [("time", .timestamp), ("temperature_2m", .float32)], metadata: [("section", "hourly")])
+        #expect(schema.hex == "100000000c00170014001600100008000c00000000000000000000000000000018000000040001000a000c000000040008000000000000001000000008000000ac00000002000000180000006400000010001200040010001100080000000c001000000010000000200000002c000000010a00000400000074696d650000080008000000040000000a0000000400000003000000555443000000000010001200040010001100080000000c00000000001400000010000000280000002c000000010300000e00000074656d70657261747572655f326d00000600060004000000080000000100000000000000010000001000000008000c0004000800000000000c00000008000000100000000700000073656374696f6e0006000000686f75726c7900")
+
+        let recordBatch = ArrowIpc.recordBatch(length: 3, nodes: [(3, 0), (3, 0)], buffers: [(0, 0), (0, 24), (24, 0), (24, 12)], bodyLength: 40)
+        #expect(recordBatch.hex == "100000000c00170014001600100008000c00000000000000280000000000000018000000040003000a001800080010001400000000000000100000000000000003000000000000000c0000003000000000000000020000000300000000000000000000000000000003000000000000000000000000000000000000000400000000000000000000000000000000000000000000000000000018000000000000001800000000000000000000000000000018000000000000000c00000000000000")
+
+        var buffer = ByteBuffer()
+        buffer.writeArrowMessage(recordBatch)
+        buffer.writeArrowEndOfStream()
+        #expect(buffer.readableBytes == 8 + recordBatch.count.ceil(to: 8) + 8)
+        #expect(buffer.getInteger(at: 4, endianness: .little, as: Int32.self) == Int32(recordBatch.count.ceil(to: 8)))
+    }
+
+    /// Split an Arrow IPC stream into metadata and body of each message. End-of-stream markers are returned as nil. Metadata and bodies must be padded to 8 bytes
+    private static func readArrowStream(_ stream: ByteBuffer) throws -> [(message: FlatBufferTable, body: ByteBuffer)?] {
+        var messages = [(message: FlatBufferTable, body: ByteBuffer)?]()
+        var position = 0
+        while position < stream.writerIndex {
+            let continuation = try #require(stream.getInteger(at: position, endianness: .little, as: UInt32.self))
+            #expect(continuation == UInt32.max)
+            let metadataLength = Int(try #require(stream.getInteger(at: position + 4, endianness: .little, as: Int32.self)))
+            position += 8
+            guard metadataLength > 0 else {
+                messages.append(nil)
+                continue
+            }
+            #expect(metadataLength % 8 == 0)
+            let metadata = try #require(stream.getSlice(at: position, length: metadataLength))
+            let message = FlatBufferTable(buffer: metadata, position: Int(try #require(metadata.getInteger(at: 0, endianness: .little, as: UInt32.self))))
+            position += metadataLength
+            let bodyLength = Int(try message.scalar(3, as: Int64.self))
+            #expect(bodyLength % 8 == 0)
+            messages.append((message, try #require(stream.getSlice(at: position, length: bodyLength))))
+            position += bodyLength
+        }
+        #expect(position == stream.writerIndex)
+        return messages
+    }
+
+    /// Decode an Arrow response with an independent FlatBuffers reader. Buffer offsets are hand-checked: a timestamp column uses 8 bytes per row, float32 columns 4 bytes per row padded to 8 bytes
+    @Test func arrowResponse() async throws {
+        let logger = Logger(label: "OutputformatTests")
+        let data = DummyDataProvider.makeData(timeformat: .iso8601, locationCount: 1)
+        let response = try data.response(format: .arrow, logger: logger)
+        #expect(response.headers.first(name: .contentType) == "application/vnd.apache.arrow.stream")
+        let arrow = await drainData(response)
+        let messages = try Self.readArrowStream(ByteBuffer(data: arrow))
+
+        let sections: [(name: String, columns: [String], time: [Int64], values: [[Float]], buffers: [[Int64]])] = [
+            ("current_weather", ["temperature_20m", "windspeed_100m"], [1657588500], [[20], [10]], [[0, 0], [0, 8], [8, 0], [8, 4], [16, 0], [16, 4]]),
+            ("hourly", ["temperature_2m", "windspeed_10m"], (0..<48).map { 1657584000 + Int64($0) * 3600 }, [.init(repeating: 20, count: 48), .init(repeating: 10, count: 48)], [[0, 0], [0, 384], [384, 0], [384, 192], [576, 0], [576, 192]]),
+            ("daily", ["temperature_2m_mean", "windspeed_10m_mean"], [1657584000, 1657670400], [[20, 20], [10, 10]], [[0, 0], [0, 16], [16, 0], [16, 8], [24, 0], [24, 8]]),
+            ("monthly", ["apparent_temperature_mean", "cloud_cover_mean"], [1656633600, 1659312000], [[20, 20], [10, 10]], [[0, 0], [0, 16], [16, 0], [16, 8], [24, 0], [24, 8]])
+        ]
+        // Each section is a separate stream: schema, record batch and end-of-stream marker
+        let isEndOfStream = messages.map { $0 == nil }
+        #expect(isEndOfStream == [[Bool]](repeating: [false, false, true], count: sections.count).flatMap { $0 })
+        for (i, section) in sections.enumerated() where isEndOfStream.count == sections.count * 3 {
+            let schemaMessage = try #require(messages[i * 3])
+            let batchMessage = try #require(messages[i * 3 + 1])
+            let rows = section.time.count
+
+            // Message: version V5, header type Schema, no body
+            #expect(try schemaMessage.message.scalar(0, as: Int16.self) == 4)
+            #expect(try schemaMessage.message.scalar(1, as: UInt8.self) == 1)
+            #expect(schemaMessage.body.readableBytes == 0)
+            let schema = try #require(try schemaMessage.message.table(2))
+            // Little endian
+            #expect(try schema.scalar(0, as: Int16.self) == 0)
+            let fields = try schema.tables(1)
+            #expect(try fields.map { try $0.string(0) } == ["time"] + section.columns)
+            #expect(try fields.map { try $0.scalar(1, as: UInt8.self) } == [1, 1, 1])
+            // Type union: Timestamp = 10, FloatingPoint = 3
+            #expect(try fields.map { try $0.scalar(2, as: UInt8.self) } == [10, 3, 3])
+            // Children vector must be present, even if empty
+            for field in fields {
+                #expect(try field.isPresent(5))
+                #expect(try field.tables(5).isEmpty)
+            }
+            // Timestamp unit SECOND with time zone UTC
+            let timestamp = try #require(try fields[0].table(3))
+            #expect(try timestamp.scalar(0, as: Int16.self) == 0)
+            #expect(try timestamp.string(1) == "UTC")
+            // Precision SINGLE
+            #expect(try fields[1...].map { try #require(try $0.table(3)).scalar(0, as: Int16.self) } == [1, 1])
+            let metadata = try schema.tables(2).map { [try $0.string(0), try $0.string(1)] }
+            #expect(metadata == [["location_id", "0"], ["latitude", "41.0"], ["longitude", "2.0"], ["elevation", "NaN"], ["utc_offset_seconds", "3600"], ["timezone", "GMT"], ["timezone_abbreviation", "GMT"], ["section", section.name]])
+
+            // Message: version V5, header type RecordBatch
+            #expect(try batchMessage.message.scalar(0, as: Int16.self) == 4)
+            #expect(try batchMessage.message.scalar(1, as: UInt8.self) == 3)
+            #expect(batchMessage.body.readableBytes == 8 * rows + 2 * (4 * rows).ceil(to: 8))
+            let recordBatch = try #require(try batchMessage.message.table(2))
+            #expect(try recordBatch.scalar(0, as: Int64.self) == Int64(rows))
+            #expect(try recordBatch.int64Pairs(1) == [[Int64]](repeating: [Int64(rows), 0], count: 3))
+            let buffers = try recordBatch.int64Pairs(2)
+            #expect(buffers == section.buffers)
+            guard buffers == section.buffers else {
+                continue
+            }
+            let body = batchMessage.body
+            let time = try (0..<rows).map { try #require(body.getInteger(at: Int(buffers[1][0]) + 8 * $0, endianness: .little, as: Int64.self)) }
+            #expect(time == section.time)
+            let values = try [3, 5].map { buffer in
+                try (0..<rows).map { Float(bitPattern: try #require(body.getInteger(at: Int(buffers[buffer][0]) + 4 * $0, endianness: .little, as: UInt32.self))) }
+            }
+            #expect(values == section.values)
+        }
+    }
+}
+
+/// Collects all buffers of a streamed response body
+final class CollectingBodyStreamWriter: AsyncBodyStreamWriter, @unchecked Sendable {
+    var buffer = ByteBuffer()
+
+    func write(_ result: BodyStreamResult) async throws {
+        if case .buffer(var data) = result {
+            buffer.writeBuffer(&data)
+        }
+    }
+}
+
+/// Independent FlatBuffers table reader following the FlatBuffers binary format: a table starts with a signed offset to its vtable, the vtable lists the field offsets relative to the table. Referenced strings, vectors and tables are stored at unsigned offsets relative to the referencing field
+fileprivate struct FlatBufferTable {
+    let buffer: ByteBuffer
+    let position: Int
+
+    private func read<T: FixedWidthInteger>(at: Int, as: T.Type) throws -> T {
+        return try #require(buffer.getInteger(at: at, endianness: .little, as: T.self))
+    }
+
+    /// Position of field `index`. Nil if the field is absent and the default value applies
+    private func field(_ index: Int) throws -> Int? {
+        let vtable = position - Int(try read(at: position, as: Int32.self))
+        guard 4 + 2 * index < Int(try read(at: vtable, as: UInt16.self)) else {
+            return nil
+        }
+        let offset = Int(try read(at: vtable + 4 + 2 * index, as: UInt16.self))
+        return offset == 0 ? nil : position + offset
+    }
+
+    /// Position of the object referenced by field `index`
+    private func reference(_ index: Int) throws -> Int? {
+        guard let fieldPosition = try field(index) else {
+            return nil
+        }
+        return fieldPosition + Int(try read(at: fieldPosition, as: UInt32.self))
+    }
+
+    /// Scalar field. All default values in the Arrow schema are 0
+    func scalar<T: FixedWidthInteger>(_ index: Int, as: T.Type) throws -> T {
+        guard let fieldPosition = try field(index) else {
+            return 0
+        }
+        return try read(at: fieldPosition, as: T.self)
+    }
+
+    func table(_ index: Int) throws -> FlatBufferTable? {
+        return try reference(index).map { FlatBufferTable(buffer: buffer, position: $0) }
+    }
+
+    func isPresent(_ index: Int) throws -> Bool {
+        return try field(index) != nil
+    }
+
+    func string(_ index: Int) throws -> String {
+        let start = try #require(try reference(index))
+        return try #require(buffer.getString(at: start + 4, length: Int(try read(at: start, as: UInt32.self))))
+    }
+
+    /// Vector of tables. Returns an empty array if the field is absent
+    func tables(_ index: Int) throws -> [FlatBufferTable] {
+        guard let start = try reference(index) else {
+            return []
+        }
+        return try (0..<Int(try read(at: start, as: UInt32.self))).map {
+            let element = start + 4 + 4 * $0
+            return FlatBufferTable(buffer: buffer, position: element + Int(try read(at: element, as: UInt32.self)))
+        }
+    }
+
+    /// Vector of structs with two 64 bit integers like `FieldNode` and `Buffer`
+    func int64Pairs(_ index: Int) throws -> [[Int64]] {
+        guard let start = try reference(index) else {
+            return []
+        }
+        return try (0..<Int(try read(at: start, as: UInt32.self))).map {
+            [try read(at: start + 4 + 16 * $0, as: Int64.self), try read(at: start + 12 + 16 * $0, as: Int64.self)]
+        }
+    }
 }
@@ -0,0 +1,69 @@
+import Foundation
+@testable import App
+import Testing
+
+@Suite struct RateLimiterTests {
+    @Test func counterTable() {
+        let table = RateLimitCounterTable(windowSeconds: 60, capacity: 1024, shardCount: 4)
+        #expect(table.capacity == 1024)
+        let now = 1_700_000_000
+        #expect(table.usage(key: 42, now: now) == 0)
+        table.add(key: 42, count: 1, now: now)
+        table.add(key: 42, count: 2.5, now: now + 10)
+        table.add(key: 43, count: 1, now: now)
+        #expect(table.usage(key: 42, now: now) == 3.5)
+        #expect(table.usage(key: 43, now: now) == 1)
+        #expect(table.activeKeys(now: now) == 2)
+
+        // Counters decay at the end of the window and slots are reused
+        let nextWindow = (now / 60 + 1) * 60
+        #expect(table.usage(key: 42, now: nextWindow) == 0)
+        #expect(table.activeKeys(now: nextWindow) == 0)
+        table.add(key: 42, count: 1, now: nextWindow)
+        #expect(table.usage(key: 42, now: nextWindow) == 1)
+    }
+
+    /// If the table is full, the key with the lowest usage is evicted
+    @Test func counterTableFull() {
+        let table = RateLimitCounterTable(windowSeconds: 60, capacity: 16, shardCount: 1)
+        let now = 1_700_000_000
+        for key in 0..<UInt64(16) {
+            table.add(key: key, count: Float(key + 1), now: now)
+        }
+        #expect(table.activeKeys(now: now) == 16)
+        table.add(key: 100, count: 1, now: now)
+        // The new key inherits the usage of the evicted key. The evicted key reports the lowest usage of the full table
+        #expect(table.usage(key: 0, now: now) == 2)
+        #expect(table.usage(key: 100, now: now) == 2)
+        #expect(table.usage(key: 15, now: now) == 16)
+    }
+
+    /// A client must not reset its counter by letting other addresses evict its slot
+    @Test func counterTableEvictionChurn() {
+        let table = RateLimitCounterTable(windowSeconds: 60, capacity: 16, shardCount: 1)
+        let now = 1_700_000_000
+        table.add(key: 0, count: 5, now: now)
+        for key in 1..<UInt64(16) {
+            table.add(key: key, count: 10, now: now)
+        }
+        for key in 100..<UInt64(110) {
+            table.add(key: key, count: 1, now: now)
+            #expect(table.usage(key: 0, now: now) >= 5)
+        }
+        table.add(key: 0, count: 1, now: now)
+        #expect(table.usage(key: 0, now: now) >= 6)
+    }
+
+    @Test func counterTableConcurrent() {
+        let table = RateLimitCounterTable(windowSeconds: 3600, capacity: 4096, shardCount: 8)
+        let now = 1_700_000_000
+        DispatchQueue.concurrentPerform(iterations: 8) { _ in
+            for i in 0..<10_000 {
+                table.add(key: UInt64(i % 100), count: 1, now: now)
+            }
+        }
+        for key in 0..<UInt64(100) {
+            #expect(table.usage(key: key, now: now) == 800)
+        }
+    }
+}